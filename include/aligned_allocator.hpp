@@ -0,0 +1,31 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides an allocator for buffers needing stronger alignment than the default,
+// such as buffers used for direct (unbuffered) file I/O
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+template <typename T, size_t Alignment = 4096>
+struct aligned_allocator {
+    using value_type = T;
+    template <typename U>
+    struct rebind {
+        using other = aligned_allocator<U, Alignment>;
+    };
+
+    aligned_allocator() noexcept = default;
+    template <typename U>
+    aligned_allocator(const aligned_allocator<U, Alignment>& /*unused*/) noexcept {}
+
+    T* allocate(const size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment))); }
+    void deallocate(T* p, const size_t /*unused*/) noexcept { ::operator delete(p, std::align_val_t(Alignment)); }
+
+    template <typename U>
+    bool operator==(const aligned_allocator<U, Alignment>& /*unused*/) const noexcept {
+        return true;
+    }
+};
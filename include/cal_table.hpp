@@ -0,0 +1,54 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides a table of precomputed IQ bias and IQ corrections, keyed by device unique ID
+// (from hello()) and frequency, which is interpolated to give the corrections at any frequency
+//
+// The table is stored as a compact binary file of fixed-size records sorted by device,
+// direction, and frequency, so a lookup is a binary search. The records are little-endian
+// whatever the host byte order.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+enum class cal_direction : uint32_t { tx = 0, rx = 1 };
+
+struct cal_entry {
+    uint32_t device_id      = 0;
+    cal_direction direction = cal_direction::tx;
+    double freq             = 0;
+    std::array<double, 2> iq_bias{0.0, 0.0};            // only used for TX
+    std::array<double, 4> iq_corr{1.0, 0.0, 0.0, 1.0};
+};
+
+class calibration_table {
+  public:
+    // reads a binary table, replacing the current contents; returns false on failure
+    bool load(const std::string& name);
+    // writes the table in binary form; returns false on failure
+    bool save(const std::string& name) const;
+    // reads a text table as written by vxsdr_tx_lo_iq_cal (or python/loopback_tx_lo_iq_corr.py)
+    // and adds its entries as TX entries for the given device; returns the number of entries read
+    size_t import_text(const std::string& name, const uint32_t device_id);
+
+    // adds or replaces the entry with the same device, direction, and frequency
+    void insert(const cal_entry& entry);
+
+    // returns the corrections at freq, linearly interpolated between the nearest entries for the
+    // device and direction, or those of the nearest entry outside the range covered;
+    // returns nothing if there are no entries for the device and direction
+    [[nodiscard]] std::optional<cal_entry> lookup(const uint32_t device_id,
+                                                  const cal_direction direction,
+                                                  const double freq) const;
+
+    [[nodiscard]] const std::vector<cal_entry>& entries() const noexcept { return table; }
+    [[nodiscard]] size_t size() const noexcept { return table.size(); }
+
+  private:
+    std::vector<cal_entry> table;
+};
@@ -0,0 +1,88 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides batched power captures, in which many RX windows, each following a TX IQ bias or
+// correction setting, are taken from one continuous RX stream
+//
+// Starting and stopping a stream for every measurement costs several command round trips and
+// startup transients each time. The scheduler instead starts one stream long enough for all the
+// queued captures, applies each capture's setting, and takes its window from the first samples
+// received at least n_settle samples after the radio acknowledged the setting. Settings are
+// changed by host commands rather than at timestamps, so each window is placed from the radio
+// time read after the change; n_guard samples are planned for each change, and captures that do
+// not fit because the changes took longer are run in a further stream, with a larger guard.
+//
+// All windows are read into one buffer, which is kept between runs, and the power of each is
+// computed from the buffer as contiguous arrays of floats.
+//
+// python/capture_scheduler.py provides the same scheduler on top of the Python bindings.
+
+#pragma once
+
+#include <array>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+// the TX settings to apply before a capture; settings not given are left as they are
+struct capture_request {
+    std::optional<std::array<double, 2>> tx_iq_bias;
+    std::optional<std::array<double, 4>> tx_iq_corr;
+};
+
+struct capture_result {
+    double power_db = 0;  // power after removing the mean, in dB relative to a full scale of 1
+    float max_abs   = 0;  // largest sample magnitude, to check for clipping
+    bool valid      = false;
+};
+
+struct capture_schedule_settings {
+    size_t n_window    = 20480;  // samples in each capture
+    size_t n_settle    = 1024;   // samples discarded after each setting is acknowledged
+    size_t n_guard     = 0;      // samples planned for each setting change; if zero, 2 ms at the rx rate
+    double start_delay = 0.01;   // seconds from the start command to the first sample
+    uint8_t subdev     = 0;
+    uint8_t channel    = 0;
+};
+
+// returns the power of the samples after removing their mean, and their largest magnitude
+double block_power(const std::span<const std::complex<float>> data, float& max_abs);
+
+class capture_scheduler {
+  public:
+    explicit capture_scheduler(const capture_schedule_settings& settings);
+
+    // returns the index of the capture's result
+    size_t add(const capture_request& request);
+    void clear() noexcept { queue.clear(); }
+    [[nodiscard]] size_t size() const noexcept { return queue.size(); }
+
+    // runs all the queued captures with the radio's current RX frequency and gain, and leaves them queued;
+    // returns false if the radio fails, in which case captures not yet taken are not valid
+    bool run(std::unique_ptr<vxsdr>& radio, std::vector<capture_result>& results);
+
+    // the number of RX streams started and captures taken so far, and the largest number of samples a
+    // setting change has taken
+    [[nodiscard]] size_t streams_started() const noexcept { return n_streams; }
+    [[nodiscard]] size_t captures_taken() const noexcept { return n_captures; }
+    [[nodiscard]] uint64_t largest_change() const noexcept { return max_change; }
+
+  private:
+    bool run_stream(std::unique_ptr<vxsdr>& radio, const double rate, std::vector<capture_result>& results, size_t& next);
+    bool read_samples(std::unique_ptr<vxsdr>& radio, const std::span<std::complex<float>> dest);
+    bool apply(std::unique_ptr<vxsdr>& radio, const capture_request& request);
+
+    capture_schedule_settings settings;
+    std::vector<capture_request> queue;
+    std::vector<std::complex<float>> buffer;
+    uint64_t n_guard    = 0;
+    uint64_t max_change = 0;
+    size_t n_streams    = 0;
+    size_t n_captures   = 0;
+};
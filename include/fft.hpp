@@ -0,0 +1,38 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides an in-place complex forward FFT of power-of-two length, using FFTW when the examples
+// are built with it (VXSDR_HAVE_FFTW) and a built-in radix-2 transform otherwise
+//
+// A plan is made once and can then be used from several threads at once; buffers passed to
+// forward() must be aligned to fft_alignment bytes.
+
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+constexpr size_t fft_alignment = 64;
+
+class fft_plan {
+  public:
+    // n must be a power of two
+    explicit fft_plan(const size_t n);
+    ~fft_plan() noexcept;
+
+    fft_plan(const fft_plan&)            = delete;
+    fft_plan& operator=(const fft_plan&) = delete;
+
+    [[nodiscard]] size_t size() const noexcept { return n_points; }
+    // returns the name of the implementation in use, for reports
+    [[nodiscard]] static const char* implementation() noexcept;
+
+    void forward(std::complex<float>* data) const;
+
+  private:
+    size_t n_points = 0;
+    void* plan      = nullptr;  // the FFTW plan, if FFTW is used
+    std::vector<std::complex<float>> twiddles;
+    std::vector<size_t> bit_reverse;
+};
@@ -5,15 +5,79 @@
 
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cal_table.hpp"
 #include "option_utils.hpp"
+#include "radio_config.hpp"
 #include "vxsdr.hpp"
 
 void add_rx_1ch_options(option_utils::program_options& desc);
 void add_tx_1ch_options(option_utils::program_options& desc);
+// the N-channel options include the single-channel options, which give the defaults for every channel
+void add_rx_nch_options(option_utils::program_options& desc);
+void add_tx_nch_options(option_utils::program_options& desc);
 void add_common_options(option_utils::program_options& desc);
 void add_network_options(option_utils::program_options& desc);
+// options for programs which transmit continuously
+void add_realtime_options(option_utils::program_options& desc);
+
+// interprets a list like "[1.0,2.0,3.0]"; (), [], and {} are accepted as brackets
+std::vector<double> interpret_bracketed_list(const std::string& list, const char delim = ',');
+
+// returns the list given by the named option (for a benchmark sweep), or the single value of the
+// fallback option if the list is not set, or {0} (meaning the library default) if neither is set
+std::vector<double> get_sweep_values(option_utils::parsed_options& vm,
+                                     const std::string& list_name,
+                                     const std::string& fallback,
+                                     const bool fallback_is_real = false);
+
+// interprets a list of channels as subdevice:channel, like "[0:0,1:0]" (a subdevice alone means its channel 0);
+// the settings other than subdev and channel are left empty
+std::vector<radio_channel_config> interpret_channel_list(const std::string& list, const std::string& option_name);
+
+// splits a comma-separated list of addresses, such as a --device_address naming several radios
+std::vector<std::string> split_address_list(const std::string& list);
+
+std::map<std::string, int64_t> get_radio_settings(option_utils::parsed_options& vm);
+// settings for one of several radios, which differ in address and network thread CPUs
+std::map<std::string, int64_t> get_radio_settings(option_utils::parsed_options& vm,
+                                                  const std::string& device_address,
+                                                  const int thread_affinity_offset);
+
+// waits until shortly before the next usable pps, and returns the host time to set at that pps
+std::chrono::time_point<std::chrono::system_clock> wait_for_pps_set_time();
 
 int set_rx_1ch_options(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio);
 int set_tx_1ch_options(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio);
+// returns the settings for each channel given by --rx_channels or --tx_channels, in the order given
+std::vector<radio_channel_config> get_rx_nch_config(option_utils::parsed_options& vm);
+std::vector<radio_channel_config> get_tx_nch_config(option_utils::parsed_options& vm);
+// sets all the channels in a few stages of commands (concurrent with --config_parallel); returns nonzero if any setting fails
+int set_rx_nch_options(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio);
+int set_tx_nch_options(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio);
 int set_common_options(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio);
+// sets the time on several radios, so that with --time_source=pps they all take the same pps
+int set_common_options(option_utils::parsed_options& vm, std::vector<std::unique_ptr<vxsdr>>& radios);
 int set_network_options(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio);
+// sets the placement of sample buffers, which should be done before any large buffers are allocated
+int set_buffer_options(option_utils::parsed_options& vm);
+// starts tracing if --trace_file is given; the trace is written when the program exits
+int set_trace_options(option_utils::parsed_options& vm);
+// checks the host's realtime setup (see rt_preflight.hpp), locking memory with --rt_preflight=require or
+// --rt_lock_memory; this should be done after the radio is created and before transmitting; returns
+// nonzero if --rt_preflight=require and a check fails
+int set_realtime_options(option_utils::parsed_options& vm);
+
+// sets the IQ bias and corrections from the table at freq (for example after retuning); returns
+// false if the table has no entries for the device or a setting fails
+bool apply_calibration(const calibration_table& table,
+                       const uint32_t device_id,
+                       const cal_direction direction,
+                       const double freq,
+                       std::unique_ptr<vxsdr>& radio);
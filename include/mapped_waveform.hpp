@@ -0,0 +1,46 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides read-only, memory-mapped access to waveform files, so that
+// sample data can be sent to the radio without first copying it to the heap
+
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+class mapped_waveform {
+  public:
+    // flags controlling how the file is mapped
+    static constexpr unsigned sequential = 0x1;  // advise the kernel that access is sequential (MADV_SEQUENTIAL)
+    static constexpr unsigned populate   = 0x2;  // fault in the whole file when mapping (MAP_POPULATE)
+
+    mapped_waveform() = default;
+    explicit mapped_waveform(const std::string& name, const unsigned flags = sequential) { open(name, flags); }
+    ~mapped_waveform() noexcept { close(); }
+
+    mapped_waveform(const mapped_waveform&)            = delete;
+    mapped_waveform& operator=(const mapped_waveform&) = delete;
+    mapped_waveform(mapped_waveform&& other) noexcept;
+    mapped_waveform& operator=(mapped_waveform&& other) noexcept;
+
+    // maps the named file, returning the number of complex<int16_t> samples it contains (0 on failure)
+    size_t open(const std::string& name, const unsigned flags = sequential);
+    void close() noexcept;
+
+    [[nodiscard]] bool is_open() const noexcept { return map_addr != nullptr; }
+    [[nodiscard]] size_t size() const noexcept { return map_bytes / sizeof(std::complex<int16_t>); }
+    [[nodiscard]] std::span<const std::byte> bytes() const noexcept {
+        return {static_cast<const std::byte*>(map_addr), map_bytes};
+    }
+    [[nodiscard]] std::span<const std::complex<int16_t>> samples() const noexcept {
+        return {static_cast<const std::complex<int16_t>*>(map_addr), size()};
+    }
+
+  private:
+    void* map_addr   = nullptr;
+    size_t map_bytes = 0;
+};
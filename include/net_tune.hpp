@@ -0,0 +1,81 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides sizing of the network queues and socket buffers from the sample rate and link speed,
+// and checks of the host network setup (interface MTU and speed, socket buffer limits, and the
+// CPUs handling the interface's interrupts) against them
+//
+// The queues are sized to hold queue_time seconds of packets at the requested rate, and the
+// socket buffers socket_time seconds (the socket buffers only need to cover the time until the
+// network threads run, while the queues cover delays in the program). The kernel limits socket
+// buffers to net.core.rmem_max and wmem_max without reporting an error, so the sizes it actually
+// grants are found by setting them on a scratch socket.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// bytes of IPv4, UDP, and VXSDR packet headers in each data packet (rounded up)
+constexpr unsigned net_packet_header_bytes = 64;
+
+struct net_tune_request {
+    double rx_rate             = 0;  // total samples per second received (over all channels)
+    double tx_rate             = 0;  // total samples per second sent
+    double network_bit_rate    = 10e9;
+    unsigned mtu_bytes         = 9000;
+    unsigned payload_bytes     = 0;  // zero to use the largest the MTU allows
+    double queue_time          = 0.05;
+    double socket_time         = 0.01;
+    int thread_affinity_offset = -1;
+    std::string local_address;
+};
+
+struct host_network_info {
+    std::string interface;  // empty if no interface has local_address
+    int mtu              = -1;
+    double link_bit_rate = -1;  // -1 if not reported (as for virtual interfaces)
+    int numa_node        = -1;
+    std::vector<int> numa_cpus;
+    std::vector<std::pair<int, std::vector<int>>> irq_cpus;  // each interrupt of the interface, with its CPUs
+    int64_t rmem_max = -1;
+    int64_t wmem_max = -1;
+};
+
+struct net_tune_result {
+    unsigned mtu_bytes             = 0;
+    unsigned samples_per_packet    = 0;
+    double rx_packet_rate          = 0;
+    double tx_packet_rate          = 0;
+    double link_load               = 0;  // fraction of the slower of the link and network_bit_rate used
+    unsigned rx_queue_packets      = 0;
+    unsigned tx_queue_packets      = 0;
+    uint64_t receive_buffer_bytes  = 0;
+    uint64_t send_buffer_bytes     = 0;
+    uint64_t granted_receive_bytes = 0;  // what the kernel grants a socket asking for receive_buffer_bytes
+    uint64_t granted_send_bytes    = 0;
+    std::vector<std::string> warnings;
+};
+
+// reads the host's network setup for the interface with the given IPv4 address
+host_network_info get_host_network_info(const std::string& local_address);
+
+// computes the queue and buffer sizes for the request, and checks them against the host
+net_tune_result tune_network(const net_tune_request& request, const host_network_info& host);
+
+// prints the sizes found, next to those in the radio settings (as from get_radio_settings), and any warnings
+void print_net_tune_report(std::ostream& report,
+                           const host_network_info& host,
+                           const net_tune_result& result,
+                           const std::map<std::string, int64_t>& settings);
+
+// returns the socket buffer size the kernel grants when asked for n_bytes (SO_RCVBUF or SO_SNDBUF),
+// or 0 if it cannot be found
+uint64_t granted_socket_buffer(const int option, const uint64_t n_bytes);
+
+// parses a CPU list like "0-3,8,10-11" from sysfs or procfs
+std::vector<int> parse_cpu_list(const std::string& list);
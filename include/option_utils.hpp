@@ -2,19 +2,30 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 // Provides a simple command line option facility similar to boost::program_options
+//
+// Options can also be listed in a constexpr schema (an array of option_decl), which declares
+// them and reads them once into a typed_options store: get<"name">() is then a tuple access,
+// and a name not in the schema is a compile error rather than a lookup error at run time.
 
 #pragma once
 
+#include <algorithm>
 #include <charconv>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <iterator>
 #include <map>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace option_utils {
@@ -121,6 +132,12 @@ struct parsed_options {
         return {name, "", supported_types::NONE, throw_on_error};
     }
     size_t count(const std::string& key) const noexcept { return values.count(key); };
+    // returns the declared type of an option, or NONE if it was not declared
+    supported_types type(const std::string& key) const noexcept {
+        auto it = types.find(key);
+        return it == types.end() ? supported_types::NONE : it->second;
+    }
+    bool throws_on_error() const noexcept { return throw_on_error; }
     void lookup_error(const std::string& error_message) const {
         if (throw_on_error) {
             throw std::runtime_error(error_message);
@@ -361,4 +378,128 @@ class program_options {
         return output_str;
     }
 };
+
+// a string which can be a template argument, so that option names can be checked when compiling
+template <size_t N>
+struct fixed_string {
+    char chars[N]{};
+    constexpr fixed_string(const char (&s)[N]) { std::copy_n(s, N, chars); }
+    constexpr std::string_view view() const { return {chars, N - 1}; }
+};
+// one entry of an option schema; the default is given as on the command line ("true" or "false" for
+// flags), and an entry with no help text is an option declared elsewhere (for example by
+// add_common_options) that is only read through the schema
+struct option_decl {
+    std::string_view name;
+    supported_types type           = supported_types::NONE;
+    std::string_view help          = "";
+    std::string_view default_value = "";
+    bool required                  = false;
+};
+template <supported_types T>
+struct option_value_type;
+template <>
+struct option_value_type<supported_types::BOOLEAN> {
+    using type = bool;
+};
+template <>
+struct option_value_type<supported_types::INTEGER> {
+    using type = int64_t;
+};
+template <>
+struct option_value_type<supported_types::REAL> {
+    using type = double;
+};
+template <>
+struct option_value_type<supported_types::STRING> {
+    using type = std::string;
+};
+// the options of a schema, converted once from the parsed options; Schema must be a constexpr array of option_decl
+template <const auto& Schema>
+class typed_options {
+  private:
+    static constexpr size_t n_options = std::size(Schema);
+    template <size_t... I>
+    static auto storage_type(std::index_sequence<I...>)
+        -> std::tuple<std::optional<typename option_value_type<Schema[I].type>::type>...>;
+    decltype(storage_type(std::make_index_sequence<n_options>{})) values;
+    bool throw_on_error = false;
+
+    template <fixed_string Name>
+    static constexpr size_t index_of() {
+        for (size_t i = 0; i < n_options; i++) {
+            if (Schema[i].name == Name.view()) {
+                return i;
+            }
+        }
+        return n_options;
+    }
+    [[noreturn]] void schema_error(const std::string& error_message) const {
+        if (throw_on_error) {
+            throw std::runtime_error(error_message);
+        }
+        std::cerr << error_message << std::endl;
+        exit(1);
+    }
+    template <size_t I>
+    void read(parsed_options& vm) {
+        constexpr auto type = Schema[I].type;
+        const std::string name(Schema[I].name);
+        if (vm.type(name) == supported_types::NONE) {
+            schema_error("option in schema has not been declared: --" + name);
+        }
+        if (vm.type(name) != type) {
+            schema_error("option \"" + name + "\" is declared as " + type_to_string(vm.type(name)) + " but the schema gives " +
+                         type_to_string(type));
+        }
+        if (vm.count(name) > 0) {
+            std::get<I>(values) = vm[name].template as<typename option_value_type<type>::type>();
+        }
+    }
+    template <size_t... I>
+    void read_all(parsed_options& vm, std::index_sequence<I...>) {
+        (read<I>(vm), ...);
+    }
+
+  public:
+    explicit typed_options(parsed_options& vm) : throw_on_error(vm.throws_on_error()) {
+        read_all(vm, std::make_index_sequence<n_options>{});
+    }
+    // declares the options of the schema which have help text, as add_flag() or add_option() does
+    static void declare(program_options& desc) {
+        for (const auto& decl : Schema) {
+            if (decl.help.empty()) {
+                continue;
+            }
+            if (decl.type == supported_types::BOOLEAN) {
+                if (decl.default_value.empty()) {
+                    desc.add_flag(std::string(decl.name), std::string(decl.help), decl.required);
+                } else {
+                    desc.add_flag(std::string(decl.name), std::string(decl.help), decl.required, decl.default_value == "true");
+                }
+            } else if (decl.default_value.empty()) {
+                desc.add_option(std::string(decl.name), std::string(decl.help), decl.type, decl.required);
+            } else {
+                desc.add_option(std::string(decl.name), std::string(decl.help), decl.type, decl.required,
+                                std::string(decl.default_value));
+            }
+        }
+    }
+    template <fixed_string Name>
+    bool has() const noexcept {
+        constexpr size_t i = index_of<Name>();
+        static_assert(i < n_options, "option is not in the schema");
+        return std::get<i>(values).has_value();
+    }
+    template <fixed_string Name>
+    const auto& get() const {
+        constexpr size_t i = index_of<Name>();
+        static_assert(i < n_options, "option is not in the schema");
+        const auto& value = std::get<i>(values);
+        if (not value.has_value()) {
+            schema_error("option requested but not set: " + std::string(Name.view()));
+        }
+        return value.value();
+    }
+};
 }  // namespace option_utils
@@ -0,0 +1,77 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides batched configuration of a radio channel: the desired settings are collected first,
+// then sent in a few stages; the independent commands in each stage can be issued concurrently,
+// so configuration takes a few command round trips rather than one per setting, but this is only
+// done when asked for (--config_parallel), since the library may not be thread-safe for them
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "cal_table.hpp"
+#include "vxsdr.hpp"
+
+struct radio_channel_config {
+    uint8_t subdev  = 0;
+    uint8_t channel = 0;
+    std::optional<double> rate;  // rate and frequency are set per subdevice
+    std::optional<double> freq;
+    std::optional<double> gain;
+    std::optional<std::string> port_name;
+    std::optional<std::array<double, 2>> iq_bias;  // only used for TX
+    std::optional<std::array<double, 4>> iq_corr;
+};
+
+struct radio_config_report {
+    unsigned n_commands = 0;
+    unsigned n_failed   = 0;
+    unsigned n_stages   = 0;
+    double elapsed_sec  = 0;
+};
+
+// sends the settings in cfg to the radio; rate and port are sent first, then frequency, then gain
+// (which may depend on the band tuned), then IQ bias and corrections (which the radio may reset when
+// retuning); the commands in a stage are only sent concurrently if parallel is true, otherwise every
+// command is sent in turn; errors are reported using context (for example the calling function)
+radio_config_report apply_radio_config(std::unique_ptr<vxsdr>& radio,
+                                       const cal_direction direction,
+                                       const radio_channel_config& cfg,
+                                       const bool parallel,
+                                       const std::string& context);
+// sends the settings for several channels, with the commands for all channels in the same four stages;
+// rate and frequency are only sent once for each subdevice
+radio_config_report apply_radio_config(std::unique_ptr<vxsdr>& radio,
+                                       const cal_direction direction,
+                                       const std::vector<radio_channel_config>& cfgs,
+                                       const bool parallel,
+                                       const std::string& context);
+
+// reads the current settings of each channel in cfgs (whose subdev and channel say which), with the
+// reads for all channels issued concurrently unless parallel is false; a setting that cannot be read
+// is left empty, and counted as failed in the report
+radio_config_report read_radio_config(std::unique_ptr<vxsdr>& radio,
+                                      const cal_direction direction,
+                                      std::vector<radio_channel_config>& cfgs,
+                                      const bool parallel,
+                                      const std::string& context);
+
+// returns the settings in target which differ from those in current (or which are not known in current),
+// which are the commands needed to change a channel from current to target; IQ bias and corrections are
+// kept if the frequency changes, since the radio may reset them when retuning
+radio_channel_config radio_config_difference(const radio_channel_config& target, const radio_channel_config& current);
+
+// returns the port names of a channel, which are only queried the first time for each device, direction, and
+// channel; the device ID is also only queried the first time for each radio, so later calls send no commands
+// (a lookup which fails is tried again next time, and returns no names)
+std::vector<std::string> get_port_names(std::unique_ptr<vxsdr>& radio,
+                                        const cal_direction direction,
+                                        const bool parallel = false,
+                                        const uint8_t subdev = 0,
+                                        const uint8_t channel = 0);
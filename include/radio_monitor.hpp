@@ -0,0 +1,18 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides periodic monitoring of radio status, buffer use, sensors, and host CPU use
+// while the radio is running, as CSV or InfluxDB line protocol
+
+#pragma once
+
+#include <memory>
+
+#include "option_utils.hpp"
+#include "vxsdr.hpp"
+
+void add_monitor_options(option_utils::program_options& desc);
+
+// samples the radio at the interval given by the options until t_stop (radio time), then returns the number of
+// samples taken; if monitoring is disabled, this simply waits until t_stop
+int monitor_radio(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio, const vxsdr::time_point t_stop);
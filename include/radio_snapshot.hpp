@@ -0,0 +1,60 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides snapshots of the radio settings (rate, frequency, gain, port, and IQ bias and
+// corrections of each channel) which can be saved to a file and restored later
+//
+// A restore reads the current settings back first, then sends only the settings which differ
+// (see radio_config_difference), so changing between two saved setups usually takes a few
+// command round trips. The file has one line per channel, like
+//     tx 0:0 rate 10000000 freq 2400000000 gain 0 port A iq_bias 0,0 iq_corr 1,0,0,1
+// and settings left out of a line are not changed by a restore.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "radio_config.hpp"
+#include "vxsdr.hpp"
+
+struct radio_snapshot {
+    uint32_t device_id = 0;  // from hello(), since IQ corrections only suit the radio they were measured on
+    std::vector<radio_channel_config> tx;
+    std::vector<radio_channel_config> rx;
+};
+
+struct snapshot_restore_report {
+    radio_config_report read;  // reading the current settings
+    radio_config_report tx;    // sending the settings which differ
+    radio_config_report rx;
+    unsigned n_settings = 0;  // in the snapshot
+};
+
+// reads the settings of the channels in snapshot.tx and snapshot.rx (whose subdev and channel say which)
+radio_config_report take_snapshot(std::unique_ptr<vxsdr>& radio, radio_snapshot& snapshot, const bool parallel = false);
+
+bool save_snapshot(const std::string& file_name, const radio_snapshot& snapshot);
+bool load_snapshot(const std::string& file_name, radio_snapshot& snapshot);
+
+// returns the channels of cfgs with no settings given, for reading the current settings of a snapshot's channels
+std::vector<radio_channel_config> same_channels(const std::vector<radio_channel_config>& cfgs);
+
+// returns true if the snapshot was taken on the device current was read from (or does not say which device)
+bool snapshot_device_matches(const radio_snapshot& snapshot, const radio_snapshot& current);
+
+// returns the settings which restoring the snapshot would send, given the current settings; IQ bias and
+// corrections are left out if the snapshot was taken on another device
+radio_snapshot snapshot_difference(const radio_snapshot& target, const radio_snapshot& current);
+
+// sets the radio to the snapshot, sending only the settings which differ from the current ones (without
+// IQ bias and corrections if the snapshot was taken on another device); errors are reported using context
+snapshot_restore_report restore_snapshot(std::unique_ptr<vxsdr>& radio,
+                                         const radio_snapshot& snapshot,
+                                         const bool parallel,
+                                         const std::string& context);
+
+// returns the number of settings given for a channel
+unsigned count_settings(const radio_channel_config& cfg);
@@ -0,0 +1,45 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides checks, made before transmitting, that the host is set up for realtime work: that
+// memory is locked, that realtime priority is permitted, that the network threads have the
+// priority and CPU affinity asked for, and that their CPUs are isolated and not slowed by
+// frequency scaling or deep idle states
+//
+// The library sets the priority and affinity of its network threads (net_thread_priority and
+// thread_affinity_offset) but does not report whether that succeeded, so the checks read the
+// threads of the process after the radio is created; every thread but the main thread is taken
+// to be one of the library's. A check which fails means underruns are likely; a warning is a
+// setting which may cause them; a check is skipped when the host does not report the setting
+// (as in many virtual machines).
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class rt_check_status { pass, warn, fail, skip };
+
+struct rt_check {
+    std::string name;
+    rt_check_status status = rt_check_status::skip;
+    std::string detail;
+};
+
+struct rt_preflight_request {
+    bool lock_memory           = false;  // lock all current (and, if the limit allows, future) memory
+    int net_thread_priority    = -1;     // as in the radio settings; negative if realtime priority is not used
+    int thread_affinity_offset = -1;     // negative if CPU affinity is not used
+    int main_thread_priority   = -1;     // realtime priority to give the calling thread; negative to leave it
+};
+
+// locks all memory (mlockall) if asked, and sets the calling thread's priority as requested, then checks
+// the host setup; returns the result of each check in the order made
+std::vector<rt_check> run_rt_preflight(const rt_preflight_request& request);
+
+// returns true if no check failed
+bool rt_preflight_passed(const std::vector<rt_check>& checks);
+
+// prints each check and a summary line
+void print_rt_preflight_report(std::ostream& report, const std::vector<rt_check>& checks);
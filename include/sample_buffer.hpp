@@ -0,0 +1,64 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides an allocator for large sample buffers, which places them on the NUMA node of the
+// network interface, backs them with hugepages when available, and (if asked) locks them in memory
+//
+// Buffers of 1 MB or more are mapped directly (using 1 GB or 2 MB hugepages if the system
+// has them reserved, and transparent hugepages otherwise) and kept in a pool when freed, so
+// repeated allocations do not fault the memory in again; smaller buffers use the heap. All
+// buffers are aligned to at least 4096 bytes, so they can be used for direct file I/O.
+
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <string>
+#include <vector>
+
+struct sample_buffer_settings {
+    int numa_node      = -1;  // negative to leave placement to the kernel
+    bool use_hugepages = true;
+    bool lock          = false;
+};
+
+// sets how sample buffers allocated from now on are placed; this should be called before any
+// large buffers are allocated, normally right after the options are parsed
+void configure_sample_buffers(const sample_buffer_settings& settings);
+
+// returns the name of the network interface with the given IPv4 address, or "" if there is none
+std::string interface_of_address(const std::string& address);
+// returns the NUMA node of the network interface with the given IPv4 address, or -1 if the
+// interface is not found or is not attached to a particular node
+int numa_node_of_address(const std::string& address);
+
+// returns memory for a sample buffer, throwing std::bad_alloc on failure
+void* allocate_sample_buffer(const size_t n_bytes);
+void free_sample_buffer(void* p, const size_t n_bytes) noexcept;
+
+template <typename T>
+struct sample_allocator {
+    using value_type = T;
+
+    sample_allocator() noexcept = default;
+    template <typename U>
+    sample_allocator(const sample_allocator<U>& /*unused*/) noexcept {}
+
+    T* allocate(const size_t n) {
+        if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T*>(allocate_sample_buffer(n * sizeof(T)));
+    }
+    void deallocate(T* p, const size_t n) noexcept { free_sample_buffer(p, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const sample_allocator<U>& /*unused*/) const noexcept {
+        return true;
+    }
+};
+
+using sample_vector = std::vector<std::complex<int16_t>, sample_allocator<std::complex<int16_t>>>;
@@ -0,0 +1,33 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides conversion of waveform files in other sample formats to the radio's complex<int16_t> format
+
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+enum class waveform_format {
+    cs16,     // complex int16, native (little-endian) byte order
+    cs16_be,  // complex int16, big-endian byte order
+    cf32,     // complex float32, full scale is +/- 1.0 before scaling
+    cs8       // complex int8
+};
+
+// interprets a format name (cs16, cs16_be, cf32, or cs8); returns false if the name is not recognized
+bool parse_waveform_format(const std::string& name, waveform_format& format);
+
+// returns the number of bytes in one complex sample of the given format
+size_t waveform_format_bytes(const waveform_format format);
+
+// converts the complete complex samples in input to output, which must hold at least
+// input.size() / waveform_format_bytes(format) samples; cf32 values are multiplied by scale,
+// and all results saturate at the int16 limits; large inputs are split across threads
+size_t convert_to_cs16(const waveform_format format,
+                       std::span<const std::byte> input,
+                       std::span<std::complex<int16_t>> output,
+                       const float scale = 32767.0F);
@@ -0,0 +1,142 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides a single-producer, single-consumer lock-free ring of fixed-size sample blocks,
+// used to decouple disk I/O from the radio data stream
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <thread>
+#include <vector>
+
+template <typename T, typename Allocator = std::allocator<T>>
+class sample_ring {
+  private:
+    size_t n_blocks;
+    size_t block_samples;
+    std::vector<T, Allocator> storage;
+    std::vector<size_t> block_used;
+    // head and tail count blocks written and read; they are never wrapped, so head - tail is the fill level
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    alignas(64) std::atomic<bool> closed{false};
+    // these change on every state change that a waiting producer or consumer needs to see
+    std::atomic<uint32_t> data_events{0};
+    std::atomic<uint32_t> space_events{0};
+    std::atomic<size_t> high_water{0};
+
+  public:
+    sample_ring(const size_t number_of_blocks, const size_t samples_per_block)
+        : n_blocks(number_of_blocks),
+          block_samples(samples_per_block),
+          storage(number_of_blocks * samples_per_block),
+          block_used(number_of_blocks, 0) {}
+    ~sample_ring() = default;
+
+    sample_ring(const sample_ring&)            = delete;
+    sample_ring& operator=(const sample_ring&) = delete;
+
+    [[nodiscard]] size_t capacity() const noexcept { return n_blocks; }
+    [[nodiscard]] size_t block_size() const noexcept { return block_samples; }
+    [[nodiscard]] size_t blocks_used() const noexcept { return head.load() - tail.load(); }
+    [[nodiscard]] size_t max_blocks_used() const noexcept { return high_water.load(); }
+
+    // producer side: returns a block to fill, or an empty span if the ring is full
+    std::span<T> try_write_block() noexcept {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= n_blocks) {
+            return {};
+        }
+        return {&storage[(h % n_blocks) * block_samples], block_samples};
+    }
+    // producer side: returns a block to fill, waiting for space; empty only if the ring has been closed
+    std::span<T> write_block() noexcept {
+        while (not closed.load(std::memory_order_acquire)) {
+            uint32_t ev = space_events.load(std::memory_order_acquire);
+            uint64_t h  = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) < n_blocks) {
+                return {&storage[(h % n_blocks) * block_samples], block_samples};
+            }
+            space_events.wait(ev, std::memory_order_acquire);
+        }
+        return {};
+    }
+    // producer side: publishes the block obtained from write_block() with n_samples valid samples
+    void commit_write(const size_t n_samples) noexcept {
+        uint64_t h               = head.load(std::memory_order_relaxed);
+        block_used[h % n_blocks] = std::min(n_samples, block_samples);
+        size_t used              = h + 1 - tail.load(std::memory_order_acquire);
+        size_t prev              = high_water.load(std::memory_order_relaxed);
+        while (used > prev and not high_water.compare_exchange_weak(prev, used, std::memory_order_relaxed)) {
+        }
+        head.store(h + 1, std::memory_order_release);
+        data_events.fetch_add(1, std::memory_order_release);
+        data_events.notify_one();
+    }
+
+    // consumer side: returns the oldest filled block, or an empty span if the ring is empty
+    std::span<const T> try_read_block() noexcept {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t) {
+            return {};
+        }
+        return {&storage[(t % n_blocks) * block_samples], block_used[t % n_blocks]};
+    }
+    // consumer side: returns the oldest filled block, waiting for data; empty only when closed and drained
+    std::span<const T> read_block() noexcept {
+        while (true) {
+            uint32_t ev  = data_events.load(std::memory_order_acquire);
+            bool is_done = closed.load(std::memory_order_acquire);
+            uint64_t t   = tail.load(std::memory_order_relaxed);
+            if (head.load(std::memory_order_acquire) != t) {
+                return {&storage[(t % n_blocks) * block_samples], block_used[t % n_blocks]};
+            }
+            if (is_done) {
+                return {};
+            }
+            data_events.wait(ev, std::memory_order_acquire);
+        }
+    }
+    // consumer side: returns the block obtained from read_block() to the producer
+    void release_read() noexcept {
+        tail.fetch_add(1, std::memory_order_release);
+        space_events.fetch_add(1, std::memory_order_release);
+        space_events.notify_one();
+    }
+
+    // either side: marks the end of the stream and wakes any waiting thread
+    void close() noexcept {
+        closed.store(true, std::memory_order_release);
+        data_events.fetch_add(1, std::memory_order_release);
+        data_events.notify_all();
+        space_events.fetch_add(1, std::memory_order_release);
+        space_events.notify_all();
+    }
+    [[nodiscard]] bool is_closed() const noexcept { return closed.load(std::memory_order_acquire); }
+};
+
+// closes a ring and joins a thread using it when leaving scope, so that an exception or early return
+// never destroys a joinable std::thread (which would call std::terminate); declare it after the ring
+template <typename Ring>
+class ring_thread_guard {
+  private:
+    Ring& ring;
+    std::thread& thread;
+
+  public:
+    ring_thread_guard(Ring& r, std::thread& t) noexcept : ring(r), thread(t) {}
+    ~ring_thread_guard() {
+        ring.close();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    ring_thread_guard(const ring_thread_guard&)            = delete;
+    ring_thread_guard& operator=(const ring_thread_guard&) = delete;
+};
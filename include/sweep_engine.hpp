@@ -0,0 +1,72 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides frequency sweeps: at each step of a precomputed plan, the TX and RX are retuned, a
+// capture is taken at a radio timestamp once the retune has settled, and the capture is
+// processed on a worker thread while the next step is retuned and captured
+//
+// The settings for every step (including any corrections from a calibration table) are made
+// before the sweep starts, and the TX and RX commands for a step may be sent concurrently.
+// Retunes are host commands, not timed ones, so each capture is started at settle_time after
+// its retune was acknowledged (or start_margin after its start command is sent, if that is
+// later), with the radio time estimated from the host clock (resynchronized every
+// resync_interval). Captures are passed to the worker through a ring of n_buffers blocks, so
+// the sweep only waits for processing when the worker falls that many steps behind, and
+// results can be written out as each step is processed.
+
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+#include "radio_config.hpp"
+
+struct sweep_step {
+    double freq = 0;                         // the frequency the step measures, for reporting
+    std::optional<radio_channel_config> tx;  // the settings to send before the capture
+    std::optional<radio_channel_config> rx;
+};
+
+struct sweep_settings {
+    size_t n_samples       = 16384;  // samples captured at each step
+    double settle_time     = 1e-3;   // seconds from a retune being acknowledged to the start of its capture
+    double start_margin    = 2e-3;   // least time in seconds allowed for a start command to reach the radio
+    double resync_interval = 1.0;    // seconds between readings of the radio time
+    size_t n_buffers       = 4;      // captures which may wait for processing
+    uint8_t rx_subdev      = 0;
+    bool parallel          = false;  // send the commands for each step concurrently
+};
+
+struct sweep_stats {
+    size_t n_steps          = 0;  // steps captured
+    unsigned n_failed       = 0;  // failed retune commands
+    double elapsed_sec      = 0;
+    double retune_sec       = 0;  // total time spent retuning
+    double max_retune_sec   = 0;
+    double capture_sec      = 0;  // total time from start command to the last sample of each capture
+    double wait_sec         = 0;  // total time the sweep waited for the worker to free a buffer
+    double process_sec      = 0;  // total time the worker spent processing
+    size_t max_buffers_used = 0;
+};
+
+// processes the capture of one step; called on the worker thread, in step order
+using sweep_processor = std::function<void(const size_t step, const std::span<const std::complex<float>> samples)>;
+
+// returns the frequencies from f_start to f_stop in steps of f_step, including f_stop if it falls on a step
+std::vector<double> sweep_frequencies(const double f_start, const double f_stop, const double f_step);
+
+// runs the steps of plan in order; returns false if a capture fails or process throws, in which case
+// the stats cover the steps done
+bool run_sweep(std::unique_ptr<vxsdr>& radio,
+               const std::vector<sweep_step>& plan,
+               const sweep_settings& settings,
+               const sweep_processor& process,
+               sweep_stats& stats);
@@ -0,0 +1,37 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides per-thread information for the current process, read from /proc
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+struct thread_cpu_sample {
+    pid_t tid = 0;
+    std::string name;
+    double cpu_seconds = 0;  // user plus system time
+};
+
+// returns the accumulated CPU time of every thread in the current process
+std::vector<thread_cpu_sample> get_thread_cpu_samples();
+
+// returns CPU usage in percent of one CPU for threads present in both samples, over the given wall-clock interval
+std::vector<std::pair<std::string, double>> compute_thread_cpu_usage(const std::vector<thread_cpu_sample>& before,
+                                                                     const std::vector<thread_cpu_sample>& after,
+                                                                     const double elapsed_seconds);
+
+struct thread_sched_info {
+    pid_t tid = 0;
+    std::string name;
+    int policy   = -1;  // SCHED_OTHER, SCHED_FIFO, etc., or -1 if it cannot be read
+    int priority = 0;
+    std::vector<int> cpus;  // the CPUs the thread may run on
+};
+
+// returns the scheduling policy, priority, and CPU affinity of every thread in the current process
+std::vector<thread_sched_info> get_thread_sched_info();
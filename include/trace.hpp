@@ -0,0 +1,68 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides lightweight tracing of program phases, written as a Chrome trace (JSON) that can be
+// viewed in Perfetto (ui.perfetto.dev) or chrome://tracing
+//
+// A trace_scope records the time from its construction to its destruction as one event in a ring
+// of events kept for the calling thread, which the thread fills without locking. When tracing has
+// not been started, a trace_scope only reads one atomic flag. Event names are not copied, so they
+// should be literals; other names are kept in a table while tracing is on. The trace is written
+// when the program exits, and should not be started until the threads that record into it have
+// been joined by then.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+using trace_clock = std::chrono::steady_clock;
+
+namespace trace_detail {
+extern std::atomic<bool> enabled;
+}  // namespace trace_detail
+
+inline bool trace_enabled() noexcept {
+    return trace_detail::enabled.load(std::memory_order_relaxed);
+}
+
+// starts recording, keeping the last events_per_thread events of each thread, and arranges for the
+// trace to be written to file_name when the program exits; returns false if the file cannot be written
+bool start_trace(const std::string& file_name, const size_t events_per_thread = 65536);
+
+// records an event that has already happened, for example one that started before tracing did
+void trace_event(const char* name, const trace_clock::time_point t_begin, const trace_clock::time_point t_end) noexcept;
+// returns a copy of name that lasts until the program exits, for names that are not literals
+const char* trace_name(const std::string& name);
+// names the calling thread in the trace
+void trace_thread_name(const std::string& name);
+
+class trace_scope {
+  public:
+    explicit trace_scope(const char* name) noexcept {
+        if (trace_enabled()) {
+            event_name = name;
+            t_begin    = trace_clock::now();
+        }
+    }
+    explicit trace_scope(const std::string& name) {
+        if (trace_enabled()) {
+            event_name = trace_name(name);
+            t_begin    = trace_clock::now();
+        }
+    }
+    ~trace_scope() {
+        if (event_name != nullptr) {
+            trace_event(event_name, t_begin, trace_clock::now());
+        }
+    }
+
+    trace_scope(const trace_scope&)            = delete;
+    trace_scope& operator=(const trace_scope&) = delete;
+
+  private:
+    const char* event_name = nullptr;
+    trace_clock::time_point t_begin;
+};
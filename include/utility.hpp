@@ -5,9 +5,63 @@
 
 #pragma once
 
+#include <bit>
 #include <chrono>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "sample_buffer.hpp"
 
 std::string format_time(const std::chrono::time_point<std::chrono::system_clock> t, const std::string& fmt = "%Y-%m-%d %H:%M:%S");
 
-size_t read_cplx_16(const std::string& name, std::vector<std::complex<int16_t> >& data);
-size_t write_cplx_16(const std::string& name, std::vector<std::complex<int16_t> >& data);
+// sample buffers are placed as set by configure_sample_buffers()
+size_t read_cplx_16(const std::string& name, sample_vector& data);
+size_t write_cplx_16(const std::string& name, sample_vector& data);
+
+// returns the number of copies of an n-sample waveform needed to make a whole number of granules
+size_t granularity_tile_count(const size_t n_samples, const size_t granularity);
+// returns n_copies of the waveform placed end to end
+sample_vector tile_waveform(std::span<const std::complex<int16_t>> data, const size_t n_copies);
+
+// read and write unsigned integers and IEEE doubles as little-endian bytes, whatever the host byte order
+template <typename T>
+T load_le(const uint8_t* p) {
+    if constexpr (std::is_same_v<T, double>) {
+        return std::bit_cast<double>(load_le<uint64_t>(p));
+    } else {
+        static_assert(std::is_unsigned_v<T>);
+        T x = 0;
+        for (size_t i = 0; i < sizeof(T); i++) {
+            x |= (T)((T)p[i] << (8 * i));
+        }
+        return x;
+    }
+}
+
+template <typename T>
+void store_le(uint8_t* p, const T x) {
+    if constexpr (std::is_same_v<T, double>) {
+        store_le(p, std::bit_cast<uint64_t>(x));
+    } else {
+        static_assert(std::is_unsigned_v<T>);
+        for (size_t i = 0; i < sizeof(T); i++) {
+            p[i] = (uint8_t)(x >> (8 * i));
+        }
+    }
+}
+
+// pins the calling thread to the given CPU; a negative CPU number leaves the affinity unchanged
+bool set_current_thread_affinity(const int cpu);
+
+// returns the CRC-32 (IEEE 802.3, as used by zlib) of data; a previous result can be passed as crc
+// to continue over more data
+uint32_t crc32(std::span<const std::byte> data, const uint32_t crc = 0);
+
+// returns the 64-bit xxHash (XXH64) of data, a fast non-cryptographic hash for telling whether
+// waveforms have changed
+uint64_t xxhash64(std::span<const std::byte> data, const uint64_t seed = 0);
@@ -0,0 +1,80 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides a waveform container format: a header carrying the sample format, rate, center
+// frequency, and intended granularity, an index of fixed-size chunks, and the chunk data, with
+// a CRC-32 for each chunk and optional LZ4 compression (when built with LZ4)
+//
+// Chunks are independent, so a reader can seek to any sample and decode chunks in parallel
+// straight into the caller's buffer; uncompressed cs16 chunks are read with no copy at all.
+
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "sample_convert.hpp"
+
+struct waveform_container_info {
+    waveform_format format = waveform_format::cs16;
+    uint64_t n_samples     = 0;
+    double rate            = 0;  // zero if not known
+    double freq            = 0;  // zero if not known
+    uint32_t granularity   = 0;  // zero if not known
+    uint32_t chunk_samples = 0;
+    uint32_t n_chunks      = 0;
+    bool compressed        = false;
+};
+
+// returns true if the named file starts with the container's magic number
+bool is_waveform_container(const std::string& name);
+
+// returns true if compressed containers can be written and read by this build
+bool waveform_container_compression_available();
+
+// writes the raw samples (in info.format) as a container, using info.rate, info.freq,
+// info.granularity, and info.chunk_samples; chunks are compressed if compress is true
+// and the compressed chunk is smaller; returns false on failure
+bool write_waveform_container(const std::string& name,
+                              std::span<const std::byte> raw,
+                              const waveform_container_info& info,
+                              const bool compress);
+
+class waveform_container_reader {
+  public:
+    waveform_container_reader() = default;
+    ~waveform_container_reader() noexcept { close(); }
+
+    waveform_container_reader(const waveform_container_reader&)            = delete;
+    waveform_container_reader& operator=(const waveform_container_reader&) = delete;
+
+    // reads and checks the header and index, including that no chunk extends past the end
+    // of the file, so a truncated file is found before any data is used; returns false on failure
+    bool open(const std::string& name);
+    void close() noexcept;
+
+    [[nodiscard]] const waveform_container_info& info() const noexcept { return header_info; }
+
+    // decodes samples [first_sample, first_sample + out.size()) into out as cs16, checking the
+    // CRC of each chunk, using up to n_threads threads (0 for one per chunk up to the number of
+    // CPUs); returns the number of samples decoded, which is less than requested on any error
+    size_t read(const uint64_t first_sample, std::span<std::complex<int16_t>> out, const unsigned n_threads = 0) const;
+
+  private:
+    struct chunk_entry {
+        uint64_t offset;
+        uint32_t stored_bytes;
+        uint32_t raw_bytes;
+        uint32_t crc;
+        uint32_t compression;
+    };
+    bool read_chunk(const uint32_t k, const size_t skip, std::span<std::complex<int16_t>> out) const;
+
+    int fd = -1;
+    waveform_container_info header_info;
+    std::vector<chunk_entry> index;
+};
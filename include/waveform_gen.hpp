@@ -0,0 +1,36 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides synthesis of standard test waveforms (tones, chirps, PRBS BPSK, and multitone)
+// directly in the radio's complex<int16_t> format, so they do not need to be written to files
+//
+// A waveform is given by a spec of the form <type>:<key>=<value>,<key>=<value>,... such as
+//     tone:f=1e6             chirp:bw=20e6,len=65536
+//     prbs:order=9,sps=4     multitone:n=16,df=250e3
+// Keys common to all types are len (number of samples) and amp (peak amplitude, as a fraction
+// of full scale, default 0.7); tone takes f, chirp takes bw and f0 (center frequency), prbs takes
+// order (7, 9, 11, 15, 23, or 31) and sps (samples per symbol), and multitone takes n, df (tone
+// spacing), and f0. Frequencies are adjusted so the waveform loops without a phase jump.
+
+#pragma once
+
+#include <complex>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "sample_buffer.hpp"
+
+struct waveform_spec {
+    std::string type;
+    std::map<std::string, double> params;
+};
+
+// interprets a waveform spec; returns false (with a message) if it cannot be interpreted
+bool parse_waveform_spec(const std::string& spec, waveform_spec& result);
+
+// synthesizes the waveform at the given sample rate; the length is rounded up to a multiple of
+// granularity (when the waveform allows it) so it can be looped end to end without gaps;
+// large waveforms are split across threads; returns an empty vector if the spec is invalid
+sample_vector synthesize_waveform(const waveform_spec& spec, const double rate, const size_t granularity = 1);
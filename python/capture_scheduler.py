@@ -0,0 +1,164 @@
+# Copyright (c) 2024 Vesperix Corporation
+# SPDX-License-Identifier: GPL-3.0-or-later
+
+# Provides batched power captures, in which many RX windows, each following a TX IQ bias or
+# correction setting, are taken from one continuous RX stream. Numpy is required.
+#
+# This is the same scheduler as include/capture_scheduler.hpp: one stream is started for all the
+# queued captures, each capture's setting is applied in turn, and its window is taken from the
+# first samples received at least n_settle samples after the radio acknowledged the setting.
+# Captures that do not fit because the setting changes took longer than planned are run in a
+# further stream. All windows are read into one buffer, which is kept between runs.
+
+import datetime
+import math
+import sys
+import time
+
+import numpy as np
+
+
+class CaptureScheduler:
+    def __init__(self, radio, n_window, n_settle=1024, guard_time=0.002, start_delay=0.01):
+        self.radio = radio
+        self.n_window = n_window
+        self.n_settle = n_settle
+        self.guard_time = guard_time
+        self.start_delay = start_delay
+        self.queue = []
+        self.streams_started = 0
+        self.largest_change = 0
+        self.n_guard = 0
+        self.buffer = np.zeros((n_window,), dtype=np.complex64)
+        # scratch space for the power calculation, so that it does not allocate
+        self._squares = np.zeros((n_window, 2), dtype=np.float32)
+        self._norms = np.zeros((n_window,), dtype=np.float32)
+
+    def add(self, tx_iq_bias=None, tx_iq_corr=None):
+        """Queues a capture after the given settings (settings not given are left as they are); returns its index."""
+        self.queue.append((tx_iq_bias, tx_iq_corr))
+        return len(self.queue) - 1
+
+    def clear(self):
+        self.queue = []
+
+    def run(self):
+        """Runs the queued captures with the radio's current RX frequency and gain, and returns
+        arrays of their powers (in dB, after removing the mean) and largest magnitudes."""
+        n = len(self.queue)
+        power_db = np.zeros((n,))
+        max_abs = np.zeros((n,))
+        if n == 0:
+            return power_db, max_abs
+        rate = self.radio.get_rx_rate()
+        if self.n_guard == 0:
+            self.n_guard = math.ceil(self.guard_time * rate)
+        next_capture = 0
+        while next_capture < n:
+            next_capture = self._run_stream(rate, next_capture, power_db, max_abs)
+            if next_capture < n:
+                # the setting changes took longer than planned; plan for more in the streams that follow
+                self.n_guard = max(2 * self.n_guard, self.largest_change + self.largest_change // 4)
+        return power_db, max_abs
+
+    def block_power(self, d):
+        """Returns the power of the samples after removing their mean, and their largest magnitude."""
+        f = d.view(np.float32).reshape(-1, 2)
+        sq = self._squares[: len(d)]
+        norms = self._norms[: len(d)]
+        np.square(f, out=sq)
+        np.add(sq[:, 0], sq[:, 1], out=norms)
+        peak = math.sqrt(float(np.max(norms)))
+        np.subtract(f, f.mean(axis=0, dtype=np.float64).astype(np.float32), out=sq)
+        np.square(sq, out=sq)
+        return float(np.sum(sq, dtype=np.float64)) / len(d), peak
+
+    def _apply(self, setting):
+        tx_iq_bias, tx_iq_corr = setting
+        if tx_iq_bias is not None:
+            self.radio.set_tx_iq_bias(tx_iq_bias)
+        if tx_iq_corr is not None:
+            self.radio.set_tx_iq_corr(tx_iq_corr)
+
+    def _read(self, n):
+        n_fill = 0
+        while n_fill < n:
+            n_recv = self.radio.get_rx_data(self.buffer[n_fill:n], n - n_fill)
+            if n_recv == 0:
+                raise RuntimeError("error receiving data")
+            n_fill += n_recv
+
+    def _run_stream(self, rate, next_capture, power_db, max_abs):
+        n_capture = self.n_settle + self.n_window
+        n_total = n_capture + (len(self.queue) - next_capture - 1) * (self.n_guard + n_capture)
+
+        # the first setting is in place before the stream starts, so its window follows the settling samples
+        self._apply(self.queue[next_capture])
+        # radio time is estimated from the host clock from here on; timing from before the request
+        # makes the estimate late rather than early, which only costs samples
+        t_host = time.monotonic()
+        t_start = self.radio.get_time_now() + datetime.timedelta(seconds=self.start_delay)
+        self.radio.rx_start(t_start, n_total)
+        self.streams_started += 1
+
+        n_read = 0
+
+        def discard_until(n_target):
+            nonlocal n_read
+            while n_read < n_target:
+                n = min(n_target - n_read, self.n_window)
+                self._read(n)
+                n_read += n
+
+        first = True
+        while next_capture < len(self.queue):
+            n_first = self.n_settle
+            if not first:
+                self._apply(self.queue[next_capture])
+                dt = time.monotonic() - t_host - self.start_delay
+                n_applied = max(math.ceil(dt * rate) if dt > 0 else 0, n_read)
+                self.largest_change = max(self.largest_change, n_applied - n_read)
+                n_first = n_applied + self.n_settle
+            if n_first + self.n_window > n_total:
+                # this capture does not fit in what remains of the stream, so it starts the next one
+                break
+            discard_until(n_first)
+            self._read(self.n_window)
+            n_read += self.n_window
+            pwr, peak = self.block_power(self.buffer)
+            power_db[next_capture] = 10 * math.log10(max(pwr, 1e-30))
+            max_abs[next_capture] = peak
+            next_capture += 1
+            first = False
+
+        # the rest of the stream is read, so that it does not arrive in the next one
+        discard_until(n_total)
+        return next_capture
+
+
+def measure_power_agc(radio, scheduler, freq, settings, gain_inc=20):
+    """Measures the power of a batch of captures at one RX frequency, where each of settings is a
+    (tx_iq_bias, tx_iq_corr) pair, and measures again with more RX gain the captures too weak to be
+    measured accurately."""
+    pwr_fs = 10 * math.log10(math.sqrt(0.5))
+
+    radio.set_rx_freq(freq)
+    scheduler.clear()
+    for bias, corr in settings:
+        scheduler.add(bias, corr)
+    pwr, peak = scheduler.run()
+    if np.any(peak >= 0.8):
+        print("warning: near clipping on rx", file=sys.stderr)
+
+    weak = np.nonzero(pwr_fs - pwr > gain_inc + 3)[0]
+    if len(weak) > 0:
+        current_gain = radio.get_rx_gain()
+        radio.set_rx_gain(current_gain + gain_inc)
+        scheduler.clear()
+        for i in weak:
+            scheduler.add(*settings[i])
+        pwr_weak, _ = scheduler.run()
+        pwr[weak] = pwr_weak - gain_inc
+        radio.set_rx_gain(current_gain)
+
+    return pwr
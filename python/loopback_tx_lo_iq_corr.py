@@ -3,6 +3,10 @@
 
 # Uses a loopback connection to measure values for LO bias (LO feedthrough)
 # and IQ corrections on a VXSDR radio. Numpy is required.
+#
+# The captures for each step of the searches are batched (see capture_scheduler.py): the
+# settings for all of them are applied in turn during one RX stream, instead of starting a
+# stream and retuning the RX for every capture.
 
 import os
 import sys
@@ -15,6 +19,8 @@ import numpy as np
 
 import vxsdr_py
 
+from capture_scheduler import CaptureScheduler, measure_power_agc
+
 
 def clip(x, xmin, xmax):
     if x < xmin:
@@ -24,34 +30,6 @@ def clip(x, xmin, xmax):
     return x
 
 
-def rx_measure_power(radio, freq, n_data):
-    n_skip = 1024  # skip any startup transients
-    rx_data = np.zeros((n_data + n_skip,), dtype=np.complex64)
-    radio.set_rx_freq(freq)
-    radio.rx_start(datetime.datetime.now(tz=datetime.timezone.utc), n_data + n_skip)
-    radio.get_rx_data(rx_data, n_data + n_skip)
-    d = rx_data[n_skip:]
-    if np.max(np.abs(d) >= 0.8):
-        print("warning: near clipping on rx", file=sys.stderr)
-    data_mean = np.mean(d)
-    pwr = np.mean(np.abs(d - data_mean) ** 2)
-    return 10 * math.log10(pwr)
-
-
-def rx_measure_power_agc(radio, freq, rx_ndata):
-    gain_inc = 20
-    pwr_fs = 10 * math.log10(math.sqrt(0.5))
-    pwr = rx_measure_power(radio, freq, rx_ndata)
-
-    if pwr_fs - pwr > gain_inc + 3:
-        current_gain = radio.get_rx_gain()
-        radio.set_rx_gain(current_gain + gain_inc)
-        pwr = rx_measure_power(radio, freq, rx_ndata) - gain_inc
-        radio.set_rx_gain(current_gain)
-
-    return pwr
-
-
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(prog=sys.argv[0], description="Measure TX LO and IQ corrections using loopback")
 
@@ -68,6 +46,7 @@ if __name__ == "__main__":
     parser.add_argument("-E", "--maximum_frequency", type=float, default=22.0e9, help="the maximum frequency to measure")
     parser.add_argument("-T", "--frequency_increment", type=float, default=100.0e6, help="the measurement frequency increment")
     parser.add_argument("-N", "--data_length", type=int, default=20480, help="the length of data received")
+    parser.add_argument("-K", "--settle_samples", type=int, default=1024, help="the number of samples discarded after each setting change")
 
     parser.add_argument("-G", "--tx_gain", type=float, default=0.0, help="the TX gain for the measurement")
     parser.add_argument("-R", "--rate", type=float, default=10.0e6, help="the TX and RX sample rate for the measurement")
@@ -128,6 +107,8 @@ if __name__ == "__main__":
     w = np.hanning(rx_ndata)
     demod_data = np.multiply(w, np.exp(-2j * math.pi * rx_offset * t_rx), dtype=np.complex64)
 
+    scheduler = CaptureScheduler(radio, rx_ndata, n_settle=args.settle_samples)
+
     base = args.output_base
 
     if args.add_unique_id:
@@ -169,9 +150,8 @@ if __name__ == "__main__":
         for tx_freq in np.arange(f_min, f_max + 1.0, f_inc):
 
             radio.set_tx_freq(tx_freq)
-            radio.set_tx_iq_bias((0.0, 0.0))
-
-            start_lo = rx_measure_power_agc(radio, tx_freq - lo_offset + rx_offset, rx_ndata)
+            lo_freq = tx_freq - lo_offset + rx_offset
+            start_lo = measure_power_agc(radio, scheduler, lo_freq, [((0.0, 0.0), None)])[0]
 
             amax = 1.0
             amin = -1.0
@@ -186,22 +166,20 @@ if __name__ == "__main__":
             b_lo = []
             v_lo = []
 
-            lo_best = radio.get_tx_iq_bias()
+            lo_best = (0.0, 0.0)
             best_lo = start_lo
 
             # uses very simple successive linear searches to find an optimum
             for its in range(15):
-                for a in np.linspace(amin, amax, n_step):
-                    radio.set_tx_iq_bias((a, lo_best[1]))
-
-                    pwr_dbm = rx_measure_power_agc(radio, tx_freq - lo_offset + rx_offset, rx_ndata)
-
-                    a_lo.append(a)
-                    b_lo.append(lo_best[1])
+                points = [(a, lo_best[1]) for a in np.linspace(amin, amax, n_step)]
+                pwrs = measure_power_agc(radio, scheduler, lo_freq, [(p, None) for p in points])
+                for p, pwr_dbm in zip(points, pwrs):
+                    a_lo.append(p[0])
+                    b_lo.append(p[1])
                     v_lo.append(pwr_dbm)
 
                     if pwr_dbm < best_lo:
-                        lo_best = radio.get_tx_iq_bias()
+                        lo_best = p
                         best_lo = pwr_dbm
 
                 arng = amax - amin
@@ -211,17 +189,15 @@ if __name__ == "__main__":
                 amax = clip(amax, -1.0, 1.0)
                 amin = clip(amin, -1.0, 1.0)
 
-                for b in np.linspace(bmin, bmax, n_step):
-                    radio.set_tx_iq_bias((lo_best[0], b))
-
-                    pwr_dbm = rx_measure_power_agc(radio, tx_freq - lo_offset + rx_offset, rx_ndata)
-
-                    a_lo.append(lo_best[0])
-                    b_lo.append(b)
+                points = [(lo_best[0], b) for b in np.linspace(bmin, bmax, n_step)]
+                pwrs = measure_power_agc(radio, scheduler, lo_freq, [(p, None) for p in points])
+                for p, pwr_dbm in zip(points, pwrs):
+                    a_lo.append(p[0])
+                    b_lo.append(p[1])
                     v_lo.append(pwr_dbm)
 
                     if pwr_dbm < best_lo:
-                        lo_best = radio.get_tx_iq_bias()
+                        lo_best = p
                         best_lo = pwr_dbm
 
                 brng = bmax - bmin
@@ -244,9 +220,14 @@ if __name__ == "__main__":
             radio.put_tx_data(tx_data)
             time.sleep(0.1)
 
-            pwr_carrier = rx_measure_power_agc(radio, tx_freq + rx_offset, rx_ndata)
-            pwr_image = rx_measure_power_agc(radio, tx_freq - iq_offset + rx_offset, rx_ndata)
-            start_iq = pwr_image - pwr_carrier
+            # the carrier and image are each measured for a whole batch, so the RX is only retuned twice
+            def measure_iq(corrs):
+                settings = [(None, c) for c in corrs]
+                pwr_carrier = measure_power_agc(radio, scheduler, tx_freq + rx_offset, settings)
+                pwr_image = measure_power_agc(radio, scheduler, tx_freq - iq_offset + rx_offset, settings)
+                return pwr_image - pwr_carrier
+
+            start_iq = measure_iq([corr])[0]
 
             alimhi = 1.9990
             alimlo = 0.5
@@ -266,7 +247,7 @@ if __name__ == "__main__":
             b_iq = []
             v_iq = []
 
-            iq_best = radio.get_tx_iq_corr()
+            iq_best = corr
             best_iq = start_iq
 
             for its in range(15):
@@ -274,19 +255,14 @@ if __name__ == "__main__":
                     n_step_a = n_step
                 else:
                     n_step_a = 1
-                for a in np.linspace(amin, amax, n_step_a):
-                    radio.set_tx_iq_corr((a, 0.0, iq_best[2], 1.0))
-
-                    pwr_carrier = rx_measure_power_agc(radio, tx_freq + rx_offset, rx_ndata)
-                    pwr_image = rx_measure_power_agc(radio, tx_freq - iq_offset + rx_offset, rx_ndata)
-                    pwr_dbm = pwr_image - pwr_carrier
-
-                    a_iq.append(a)
-                    b_iq.append(iq_best[2])
+                corrs = [(a, 0.0, iq_best[2], 1.0) for a in np.linspace(amin, amax, n_step_a)]
+                for c, pwr_dbm in zip(corrs, measure_iq(corrs)):
+                    a_iq.append(c[0])
+                    b_iq.append(c[2])
                     v_iq.append(pwr_dbm)
 
                     if pwr_dbm < best_iq:
-                        iq_best = radio.get_tx_iq_corr()
+                        iq_best = c
                         best_iq = pwr_dbm
 
                 if n_step_a > 1:
@@ -300,19 +276,14 @@ if __name__ == "__main__":
                     n_step_b = n_step
                 else:
                     n_step_b = 1
-                for b in np.linspace(bmin, bmax, n_step_b):
-                    radio.set_tx_iq_corr((iq_best[0], 0.0, b, 1.0))
-
-                    pwr_carrier = rx_measure_power_agc(radio, tx_freq + rx_offset, rx_ndata)
-                    pwr_image = rx_measure_power_agc(radio, tx_freq - iq_offset + rx_offset, rx_ndata)
-                    pwr_dbm = pwr_image - pwr_carrier
-
-                    a_iq.append(iq_best[0])
-                    b_iq.append(b)
+                corrs = [(iq_best[0], 0.0, b, 1.0) for b in np.linspace(bmin, bmax, n_step_b)]
+                for c, pwr_dbm in zip(corrs, measure_iq(corrs)):
+                    a_iq.append(c[0])
+                    b_iq.append(c[2])
                     v_iq.append(pwr_dbm)
 
                     if pwr_dbm < best_iq:
-                        iq_best = radio.get_tx_iq_corr()
+                        iq_best = c
                         best_iq = pwr_dbm
 
                 if n_step_b > 1:
@@ -325,6 +296,7 @@ if __name__ == "__main__":
                 if (amax - amin) <= iq_tol and (bmax - bmin) <= iq_tol:
                     break
 
+            radio.set_tx_iq_corr(iq_best)
             radio.tx_stop()
 
             outstr = " {:10.3f} {:10.6f} {:10.6f} {:8.2f} {:8.2f} {:10.6f} {:10.6f} {:10.6f} {:10.6f} {:8.2f} {:8.2f}".format(
@@ -336,4 +308,4 @@ if __name__ == "__main__":
     radio.tx_stop()
     t1 = time.time()
 
-    print("Done. Elapsed time = {:.1f} seconds".format(t1 - t0))
+    print("Done. Elapsed time = {:.1f} seconds ({:d} rx streams)".format(t1 - t0, scheduler.streams_started))
@@ -0,0 +1,196 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides a table of precomputed IQ bias and IQ corrections, keyed by device unique ID and frequency
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "cal_table.hpp"
+#include "utility.hpp"
+
+namespace {
+constexpr std::array<char, 8> cal_magic = {'V', 'X', 'C', 'A', 'L', 'T', 'B', 'L'};
+constexpr uint32_t cal_version          = 1;
+
+// the file is a 16-byte header followed by n_entries 64-byte records, all little-endian:
+//     header: magic[8], version (uint32), n_entries (uint32)
+//     record: device_id (uint32), direction (uint32), freq, iq_bias[2], iq_corr[4] (IEEE doubles)
+constexpr size_t cal_header_bytes = 16;
+constexpr size_t cal_record_bytes = 64;
+
+using cal_record_bytes_t = std::array<uint8_t, cal_record_bytes>;
+
+cal_record_bytes_t encode_record(const cal_entry& e) {
+    cal_record_bytes_t r{};
+    store_le(&r[0], e.device_id);
+    store_le(&r[4], (uint32_t)e.direction);
+    store_le(&r[8], e.freq);
+    for (size_t i = 0; i < e.iq_bias.size(); i++) {
+        store_le(&r[16 + 8 * i], e.iq_bias[i]);
+    }
+    for (size_t i = 0; i < e.iq_corr.size(); i++) {
+        store_le(&r[32 + 8 * i], e.iq_corr[i]);
+    }
+    return r;
+}
+
+cal_entry decode_record(const uint8_t* r) {
+    cal_entry e;
+    e.device_id = load_le<uint32_t>(&r[0]);
+    e.direction = (cal_direction)load_le<uint32_t>(&r[4]);
+    e.freq      = load_le<double>(&r[8]);
+    for (size_t i = 0; i < e.iq_bias.size(); i++) {
+        e.iq_bias[i] = load_le<double>(&r[16 + 8 * i]);
+    }
+    for (size_t i = 0; i < e.iq_corr.size(); i++) {
+        e.iq_corr[i] = load_le<double>(&r[32 + 8 * i]);
+    }
+    return e;
+}
+
+auto sort_key(const cal_entry& e) {
+    return std::make_tuple(e.device_id, e.direction, e.freq);
+}
+
+bool key_less(const cal_entry& a, const cal_entry& b) {
+    return sort_key(a) < sort_key(b);
+}
+}  // namespace
+
+bool calibration_table::load(const std::string& name) {
+    std::ifstream infile(name, std::ios::binary | std::ios::ate);
+    if (not infile.is_open()) {
+        std::cerr << "unable to open calibration table " << name << std::endl;
+        return false;
+    }
+    const auto file_size = (uint64_t)infile.tellg();
+    infile.seekg(0);
+    std::array<uint8_t, cal_header_bytes> header{};
+    if (not infile.read(reinterpret_cast<char*>(header.data()), header.size())
+        or std::memcmp(header.data(), cal_magic.data(), cal_magic.size()) != 0) {
+        std::cerr << "file " << name << " is not a calibration table" << std::endl;
+        return false;
+    }
+    uint32_t version   = load_le<uint32_t>(&header[8]);
+    uint32_t n_entries = load_le<uint32_t>(&header[12]);
+    if (version != cal_version) {
+        std::cerr << "calibration table " << name << " has unsupported version " << version << std::endl;
+        return false;
+    }
+    // the entry count is checked against the file before anything is allocated for it
+    if ((uint64_t)n_entries * cal_record_bytes > file_size - cal_header_bytes) {
+        std::cerr << "calibration table " << name << " is truncated" << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> records((size_t)n_entries * cal_record_bytes);
+    if (not infile.read(reinterpret_cast<char*>(records.data()), (std::streamsize)records.size())) {
+        std::cerr << "calibration table " << name << " is truncated" << std::endl;
+        return false;
+    }
+
+    table.clear();
+    table.reserve(n_entries);
+    for (size_t i = 0; i < n_entries; i++) {
+        table.push_back(decode_record(&records[i * cal_record_bytes]));
+    }
+    // files are written sorted, but sorting again costs little and protects the binary search
+    std::sort(table.begin(), table.end(), key_less);
+    return true;
+}
+
+bool calibration_table::save(const std::string& name) const {
+    std::ofstream outfile(name, std::ios::binary | std::ios::trunc);
+    if (not outfile.is_open()) {
+        std::cerr << "unable to create calibration table " << name << std::endl;
+        return false;
+    }
+    std::array<uint8_t, cal_header_bytes> header{};
+    std::memcpy(header.data(), cal_magic.data(), cal_magic.size());
+    store_le(&header[8], cal_version);
+    store_le(&header[12], (uint32_t)table.size());
+    outfile.write(reinterpret_cast<const char*>(header.data()), header.size());
+    for (const auto& e : table) {
+        auto r = encode_record(e);
+        outfile.write(reinterpret_cast<const char*>(r.data()), r.size());
+    }
+    return outfile.good();
+}
+
+size_t calibration_table::import_text(const std::string& name, const uint32_t device_id) {
+    std::ifstream infile(name);
+    if (not infile.is_open()) {
+        std::cerr << "unable to open calibration text file " << name << std::endl;
+        return 0;
+    }
+    size_t n_read = 0;
+    std::string line;
+    while (std::getline(infile, line)) {
+        // each line is: F (GHz), bias 1-2, LO uncorr, LO corr, IQ 1-4, IQ uncorr, IQ corr
+        std::istringstream iss(line);
+        double freq_ghz  = 0;
+        double lo_uncorr = 0;
+        double lo_corr   = 0;
+        cal_entry e;
+        e.device_id = device_id;
+        e.direction = cal_direction::tx;
+        if (not(iss >> freq_ghz >> e.iq_bias[0] >> e.iq_bias[1] >> lo_uncorr >> lo_corr >> e.iq_corr[0] >> e.iq_corr[1] >>
+                e.iq_corr[2] >> e.iq_corr[3])) {
+            // header and comment lines
+            continue;
+        }
+        e.freq = 1e9 * freq_ghz;
+        insert(e);
+        n_read++;
+    }
+    return n_read;
+}
+
+void calibration_table::insert(const cal_entry& entry) {
+    auto it = std::lower_bound(table.begin(), table.end(), entry, key_less);
+    if (it != table.end() and sort_key(*it) == sort_key(entry)) {
+        *it = entry;
+    } else {
+        table.insert(it, entry);
+    }
+}
+
+std::optional<cal_entry> calibration_table::lookup(const uint32_t device_id,
+                                                   const cal_direction direction,
+                                                   const double freq) const {
+    auto [first, last] = std::equal_range(table.begin(), table.end(), cal_entry{device_id, direction},
+                                          [](const cal_entry& a, const cal_entry& b) {
+                                              return std::tie(a.device_id, a.direction) < std::tie(b.device_id, b.direction);
+                                          });
+    if (first == last) {
+        return std::nullopt;
+    }
+    auto upper = std::lower_bound(first, last, freq, [](const cal_entry& e, const double f) { return e.freq < f; });
+    if (upper == first) {
+        return *first;
+    }
+    if (upper == last) {
+        return *(last - 1);
+    }
+    auto lower = upper - 1;
+
+    double w = (freq - lower->freq) / (upper->freq - lower->freq);
+    cal_entry result;
+    result.device_id = device_id;
+    result.direction = direction;
+    result.freq      = freq;
+    for (size_t i = 0; i < result.iq_bias.size(); i++) {
+        result.iq_bias[i] = (1 - w) * lower->iq_bias[i] + w * upper->iq_bias[i];
+    }
+    for (size_t i = 0; i < result.iq_corr.size(); i++) {
+        result.iq_corr[i] = (1 - w) * lower->iq_corr[i] + w * upper->iq_corr[i];
+    }
+    return result;
+}
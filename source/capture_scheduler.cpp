@@ -0,0 +1,229 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides batched power captures taken from one continuous RX stream
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <iostream>
+#include <span>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+#include "capture_scheduler.hpp"
+
+// samples are summed in lanes of this many complex values, which the compiler can keep in vector registers
+constexpr size_t power_lanes = 8;
+// float sums cover at most this many samples, and are added in double between blocks to limit rounding error
+constexpr size_t power_block = 4096;
+
+double block_power(const std::span<const std::complex<float>> data, float& max_abs) {
+    max_abs = 0;
+    if (data.empty()) {
+        return 0;
+    }
+    // an array of std::complex<float> may be read as floats, with the real and imaginary parts alternating
+    const auto* x      = reinterpret_cast<const float*>(data.data());
+    const size_t n     = data.size();
+    const size_t n_vec = n - n % power_lanes;
+
+    // the first pass finds the mean and the largest magnitude
+    std::array<double, 2> sum = {0, 0};
+    std::array<float, power_lanes> max_norm{};
+    for (size_t i0 = 0; i0 < n_vec; i0 += power_block) {
+        const size_t i1 = std::min(n_vec, i0 + power_block);
+        std::array<float, 2 * power_lanes> s{};
+        for (size_t i = i0; i < i1; i += power_lanes) {
+            const float* v = x + 2 * i;
+            for (size_t j = 0; j < 2 * power_lanes; j++) {
+                s[j] += v[j];
+            }
+            for (size_t j = 0; j < power_lanes; j++) {
+                float m     = v[2 * j] * v[2 * j] + v[2 * j + 1] * v[2 * j + 1];
+                max_norm[j] = std::max(max_norm[j], m);
+            }
+        }
+        for (size_t j = 0; j < 2 * power_lanes; j++) {
+            sum[j % 2] += s[j];
+        }
+    }
+    float max_all = *std::max_element(max_norm.begin(), max_norm.end());
+    for (size_t i = n_vec; i < n; i++) {
+        sum[0] += x[2 * i];
+        sum[1] += x[2 * i + 1];
+        max_all = std::max(max_all, x[2 * i] * x[2 * i] + x[2 * i + 1] * x[2 * i + 1]);
+    }
+    max_abs = std::sqrt(max_all);
+
+    // the second pass sums the squared deviations from the mean
+    const std::array<float, 2> mean = {(float)(sum[0] / (double)n), (float)(sum[1] / (double)n)};
+    std::array<float, 2 * power_lanes> mean_lanes{};
+    for (size_t j = 0; j < 2 * power_lanes; j++) {
+        mean_lanes[j] = mean[j % 2];
+    }
+    double pwr = 0;
+    for (size_t i0 = 0; i0 < n_vec; i0 += power_block) {
+        const size_t i1 = std::min(n_vec, i0 + power_block);
+        std::array<float, 2 * power_lanes> s{};
+        for (size_t i = i0; i < i1; i += power_lanes) {
+            const float* v = x + 2 * i;
+            for (size_t j = 0; j < 2 * power_lanes; j++) {
+                float d = v[j] - mean_lanes[j];
+                s[j] += d * d;
+            }
+        }
+        for (auto p : s) {
+            pwr += p;
+        }
+    }
+    for (size_t i = n_vec; i < n; i++) {
+        double d_re = x[2 * i] - mean[0];
+        double d_im = x[2 * i + 1] - mean[1];
+        pwr += d_re * d_re + d_im * d_im;
+    }
+    return pwr / (double)n;
+}
+
+capture_scheduler::capture_scheduler(const capture_schedule_settings& settings) : settings(settings) {
+    buffer.resize(settings.n_window);
+    n_guard = settings.n_guard;
+}
+
+size_t capture_scheduler::add(const capture_request& request) {
+    queue.push_back(request);
+    return queue.size() - 1;
+}
+
+bool capture_scheduler::apply(std::unique_ptr<vxsdr>& radio, const capture_request& request) {
+    if (request.tx_iq_bias.has_value() and not radio->set_tx_iq_bias(*request.tx_iq_bias, settings.subdev, settings.channel)) {
+        std::cerr << "unable to set tx iq bias" << std::endl;
+        return false;
+    }
+    if (request.tx_iq_corr.has_value() and not radio->set_tx_iq_corr(*request.tx_iq_corr, settings.subdev, settings.channel)) {
+        std::cerr << "unable to set tx iq correction" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool capture_scheduler::read_samples(std::unique_ptr<vxsdr>& radio, const std::span<std::complex<float>> dest) {
+    size_t n_fill = 0;
+    while (n_fill < dest.size()) {
+        size_t n = radio->get_rx_data(dest.subspan(n_fill), dest.size() - n_fill, settings.subdev);
+        if (n == 0) {
+            std::cerr << "error receiving data" << std::endl;
+            return false;
+        }
+        n_fill += n;
+    }
+    return true;
+}
+
+bool capture_scheduler::run(std::unique_ptr<vxsdr>& radio, std::vector<capture_result>& results) {
+    results.assign(queue.size(), {});
+    if (queue.empty()) {
+        return true;
+    }
+    double rate = radio->get_rx_rate(settings.subdev).value_or(-1);
+    if (rate <= 0) {
+        std::cerr << "unable to get rx rate" << std::endl;
+        return false;
+    }
+    if (n_guard == 0) {
+        n_guard = (uint64_t)std::ceil(2e-3 * rate);
+    }
+    size_t next = 0;
+    while (next < queue.size()) {
+        if (not run_stream(radio, rate, results, next)) {
+            return false;
+        }
+        if (next < queue.size()) {
+            // the setting changes took longer than planned; plan for more in the streams that follow
+            n_guard = std::max(2 * n_guard, max_change + max_change / 4);
+        }
+    }
+    return true;
+}
+
+bool capture_scheduler::run_stream(std::unique_ptr<vxsdr>& radio,
+                                   const double rate,
+                                   std::vector<capture_result>& results,
+                                   size_t& next) {
+    const uint64_t n_capture = settings.n_settle + settings.n_window;
+    const uint64_t n_total   = n_capture + (uint64_t)(queue.size() - next - 1) * (n_guard + n_capture);
+
+    // the first setting is in place before the stream starts, so its window follows the settling samples
+    if (not apply(radio, queue[next])) {
+        return false;
+    }
+    // radio time is estimated from the host clock from here on, instead of asking the radio after every change;
+    // timing from before the request makes the estimate late rather than early, which only costs samples
+    auto t_host  = std::chrono::steady_clock::now();
+    auto t_radio = radio->get_time_now();
+    if (not t_radio.has_value()) {
+        std::cerr << "unable to get radio time" << std::endl;
+        return false;
+    }
+    auto t_start =
+        t_radio.value() + std::chrono::duration_cast<vxsdr::duration>(std::chrono::duration<double>(settings.start_delay));
+    auto samples_since_start = [&]() -> uint64_t {
+        double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_host).count() - settings.start_delay;
+        return dt > 0 ? (uint64_t)std::ceil(dt * rate) : 0;
+    };
+    if (not radio->rx_start(t_start, n_total, settings.subdev)) {
+        std::cerr << "rx_start() failed" << std::endl;
+        return false;
+    }
+    n_streams++;
+
+    bool ok            = true;
+    uint64_t n_read    = 0;
+    auto discard_until = [&](const uint64_t n_target) {
+        while (ok and n_read < n_target) {
+            size_t n = std::min<uint64_t>(n_target - n_read, buffer.size());
+            ok       = read_samples(radio, std::span(buffer).first(n));
+            n_read += n;
+        }
+    };
+
+    for (bool first = true; next < queue.size(); first = false) {
+        uint64_t n_first = settings.n_settle;
+        if (not first) {
+            if (not apply(radio, queue[next])) {
+                ok = false;
+                break;
+            }
+            uint64_t n_applied = std::max(samples_since_start(), n_read);
+            max_change         = std::max(max_change, n_applied - n_read);
+            n_first            = n_applied + settings.n_settle;
+        }
+        if (n_first + settings.n_window > n_total) {
+            // this capture does not fit in what remains of the stream, so it starts the next one
+            break;
+        }
+        discard_until(n_first);
+        if (ok) {
+            ok = read_samples(radio, buffer);
+            n_read += buffer.size();
+        }
+        if (not ok) {
+            break;
+        }
+        auto& res    = results[next];
+        res.power_db = 10 * std::log10(std::max(block_power(buffer, res.max_abs), 1e-30));
+        res.valid    = true;
+        n_captures++;
+        next++;
+    }
+
+    // the rest of the stream is read, so that it does not arrive in the next one
+    discard_until(n_total);
+    if (not ok) {
+        radio->rx_stop(settings.subdev);
+    }
+    return ok;
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides an in-place complex forward FFT of power-of-two length
+
+#include <cmath>
+#include <complex>
+#include <mutex>
+#include <numbers>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#ifdef VXSDR_HAVE_FFTW
+#include <fftw3.h>
+#endif
+
+#include "fft.hpp"
+
+fft_plan::fft_plan(const size_t n) : n_points(n) {
+    if (n < 2 or (n & (n - 1)) != 0) {
+        throw std::invalid_argument("fft_plan: size must be a power of two");
+    }
+#ifdef VXSDR_HAVE_FFTW
+    // planning is not thread-safe in FFTW, although executing a plan is
+    static std::mutex planner_mutex;
+    std::lock_guard<std::mutex> lock(planner_mutex);
+    auto* buf = fftwf_alloc_complex(n);
+    plan      = fftwf_plan_dft_1d((int)n, buf, buf, FFTW_FORWARD, FFTW_MEASURE);
+    fftwf_free(buf);
+    if (plan == nullptr) {
+        throw std::runtime_error("fft_plan: unable to make FFTW plan");
+    }
+#else
+    twiddles.resize(n / 2);
+    for (size_t k = 0; k < n / 2; k++) {
+        double theta = -2 * std::numbers::pi * (double)k / (double)n;
+        twiddles[k]  = {(float)std::cos(theta), (float)std::sin(theta)};
+    }
+    unsigned log2n = 0;
+    while ((1UL << log2n) < n) {
+        log2n++;
+    }
+    bit_reverse.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        size_t r = 0;
+        for (unsigned b = 0; b < log2n; b++) {
+            r |= ((i >> b) & 1U) << (log2n - 1 - b);
+        }
+        bit_reverse[i] = r;
+    }
+#endif
+}
+
+fft_plan::~fft_plan() noexcept {
+#ifdef VXSDR_HAVE_FFTW
+    if (plan != nullptr) {
+        fftwf_destroy_plan(static_cast<fftwf_plan>(plan));
+    }
+#endif
+}
+
+const char* fft_plan::implementation() noexcept {
+#ifdef VXSDR_HAVE_FFTW
+    return "FFTW";
+#else
+    return "built-in radix-2";
+#endif
+}
+
+void fft_plan::forward(std::complex<float>* data) const {
+#ifdef VXSDR_HAVE_FFTW
+    auto* p = reinterpret_cast<fftwf_complex*>(data);
+    fftwf_execute_dft(static_cast<fftwf_plan>(plan), p, p);
+#else
+    for (size_t i = 0; i < n_points; i++) {
+        if (i < bit_reverse[i]) {
+            std::swap(data[i], data[bit_reverse[i]]);
+        }
+    }
+    // the products are written out, since std::complex multiplication checks for infinities
+    auto* x = reinterpret_cast<float*>(data);
+    auto* w = reinterpret_cast<const float*>(twiddles.data());
+    for (size_t half = 1; half < n_points; half *= 2) {
+        const size_t stride = n_points / (2 * half);
+        for (size_t start = 0; start < n_points; start += 2 * half) {
+            for (size_t k = 0; k < half; k++) {
+                float wr = w[2 * k * stride];
+                float wi = w[2 * k * stride + 1];
+                float* a = x + 2 * (start + k);
+                float* b = x + 2 * (start + k + half);
+                float tr = b[0] * wr - b[1] * wi;
+                float ti = b[0] * wi + b[1] * wr;
+                b[0]     = a[0] - tr;
+                b[1]     = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+        }
+    }
+#endif
+}
@@ -3,18 +3,31 @@
 
 // Provides a simple way to set commonly used VXSDR options
 
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <map>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "cal_table.hpp"
+#include "host_radio_options.hpp"
+#include "net_tune.hpp"
 #include "option_utils.hpp"
+#include "radio_config.hpp"
+#include "rt_preflight.hpp"
+#include "sample_buffer.hpp"
+#include "trace.hpp"
 #include "vxsdr.hpp"
 
-std::vector<double> interpret_bracketed_list(const std::string& list, const char delim = ',') {
+std::vector<double> interpret_bracketed_list(const std::string& list, const char delim) {
     // these list matching brackets in the same order
     const std::string left_brackets  = "[({";
     const std::string right_brackets = "])}";
@@ -76,6 +89,29 @@ void add_tx_1ch_options(option_utils::program_options& desc) {
     // clang-format on
 }
 
+void add_rx_nch_options(option_utils::program_options& desc) {
+    add_rx_1ch_options(desc);
+    // clang-format off
+    desc.add_option("rx_channels", "RX channels as subdevice:channel, for example \"[0:0,1:0]\"", option_utils::supported_types::STRING, false, "[0:0]");
+    desc.add_option("rx_freqs", "RX center frequency in Hz for each channel, for example \"[1e9,2e9]\" (instead of --freq)", option_utils::supported_types::STRING);
+    desc.add_option("rx_gains", "RX gain in dB for each channel, for example \"[0,10]\"", option_utils::supported_types::STRING);
+    desc.add_option("rx_ants", "RX antenna input selection for each channel, for example \"[A,B]\"", option_utils::supported_types::STRING);
+    desc.add_option("rx_iq_corrs", "RX iq correction for each channel, separated by semicolons, for example \"[(1,0,0,1);(1,0,0,1)]\"", option_utils::supported_types::STRING);
+    // clang-format on
+}
+
+void add_tx_nch_options(option_utils::program_options& desc) {
+    add_tx_1ch_options(desc);
+    // clang-format off
+    desc.add_option("tx_channels", "TX channels as subdevice:channel, for example \"[0:0,1:0]\"", option_utils::supported_types::STRING, false, "[0:0]");
+    desc.add_option("tx_freqs", "TX center frequency in Hz for each channel, for example \"[1e9,2e9]\" (instead of --freq)", option_utils::supported_types::STRING);
+    desc.add_option("tx_gains", "TX gain in dB for each channel, for example \"[0,-10]\"", option_utils::supported_types::STRING);
+    desc.add_option("tx_ants", "TX antenna output selection for each channel, for example \"[A,B]\"", option_utils::supported_types::STRING);
+    desc.add_option("tx_iq_biases", "TX iq bias for each channel, separated by semicolons, for example \"[(0,0);(0.01,0)]\"", option_utils::supported_types::STRING);
+    desc.add_option("tx_iq_corrs", "TX iq correction for each channel, separated by semicolons, for example \"[(1,0,0,1);(1,0,0,1)]\"", option_utils::supported_types::STRING);
+    // clang-format on
+}
+
 void add_common_options(option_utils::program_options& desc) {
     // clang-format off
     desc.add_flag("help", "show help message");
@@ -88,6 +124,9 @@ void add_common_options(option_utils::program_options& desc) {
     desc.add_option("rate", "TX/RX sample rate in Hz", option_utils::supported_types::REAL, true);
     desc.add_option("freq", "TX/RX center frequency in Hz", option_utils::supported_types::REAL, true);
     desc.add_flag("quit_on_error", "quit on errors");
+    desc.add_flag("config_parallel", "send independent radio configuration commands concurrently (only if the library is thread-safe for them)", false, false);
+    desc.add_option("cal_table_file", "binary calibration table giving IQ bias and corrections by device and frequency", option_utils::supported_types::STRING);
+    desc.add_option("trace_file", "file to write a trace of program phases to (Chrome trace JSON, for Perfetto)", option_utils::supported_types::STRING);
     // clang-format on
 }
 
@@ -107,209 +146,593 @@ void add_network_options(option_utils::program_options& desc) {
     desc.add_option("thread_affinity_offset", "offset in CPU number for UDP handler threads when CPU affinity is used (set to a negative number to not use CPU affinity)",
                 option_utils::supported_types::INTEGER, false, "0");
     desc.add_option("network_bit_rate", "the bit rate of the network interface", option_utils::supported_types::REAL, false, "10e9");
+    desc.add_option("buffer_numa_node", "NUMA node for sample buffers (set to a negative number to use the node of the interface with local_address)",
+                option_utils::supported_types::INTEGER, false, "-1");
+    desc.add_flag("buffer_hugepages", "use hugepages for large sample buffers when available", false, true);
+    desc.add_flag("buffer_lock", "lock sample buffers in memory so they are never paged out", false, false);
+    desc.add_option("net_autotune", "size network queues and buffers from the rate and check the host network setup (off, report, or apply)",
+                option_utils::supported_types::STRING, false, "off");
+    desc.add_option("net_queue_time", "time in seconds of packets held in the packet queues when autotuning", option_utils::supported_types::REAL, false, "0.05");
+    desc.add_option("net_socket_time", "time in seconds of packets held in the socket buffers when autotuning", option_utils::supported_types::REAL, false, "0.01");
+
+    // clang-format on
+}
 
+void add_realtime_options(option_utils::program_options& desc) {
+    // clang-format off
+    desc.add_option("rt_preflight", "check the host's realtime setup before transmitting (off, report, or require; require also locks memory and stops if a check fails)",
+                option_utils::supported_types::STRING, false, "report");
+    desc.add_flag("rt_lock_memory", "lock all memory (mlockall) before transmitting, including the mapped waveform", false, false);
+    desc.add_option("rt_main_priority", "realtime priority for the main thread (set to a negative number to not use realtime priority)",
+                option_utils::supported_types::INTEGER, false, "-1");
     // clang-format on
 }
 
+std::vector<double> get_sweep_values(option_utils::parsed_options& vm,
+                                     const std::string& list_name,
+                                     const std::string& fallback,
+                                     const bool fallback_is_real) {
+    if (vm.count(list_name) > 0) {
+        return interpret_bracketed_list(vm[list_name].as<std::string>());
+    }
+    if (vm.count(fallback) > 0) {
+        if (fallback_is_real) {
+            return {vm[fallback].as<double>()};
+        }
+        return {(double)vm[fallback].as<int64_t>()};
+    }
+    // a zero means "leave the library default"
+    return {0.0};
+}
+
+std::vector<std::string> split_address_list(const std::string& list) {
+    std::vector<std::string> ret;
+    std::istringstream iss(list);
+    std::string address;
+    while (std::getline(iss, address, ',')) {
+        if (not address.empty()) {
+            ret.push_back(address);
+        }
+    }
+    return ret;
+}
+
+enum class autotune_mode { off, report, apply };
+
+static autotune_mode net_autotune_mode(option_utils::parsed_options& vm) {
+    if (vm.count("net_autotune") == 0) {
+        return autotune_mode::off;
+    }
+    std::string mode_str = vm["net_autotune"].as<std::string>();
+    for (unsigned i = 0; i < mode_str.size(); i++) {
+        mode_str[i] = std::tolower(mode_str[i]);
+    }
+    if (mode_str.compare("off") == 0) {
+        return autotune_mode::off;
+    }
+    if (mode_str.compare("report") == 0) {
+        return autotune_mode::report;
+    }
+    if (mode_str.compare("apply") == 0) {
+        return autotune_mode::apply;
+    }
+    std::cerr << "Error: unknown option value for --net_autotune: " << vm["net_autotune"].as<std::string>() << std::endl;
+    exit(1);
+}
+
+// the number of channels given by --rx_channels or --tx_channels (one if not used); the radio has not
+// been opened yet, so this is the most that can be streamed rather than the streams the program uses
+static unsigned channel_count(option_utils::parsed_options& vm, const std::string& name) {
+    if (vm.count(name) == 0) {
+        return 1;
+    }
+    const std::string list = vm[name].as<std::string>();
+    return 1 + std::count(list.begin(), list.end(), ',');
+}
+
+// sizes the queues and socket buffers for the rate, and reports them (once, since programs with several
+// radios get the settings for each); with --net_autotune=apply, they replace the sizes in settings
+static void autotune_network(option_utils::parsed_options& vm,
+                             const int thread_affinity_offset,
+                             std::map<std::string, int64_t>& settings) {
+    static bool reported = false;
+
+    net_tune_request request;
+    double rate = (vm.count("rate") > 0) ? vm["rate"].as<double>() : 0.0;
+    if (vm.count("rx_rate") > 0) {
+        rate = std::max(rate, vm["rx_rate"].as<double>());
+    }
+    if (vm.count("tx_rate") > 0) {
+        rate = std::max(rate, vm["tx_rate"].as<double>());
+    }
+    request.rx_rate          = rate * channel_count(vm, "rx_channels");
+    request.tx_rate          = rate * channel_count(vm, "tx_channels");
+    request.network_bit_rate = vm["network_bit_rate"].as<double>();
+    request.mtu_bytes        = vm["network_mtu"].as<unsigned>();
+    if (vm.count("payload_size") > 0) {
+        request.payload_bytes = vm["payload_size"].as<unsigned>();
+    }
+    request.queue_time             = vm["net_queue_time"].as<double>();
+    request.socket_time            = vm["net_socket_time"].as<double>();
+    request.thread_affinity_offset = thread_affinity_offset;
+    request.local_address          = vm["local_address"].as<std::string>();
+
+    auto host   = get_host_network_info(request.local_address);
+    auto result = tune_network(request, host);
+    if (not reported) {
+        print_net_tune_report(std::cout, host, result, settings);
+        std::cout << "    (sized for every channel in --rx_channels and --tx_channels at the full rate, so an upper bound"
+                  << " for programs streaming fewer)" << std::endl;
+        reported = true;
+    }
+    if (net_autotune_mode(vm) == autotune_mode::apply and result.samples_per_packet > 0) {
+        settings["udp_data_transport:mtu_bytes"] = result.mtu_bytes;
+        settings["rx_data_queue_packets"]        = result.rx_queue_packets;
+        settings["tx_data_queue_packets"]        = result.tx_queue_packets;
+        settings["network_receive_buffer_bytes"] = result.receive_buffer_bytes;
+        settings["network_send_buffer_bytes"]    = result.send_buffer_bytes;
+    }
+}
+
+std::map<std::string, int64_t> get_radio_settings(option_utils::parsed_options& vm,
+                                                  const std::string& device_address,
+                                                  const int thread_affinity_offset) {
+    uint32_t local_addr  = ntohl(inet_addr(vm["local_address"].as<std::string>().c_str()));
+    uint32_t device_addr = ntohl(inet_addr(device_address.c_str()));
+
+    std::map<std::string, int64_t> settings = {
+        {"udp_transport:local_address", local_addr},
+        {"udp_transport:device_address", device_addr},
+        {"tx_data_queue_packets", vm["tx_data_queue_packets"].as<unsigned>()},
+        {"rx_data_queue_packets", vm["rx_data_queue_packets"].as<unsigned>()},
+        {"network_send_buffer_bytes", vm["network_send_buffer_bytes"].as<unsigned>()},
+        {"network_receive_buffer_bytes", vm["network_receive_buffer_bytes"].as<unsigned>()},
+        {"net_thread_priority", vm["net_thread_priority"].as<int>()},
+        {"thread_affinity_offset", thread_affinity_offset}};
+
+    if (vm.count("network_mtu") > 0) {
+        settings["udp_data_transport:mtu_bytes"] = vm["network_mtu"].as<unsigned>();
+    }
+
+    if (net_autotune_mode(vm) != autotune_mode::off) {
+        autotune_network(vm, thread_affinity_offset, settings);
+    }
+
+    return settings;
+}
+
+std::map<std::string, int64_t> get_radio_settings(option_utils::parsed_options& vm) {
+    return get_radio_settings(vm, vm["device_address"].as<std::string>(), vm["thread_affinity_offset"].as<int>());
+}
+
+std::chrono::time_point<std::chrono::system_clock> wait_for_pps_set_time() {
+    constexpr unsigned max_host_clock_error_ms = 200;  // cannot be 500 or more!
+    auto t_now                                 = std::chrono::system_clock::now();
+    auto msecs                                 = std::chrono::time_point_cast<std::chrono::milliseconds>(t_now) -
+                 std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::floor<std::chrono::seconds>(t_now));
+    std::chrono::time_point<std::chrono::system_clock> t_set;
+    trace_scope trace("wait_for_pps_set_time");
+    if (msecs.count() < 1000 - max_host_clock_error_ms) {
+        // set time at next second (i.e. ceil(t_now))
+        t_set = std::chrono::ceil<std::chrono::seconds>(t_now);
+    } else {
+        // too close to second boundary, wait until second after next
+        t_set = std::chrono::ceil<std::chrono::seconds>(t_now) + std::chrono::seconds(1);
+    }
+    // wait until nearly t_set, so the command arrives before the pps
+    std::this_thread::sleep_until(t_set - std::chrono::milliseconds(max_host_clock_error_ms));
+    return t_set;
+}
+
+static bool time_source_is_pps(option_utils::parsed_options& vm) {
+    std::string ts_str = vm["time_source"].as<std::string>();
+    for (unsigned i = 0; i < ts_str.size(); i++) {
+        ts_str[i] = std::tolower(ts_str[i]);
+    }
+    if (ts_str.compare("host") == 0) {
+        return false;
+    }
+    if (ts_str.compare("pps") == 0) {
+        return true;
+    }
+    std::cerr << "Error: unknown option value for --time_source: " << vm["time_source"].as<std::string>() << std::endl;
+    exit(1);
+}
+
 int set_common_options(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio) {
+    trace_scope trace("set_common_options");
     if (vm.count("time_source") > 0) {
-        std::string ts_str = vm["time_source"].as<std::string>();
-        for (unsigned i = 0; i < ts_str.size(); i++) {
-            ts_str[i] = std::tolower(ts_str[i]);
-        }
-        if (ts_str.compare("host") == 0) {
+        if (not time_source_is_pps(vm)) {
+            trace_scope trace_set("set_time_now");
             if (not radio->set_time_now(std::chrono::system_clock::now())) {
                 std::cerr << "error in set_common_options: set_time_now" << std::endl;
             }
-        } else if (ts_str.compare("pps") == 0) {
-            constexpr unsigned max_host_clock_error_ms = 200;  // cannot be 500 or more!
-            auto t_now                                 = std::chrono::system_clock::now();
-            auto msecs                                 = std::chrono::time_point_cast<std::chrono::milliseconds>(t_now) -
-                         std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::floor<std::chrono::seconds>(t_now));
-            std::chrono::time_point<std::chrono::system_clock> t_set;
-            if (msecs.count() < 1000 - max_host_clock_error_ms) {
-                // set time at next second (i.e. ceil(t_now))
-                t_set = std::chrono::ceil<std::chrono::seconds>(t_now);
-            } else {
-                // too close to second boundary, wait until second after next
-                t_set = std::chrono::ceil<std::chrono::seconds>(t_now) + std::chrono::seconds(1);
-            }
-            // wait until nearly t_set, then send the command
-            std::this_thread::sleep_until(t_set - std::chrono::milliseconds(max_host_clock_error_ms));
+        } else {
+            auto t_set = wait_for_pps_set_time();
+            trace_scope trace_set("set_time_next_pps");
             if (not radio->set_time_next_pps(std::chrono::time_point_cast<vxsdr::duration>(t_set))) {
                 std::cerr << "error in set_common_options: set_time_next_pps" << std::endl;
             }
-        } else {
-            std::cerr << "Error: unknown option value for --time_source: " << vm["time_source"].as<std::string>() << std::endl;
-            exit(1);
         }
     }
 
     return 0;
 }
 
-int set_rx_1ch_options(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio) {
-    if (vm.count("rate") > 0) {
-        if (not radio->set_rx_rate(vm["rate"].as<double>())) {
-            std::cerr << "error in set_rx_1ch_options: set_rx_rate" << std::endl;
+int set_common_options(option_utils::parsed_options& vm, std::vector<std::unique_ptr<vxsdr>>& radios) {
+    trace_scope trace("set_common_options");
+    if (vm.count("time_source") > 0) {
+        if (not time_source_is_pps(vm)) {
+            for (auto& radio : radios) {
+                if (not radio->set_time_now(std::chrono::system_clock::now())) {
+                    std::cerr << "error in set_common_options: set_time_now" << std::endl;
+                }
+            }
+        } else {
+            // one wait serves all the radios, and the commands are sent together so they all arrive before the same pps
+            auto t_set = wait_for_pps_set_time();
+            std::vector<std::thread> senders;
+            for (auto& radio : radios) {
+                senders.emplace_back([&radio, t_set]() {
+                    trace_scope trace_set("set_time_next_pps");
+                    if (not radio->set_time_next_pps(std::chrono::time_point_cast<vxsdr::duration>(t_set))) {
+                        std::cerr << "error in set_common_options: set_time_next_pps" << std::endl;
+                    }
+                });
+            }
+            for (auto& s : senders) {
+                s.join();
+            }
         }
-        if (vm.count("rx_rate") > 0) {
-            std::cout << "Global option --rate overrides --rx_rate" << std::endl;
+    }
+
+    return 0;
+}
+
+bool apply_calibration(const calibration_table& table,
+                       const uint32_t device_id,
+                       const cal_direction direction,
+                       const double freq,
+                       std::unique_ptr<vxsdr>& radio) {
+    auto cal = table.lookup(device_id, direction, freq);
+    if (not cal.has_value()) {
+        return false;
+    }
+    if (direction == cal_direction::tx) {
+        return radio->set_tx_iq_bias(cal->iq_bias) and radio->set_tx_iq_corr(cal->iq_corr);
+    }
+    return radio->set_rx_iq_corr(cal->iq_corr);
+}
+
+// fills in the corrections from --cal_table_file at the configured frequency, unless they are given explicitly
+static void get_calibration_config(option_utils::parsed_options& vm,
+                                   std::unique_ptr<vxsdr>& radio,
+                                   const cal_direction direction,
+                                   radio_channel_config& cfg) {
+    const char* dir_name = (direction == cal_direction::tx) ? "tx" : "rx";
+    trace_scope trace("get_calibration_config");
+    // each file is read only once, although both directions (and every radio) look up corrections in it
+    static std::map<std::string, std::optional<calibration_table>> tables;
+    auto file_name       = vm["cal_table_file"].as<std::string>();
+    auto [entry, is_new] = tables.try_emplace(file_name);
+    if (is_new) {
+        calibration_table loaded;
+        if (loaded.load(file_name)) {
+            entry->second = std::move(loaded);
         }
-    } else if (vm.count("rx_rate") > 0) {
-        if (not radio->set_rx_rate(vm["rx_rate"].as<double>())) {
-            std::cerr << "error in set_rx_1ch_options: set_rx_rate" << std::endl;
+    }
+    if (not entry->second.has_value()) {
+        std::cerr << "error in set_" << dir_name << "_1ch_options: unable to load calibration table" << std::endl;
+        return;
+    }
+    const auto& table = entry->second.value();
+    auto hello_info = radio->hello();
+    if (not hello_info.has_value()) {
+        std::cerr << "error in set_" << dir_name << "_1ch_options: unable to get device id" << std::endl;
+        return;
+    }
+    uint32_t device_id = hello_info->at(3);
+    auto cal           = table.lookup(device_id, direction, cfg.freq.value());
+    if (not cal.has_value()) {
+        std::cerr << "error in set_" << dir_name << "_1ch_options: no calibration for device " << device_id << std::endl;
+        return;
+    }
+    std::cout << "using " << dir_name << " calibration for device " << device_id << " at " << cfg.freq.value() << " Hz"
+              << std::endl;
+    if (direction == cal_direction::tx and not cfg.iq_bias.has_value()) {
+        cfg.iq_bias = cal->iq_bias;
+    }
+    if (not cfg.iq_corr.has_value()) {
+        cfg.iq_corr = cal->iq_corr;
+    }
+}
+
+// collects the settings for one channel, which are the same for TX and RX apart from IQ bias
+static radio_channel_config get_1ch_config(option_utils::parsed_options& vm, const cal_direction direction) {
+    const bool tx              = (direction == cal_direction::tx);
+    const std::string dir      = tx ? "tx" : "rx";
+    const std::string dir_name = tx ? "TX" : "RX";
+    const std::string context  = "set_" + dir + "_1ch_options";
+    radio_channel_config cfg;
+
+    if (vm.count("rate") > 0) {
+        cfg.rate = vm["rate"].as<double>();
+        if (vm.count(dir + "_rate") > 0) {
+            std::cout << "Global option --rate overrides --" << dir << "_rate" << std::endl;
         }
+    } else if (vm.count(dir + "_rate") > 0) {
+        cfg.rate = vm[dir + "_rate"].as<double>();
     } else {
-        std::cerr << "Please specify the global sample rate with --rate or the RX sample rate with --rx_rate" << std::endl;
+        std::cerr << "Please specify the global sample rate with --rate or the " << dir_name << " sample rate with --" << dir
+                  << "_rate" << std::endl;
         exit(1);
     }
 
     if (vm.count("freq") > 0) {
-        if (not radio->set_rx_freq(vm["freq"].as<double>())) {
-            std::cerr << "error in set_rx_1ch_options: set_rx_freq" << std::endl;
-        }
-        if (vm.count("rx_freq") > 0) {
-            std::cout << "Global option --freq overrides --rx_freq" << std::endl;
-        }
-    } else if (vm.count("rx_freq") > 0) {
-        if (not radio->set_rx_freq(vm["rx_freq"].as<double>())) {
-            std::cerr << "error in set_rx_1ch_options: set_rx_freq" << std::endl;
+        cfg.freq = vm["freq"].as<double>();
+        if (vm.count(dir + "_freq") > 0) {
+            std::cout << "Global option --freq overrides --" << dir << "_freq" << std::endl;
         }
+    } else if (vm.count(dir + "_freq") > 0) {
+        cfg.freq = vm[dir + "_freq"].as<double>();
     } else {
-        std::cerr << "Please specify the global center frequency with --freq or the RX center frequency with --rx_freq"
-                  << std::endl;
+        std::cerr << "Please specify the global center frequency with --freq or the " << dir_name
+                  << " center frequency with --" << dir << "_freq" << std::endl;
         exit(1);
     }
 
-    if (vm.count("rx_ant") > 0) {
-        bool port_set = false;
-        for (unsigned n = 0; n < radio->get_rx_num_ports().value_or(-1); n++) {
-            if (radio->get_rx_port_name(n).value_or("") == vm["rx_ant"].as<std::string>()) {
-                if (radio->set_rx_port(n)) {
-                    port_set = true;
-                    break;
-                }
-            }
-        }
-        if (not port_set) {
-            std::cerr << "error in set_rx_1ch_options: set_rx_port" << std::endl;
-        }
+    if (vm.count(dir + "_ant") > 0) {
+        cfg.port_name = vm[dir + "_ant"].as<std::string>();
     }
 
-    if (vm.count("rx_gain") > 0) {
-        if (not radio->set_rx_gain(vm["rx_gain"].as<double>())) {
-            std::cerr << "error in set_rx_1ch_options: set_rx_gain" << std::endl;
+    if (vm.count(dir + "_gain") > 0) {
+        cfg.gain = vm[dir + "_gain"].as<double>();
+    }
+
+    if (tx and vm.count("tx_iq_bias") > 0) {
+        auto x = interpret_bracketed_list(vm["tx_iq_bias"].as<std::string>());
+        if (x.size() != 2) {
+            std::cerr << "error in " << context << ": set_tx_iq_bias (requires 2 arguments)" << std::endl;
+        } else {
+            cfg.iq_bias = {x[0], x[1]};
         }
     }
 
-    if (vm.count("rx_iq_corr") > 0) {
-        auto x = interpret_bracketed_list(vm["rx_iq_corr"].as<std::string>());
+    if (vm.count(dir + "_iq_corr") > 0) {
+        auto x = interpret_bracketed_list(vm[dir + "_iq_corr"].as<std::string>());
         if (x.size() != 4) {
-            std::cerr << "error in set_rx_1ch_options: set_rx_iq_corr (requires 4 arguments)" << std::endl;
+            std::cerr << "error in " << context << ": set_" << dir << "_iq_corr (requires 4 arguments)" << std::endl;
         } else {
-            std::array<double, 4> y;
-            for (int i = 0; i < 4; i++) {
-                y[i] = x[i];
-            }
-            if (not radio->set_rx_iq_corr(y)) {
-                std::cerr << "error in set_rx_1ch_options: set_rx_iq_corr" << std::endl;
-            }
+            cfg.iq_corr = {x[0], x[1], x[2], x[3]};
         }
     }
 
+    return cfg;
+}
+
+static int set_1ch_options(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio, const cal_direction direction) {
+    const std::string context = (direction == cal_direction::tx) ? "set_tx_1ch_options" : "set_rx_1ch_options";
+    trace_scope trace(context);
+
+    auto cfg = get_1ch_config(vm, direction);
+    if (vm.count("cal_table_file") > 0) {
+        get_calibration_config(vm, radio, direction, cfg);
+    }
+
+    const bool parallel       = vm.count("config_parallel") > 0 and vm["config_parallel"].as<bool>();
+    auto report               = apply_radio_config(radio, direction, cfg, parallel, context);
+    std::cout << context << ": " << report.n_commands << " commands in " << report.n_stages << " stages took "
+              << 1e3 * report.elapsed_sec << " ms" << std::endl;
+
     return 0;
 }
 
+int set_rx_1ch_options(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio) {
+    return set_1ch_options(vm, radio, cal_direction::rx);
+}
+
 int set_tx_1ch_options(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio) {
-    if (vm.count("rate") > 0) {
-        if (not radio->set_tx_rate(vm["rate"].as<double>())) {
-            std::cerr << "error in set_tx_1ch_options: set_tx_rate" << std::endl;
-        }
-        if (vm.count("tx_rate") > 0) {
-            std::cout << "Global option --rate overrides --tx_rate" << std::endl;
+    return set_1ch_options(vm, radio, cal_direction::tx);
+}
+
+// splits the inside of a bracketed list into its items, for example "[A,B]" into "A" and "B"
+static std::vector<std::string> split_bracketed_list(const std::string& list, const char delim = ',') {
+    const std::string left_brackets  = "[({";
+    const std::string right_brackets = "])}";
+    std::string inside               = list;
+    auto i_bracket                   = left_brackets.find(list.empty() ? ' ' : list.front());
+    if (i_bracket != std::string::npos and list.back() == right_brackets[i_bracket]) {
+        inside = list.substr(1, list.size() - 2);
+    }
+    std::vector<std::string> ret;
+    std::istringstream iss(inside);
+    std::string item;
+    while (std::getline(iss, item, delim)) {
+        if (not item.empty()) {
+            ret.push_back(item);
         }
-    } else if (vm.count("tx_rate") > 0) {
-        if (not radio->set_tx_rate(vm["tx_rate"].as<double>())) {
-            std::cerr << "error in set_tx_1ch_options: set_tx_rate" << std::endl;
+    }
+    return ret;
+}
+
+std::vector<radio_channel_config> interpret_channel_list(const std::string& list, const std::string& option_name) {
+    std::vector<radio_channel_config> cfgs;
+    for (const auto& item : split_bracketed_list(list)) {
+        auto colon = item.find(':');
+        try {
+            radio_channel_config cfg;
+            cfg.subdev  = (uint8_t)std::stoul(item.substr(0, colon));
+            cfg.channel = (colon == std::string::npos) ? 0 : (uint8_t)std::stoul(item.substr(colon + 1));
+            cfgs.push_back(cfg);
+        } catch (std::exception&) {
+            std::cerr << "Error: cannot interpret channel " << item << " in --" << option_name << std::endl;
+            exit(1);
         }
-    } else {
-        std::cerr << "Please specify the global sample rate with --rate or the TX sample rate with --tx_rate" << std::endl;
+    }
+    if (cfgs.empty()) {
+        std::cerr << "Error: --" << option_name << " must list at least one channel" << std::endl;
         exit(1);
     }
+    return cfgs;
+}
 
-    if (vm.count("freq") > 0) {
-        if (not radio->set_tx_freq(vm["freq"].as<double>())) {
-            std::cerr << "error in set_tx_1ch_options: set_tx_freq" << std::endl;
-        }
-        if (vm.count("tx_freq") > 0) {
-            std::cout << "Global option --freq overrides --tx_freq" << std::endl;
-        }
-    } else if (vm.count("tx_freq") > 0) {
-        if (not radio->set_tx_freq(vm["tx_freq"].as<double>())) {
-            std::cerr << "error in set_tx_1ch_options: set_tx_freq" << std::endl;
-        }
-    } else {
-        std::cout << "Please specify the global center frequency with --freq or the TX center frequency with --tx_freq"
-                  << std::endl;
+// returns the per-channel values given by option name, which must have either one value for
+// all channels or one for each channel; an empty vector means the option was not given
+static std::vector<std::string> get_channel_values(option_utils::parsed_options& vm,
+                                                   const std::string& name,
+                                                   const size_t n_channels,
+                                                   const char delim = ',') {
+    if (vm.count(name) == 0) {
+        return {};
+    }
+    auto values = split_bracketed_list(vm[name].as<std::string>(), delim);
+    if (values.size() == 1) {
+        values.resize(n_channels, values[0]);
+    }
+    if (values.size() != n_channels) {
+        std::cerr << "Error: --" << name << " must have one value or " << n_channels << " values (one per channel)" << std::endl;
         exit(1);
     }
+    return values;
+}
 
-    if (vm.count("tx_ant") > 0) {
-        bool port_set = false;
-        for (unsigned n = 0; n < radio->get_tx_num_ports().value_or(-1); n++) {
-            if (radio->get_tx_port_name(n).value_or("") == vm["tx_ant"].as<std::string>()) {
-                if (radio->set_tx_port(n)) {
-                    port_set = true;
-                    break;
-                }
+static std::vector<radio_channel_config> get_nch_config(option_utils::parsed_options& vm, const cal_direction direction) {
+    const bool tx             = (direction == cal_direction::tx);
+    const std::string dir     = tx ? "tx" : "rx";
+    const std::string context = "set_" + dir + "_nch_options";
+
+    // the single-channel options give the defaults for every channel
+    auto base = get_1ch_config(vm, direction);
+
+    auto cfgs = interpret_channel_list(vm[dir + "_channels"].as<std::string>(), dir + "_channels");
+    for (auto& cfg : cfgs) {
+        const uint8_t sd = cfg.subdev;
+        const uint8_t ch = cfg.channel;
+        cfg              = base;
+        cfg.subdev       = sd;
+        cfg.channel      = ch;
+    }
+
+    const size_t n = cfgs.size();
+    auto freqs     = get_channel_values(vm, dir + "_freqs", n);
+    auto gains     = get_channel_values(vm, dir + "_gains", n);
+    auto ants      = get_channel_values(vm, dir + "_ants", n);
+    auto biases    = tx ? get_channel_values(vm, "tx_iq_biases", n, ';') : std::vector<std::string>{};
+    auto corrs     = get_channel_values(vm, dir + "_iq_corrs", n, ';');
+    for (size_t k = 0; k < n; k++) {
+        try {
+            if (not freqs.empty()) {
+                cfgs[k].freq = std::stod(freqs[k]);
+            }
+            if (not gains.empty()) {
+                cfgs[k].gain = std::stod(gains[k]);
             }
+        } catch (std::exception&) {
+            std::cerr << "error parsing command line options: cannot interpret --" << dir << "_freqs or --" << dir << "_gains"
+                      << std::endl;
+            exit(1);
         }
-        if (not port_set) {
-            std::cerr << "error in set_tx_1ch_options: set_tx_port" << std::endl;
+        if (not ants.empty()) {
+            cfgs[k].port_name = ants[k];
         }
-    }
-
-    if (vm.count("tx_gain") > 0) {
-        if (not radio->set_tx_gain(vm["tx_gain"].as<double>())) {
-            std::cerr << "error in set_tx_1ch_options: set_tx_gain" << std::endl;
+        if (not biases.empty()) {
+            auto x = interpret_bracketed_list(biases[k]);
+            if (x.size() != 2) {
+                std::cerr << "error in " << context << ": set_tx_iq_bias (requires 2 arguments)" << std::endl;
+            } else {
+                cfgs[k].iq_bias = {x[0], x[1]};
+            }
+        }
+        if (not corrs.empty()) {
+            auto x = interpret_bracketed_list(corrs[k]);
+            if (x.size() != 4) {
+                std::cerr << "error in " << context << ": set_" << dir << "_iq_corr (requires 4 arguments)" << std::endl;
+            } else {
+                cfgs[k].iq_corr = {x[0], x[1], x[2], x[3]};
+            }
         }
     }
 
-    if (vm.count("tx_iq_bias") > 0) {
-        auto x = interpret_bracketed_list(vm["tx_iq_bias"].as<std::string>());
-        if (x.size() != 2) {
-            std::cerr << "error in set_tx_1ch_options: set_tx_iq_bias (requires 2 arguments)" << std::endl;
-        } else {
-            std::array<double, 2> y;
-            for (int i = 0; i < 2; i++) {
-                y[i] = x[i];
+    // frequency is set per subdevice, so channels sharing a subdevice must agree
+    for (size_t j = 0; j < n; j++) {
+        for (size_t k = j + 1; k < n; k++) {
+            if (cfgs[j].subdev == cfgs[k].subdev and cfgs[j].channel == cfgs[k].channel) {
+                std::cerr << "Error: channel " << (int)cfgs[k].subdev << ":" << (int)cfgs[k].channel << " is listed twice in --"
+                          << dir << "_channels" << std::endl;
+                exit(1);
             }
-            if (not radio->set_tx_iq_bias(y)) {
-                std::cerr << "error in set_tx_1ch_options: set_tx_iq_bias" << std::endl;
+            if (cfgs[j].subdev == cfgs[k].subdev and cfgs[j].freq != cfgs[k].freq) {
+                std::cerr << "Error: channels on subdevice " << (int)cfgs[k].subdev << " must use the same frequency" << std::endl;
+                exit(1);
             }
         }
     }
+    return cfgs;
+}
 
-    if (vm.count("tx_iq_corr") > 0) {
-        auto x = interpret_bracketed_list(vm["tx_iq_corr"].as<std::string>());
-        if (x.size() != 4) {
-            std::cerr << "error in set_tx_1ch_options: set_tx_iq_corr (requires 4 arguments)" << std::endl;
-        } else {
-            std::array<double, 4> y;
-            for (int i = 0; i < 4; i++) {
-                y[i] = x[i];
-            }
-            if (not radio->set_tx_iq_corr(y)) {
-                std::cerr << "error in set_tx_1ch_options: set_tx_iq_corr" << std::endl;
+std::vector<radio_channel_config> get_rx_nch_config(option_utils::parsed_options& vm) {
+    return get_nch_config(vm, cal_direction::rx);
+}
+
+std::vector<radio_channel_config> get_tx_nch_config(option_utils::parsed_options& vm) {
+    return get_nch_config(vm, cal_direction::tx);
+}
+
+static int set_nch_options(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio, const cal_direction direction) {
+    auto cfgs                 = get_nch_config(vm, direction);
+    const std::string context = (direction == cal_direction::tx) ? "set_tx_nch_options" : "set_rx_nch_options";
+    trace_scope trace(context);
+
+    auto n_subdevs = radio->get_num_subdevices();
+    for (const auto& cfg : cfgs) {
+        if (n_subdevs.has_value() and cfg.subdev >= n_subdevs.value()) {
+            std::cerr << "error in " << context << ": radio has " << n_subdevs.value() << " subdevices, subdevice "
+                      << (int)cfg.subdev << " requested" << std::endl;
+            return 1;
+        }
+    }
+    // the table is keyed by device, so it is only used for the first channel of the first subdevice
+    if (vm.count("cal_table_file") > 0) {
+        for (auto& cfg : cfgs) {
+            if (cfg.subdev == 0 and cfg.channel == 0) {
+                get_calibration_config(vm, radio, direction, cfg);
             }
         }
     }
 
+    const bool parallel = vm.count("config_parallel") > 0 and vm["config_parallel"].as<bool>();
+    auto report         = apply_radio_config(radio, direction, cfgs, parallel, context);
+    std::cout << context << ": " << report.n_commands << " commands for " << cfgs.size() << " channels in " << report.n_stages
+              << " stages took " << 1e3 * report.elapsed_sec << " ms" << std::endl;
+
+    return report.n_failed == 0 ? 0 : 1;
+}
+
+int set_rx_nch_options(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio) {
+    return set_nch_options(vm, radio, cal_direction::rx);
+}
+
+int set_tx_nch_options(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio) {
+    return set_nch_options(vm, radio, cal_direction::tx);
+}
+
+int set_buffer_options(option_utils::parsed_options& vm) {
+    sample_buffer_settings settings;
+    settings.numa_node     = vm["buffer_numa_node"].as<int>();
+    settings.use_hugepages = vm["buffer_hugepages"].as<bool>();
+    settings.lock          = vm["buffer_lock"].as<bool>();
+    if (settings.numa_node < 0) {
+        settings.numa_node = numa_node_of_address(vm["local_address"].as<std::string>());
+    }
+    if (settings.numa_node >= 0) {
+        std::cout << "using NUMA node " << settings.numa_node << " for sample buffers" << std::endl;
+    }
+    configure_sample_buffers(settings);
     return 0;
 }
 
 int set_network_options(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio) {
+    trace_scope trace("set_network_options");
     if (vm.count("payload_size") > 0) {
         if (not radio->set_max_payload_bytes(vm["payload_size"].as<unsigned>())) {
             std::cerr << "error in set_network_options: set_max_payload_bytes" << std::endl;
@@ -318,3 +741,55 @@ int set_network_options(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>
 
     return 0;
 }
+
+int set_trace_options(option_utils::parsed_options& vm) {
+    if (vm.count("trace_file") > 0 and not start_trace(vm["trace_file"].as<std::string>())) {
+        return 1;
+    }
+    return 0;
+}
+
+enum class preflight_mode { off, report, require };
+
+static preflight_mode rt_preflight_mode(option_utils::parsed_options& vm) {
+    if (vm.count("rt_preflight") == 0) {
+        return preflight_mode::off;
+    }
+    std::string mode_str = vm["rt_preflight"].as<std::string>();
+    for (unsigned i = 0; i < mode_str.size(); i++) {
+        mode_str[i] = std::tolower(mode_str[i]);
+    }
+    if (mode_str.compare("off") == 0) {
+        return preflight_mode::off;
+    }
+    if (mode_str.compare("report") == 0) {
+        return preflight_mode::report;
+    }
+    if (mode_str.compare("require") == 0) {
+        return preflight_mode::require;
+    }
+    std::cerr << "Error: unknown option value for --rt_preflight: " << vm["rt_preflight"].as<std::string>() << std::endl;
+    exit(1);
+}
+
+int set_realtime_options(option_utils::parsed_options& vm) {
+    auto mode = rt_preflight_mode(vm);
+    if (mode == preflight_mode::off) {
+        return 0;
+    }
+    trace_scope trace("set_realtime_options");
+    // only an explicit request changes memory behavior, since locking pins the whole mapped waveform
+    rt_preflight_request request;
+    request.lock_memory            = mode == preflight_mode::require or vm["rt_lock_memory"].as<bool>();
+    request.net_thread_priority    = vm["net_thread_priority"].as<int>();
+    request.thread_affinity_offset = vm["thread_affinity_offset"].as<int>();
+    request.main_thread_priority   = vm["rt_main_priority"].as<int>();
+
+    auto checks = run_rt_preflight(request);
+    print_rt_preflight_report(std::cout, checks);
+    if (mode == preflight_mode::require and not rt_preflight_passed(checks)) {
+        std::cerr << "realtime preflight failed (use --rt_preflight=report to transmit anyway)" << std::endl;
+        return 1;
+    }
+    return 0;
+}
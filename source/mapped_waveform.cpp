@@ -0,0 +1,74 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides read-only, memory-mapped access to waveform files
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include "mapped_waveform.hpp"
+
+mapped_waveform::mapped_waveform(mapped_waveform&& other) noexcept
+    : map_addr(std::exchange(other.map_addr, nullptr)), map_bytes(std::exchange(other.map_bytes, 0)) {}
+
+mapped_waveform& mapped_waveform::operator=(mapped_waveform&& other) noexcept {
+    if (this != &other) {
+        close();
+        map_addr  = std::exchange(other.map_addr, nullptr);
+        map_bytes = std::exchange(other.map_bytes, 0);
+    }
+    return *this;
+}
+
+size_t mapped_waveform::open(const std::string& name, const unsigned flags) {
+    close();
+
+    int fd = ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+
+    struct stat st = {};
+    if (fstat(fd, &st) != 0 or st.st_size <= 0) {
+        // mmap cannot map an empty file
+        ::close(fd);
+        return 0;
+    }
+
+    int map_flags = MAP_PRIVATE;
+    if ((flags & populate) != 0) {
+        map_flags |= MAP_POPULATE;
+    }
+
+    void* addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, map_flags, fd, 0);
+    // the mapping remains valid after the descriptor is closed
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        std::cerr << "error in mapped_waveform: unable to map " << name << std::endl;
+        return 0;
+    }
+
+    if ((flags & sequential) != 0) {
+        // this is only advice, so a failure is not an error
+        madvise(addr, (size_t)st.st_size, MADV_SEQUENTIAL);
+    }
+
+    map_addr  = addr;
+    map_bytes = (size_t)st.st_size;
+
+    return size();
+}
+
+void mapped_waveform::close() noexcept {
+    if (map_addr != nullptr) {
+        munmap(map_addr, map_bytes);
+        map_addr  = nullptr;
+        map_bytes = 0;
+    }
+}
@@ -0,0 +1,289 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides sizing of the network queues and socket buffers, and checks of the host network setup
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+#include "net_tune.hpp"
+#include "sample_buffer.hpp"
+
+namespace {
+// Ethernet header, FCS, preamble, and interframe gap, which take link time but are not in the MTU
+constexpr unsigned ethernet_overhead_bytes = 38;
+constexpr unsigned min_queue_packets       = 64;
+constexpr unsigned max_queue_packets       = 1U << 22;
+constexpr uint64_t min_socket_bytes        = 262144;
+constexpr uint64_t socket_bytes_increment  = 65536;
+// the link is treated as full above this load, since the radio sends in bursts
+constexpr double max_link_load = 0.9;
+
+template <typename T>
+bool read_value(const std::string& file_name, T& value) {
+    std::ifstream infile(file_name);
+    return infile.is_open() and static_cast<bool>(infile >> value);
+}
+
+unsigned round_up_pow2(const double n) {
+    unsigned p = min_queue_packets;
+    while (p < n and p < max_queue_packets) {
+        p *= 2;
+    }
+    return p;
+}
+
+uint64_t round_up_socket_bytes(const double n) {
+    auto n_inc = (uint64_t)std::ceil(n / (double)socket_bytes_increment);
+    return std::max(min_socket_bytes, n_inc * socket_bytes_increment);
+}
+
+std::string format_bit_rate(const double bits_per_sec) {
+    std::ostringstream oss;
+    oss.precision(3);
+    oss << 1e-9 * bits_per_sec << " Gb/s";
+    return oss.str();
+}
+
+bool contains(const std::vector<int>& cpus, const int cpu) {
+    return std::find(cpus.begin(), cpus.end(), cpu) != cpus.end();
+}
+}  // namespace
+
+std::vector<int> parse_cpu_list(const std::string& list) {
+    std::vector<int> cpus;
+    std::istringstream iss(list);
+    std::string range;
+    while (std::getline(iss, range, ',')) {
+        int first = 0;
+        int last  = 0;
+        char dash = 0;
+        std::istringstream rss(range);
+        if (not(rss >> first)) {
+            continue;
+        }
+        last = first;
+        if (rss >> dash and dash == '-') {
+            rss >> last;
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+uint64_t granted_socket_buffer(const int option, const uint64_t n_bytes) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        return 0;
+    }
+    int requested = (int)std::min<uint64_t>(n_bytes, INT_MAX / 2);
+    int granted   = 0;
+    socklen_t len = sizeof(granted);
+    if (setsockopt(sock, SOL_SOCKET, option, &requested, sizeof(requested)) != 0
+        or getsockopt(sock, SOL_SOCKET, option, &granted, &len) != 0) {
+        close(sock);
+        return 0;
+    }
+    close(sock);
+    // Linux doubles the size asked for to allow for its bookkeeping, and reports the doubled size
+    return (uint64_t)granted / 2;
+}
+
+host_network_info get_host_network_info(const std::string& local_address) {
+    host_network_info info;
+    read_value("/proc/sys/net/core/rmem_max", info.rmem_max);
+    read_value("/proc/sys/net/core/wmem_max", info.wmem_max);
+
+    info.interface = interface_of_address(local_address);
+    if (info.interface.empty()) {
+        return info;
+    }
+    const std::string if_dir = "/sys/class/net/" + info.interface;
+    read_value(if_dir + "/mtu", info.mtu);
+    // the speed is in Mb/s, and is -1 (or cannot be read) when the link is down or virtual
+    int speed = -1;
+    if (read_value(if_dir + "/speed", speed) and speed > 0) {
+        info.link_bit_rate = 1e6 * speed;
+    }
+    info.numa_node = numa_node_of_address(local_address);
+    if (info.numa_node >= 0) {
+        std::string cpulist;
+        if (read_value("/sys/devices/system/node/node" + std::to_string(info.numa_node) + "/cpulist", cpulist)) {
+            info.numa_cpus = parse_cpu_list(cpulist);
+        }
+    }
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(if_dir + "/device/msi_irqs", ec)) {
+        int irq = -1;
+        std::string cpulist;
+        try {
+            irq = std::stoi(entry.path().filename().string());
+        } catch (std::exception&) {
+            continue;
+        }
+        if (read_value("/proc/irq/" + std::to_string(irq) + "/smp_affinity_list", cpulist)) {
+            info.irq_cpus.emplace_back(irq, parse_cpu_list(cpulist));
+        }
+    }
+    std::sort(info.irq_cpus.begin(), info.irq_cpus.end());
+    return info;
+}
+
+net_tune_result tune_network(const net_tune_request& request, const host_network_info& host) {
+    net_tune_result result;
+    result.mtu_bytes = request.mtu_bytes;
+    if (host.mtu > 0 and (unsigned)host.mtu < request.mtu_bytes) {
+        result.warnings.push_back("interface " + host.interface + " has mtu " + std::to_string(host.mtu)
+                                  + ", less than network_mtu " + std::to_string(request.mtu_bytes)
+                                  + ", so larger packets would be dropped");
+        result.mtu_bytes = host.mtu;
+    }
+    if (result.mtu_bytes <= net_packet_header_bytes + sizeof(vxsdr::wire_sample)) {
+        result.warnings.push_back("network_mtu " + std::to_string(result.mtu_bytes) + " is too small for data packets");
+        return result;
+    }
+
+    unsigned payload_bytes = result.mtu_bytes - net_packet_header_bytes;
+    if (request.payload_bytes > 0) {
+        payload_bytes = std::min(payload_bytes, request.payload_bytes);
+    }
+    result.samples_per_packet = payload_bytes / sizeof(vxsdr::wire_sample);
+    payload_bytes             = result.samples_per_packet * sizeof(vxsdr::wire_sample);
+    result.rx_packet_rate     = request.rx_rate / result.samples_per_packet;
+    result.tx_packet_rate     = request.tx_rate / result.samples_per_packet;
+
+    // the link is full duplex, so the busier direction sets the load
+    const double packet_bytes = payload_bytes + net_packet_header_bytes;
+    const double wire_bits    = 8.0 * (packet_bytes + ethernet_overhead_bytes);
+    double bit_rate           = request.network_bit_rate;
+    if (host.link_bit_rate > 0 and host.link_bit_rate < bit_rate) {
+        result.warnings.push_back("interface " + host.interface + " links at " + format_bit_rate(host.link_bit_rate)
+                                  + ", less than network_bit_rate " + format_bit_rate(request.network_bit_rate));
+        bit_rate = host.link_bit_rate;
+    }
+    if (bit_rate > 0) {
+        result.link_load = wire_bits * std::max(result.rx_packet_rate, result.tx_packet_rate) / bit_rate;
+    }
+    if (result.link_load > 1.0) {
+        result.warnings.push_back("the sample rate needs "
+                                  + format_bit_rate(wire_bits * std::max(result.rx_packet_rate, result.tx_packet_rate))
+                                  + ", more than the link's " + format_bit_rate(bit_rate) + "; samples will be lost");
+    } else if (result.link_load > max_link_load) {
+        result.warnings.push_back("the sample rate uses " + std::to_string((int)std::lround(100 * result.link_load))
+                                  + "% of the link, which leaves little room for bursts");
+    }
+
+    result.rx_queue_packets = round_up_pow2(request.queue_time * result.rx_packet_rate);
+    result.tx_queue_packets = round_up_pow2(request.queue_time * result.tx_packet_rate);
+    // the kernel's doubling of the size asked for covers its per-packet overhead, so only the packets are counted
+    result.receive_buffer_bytes = round_up_socket_bytes(request.socket_time * result.rx_packet_rate * packet_bytes);
+    result.send_buffer_bytes    = round_up_socket_bytes(request.socket_time * result.tx_packet_rate * packet_bytes);
+
+    result.granted_receive_bytes = granted_socket_buffer(SO_RCVBUF, result.receive_buffer_bytes);
+    result.granted_send_bytes    = granted_socket_buffer(SO_SNDBUF, result.send_buffer_bytes);
+    if (result.granted_receive_bytes > 0 and result.granted_receive_bytes < result.receive_buffer_bytes) {
+        result.warnings.push_back("the kernel limits socket receive buffers to " + std::to_string(result.granted_receive_bytes)
+                                  + " bytes; to allow " + std::to_string(result.receive_buffer_bytes)
+                                  + " bytes, run: sysctl -w net.core.rmem_max=" + std::to_string(result.receive_buffer_bytes));
+    }
+    if (result.granted_send_bytes > 0 and result.granted_send_bytes < result.send_buffer_bytes) {
+        result.warnings.push_back("the kernel limits socket send buffers to " + std::to_string(result.granted_send_bytes)
+                                  + " bytes; to allow " + std::to_string(result.send_buffer_bytes)
+                                  + " bytes, run: sysctl -w net.core.wmem_max=" + std::to_string(result.send_buffer_bytes));
+    }
+
+    // the network threads should be near the interface, but not share CPUs with its interrupts
+    const int cpu = request.thread_affinity_offset;
+    if (cpu >= 0 and not host.numa_cpus.empty() and not contains(host.numa_cpus, cpu)) {
+        result.warnings.push_back("thread_affinity_offset " + std::to_string(cpu) + " is not a CPU of NUMA node "
+                                  + std::to_string(host.numa_node) + ", which " + host.interface + " is attached to");
+    }
+    if (cpu >= 0) {
+        for (const auto& [irq, irq_cpus] : host.irq_cpus) {
+            if (irq_cpus.size() == 1 and irq_cpus.front() == cpu) {
+                result.warnings.push_back("interrupt " + std::to_string(irq) + " of " + host.interface + " is handled on CPU "
+                                          + std::to_string(cpu) + ", the first network thread CPU (thread_affinity_offset)");
+            }
+        }
+    }
+    return result;
+}
+
+void print_net_tune_report(std::ostream& report,
+                           const host_network_info& host,
+                           const net_tune_result& result,
+                           const std::map<std::string, int64_t>& settings) {
+    // the report is formatted separately, so its precision and alignment are not left on the caller's stream
+    std::ostringstream out;
+    auto setting = [&settings](const std::string& key) {
+        auto it = settings.find(key);
+        return (it == settings.end()) ? std::string("default") : std::to_string(it->second);
+    };
+    auto line = [&out](const std::string& name, const std::string& now, const std::string& tuned) {
+        out << "    " << std::left << std::setw(30) << name << std::right << std::setw(10) << now << std::setw(12) << tuned
+            << std::endl;
+    };
+    out << "network tuning for " << (host.interface.empty() ? std::string("unknown interface") : host.interface);
+    if (host.link_bit_rate > 0) {
+        out << " (" << format_bit_rate(host.link_bit_rate) << ", mtu " << host.mtu << ")";
+    }
+    out << ":" << std::endl;
+    out << "    " << result.samples_per_packet << " samples per packet, " << std::lround(result.rx_packet_rate) << " rx and "
+        << std::lround(result.tx_packet_rate) << " tx packets/s, " << std::setprecision(3) << 100 * result.link_load
+        << "% of link" << std::endl;
+    line("", "settings", "tuned");
+    line("network_mtu", setting("udp_data_transport:mtu_bytes"), std::to_string(result.mtu_bytes));
+    line("rx_data_queue_packets", setting("rx_data_queue_packets"), std::to_string(result.rx_queue_packets));
+    line("tx_data_queue_packets", setting("tx_data_queue_packets"), std::to_string(result.tx_queue_packets));
+    line("network_receive_buffer_bytes", setting("network_receive_buffer_bytes"), std::to_string(result.receive_buffer_bytes));
+    line("network_send_buffer_bytes", setting("network_send_buffer_bytes"), std::to_string(result.send_buffer_bytes));
+    out << "    kernel limits: rmem_max " << host.rmem_max << ", wmem_max " << host.wmem_max << std::endl;
+    if (not host.irq_cpus.empty()) {
+        std::vector<int> irq_cpus;
+        for (const auto& [irq, cpus] : host.irq_cpus) {
+            irq_cpus.insert(irq_cpus.end(), cpus.begin(), cpus.end());
+        }
+        std::sort(irq_cpus.begin(), irq_cpus.end());
+        irq_cpus.erase(std::unique(irq_cpus.begin(), irq_cpus.end()), irq_cpus.end());
+        out << "    " << host.irq_cpus.size() << " interrupts, on cpus";
+        for (auto cpu : irq_cpus) {
+            out << " " << cpu;
+        }
+        out << std::endl;
+    }
+    // the sizes in the settings are the ones that will be used unless tuning is applied
+    for (const auto& [key, option] : {std::pair{"network_receive_buffer_bytes", SO_RCVBUF},
+                                      std::pair{"network_send_buffer_bytes", SO_SNDBUF}}) {
+        auto it = settings.find(key);
+        if (it != settings.end() and it->second > 0) {
+            uint64_t granted = granted_socket_buffer(option, it->second);
+            if (granted > 0 and granted < (uint64_t)it->second) {
+                out << "warning: the kernel will limit " << key << " " << it->second << " to " << granted << " bytes"
+                    << std::endl;
+            }
+        }
+    }
+    for (const auto& w : result.warnings) {
+        out << "warning: " << w << std::endl;
+    }
+    report << out.str();
+}
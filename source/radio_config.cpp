@@ -0,0 +1,305 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides batched configuration of a radio channel
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "radio_config.hpp"
+#include "trace.hpp"
+
+namespace {
+struct radio_command {
+    std::string name;
+    std::function<bool()> send;
+};
+
+// sends one stage of independent commands, and returns the number that failed
+unsigned send_stage(const std::vector<radio_command>& stage, const bool parallel, const std::string& context) {
+    std::vector<char> ok(stage.size(), 0);
+    if (parallel and stage.size() > 1) {
+        std::vector<std::future<bool>> results;
+        for (const auto& cmd : stage) {
+            results.push_back(std::async(std::launch::async, [&cmd]() {
+                trace_scope trace(cmd.name);
+                return cmd.send();
+            }));
+        }
+        for (size_t i = 0; i < stage.size(); i++) {
+            ok[i] = results[i].get() ? 1 : 0;
+        }
+    } else {
+        for (size_t i = 0; i < stage.size(); i++) {
+            trace_scope trace(stage[i].name);
+            ok[i] = stage[i].send() ? 1 : 0;
+        }
+    }
+    unsigned n_failed = 0;
+    for (size_t i = 0; i < stage.size(); i++) {
+        if (ok[i] == 0) {
+            std::cerr << "error in " << context << ": " << stage[i].name << std::endl;
+            n_failed++;
+        }
+    }
+    return n_failed;
+}
+}  // namespace
+
+std::vector<std::string> get_port_names(std::unique_ptr<vxsdr>& radio,
+                                        const cal_direction direction,
+                                        const bool parallel,
+                                        const uint8_t subdev,
+                                        const uint8_t channel) {
+    static std::mutex cache_mutex;
+    static std::map<vxsdr*, uint32_t> device_ids;
+    static std::map<std::tuple<uint32_t, cal_direction, uint8_t, uint8_t>, std::vector<std::string>> cache;
+
+    trace_scope trace("get_port_names");
+    auto* r = radio.get();
+    // the names are cached by device ID, and the ID is only asked for once per radio object, so a
+    // lookup that hits the cache needs no command; a radio object made after another is destroyed
+    // may have the same address, but the programs here only do that for the same device
+    std::optional<uint32_t> device_id;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = device_ids.find(r);
+        if (it != device_ids.end()) {
+            device_id = it->second;
+        }
+    }
+    if (not device_id.has_value()) {
+        auto hello_info = r->hello();
+        if (hello_info.has_value()) {
+            device_id = hello_info->at(3);
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            device_ids[r] = device_id.value();
+        }
+    }
+    auto key = std::make_tuple(device_id.value_or(0U), direction, subdev, channel);
+    if (device_id.has_value()) {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache.find(key);
+        if (it != cache.end()) {
+            return it->second;
+        }
+    }
+    const bool tx = (direction == cal_direction::tx);
+    auto n_ports  = tx ? r->get_tx_num_ports(subdev, channel) : r->get_rx_num_ports(subdev, channel);
+    if (not n_ports.has_value()) {
+        return {};
+    }
+    // the names are independent, so they are all requested at once
+    std::vector<std::future<std::optional<std::string>>> results;
+    for (unsigned n = 0; n < n_ports.value(); n++) {
+        results.push_back(std::async(parallel ? std::launch::async : std::launch::deferred, [r, tx, n, subdev, channel]() {
+            return tx ? r->get_tx_port_name(n, subdev, channel) : r->get_rx_port_name(n, subdev, channel);
+        }));
+    }
+    std::vector<std::string> names;
+    bool complete = true;
+    for (auto& name : results) {
+        auto x   = name.get();
+        complete = complete and x.has_value();
+        names.push_back(x.value_or(""));
+    }
+    // a failed lookup is not cached, so it is tried again next time
+    if (device_id.has_value() and complete) {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        cache[key] = names;
+    }
+    return names;
+}
+
+radio_config_report apply_radio_config(std::unique_ptr<vxsdr>& radio,
+                                       const cal_direction direction,
+                                       const radio_channel_config& cfg,
+                                       const bool parallel,
+                                       const std::string& context) {
+    return apply_radio_config(radio, direction, std::vector<radio_channel_config>{cfg}, parallel, context);
+}
+
+radio_config_report apply_radio_config(std::unique_ptr<vxsdr>& radio,
+                                       const cal_direction direction,
+                                       const std::vector<radio_channel_config>& cfgs,
+                                       const bool parallel,
+                                       const std::string& context) {
+    const bool tx         = (direction == cal_direction::tx);
+    const std::string dir = tx ? "tx" : "rx";
+    auto* r               = radio.get();
+
+    std::vector<std::vector<radio_command>> stages(4);
+    std::set<uint8_t> rate_set;
+    std::set<uint8_t> freq_set;
+    for (const auto& cfg : cfgs) {
+        const uint8_t sd = cfg.subdev;
+        const uint8_t ch = cfg.channel;
+        // the names of commands for other than the first channel say which channel they are for
+        const std::string where = (sd == 0 and ch == 0) ? "" : " (" + std::to_string(sd) + ":" + std::to_string(ch) + ")";
+        if (cfg.rate.has_value() and rate_set.insert(sd).second) {
+            double x = cfg.rate.value();
+            stages[0].push_back(
+                {"set_" + dir + "_rate" + where, [r, tx, x, sd]() { return tx ? r->set_tx_rate(x, sd) : r->set_rx_rate(x, sd); }});
+        }
+        if (cfg.port_name.has_value()) {
+            std::string name = cfg.port_name.value();
+            stages[0].push_back({"set_" + dir + "_port" + where, [&radio, r, tx, direction, name, parallel, sd, ch]() {
+                                     const auto& names = get_port_names(radio, direction, parallel, sd, ch);
+                                     for (unsigned n = 0; n < names.size(); n++) {
+                                         if (names[n] == name) {
+                                             return tx ? r->set_tx_port(n, sd, ch) : r->set_rx_port(n, sd, ch);
+                                         }
+                                     }
+                                     return false;
+                                 }});
+        }
+        if (cfg.freq.has_value() and freq_set.insert(sd).second) {
+            double x = cfg.freq.value();
+            stages[1].push_back(
+                {"set_" + dir + "_freq" + where, [r, tx, x, sd]() { return tx ? r->set_tx_freq(x, sd) : r->set_rx_freq(x, sd); }});
+        }
+        // the gain is set once the frequency is tuned, since it may depend on the band
+        if (cfg.gain.has_value()) {
+            double x = cfg.gain.value();
+            stages[2].push_back({"set_" + dir + "_gain" + where,
+                                 [r, tx, x, sd, ch]() { return tx ? r->set_tx_gain(x, sd, ch) : r->set_rx_gain(x, sd, ch); }});
+        }
+        if (cfg.iq_bias.has_value() and tx) {
+            auto x = cfg.iq_bias.value();
+            stages[3].push_back({"set_tx_iq_bias" + where, [r, x, sd, ch]() { return r->set_tx_iq_bias(x, sd, ch); }});
+        }
+        if (cfg.iq_corr.has_value()) {
+            auto x = cfg.iq_corr.value();
+            stages[3].push_back({"set_" + dir + "_iq_corr" + where, [r, tx, x, sd, ch]() {
+                                     return tx ? r->set_tx_iq_corr(x, sd, ch) : r->set_rx_iq_corr(x, sd, ch);
+                                 }});
+        }
+    }
+
+    radio_config_report report;
+    auto t0 = std::chrono::steady_clock::now();
+    for (const auto& stage : stages) {
+        if (stage.empty()) {
+            continue;
+        }
+        report.n_stages++;
+        report.n_commands += stage.size();
+        report.n_failed += send_stage(stage, parallel, context);
+    }
+    report.elapsed_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return report;
+}
+
+radio_config_report read_radio_config(std::unique_ptr<vxsdr>& radio,
+                                      const cal_direction direction,
+                                      std::vector<radio_channel_config>& cfgs,
+                                      const bool parallel,
+                                      const std::string& context) {
+    const bool tx         = (direction == cal_direction::tx);
+    const std::string dir = tx ? "tx" : "rx";
+    auto* r               = radio.get();
+
+    // each read stores into its own field of cfgs, so the reads are independent
+    std::vector<radio_command> stage;
+    for (auto& cfg : cfgs) {
+        const uint8_t sd = cfg.subdev;
+        const uint8_t ch = cfg.channel;
+        cfg              = radio_channel_config{};
+        cfg.subdev       = sd;
+        cfg.channel      = ch;
+
+        const std::string where = (sd == 0 and ch == 0) ? "" : " (" + std::to_string(sd) + ":" + std::to_string(ch) + ")";
+        auto* c                 = &cfg;
+        stage.push_back({"get_" + dir + "_rate" + where, [r, tx, c, sd]() {
+                             c->rate = tx ? r->get_tx_rate(sd) : r->get_rx_rate(sd);
+                             return c->rate.has_value();
+                         }});
+        stage.push_back({"get_" + dir + "_freq" + where, [r, tx, c, sd]() {
+                             c->freq = tx ? r->get_tx_freq(sd) : r->get_rx_freq(sd);
+                             return c->freq.has_value();
+                         }});
+        stage.push_back({"get_" + dir + "_gain" + where, [r, tx, c, sd, ch]() {
+                             c->gain = tx ? r->get_tx_gain(sd, ch) : r->get_rx_gain(sd, ch);
+                             return c->gain.has_value();
+                         }});
+        stage.push_back({"get_" + dir + "_port" + where, [&radio, r, tx, direction, c, parallel, sd, ch]() {
+                             auto n            = tx ? r->get_tx_port(sd, ch) : r->get_rx_port(sd, ch);
+                             const auto& names = get_port_names(radio, direction, parallel, sd, ch);
+                             if (not n.has_value() or n.value() >= names.size()) {
+                                 return false;
+                             }
+                             c->port_name = names[n.value()];
+                             return true;
+                         }});
+        if (tx) {
+            stage.push_back({"get_tx_iq_bias" + where, [r, c, sd, ch]() {
+                                 c->iq_bias = r->get_tx_iq_bias(sd, ch);
+                                 return c->iq_bias.has_value();
+                             }});
+        }
+        stage.push_back({"get_" + dir + "_iq_corr" + where, [r, tx, c, sd, ch]() {
+                             c->iq_corr = tx ? r->get_tx_iq_corr(sd, ch) : r->get_rx_iq_corr(sd, ch);
+                             return c->iq_corr.has_value();
+                         }});
+    }
+
+    radio_config_report report;
+    auto t0            = std::chrono::steady_clock::now();
+    report.n_stages    = stage.empty() ? 0 : 1;
+    report.n_commands  = stage.size();
+    report.n_failed    = send_stage(stage, parallel, context);
+    report.elapsed_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return report;
+}
+
+namespace {
+// settings read back from the radio may be rounded, so values this close are taken as equal
+bool nearly_equal(const double a, const double b) {
+    return std::abs(a - b) <= 1e-9 * std::max(std::abs(a), std::abs(b)) + 1e-9;
+}
+
+template <size_t N>
+bool nearly_equal(const std::array<double, N>& a, const std::array<double, N>& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), [](double x, double y) { return nearly_equal(x, y); });
+}
+
+template <typename T>
+std::optional<T> if_changed(const std::optional<T>& target, const std::optional<T>& current) {
+    if (target.has_value() and current.has_value() and nearly_equal(target.value(), current.value())) {
+        return std::nullopt;
+    }
+    return target;
+}
+}  // namespace
+
+radio_channel_config radio_config_difference(const radio_channel_config& target, const radio_channel_config& current) {
+    radio_channel_config diff;
+    diff.subdev  = target.subdev;
+    diff.channel = target.channel;
+    diff.rate    = if_changed(target.rate, current.rate);
+    diff.freq    = if_changed(target.freq, current.freq);
+    diff.gain    = if_changed(target.gain, current.gain);
+    if (target.port_name != current.port_name or not current.port_name.has_value()) {
+        diff.port_name = target.port_name;
+    }
+    if (diff.freq.has_value()) {
+        diff.iq_bias = target.iq_bias;
+        diff.iq_corr = target.iq_corr;
+    } else {
+        diff.iq_bias = if_changed(target.iq_bias, current.iq_bias);
+        diff.iq_corr = if_changed(target.iq_corr, current.iq_corr);
+    }
+    return diff;
+}
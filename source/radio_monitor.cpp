@@ -0,0 +1,165 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides periodic monitoring of radio status, buffer use, sensors, and host CPU use
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "option_utils.hpp"
+#include "radio_monitor.hpp"
+#include "thread_stats.hpp"
+#include "utility.hpp"
+#include "vxsdr.hpp"
+
+void add_monitor_options(option_utils::program_options& desc) {
+    // clang-format off
+    desc.add_option("monitor_interval", "interval in seconds between radio status reports (zero for no reports)", option_utils::supported_types::REAL, false, "0.0");
+    desc.add_option("monitor_file", "file for radio status reports (the default is standard output)", option_utils::supported_types::STRING);
+    desc.add_option("monitor_format", "format of radio status reports (csv or line for InfluxDB line protocol)", option_utils::supported_types::STRING, false, "csv");
+    // clang-format on
+}
+
+// sensor names are fixed, so they are only asked for once
+static std::vector<std::string> get_sensor_names(std::unique_ptr<vxsdr>& radio) {
+    std::vector<std::string> names;
+    unsigned n_sensors = radio->get_num_sensors().value_or(0);
+    for (unsigned i = 0; i < n_sensors; i++) {
+        auto name = radio->get_sensor_name(i).value_or("sensor_" + std::to_string(i));
+        // make the name usable as a CSV column or line protocol field key
+        std::replace_if(name.begin(), name.end(), [](char c) { return c == ' ' or c == ',' or c == '='; }, '_');
+        names.push_back(name);
+    }
+    return names;
+}
+
+int monitor_radio(option_utils::parsed_options& vm, std::unique_ptr<vxsdr>& radio, const vxsdr::time_point t_stop) {
+    auto t_radio = radio->get_time_now();
+    // radio times are converted to host times for waiting, so the radio is not polled for the time
+    auto radio_host_offset = t_radio.has_value() ? t_radio.value() - std::chrono::system_clock::now() : vxsdr::duration(0);
+    auto host_stop         = t_stop - radio_host_offset;
+
+    auto interval_sec = vm["monitor_interval"].as<double>();
+    if (interval_sec <= 0) {
+        std::this_thread::sleep_until(host_stop);
+        return 0;
+    }
+
+    auto format = vm["monitor_format"].as<std::string>();
+    if (format != "csv" and format != "line") {
+        std::cerr << "Error: unknown option value for --monitor_format: " << format << std::endl;
+        exit(1);
+    }
+
+    std::ofstream outfile;
+    if (vm.count("monitor_file") > 0) {
+        outfile.open(vm["monitor_file"].as<std::string>());
+        if (not outfile.is_open()) {
+            std::cerr << "unable to open monitor file " << vm["monitor_file"].as<std::string>() << std::endl;
+            exit(1);
+        }
+    }
+    std::ostream& out = outfile.is_open() ? outfile : std::cout;
+
+    auto sensor_names = get_sensor_names(radio);
+    // the status and buffer use replies have different lengths, which are taken from the library's types
+    constexpr size_t n_status_words = std::tuple_size_v<decltype(radio->get_status())::value_type>;
+    constexpr size_t n_buffer_words = std::tuple_size_v<decltype(radio->get_buffer_use())::value_type>;
+
+    if (format == "csv") {
+        out << "host_time,radio_time";
+        for (size_t i = 0; i < n_status_words; i++) {
+            out << ",status_" << i;
+        }
+        for (size_t i = 0; i < n_buffer_words; i++) {
+            out << ",buffer_use_" << i;
+        }
+        for (const auto& name : sensor_names) {
+            out << "," << name;
+        }
+        out << ",host_cpu_percent,max_thread_cpu_percent" << std::endl;
+    }
+
+    auto interval   = std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::duration<double>(interval_sec));
+    auto t_next     = std::chrono::system_clock::now();
+    auto cpu_before = get_thread_cpu_samples();
+    auto t_cpu      = std::chrono::steady_clock::now();
+    int n_reports   = 0;
+
+    while (t_next < host_stop) {
+        std::this_thread::sleep_until(t_next);
+        t_next += interval;
+
+        auto t_host  = std::chrono::system_clock::now();
+        auto t_now   = radio->get_time_now();
+        auto status  = radio->get_status();
+        auto buf_use = radio->get_buffer_use();
+        std::vector<double> readings;
+        for (unsigned i = 0; i < sensor_names.size(); i++) {
+            readings.push_back(radio->get_sensor_reading(i).value_or(NAN));
+        }
+
+        auto cpu_after   = get_thread_cpu_samples();
+        auto t_cpu_now   = std::chrono::steady_clock::now();
+        double cpu_sec   = std::chrono::duration<double>(t_cpu_now - t_cpu).count();
+        auto usage       = compute_thread_cpu_usage(cpu_before, cpu_after, cpu_sec);
+        cpu_before       = cpu_after;
+        t_cpu            = t_cpu_now;
+        double total_cpu = 0;
+        double max_cpu   = 0;
+        for (const auto& [name, pct] : usage) {
+            total_cpu += pct;
+            max_cpu = std::max(max_cpu, pct);
+        }
+
+        if (format == "csv") {
+            out << format_time(t_host) << "," << (t_now.has_value() ? format_time(t_now.value()) : "");
+            for (size_t i = 0; i < n_status_words; i++) {
+                out << "," << (status.has_value() ? std::to_string(status->at(i)) : "");
+            }
+            for (size_t i = 0; i < n_buffer_words; i++) {
+                out << "," << (buf_use.has_value() ? std::to_string(buf_use->at(i)) : "");
+            }
+            for (auto r : readings) {
+                out << "," << r;
+            }
+            // the CPU columns are formatted separately, so their precision does not carry over to the next row
+            std::stringstream cpu;
+            cpu << std::fixed << std::setprecision(1) << total_cpu << "," << max_cpu;
+            out << "," << cpu.str() << std::endl;
+        } else {
+            // fields which could not be read are left out, as line protocol has no null values
+            std::stringstream fields;
+            if (t_now.has_value()) {
+                fields << ",radio_time=" << t_now->time_since_epoch().count() << "i";
+            }
+            for (unsigned i = 0; status.has_value() and i < n_status_words; i++) {
+                fields << ",status_" << i << "=" << status->at(i) << "i";
+            }
+            for (unsigned i = 0; buf_use.has_value() and i < n_buffer_words; i++) {
+                fields << ",buffer_use_" << i << "=" << buf_use->at(i) << "i";
+            }
+            for (unsigned i = 0; i < readings.size(); i++) {
+                if (not std::isnan(readings[i])) {
+                    fields << "," << sensor_names[i] << "=" << readings[i];
+                }
+            }
+            fields << ",host_cpu_percent=" << total_cpu << ",max_thread_cpu_percent=" << max_cpu;
+            out << "vxsdr " << fields.str().substr(1) << " "
+                << std::chrono::duration_cast<std::chrono::nanoseconds>(t_host.time_since_epoch()).count() << std::endl;
+        }
+        n_reports++;
+    }
+
+    std::this_thread::sleep_until(host_stop);
+    return n_reports;
+}
@@ -0,0 +1,275 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides snapshots of the radio settings, saved to and restored from files
+
+#include <array>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "radio_config.hpp"
+#include "radio_snapshot.hpp"
+#include "trace.hpp"
+
+namespace {
+template <size_t N>
+std::string format_array(const std::array<double, N>& x) {
+    std::ostringstream oss;
+    oss << std::setprecision(std::numeric_limits<double>::max_digits10);
+    for (size_t i = 0; i < N; i++) {
+        oss << (i == 0 ? "" : ",") << x[i];
+    }
+    return oss.str();
+}
+
+template <size_t N>
+bool interpret_array(const std::string& value, std::array<double, N>& x) {
+    std::istringstream iss(value);
+    std::string item;
+    for (size_t i = 0; i < N; i++) {
+        if (not std::getline(iss, item, ',')) {
+            return false;
+        }
+        x[i] = std::stod(item);
+    }
+    return not std::getline(iss, item, ',');
+}
+
+void write_channel(std::ostream& out, const std::string& dir, const radio_channel_config& cfg) {
+    out << dir << " " << (unsigned)cfg.subdev << ":" << (unsigned)cfg.channel;
+    out << std::setprecision(std::numeric_limits<double>::max_digits10);
+    if (cfg.rate.has_value()) {
+        out << " rate " << cfg.rate.value();
+    }
+    if (cfg.freq.has_value()) {
+        out << " freq " << cfg.freq.value();
+    }
+    if (cfg.gain.has_value()) {
+        out << " gain " << cfg.gain.value();
+    }
+    if (cfg.port_name.has_value()) {
+        out << " port " << cfg.port_name.value();
+    }
+    if (cfg.iq_bias.has_value()) {
+        out << " iq_bias " << format_array(cfg.iq_bias.value());
+    }
+    if (cfg.iq_corr.has_value()) {
+        out << " iq_corr " << format_array(cfg.iq_corr.value());
+    }
+    out << "\n";
+}
+
+void add_report(radio_config_report& total, const radio_config_report& part) {
+    total.n_commands += part.n_commands;
+    total.n_failed += part.n_failed;
+    total.n_stages += part.n_stages;
+    total.elapsed_sec += part.elapsed_sec;
+}
+}  // namespace
+
+std::vector<radio_channel_config> same_channels(const std::vector<radio_channel_config>& cfgs) {
+    std::vector<radio_channel_config> ret;
+    for (const auto& cfg : cfgs) {
+        radio_channel_config c;
+        c.subdev  = cfg.subdev;
+        c.channel = cfg.channel;
+        ret.push_back(c);
+    }
+    return ret;
+}
+
+unsigned count_settings(const radio_channel_config& cfg) {
+    return (unsigned)cfg.rate.has_value() + (unsigned)cfg.freq.has_value() + (unsigned)cfg.gain.has_value()
+           + (unsigned)cfg.port_name.has_value() + (unsigned)cfg.iq_bias.has_value() + (unsigned)cfg.iq_corr.has_value();
+}
+
+radio_config_report take_snapshot(std::unique_ptr<vxsdr>& radio, radio_snapshot& snapshot, const bool parallel) {
+    trace_scope trace("take_snapshot");
+    auto* r = radio.get();
+    // the device is identified while the settings are read
+    auto hello = std::async(parallel ? std::launch::async : std::launch::deferred, [r]() { return r->hello(); });
+
+    radio_config_report report;
+    if (parallel) {
+        // the tx and rx reads are independent, so they go in the same round trip
+        auto rx_read = std::async(std::launch::async, [&]() {
+            return read_radio_config(radio, cal_direction::rx, snapshot.rx, true, "take_snapshot");
+        });
+        report = read_radio_config(radio, cal_direction::tx, snapshot.tx, true, "take_snapshot");
+        add_report(report, rx_read.get());
+        report.n_stages = 1;
+    } else {
+        report = read_radio_config(radio, cal_direction::tx, snapshot.tx, false, "take_snapshot");
+        add_report(report, read_radio_config(radio, cal_direction::rx, snapshot.rx, false, "take_snapshot"));
+    }
+
+    auto hello_info = hello.get();
+    if (hello_info.has_value()) {
+        snapshot.device_id = hello_info->at(3);
+    } else {
+        std::cerr << "error in take_snapshot: hello" << std::endl;
+        report.n_failed++;
+    }
+    return report;
+}
+
+bool save_snapshot(const std::string& file_name, const radio_snapshot& snapshot) {
+    std::ofstream outfile(file_name);
+    if (not outfile.is_open()) {
+        std::cerr << "unable to open snapshot file " << file_name << std::endl;
+        return false;
+    }
+    outfile << "# vxsdr radio snapshot\n";
+    outfile << "device_id " << snapshot.device_id << "\n";
+    for (const auto& cfg : snapshot.tx) {
+        write_channel(outfile, "tx", cfg);
+    }
+    for (const auto& cfg : snapshot.rx) {
+        write_channel(outfile, "rx", cfg);
+    }
+    if (not outfile.good()) {
+        std::cerr << "error writing snapshot file " << file_name << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool load_snapshot(const std::string& file_name, radio_snapshot& snapshot) {
+    std::ifstream infile(file_name);
+    if (not infile.is_open()) {
+        std::cerr << "unable to open snapshot file " << file_name << std::endl;
+        return false;
+    }
+    snapshot = radio_snapshot{};
+    std::string line;
+    unsigned line_number = 0;
+    while (std::getline(infile, line)) {
+        line_number++;
+        std::istringstream iss(line);
+        std::string dir;
+        if (not(iss >> dir) or dir.starts_with("#")) {
+            continue;
+        }
+        try {
+            if (dir == "device_id") {
+                std::string id;
+                iss >> id;
+                snapshot.device_id = (uint32_t)std::stoul(id);
+                continue;
+            }
+            std::string where;
+            if ((dir != "tx" and dir != "rx") or not(iss >> where)) {
+                throw std::invalid_argument(dir);
+            }
+            radio_channel_config cfg;
+            auto colon  = where.find(':');
+            cfg.subdev  = (uint8_t)std::stoul(where.substr(0, colon));
+            cfg.channel = (colon == std::string::npos) ? 0 : (uint8_t)std::stoul(where.substr(colon + 1));
+
+            std::string key;
+            std::string value;
+            while (iss >> key) {
+                if (not(iss >> value)) {
+                    throw std::invalid_argument(key + " (no value given)");
+                }
+                if (key == "rate") {
+                    cfg.rate = std::stod(value);
+                } else if (key == "freq") {
+                    cfg.freq = std::stod(value);
+                } else if (key == "gain") {
+                    cfg.gain = std::stod(value);
+                } else if (key == "port") {
+                    cfg.port_name = value;
+                } else if (key == "iq_bias") {
+                    cfg.iq_bias.emplace();
+                    if (not interpret_array(value, cfg.iq_bias.value())) {
+                        throw std::invalid_argument(key);
+                    }
+                } else if (key == "iq_corr") {
+                    cfg.iq_corr.emplace();
+                    if (not interpret_array(value, cfg.iq_corr.value())) {
+                        throw std::invalid_argument(key);
+                    }
+                } else {
+                    throw std::invalid_argument(key);
+                }
+            }
+            (dir == "tx" ? snapshot.tx : snapshot.rx).push_back(cfg);
+        } catch (std::exception& e) {
+            std::cerr << "error in snapshot file " << file_name << " line " << line_number << ": cannot interpret " << e.what()
+                      << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool snapshot_device_matches(const radio_snapshot& snapshot, const radio_snapshot& current) {
+    return snapshot.device_id == 0 or snapshot.device_id == current.device_id;
+}
+
+radio_snapshot snapshot_difference(const radio_snapshot& target, const radio_snapshot& current) {
+    radio_snapshot diff;
+    diff.device_id = target.device_id;
+    // current is read for the same channels as target, in the same order
+    for (size_t k = 0; k < target.tx.size(); k++) {
+        diff.tx.push_back(radio_config_difference(target.tx[k], k < current.tx.size() ? current.tx[k] : radio_channel_config{}));
+    }
+    for (size_t k = 0; k < target.rx.size(); k++) {
+        diff.rx.push_back(radio_config_difference(target.rx[k], k < current.rx.size() ? current.rx[k] : radio_channel_config{}));
+    }
+    // IQ corrections measured on another device would be wrong for this one
+    if (not snapshot_device_matches(target, current)) {
+        for (auto* cfgs : {&diff.tx, &diff.rx}) {
+            for (auto& cfg : *cfgs) {
+                cfg.iq_bias.reset();
+                cfg.iq_corr.reset();
+            }
+        }
+    }
+    return diff;
+}
+
+snapshot_restore_report restore_snapshot(std::unique_ptr<vxsdr>& radio,
+                                         const radio_snapshot& snapshot,
+                                         const bool parallel,
+                                         const std::string& context) {
+    trace_scope trace("restore_snapshot");
+    snapshot_restore_report report;
+    for (const auto& cfg : snapshot.tx) {
+        report.n_settings += count_settings(cfg);
+    }
+    for (const auto& cfg : snapshot.rx) {
+        report.n_settings += count_settings(cfg);
+    }
+
+    radio_snapshot current;
+    current.tx  = same_channels(snapshot.tx);
+    current.rx  = same_channels(snapshot.rx);
+    report.read = take_snapshot(radio, current, parallel);
+
+    if (not snapshot_device_matches(snapshot, current)) {
+        std::cerr << "warning in " << context << ": snapshot was taken on device " << snapshot.device_id << ", not this device ("
+                  << current.device_id << "), so its IQ bias and corrections are not restored" << std::endl;
+    }
+
+    auto diff = snapshot_difference(snapshot, current);
+    if (parallel) {
+        auto rx_apply = std::async(std::launch::async,
+                                   [&]() { return apply_radio_config(radio, cal_direction::rx, diff.rx, true, context); });
+        report.tx     = apply_radio_config(radio, cal_direction::tx, diff.tx, true, context);
+        report.rx     = rx_apply.get();
+    } else {
+        report.tx = apply_radio_config(radio, cal_direction::tx, diff.tx, false, context);
+        report.rx = apply_radio_config(radio, cal_direction::rx, diff.rx, false, context);
+    }
+    return report;
+}
@@ -0,0 +1,337 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides checks that the host is set up for realtime transmit
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "net_tune.hpp"
+#include "rt_preflight.hpp"
+#include "thread_stats.hpp"
+
+namespace {
+// capability bits, as in linux/capability.h
+constexpr unsigned cap_ipc_lock = 14;
+constexpr unsigned cap_sys_nice = 23;
+// idle states which take longer than this to leave are long compared to a packet time
+constexpr unsigned max_idle_latency_us = 10;
+
+const std::string cpu_sysfs = "/sys/devices/system/cpu/";
+
+bool read_line(const std::string& file_name, std::string& line) {
+    std::ifstream infile(file_name);
+    return infile.is_open() and static_cast<bool>(std::getline(infile, line));
+}
+
+bool has_capability(const unsigned cap) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("CapEff:", 0) == 0) {
+            uint64_t caps = std::stoull(line.substr(7), nullptr, 16);
+            return ((caps >> cap) & 1U) != 0;
+        }
+    }
+    return false;
+}
+
+std::string limit_string(const rlim_t limit) {
+    return (limit == RLIM_INFINITY) ? std::string("unlimited") : std::to_string(limit);
+}
+
+std::string cpu_list_string(const std::vector<int>& cpus) {
+    std::string list;
+    for (auto cpu : cpus) {
+        list += (list.empty() ? "" : " ") + std::to_string(cpu);
+    }
+    return list;
+}
+
+bool is_realtime(const int policy) {
+    return policy == SCHED_FIFO or policy == SCHED_RR;
+}
+
+rt_check lock_memory(const bool lock) {
+    rt_check check{"memory lock", rt_check_status::skip, {}};
+    rlimit limit{};
+    getrlimit(RLIMIT_MEMLOCK, &limit);
+    // with a finite limit, locking future memory would make large allocations fail instead of paging
+    const bool unlimited = limit.rlim_cur == RLIM_INFINITY or has_capability(cap_ipc_lock);
+    if (not lock) {
+        check.detail = "memory not locked (RLIMIT_MEMLOCK is " + limit_string(limit.rlim_cur) + " bytes"
+                       + (unlimited ? ", which allows locking all memory)" : ")");
+        return check;
+    }
+    if (mlockall(MCL_CURRENT | (unlimited ? MCL_FUTURE : 0)) != 0) {
+        check.status = rt_check_status::fail;
+        check.detail = std::string("mlockall failed (") + std::strerror(errno) + "); RLIMIT_MEMLOCK is "
+                       + limit_string(limit.rlim_cur) + " bytes, raise it (ulimit -l) or grant CAP_IPC_LOCK";
+    } else if (not unlimited) {
+        check.status = rt_check_status::warn;
+        check.detail = "memory allocated later is not locked, since RLIMIT_MEMLOCK is " + limit_string(limit.rlim_cur) + " bytes";
+    } else {
+        check.status = rt_check_status::pass;
+        check.detail = "current and future memory locked";
+    }
+    return check;
+}
+
+rt_check check_rt_limit(const int priority) {
+    rt_check check{"realtime limit", rt_check_status::skip, {}};
+    if (priority < 0) {
+        check.detail = "realtime priority not requested";
+        return check;
+    }
+    rlimit limit{};
+    getrlimit(RLIMIT_RTPRIO, &limit);
+    if (has_capability(cap_sys_nice)) {
+        check.status = rt_check_status::pass;
+        check.detail = "CAP_SYS_NICE allows any priority";
+    } else if (limit.rlim_cur == RLIM_INFINITY or limit.rlim_cur >= (rlim_t)priority) {
+        check.status = rt_check_status::pass;
+        check.detail = "RLIMIT_RTPRIO " + limit_string(limit.rlim_cur) + " allows priority " + std::to_string(priority);
+    } else {
+        check.status = rt_check_status::fail;
+        check.detail = "priority " + std::to_string(priority) + " needs RLIMIT_RTPRIO of at least " + std::to_string(priority)
+                       + " (it is " + limit_string(limit.rlim_cur) + ") or CAP_SYS_NICE";
+    }
+    return check;
+}
+
+rt_check set_main_priority(const int priority) {
+    rt_check check{"main thread", rt_check_status::skip, {}};
+    if (priority < 0) {
+        check.detail = "realtime priority not requested";
+        return check;
+    }
+    sched_param param{};
+    param.sched_priority = priority;
+    int err              = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0) {
+        check.status = rt_check_status::fail;
+        check.detail = "unable to set SCHED_FIFO priority " + std::to_string(priority) + " (" + std::strerror(err) + ")";
+    } else {
+        check.status = rt_check_status::pass;
+        check.detail = "SCHED_FIFO priority " + std::to_string(priority);
+    }
+    return check;
+}
+
+rt_check check_net_priority(const std::vector<thread_sched_info>& threads, const int priority) {
+    rt_check check{"network priority", rt_check_status::skip, {}};
+    if (priority < 0) {
+        check.detail = "net_thread_priority is negative, so realtime priority is not used";
+        return check;
+    }
+    auto n_rt = std::count_if(threads.begin(), threads.end(), [](const auto& t) { return is_realtime(t.policy); });
+    if (n_rt == 0) {
+        check.status = rt_check_status::fail;
+        check.detail = "none of the " + std::to_string(threads.size())
+                       + " library threads has realtime priority, so net_thread_priority " + std::to_string(priority)
+                       + " did not take effect";
+    } else {
+        check.status = rt_check_status::pass;
+        check.detail = std::to_string(n_rt) + " of " + std::to_string(threads.size()) + " library threads have realtime priority";
+    }
+    return check;
+}
+
+rt_check check_net_affinity(const std::vector<int>& pinned_cpus, const size_t n_threads, const int offset) {
+    rt_check check{"network affinity", rt_check_status::skip, {}};
+    if (offset < 0) {
+        check.detail = "thread_affinity_offset is negative, so CPU affinity is not used";
+        return check;
+    }
+    if (pinned_cpus.empty()) {
+        check.status = rt_check_status::fail;
+        check.detail = "none of the " + std::to_string(n_threads)
+                       + " library threads is pinned to a CPU, so thread_affinity_offset " + std::to_string(offset)
+                       + " did not take effect";
+        return check;
+    }
+    std::string isolated_list;
+    read_line(cpu_sysfs + "isolated", isolated_list);
+    auto isolated = parse_cpu_list(isolated_list);
+    std::vector<int> shared;
+    for (auto cpu : pinned_cpus) {
+        if (std::find(isolated.begin(), isolated.end(), cpu) == isolated.end()) {
+            shared.push_back(cpu);
+        }
+    }
+    if (not shared.empty()) {
+        check.status = rt_check_status::warn;
+        check.detail = "threads are pinned to cpus " + cpu_list_string(pinned_cpus) + ", but cpus " + cpu_list_string(shared)
+                       + " are not isolated (isolcpus), so other tasks may run on them";
+    } else {
+        check.status = rt_check_status::pass;
+        check.detail = "threads are pinned to isolated cpus " + cpu_list_string(pinned_cpus);
+    }
+    return check;
+}
+
+rt_check check_governors(const std::vector<int>& cpus) {
+    rt_check check{"cpu governor", rt_check_status::skip, {}};
+    std::vector<int> slow;
+    std::string slow_governor;
+    unsigned n_read = 0;
+    for (auto cpu : cpus) {
+        std::string governor;
+        if (read_line(cpu_sysfs + "cpu" + std::to_string(cpu) + "/cpufreq/scaling_governor", governor)) {
+            n_read++;
+            if (governor != "performance") {
+                slow.push_back(cpu);
+                slow_governor = governor;
+            }
+        }
+    }
+    if (n_read == 0) {
+        check.detail = "cpu frequency scaling is not reported";
+    } else if (not slow.empty()) {
+        check.status = rt_check_status::warn;
+        check.detail = "cpus " + cpu_list_string(slow) + " use governor " + slow_governor
+                       + " rather than performance, so they may be slow to respond to load";
+    } else {
+        check.status = rt_check_status::pass;
+        check.detail = "cpus " + cpu_list_string(cpus) + " use governor performance";
+    }
+    return check;
+}
+
+rt_check check_idle_states(const std::vector<int>& cpus) {
+    rt_check check{"cpu idle states", rt_check_status::skip, {}};
+    std::vector<int> deep;
+    unsigned max_latency = 0;
+    std::string deepest;
+    bool reported = false;
+    std::error_code ec;
+    for (auto cpu : cpus) {
+        bool is_deep = false;
+        for (const auto& entry : std::filesystem::directory_iterator(cpu_sysfs + "cpu" + std::to_string(cpu) + "/cpuidle", ec)) {
+            std::string latency;
+            std::string disable;
+            std::string name;
+            if (not read_line(entry.path() / "latency", latency)) {
+                continue;
+            }
+            reported = true;
+            read_line(entry.path() / "disable", disable);
+            read_line(entry.path() / "name", name);
+            unsigned latency_us = std::stoul(latency);
+            if (disable != "1" and latency_us > max_idle_latency_us) {
+                is_deep = true;
+                if (latency_us > max_latency) {
+                    max_latency = latency_us;
+                    deepest     = name;
+                }
+            }
+        }
+        if (is_deep) {
+            deep.push_back(cpu);
+        }
+    }
+    if (not reported) {
+        check.detail = "cpu idle states are not reported";
+    } else if (not deep.empty()) {
+        check.status = rt_check_status::warn;
+        check.detail = "cpus " + cpu_list_string(deep) + " may enter idle states taking up to " + std::to_string(max_latency)
+                       + " us to leave (" + deepest + "); limit them with a kernel parameter or /dev/cpu_dma_latency";
+    } else {
+        check.status = rt_check_status::pass;
+        check.detail = "no idle state takes more than " + std::to_string(max_idle_latency_us) + " us to leave";
+    }
+    return check;
+}
+
+const char* status_string(const rt_check_status status) {
+    switch (status) {
+        case rt_check_status::pass:
+            return "PASS";
+        case rt_check_status::warn:
+            return "WARN";
+        case rt_check_status::fail:
+            return "FAIL";
+        default:
+            return "SKIP";
+    }
+}
+}  // namespace
+
+std::vector<rt_check> run_rt_preflight(const rt_preflight_request& request) {
+    std::vector<rt_check> checks;
+    checks.push_back(lock_memory(request.lock_memory));
+    checks.push_back(check_rt_limit(std::max(request.net_thread_priority, request.main_thread_priority)));
+    checks.push_back(set_main_priority(request.main_thread_priority));
+
+    // the threads other than this one are the library's
+    std::vector<thread_sched_info> threads;
+    for (const auto& t : get_thread_sched_info()) {
+        if (t.tid != getpid()) {
+            threads.push_back(t);
+        }
+    }
+    if (threads.empty()) {
+        checks.push_back({"network threads", rt_check_status::fail, "no library threads found; the radio must be created first"});
+    } else {
+        checks.push_back(check_net_priority(threads, request.net_thread_priority));
+    }
+
+    std::vector<int> pinned_cpus;
+    for (const auto& t : threads) {
+        if (t.cpus.size() == 1) {
+            pinned_cpus.push_back(t.cpus[0]);
+        }
+    }
+    std::sort(pinned_cpus.begin(), pinned_cpus.end());
+    pinned_cpus.erase(std::unique(pinned_cpus.begin(), pinned_cpus.end()), pinned_cpus.end());
+    if (not threads.empty()) {
+        checks.push_back(check_net_affinity(pinned_cpus, threads.size(), request.thread_affinity_offset));
+    }
+
+    // frequency scaling and idle states matter on the CPUs the network threads use, or on every CPU if they are not pinned
+    std::vector<int> cpus = pinned_cpus;
+    if (cpus.empty()) {
+        std::string online;
+        read_line(cpu_sysfs + "online", online);
+        cpus = parse_cpu_list(online);
+    }
+    checks.push_back(check_governors(cpus));
+    checks.push_back(check_idle_states(cpus));
+    return checks;
+}
+
+bool rt_preflight_passed(const std::vector<rt_check>& checks) {
+    return std::none_of(checks.begin(), checks.end(), [](const auto& c) { return c.status == rt_check_status::fail; });
+}
+
+void print_rt_preflight_report(std::ostream& report, const std::vector<rt_check>& checks) {
+    // the report is formatted separately, so its alignment is not left on the caller's stream
+    std::ostringstream out;
+    unsigned n[4] = {0, 0, 0, 0};
+    out << "realtime preflight:" << std::endl;
+    for (const auto& c : checks) {
+        n[(int)c.status]++;
+        out << "    " << status_string(c.status) << "  " << std::left << std::setw(18) << c.name << std::right << c.detail
+            << std::endl;
+    }
+    out << "realtime preflight " << (rt_preflight_passed(checks) ? "passed" : "FAILED") << ": "
+        << n[(int)rt_check_status::pass] << " passed, " << n[(int)rt_check_status::warn] << " warnings, "
+        << n[(int)rt_check_status::fail] << " failed, " << n[(int)rt_check_status::skip] << " skipped" << std::endl;
+    report << out.str();
+}
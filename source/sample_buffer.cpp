@@ -0,0 +1,206 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides NUMA-aware, hugepage-backed, locked allocation of large sample buffers
+
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <linux/mempolicy.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <new>
+#include <string>
+
+#include "sample_buffer.hpp"
+
+namespace {
+constexpr size_t min_mapped_bytes = 1UL << 20U;  // smaller buffers come from the heap
+constexpr size_t huge_2m_bytes    = 1UL << 21U;
+constexpr size_t huge_1g_bytes    = 1UL << 30U;
+constexpr size_t max_pooled_bytes = 1UL << 30U;  // freed regions beyond this are unmapped
+constexpr size_t heap_alignment   = 4096;
+
+size_t round_up(const size_t n, const size_t m) {
+    return m * ((n + m - 1) / m);
+}
+
+class sample_arena {
+  public:
+    void configure(const sample_buffer_settings& s) {
+        std::lock_guard<std::mutex> lock(mutex);
+        settings = s;
+    }
+
+    void* allocate(const size_t n_bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        // a pooled region is reused if it is no more than twice the size needed
+        size_t needed = round_up(n_bytes, huge_2m_bytes);
+        auto it       = pool.lower_bound(needed);
+        if (it != pool.end() and it->first <= 2 * needed) {
+            void* p    = it->second;
+            regions[p] = it->first;
+            pooled_bytes -= it->first;
+            // the settings may have changed since the region was placed (for example, memory locking is
+            // often enabled after the first buffers are allocated), so it is placed again
+            place_region(p, it->first, true);
+            pool.erase(it);
+            return p;
+        }
+
+        size_t mapped = 0;
+        void* p       = map_region(n_bytes, mapped);
+        if (p == nullptr) {
+            throw std::bad_alloc();
+        }
+        place_region(p, mapped, false);
+        regions[p] = mapped;
+        return p;
+    }
+
+    void free(void* p) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = regions.find(p);
+        if (it == regions.end()) {
+            return;
+        }
+        size_t mapped = it->second;
+        regions.erase(it);
+        if (pooled_bytes + mapped <= max_pooled_bytes) {
+            pool.emplace(mapped, p);
+            pooled_bytes += mapped;
+        } else {
+            munmap(p, mapped);
+        }
+    }
+
+  private:
+    // maps at least n_bytes, using reserved hugepages if possible; returns nullptr on failure
+    void* map_region(const size_t n_bytes, size_t& mapped) {
+        constexpr int base_flags = MAP_PRIVATE | MAP_ANONYMOUS;
+        if (settings.use_hugepages) {
+            // these fail unless enough hugepages have been reserved (for example in /proc/sys/vm/nr_hugepages);
+            // without MAP_NORESERVE the reservation is checked here, instead of faulting when the pages are used
+            if (n_bytes >= huge_1g_bytes) {
+                mapped  = round_up(n_bytes, huge_1g_bytes);
+                void* p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, base_flags | MAP_HUGETLB | (30 << MAP_HUGE_SHIFT), -1, 0);
+                if (p != MAP_FAILED) {
+                    return p;
+                }
+            }
+            mapped  = round_up(n_bytes, huge_2m_bytes);
+            void* p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, base_flags | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+            if (p != MAP_FAILED) {
+                return p;
+            }
+        }
+        mapped  = round_up(n_bytes, huge_2m_bytes);
+        void* p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, base_flags, -1, 0);
+        if (p == MAP_FAILED) {
+            return nullptr;
+        }
+        if (settings.use_hugepages) {
+            // this is only advice, so a failure is not an error
+            madvise(p, mapped, MADV_HUGEPAGE);
+        }
+        return p;
+    }
+
+    // binds a region to the configured node (before a new region is touched, or moving the pages of
+    // a reused one), then locks or unlocks it
+    void place_region(void* p, const size_t mapped, const bool reused) {
+        if (settings.numa_node >= 0 and settings.numa_node < 64) {
+            // preferred rather than bound, so the allocation still succeeds if the node is full
+            unsigned long node_mask = 1UL << (unsigned)settings.numa_node;
+            unsigned flags          = reused ? MPOL_MF_MOVE : 0;
+            if (syscall(SYS_mbind, p, mapped, MPOL_PREFERRED, &node_mask, 64, flags) != 0 and not warned_bind) {
+                std::cerr << "warning: unable to place sample buffers on NUMA node " << settings.numa_node << std::endl;
+                warned_bind = true;
+            }
+        }
+        if (settings.lock and mlock(p, mapped) != 0 and not warned_lock) {
+            std::cerr << "warning: unable to lock sample buffers in memory (check the limit from ulimit -l)" << std::endl;
+            warned_lock = true;
+        }
+        if (reused and not settings.lock) {
+            munlock(p, mapped);
+        }
+    }
+
+    std::mutex mutex;
+    sample_buffer_settings settings;
+    std::map<void*, size_t> regions;    // regions in use, with their mapped sizes
+    std::multimap<size_t, void*> pool;  // freed regions by mapped size
+    size_t pooled_bytes = 0;
+    bool warned_bind    = false;
+    bool warned_lock    = false;
+};
+
+sample_arena& arena() {
+    // never destroyed, since buffers may be freed by other static destructors
+    static auto* a = new sample_arena;
+    return *a;
+}
+}  // namespace
+
+void configure_sample_buffers(const sample_buffer_settings& settings) {
+    arena().configure(settings);
+}
+
+std::string interface_of_address(const std::string& address) {
+    in_addr addr = {};
+    if (inet_pton(AF_INET, address.c_str(), &addr) != 1) {
+        return "";
+    }
+    ifaddrs* ifs = nullptr;
+    if (getifaddrs(&ifs) != 0) {
+        return "";
+    }
+    std::string if_name;
+    for (ifaddrs* i = ifs; i != nullptr; i = i->ifa_next) {
+        if (i->ifa_addr != nullptr and i->ifa_addr->sa_family == AF_INET
+            and reinterpret_cast<sockaddr_in*>(i->ifa_addr)->sin_addr.s_addr == addr.s_addr) {
+            if_name = i->ifa_name;
+            break;
+        }
+    }
+    freeifaddrs(ifs);
+    return if_name;
+}
+
+int numa_node_of_address(const std::string& address) {
+    std::string if_name = interface_of_address(address);
+
+    // virtual interfaces have no device, and single-node systems report -1
+    int node = -1;
+    std::ifstream node_file("/sys/class/net/" + if_name + "/device/numa_node");
+    if (if_name.empty() or not(node_file >> node)) {
+        return -1;
+    }
+    return node;
+}
+
+void* allocate_sample_buffer(const size_t n_bytes) {
+    if (n_bytes < min_mapped_bytes) {
+        return ::operator new(std::max<size_t>(n_bytes, 1), std::align_val_t(heap_alignment));
+    }
+    return arena().allocate(n_bytes);
+}
+
+void free_sample_buffer(void* p, const size_t n_bytes) noexcept {
+    if (p == nullptr) {
+        return;
+    }
+    if (n_bytes < min_mapped_bytes) {
+        ::operator delete(p, std::align_val_t(heap_alignment));
+        return;
+    }
+    arena().free(p);
+}
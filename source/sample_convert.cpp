@@ -0,0 +1,238 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides conversion of waveform files in other sample formats to the radio's complex<int16_t> format
+//
+// Each conversion has a scalar version, and vectorized versions for AVX2 (selected at run time,
+// so no special compiler flags are needed) and NEON; the vectorized versions do the bulk of the
+// work and the scalar version handles what remains
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VXSDR_CONVERT_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VXSDR_CONVERT_NEON
+// the rounding float conversion (vcvtnq) is only in ARMv8, so 32-bit NEON converts floats with the scalar version
+#if defined(__aarch64__)
+#define VXSDR_CONVERT_NEON_FLOAT
+#endif
+#endif
+
+#include "sample_convert.hpp"
+
+bool parse_waveform_format(const std::string& name, waveform_format& format) {
+    if (name == "cs16") {
+        format = waveform_format::cs16;
+    } else if (name == "cs16_be") {
+        format = waveform_format::cs16_be;
+    } else if (name == "cf32") {
+        format = waveform_format::cf32;
+    } else if (name == "cs8") {
+        format = waveform_format::cs8;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+size_t waveform_format_bytes(const waveform_format format) {
+    switch (format) {
+        case waveform_format::cs16:
+        case waveform_format::cs16_be:
+            return 2 * sizeof(int16_t);
+        case waveform_format::cf32:
+            return 2 * sizeof(float);
+        case waveform_format::cs8:
+            return 2 * sizeof(int8_t);
+    }
+    return 0;
+}
+
+// the scalar versions count in int16 values (twice the number of complex samples)
+
+static void swap_16_scalar(const uint8_t* in, int16_t* out, const size_t i_start, const size_t n) {
+    for (size_t i = i_start; i < n; i++) {
+        out[i] = (int16_t)(((uint16_t)in[2 * i] << 8) | (uint16_t)in[2 * i + 1]);
+    }
+}
+
+static void float_to_16_scalar(const float* in, int16_t* out, const size_t i_start, const size_t n, const float scale) {
+    constexpr float max_value = std::numeric_limits<int16_t>::max();
+    constexpr float min_value = std::numeric_limits<int16_t>::min();
+    for (size_t i = i_start; i < n; i++) {
+        float x = in[i] * scale;
+        if (std::isnan(x)) {
+            x = 0;
+        }
+        out[i] = (int16_t)std::lrint(std::clamp(x, min_value, max_value));
+    }
+}
+
+static void int8_to_16_scalar(const int8_t* in, int16_t* out, const size_t i_start, const size_t n) {
+    for (size_t i = i_start; i < n; i++) {
+        out[i] = (int16_t)(in[i] * 256);
+    }
+}
+
+#if defined(VXSDR_CONVERT_X86)
+
+static bool have_avx2() {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+__attribute__((target("avx2"))) static size_t swap_16_avx2(const uint8_t* in, int16_t* out, const size_t n) {
+    const __m256i swap_mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, 1, 0, 3, 2, 5, 4, 7, 6, 9,
+                                               8, 11, 10, 13, 12, 15, 14);
+    size_t i                = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(in + 2 * i));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_shuffle_epi8(x, swap_mask));
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) static size_t float_to_16_avx2(const float* in, int16_t* out, const size_t n, const float scale) {
+    const __m256 s = _mm256_set1_ps(scale);
+    size_t i       = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 a = _mm256_mul_ps(_mm256_loadu_ps(in + i), s);
+        __m256 b = _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), s);
+        // zero any NaNs, which would otherwise convert to the most negative value
+        a = _mm256_and_ps(a, _mm256_cmp_ps(a, a, _CMP_ORD_Q));
+        b = _mm256_and_ps(b, _mm256_cmp_ps(b, b, _CMP_ORD_Q));
+        // out-of-range values convert to INT32_MIN, so clamp before converting
+        a = _mm256_max_ps(_mm256_min_ps(a, _mm256_set1_ps(32767.0F)), _mm256_set1_ps(-32768.0F));
+        b = _mm256_max_ps(_mm256_min_ps(b, _mm256_set1_ps(32767.0F)), _mm256_set1_ps(-32768.0F));
+        // packs works within 128-bit lanes, so the 64-bit quarters must be put back in order
+        __m256i p = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_permute4x64_epi64(p, 0xD8));
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) static size_t int8_to_16_avx2(const int8_t* in, int16_t* out, const size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i x = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(in + i)));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_slli_epi16(x, 8));
+    }
+    return i;
+}
+
+#elif defined(VXSDR_CONVERT_NEON)
+
+static size_t swap_16_neon(const uint8_t* in, int16_t* out, const size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        vst1q_s16(out + i, vreinterpretq_s16_u8(vrev16q_u8(vld1q_u8(in + 2 * i))));
+    }
+    return i;
+}
+
+#if defined(VXSDR_CONVERT_NEON_FLOAT)
+static size_t float_to_16_neon(const float* in, int16_t* out, const size_t n, const float scale) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        float32x4_t a = vmulq_n_f32(vld1q_f32(in + i), scale);
+        float32x4_t b = vmulq_n_f32(vld1q_f32(in + i + 4), scale);
+        // vcvtnq rounds to nearest, saturates, and converts NaN to zero; vqmovn saturates to int16
+        int16x4_t lo = vqmovn_s32(vcvtnq_s32_f32(a));
+        int16x4_t hi = vqmovn_s32(vcvtnq_s32_f32(b));
+        vst1q_s16(out + i, vcombine_s16(lo, hi));
+    }
+    return i;
+}
+#endif
+
+static size_t int8_to_16_neon(const int8_t* in, int16_t* out, const size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        vst1q_s16(out + i, vshlq_n_s16(vmovl_s8(vld1_s8(in + i)), 8));
+    }
+    return i;
+}
+
+#endif
+
+// converts n int16 values; the input is the corresponding part of the raw data
+static void convert_block(const waveform_format format, const std::byte* in, int16_t* out, const size_t n, const float scale) {
+    size_t i = 0;
+    switch (format) {
+        case waveform_format::cs16:
+            std::memcpy(out, in, n * sizeof(int16_t));
+            break;
+        case waveform_format::cs16_be:
+#if defined(VXSDR_CONVERT_X86)
+            if (have_avx2()) {
+                i = swap_16_avx2((const uint8_t*)in, out, n);
+            }
+#elif defined(VXSDR_CONVERT_NEON)
+            i = swap_16_neon((const uint8_t*)in, out, n);
+#endif
+            swap_16_scalar((const uint8_t*)in, out, i, n);
+            break;
+        case waveform_format::cf32:
+#if defined(VXSDR_CONVERT_X86)
+            if (have_avx2()) {
+                i = float_to_16_avx2((const float*)in, out, n, scale);
+            }
+#elif defined(VXSDR_CONVERT_NEON_FLOAT)
+            i = float_to_16_neon((const float*)in, out, n, scale);
+#endif
+            float_to_16_scalar((const float*)in, out, i, n, scale);
+            break;
+        case waveform_format::cs8:
+#if defined(VXSDR_CONVERT_X86)
+            if (have_avx2()) {
+                i = int8_to_16_avx2((const int8_t*)in, out, n);
+            }
+#elif defined(VXSDR_CONVERT_NEON)
+            i = int8_to_16_neon((const int8_t*)in, out, n);
+#endif
+            int8_to_16_scalar((const int8_t*)in, out, i, n);
+            break;
+    }
+}
+
+size_t convert_to_cs16(const waveform_format format,
+                       std::span<const std::byte> input,
+                       std::span<std::complex<int16_t>> output,
+                       const float scale) {
+    // below this size, starting threads costs more than it saves
+    constexpr size_t min_samples_per_thread = 1U << 20U;
+
+    const size_t sample_bytes = waveform_format_bytes(format);
+    const size_t n_samples    = std::min(input.size() / sample_bytes, output.size());
+    const size_t value_bytes  = sample_bytes / 2;
+
+    auto* out = reinterpret_cast<int16_t*>(output.data());
+
+    size_t n_threads = std::clamp<size_t>(n_samples / min_samples_per_thread, 1, std::max(1U, std::thread::hardware_concurrency()));
+    if (n_threads == 1) {
+        convert_block(format, input.data(), out, 2 * n_samples, scale);
+        return n_samples;
+    }
+
+    std::vector<std::thread> workers;
+    size_t per_thread = (n_samples + n_threads - 1) / n_threads;
+    for (size_t start = 0; start < n_samples; start += per_thread) {
+        size_t n = std::min(per_thread, n_samples - start);
+        workers.emplace_back(convert_block, format, input.data() + 2 * start * value_bytes, out + 2 * start, 2 * n, scale);
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    return n_samples;
+}
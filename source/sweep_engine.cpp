@@ -0,0 +1,184 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides frequency sweeps with precomputed retunes and processing overlapped with capture
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+#include "radio_config.hpp"
+#include "sample_ring.hpp"
+#include "sweep_engine.hpp"
+#include "trace.hpp"
+
+std::vector<double> sweep_frequencies(const double f_start, const double f_stop, const double f_step) {
+    std::vector<double> freqs;
+    if (f_step <= 0 or f_stop < f_start) {
+        freqs.push_back(f_start);
+        return freqs;
+    }
+    // the steps are counted rather than summed, so rounding does not accumulate or lose the last step
+    auto n_steps = (size_t)std::floor((f_stop - f_start) / f_step + 1e-9);
+    for (size_t k = 0; k <= n_steps; k++) {
+        freqs.push_back(f_start + (double)k * f_step);
+    }
+    return freqs;
+}
+
+namespace {
+// sends the TX and RX settings of a step, concurrently if parallel; returns the number of failed commands
+unsigned retune(std::unique_ptr<vxsdr>& radio, const sweep_step& step, const bool parallel) {
+    trace_scope trace("sweep retune");
+    std::future<radio_config_report> rx_report;
+    if (step.rx.has_value()) {
+        rx_report = std::async(parallel ? std::launch::async : std::launch::deferred, [&]() {
+            return apply_radio_config(radio, cal_direction::rx, step.rx.value(), parallel, "run_sweep");
+        });
+    }
+    unsigned n_failed = 0;
+    if (step.tx.has_value()) {
+        n_failed += apply_radio_config(radio, cal_direction::tx, step.tx.value(), parallel, "run_sweep").n_failed;
+    }
+    if (rx_report.valid()) {
+        n_failed += rx_report.get().n_failed;
+    }
+    return n_failed;
+}
+
+bool read_samples(std::unique_ptr<vxsdr>& radio, const std::span<std::complex<float>> dest, const uint8_t subdev) {
+    size_t n_fill = 0;
+    while (n_fill < dest.size()) {
+        size_t n = radio->get_rx_data(dest.subspan(n_fill), dest.size() - n_fill, subdev);
+        if (n == 0) {
+            std::cerr << "error receiving data" << std::endl;
+            return false;
+        }
+        n_fill += n;
+    }
+    return true;
+}
+}  // namespace
+
+bool run_sweep(std::unique_ptr<vxsdr>& radio,
+               const std::vector<sweep_step>& plan,
+               const sweep_settings& settings,
+               const sweep_processor& process,
+               sweep_stats& stats) {
+    using clock = std::chrono::steady_clock;
+    stats       = sweep_stats{};
+    if (plan.empty() or settings.n_samples == 0) {
+        return true;
+    }
+
+    sample_ring<std::complex<float>> ring(std::max<size_t>(settings.n_buffers, 1), settings.n_samples);
+    std::atomic<bool> process_failed{false};
+    std::thread worker([&]() {
+        trace_thread_name("sweep worker");
+        for (size_t k = 0;; k++) {
+            auto block = ring.read_block();
+            if (block.empty()) {
+                break;
+            }
+            auto t0 = clock::now();
+            try {
+                trace_scope trace("sweep process");
+                process(k, block);
+            } catch (std::exception& e) {
+                std::cerr << "exception processing sweep step " << k << ": " << e.what() << std::endl;
+                process_failed.store(true);
+            }
+            stats.process_sec += std::chrono::duration<double>(clock::now() - t0).count();
+            ring.release_read();
+            if (process_failed.load()) {
+                // the sweep stops at its next step, or when it next waits for a block
+                ring.close();
+                break;
+            }
+        }
+    });
+    // an exception from the radio calls below must still stop and join the worker
+    ring_thread_guard worker_guard(ring, worker);
+
+    // radio time is estimated from the host clock between readings; like capture_scheduler, the
+    // host time is taken before the request, so the estimate is late rather than early
+    clock::time_point t_host_sync;
+    vxsdr::time_point t_radio_sync;
+    auto sync_time = [&]() {
+        t_host_sync = clock::now();
+        auto t      = radio->get_time_now();
+        if (not t.has_value()) {
+            std::cerr << "unable to get radio time" << std::endl;
+            return false;
+        }
+        t_radio_sync = t.value();
+        return true;
+    };
+    auto to_radio_time = [&](const clock::time_point t) {
+        return t_radio_sync + std::chrono::duration_cast<vxsdr::duration>(t - t_host_sync);
+    };
+    const auto settle_delay    = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(settings.settle_time));
+    const auto start_margin    = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(settings.start_margin));
+    const auto resync_interval = std::chrono::duration<double>(settings.resync_interval);
+
+    bool ok      = sync_time();
+    auto t_sweep = clock::now();
+    for (size_t k = 0; ok and k < plan.size() and not process_failed.load(); k++) {
+        // a free block is found before retuning, so the capture can start as soon as the retune has settled
+        auto t_wait = clock::now();
+        auto block  = ring.write_block();
+        if (block.empty()) {
+            break;
+        }
+        auto t0 = clock::now();
+        stats.wait_sec += std::chrono::duration<double>(t0 - t_wait).count();
+
+        stats.n_failed += retune(radio, plan[k], settings.parallel);
+        auto t_ack      = clock::now();
+        double t_retune = std::chrono::duration<double>(t_ack - t0).count();
+        stats.retune_sec += t_retune;
+        stats.max_retune_sec = std::max(stats.max_retune_sec, t_retune);
+        if (t_ack - t_host_sync > resync_interval) {
+            ok = sync_time();
+            if (not ok) {
+                break;
+            }
+        }
+
+        // the capture starts once the retune has settled, and no sooner than a start command sent now can
+        // reach the radio (a resync since the retune was acknowledged may have used up the settling time)
+        auto t_start   = clock::now();
+        auto t_capture = std::max(t_ack + settle_delay, t_start + start_margin);
+        {
+            trace_scope trace("sweep capture");
+            if (not radio->rx_start(to_radio_time(t_capture), settings.n_samples, settings.rx_subdev)) {
+                std::cerr << "rx_start() failed at sweep step " << k << std::endl;
+                ok = false;
+                break;
+            }
+            ok = read_samples(radio, block, settings.rx_subdev);
+        }
+        if (not ok) {
+            radio->rx_stop(settings.rx_subdev);
+            break;
+        }
+        stats.capture_sec += std::chrono::duration<double>(clock::now() - t_start).count();
+        ring.commit_write(block.size());
+        stats.n_steps++;
+    }
+    ring.close();
+    worker.join();
+    stats.elapsed_sec      = std::chrono::duration<double>(clock::now() - t_sweep).count();
+    stats.max_buffers_used = ring.max_blocks_used();
+    return ok and not process_failed.load();
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides per-thread information for the current process, read from /proc
+
+#include <sched.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "thread_stats.hpp"
+
+std::vector<thread_cpu_sample> get_thread_cpu_samples() {
+    std::vector<thread_cpu_sample> samples;
+    const double ticks_per_sec = (double)sysconf(_SC_CLK_TCK);
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator("/proc/self/task", ec)) {
+        thread_cpu_sample s;
+        s.tid = (pid_t)std::stol(entry.path().filename().string());
+
+        std::ifstream comm(entry.path() / "comm");
+        std::getline(comm, s.name);
+
+        std::ifstream stat(entry.path() / "stat");
+        std::string line;
+        std::getline(stat, line);
+        // the thread name may contain spaces, so fields are counted from the closing parenthesis
+        auto pos = line.rfind(')');
+        if (pos == std::string::npos) {
+            continue;
+        }
+        std::istringstream fields(line.substr(pos + 2));
+        std::string field;
+        // utime and stime are fields 14 and 15, i.e. the 12th and 13th after the name
+        uint64_t utime = 0;
+        uint64_t stime = 0;
+        for (int i = 3; i <= 15 and fields >> field; i++) {
+            if (i == 14) {
+                utime = std::stoull(field);
+            } else if (i == 15) {
+                stime = std::stoull(field);
+            }
+        }
+        s.cpu_seconds = (double)(utime + stime) / ticks_per_sec;
+        samples.push_back(s);
+    }
+    return samples;
+}
+
+std::vector<std::pair<std::string, double>> compute_thread_cpu_usage(const std::vector<thread_cpu_sample>& before,
+                                                                     const std::vector<thread_cpu_sample>& after,
+                                                                     const double elapsed_seconds) {
+    std::vector<std::pair<std::string, double>> usage;
+    if (elapsed_seconds <= 0) {
+        return usage;
+    }
+    for (const auto& a : after) {
+        for (const auto& b : before) {
+            if (a.tid == b.tid) {
+                usage.emplace_back(a.name, 100.0 * (a.cpu_seconds - b.cpu_seconds) / elapsed_seconds);
+                break;
+            }
+        }
+    }
+    return usage;
+}
+
+std::vector<thread_sched_info> get_thread_sched_info() {
+    std::vector<thread_sched_info> threads;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator("/proc/self/task", ec)) {
+        thread_sched_info t;
+        t.tid = (pid_t)std::stol(entry.path().filename().string());
+
+        std::ifstream comm(entry.path() / "comm");
+        std::getline(comm, t.name);
+
+        t.policy = sched_getscheduler(t.tid);
+        sched_param param{};
+        if (sched_getparam(t.tid, &param) == 0) {
+            t.priority = param.sched_priority;
+        }
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        if (sched_getaffinity(t.tid, sizeof(cpu_set_t), &cpus) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &cpus)) {
+                    t.cpus.push_back(cpu);
+                }
+            }
+        }
+        threads.push_back(t);
+    }
+    return threads;
+}
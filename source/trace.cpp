@@ -0,0 +1,205 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides lightweight tracing of program phases, written as a Chrome trace
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "trace.hpp"
+
+std::atomic<bool> trace_detail::enabled{false};
+
+namespace {
+struct trace_record {
+    const char* name = nullptr;
+    int64_t begin_ns = 0;  // from the start of the trace
+    int64_t end_ns   = 0;
+};
+
+struct thread_ring {
+    long tid = 0;
+    std::string name;  // guarded by the registry mutex
+    // the ring grows as it is used, so the many short-lived threads of std::async cost little
+    std::vector<trace_record> events;
+    uint64_t n_recorded = 0;
+};
+
+struct trace_registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<thread_ring>> rings;
+    std::unordered_set<std::string> names;
+    std::string file_name;
+    size_t capacity = 0;
+    trace_clock::time_point t_start;
+};
+
+trace_registry& registry() {
+    static trace_registry reg;
+    return reg;
+}
+
+// the rings are owned by the registry as well, so they outlast their threads
+thread_ring& this_thread_ring() {
+    thread_local std::shared_ptr<thread_ring> ring;
+    if (not ring) {
+        auto& reg = registry();
+        auto r    = std::make_shared<thread_ring>();
+        r->tid    = syscall(SYS_gettid);
+        r->events.reserve(std::min<size_t>(reg.capacity, 64));
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        r->name = "thread " + std::to_string(reg.rings.size());
+        reg.rings.push_back(r);
+        ring = std::move(r);
+    }
+    return *ring;
+}
+
+void write_json_string(std::ostream& out, const std::string& s) {
+    out << '"';
+    for (char c : s) {
+        if (c == '"' or c == '\\') {
+            out << '\\' << c;
+        } else if ((unsigned char)c < 0x20) {
+            out << ' ';
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+void write_trace() {
+    auto& reg = registry();
+    trace_detail::enabled.store(false);
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    std::ofstream out(reg.file_name);
+    if (not out.is_open()) {
+        std::cerr << "unable to open trace file " << reg.file_name << std::endl;
+        return;
+    }
+    // events recorded after the fact (such as option parsing) may start before the trace did
+    int64_t t_first = 0;
+    for (const auto& ring : reg.rings) {
+        for (const auto& ev : ring->events) {
+            t_first = std::min(t_first, ev.begin_ns);
+        }
+    }
+    const long pid   = getpid();
+    size_t n_written = 0;
+    bool first       = true;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::fixed << std::setprecision(3);
+    for (const auto& ring : reg.rings) {
+        out << (first ? "\n" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid << ",\"tid\":" << ring->tid
+            << ",\"args\":{\"name\":";
+        write_json_string(out, ring->name);
+        out << "}}";
+        first = false;
+
+        // once the ring has wrapped, the oldest event is the one after the last written
+        const size_t n      = ring->events.size();
+        const size_t oldest = (ring->n_recorded > n) ? ring->n_recorded % n : 0;
+        for (size_t k = 0; k < n; k++) {
+            const auto& ev = ring->events[(oldest + k) % n];
+            out << ",\n{\"ph\":\"X\",\"name\":";
+            write_json_string(out, ev.name);
+            out << ",\"pid\":" << pid << ",\"tid\":" << ring->tid << ",\"ts\":" << 1e-3 * (double)(ev.begin_ns - t_first)
+                << ",\"dur\":" << 1e-3 * (double)(ev.end_ns - ev.begin_ns) << "}";
+        }
+        n_written += n;
+        if (ring->n_recorded > n) {
+            std::cerr << "trace: " << ring->name << " recorded " << ring->n_recorded << " events, only the last " << n
+                      << " were kept" << std::endl;
+        }
+    }
+    out << "\n]}\n";
+    if (not out.good()) {
+        std::cerr << "error writing trace file " << reg.file_name << std::endl;
+        return;
+    }
+    std::cout << "trace of " << n_written << " events from " << reg.rings.size() << " threads written to " << reg.file_name
+              << std::endl;
+}
+
+void write_trace_at_exit() {
+    try {
+        write_trace();
+    } catch (std::exception& e) {
+        std::cerr << "exception writing trace: " << e.what() << std::endl;
+    }
+}
+}  // namespace
+
+bool start_trace(const std::string& file_name, const size_t events_per_thread) {
+    auto& reg = registry();
+    if (trace_enabled()) {
+        return true;
+    }
+    // the file is opened now, so that a bad name is found before the program runs
+    if (not std::ofstream(file_name).is_open()) {
+        std::cerr << "unable to open trace file " << file_name << std::endl;
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.file_name = file_name;
+        reg.capacity  = std::max<size_t>(events_per_thread, 1);
+        reg.t_start   = trace_clock::now();
+    }
+    // the registry was made before this, so it is still there when the trace is written
+    std::atexit(write_trace_at_exit);
+    trace_detail::enabled.store(true);
+    trace_thread_name("main");
+    return true;
+}
+
+void trace_event(const char* name, const trace_clock::time_point t_begin, const trace_clock::time_point t_end) noexcept {
+    if (not trace_enabled()) {
+        return;
+    }
+    try {
+        auto& reg  = registry();
+        auto& ring = this_thread_ring();
+        trace_record ev{name, std::chrono::duration_cast<std::chrono::nanoseconds>(t_begin - reg.t_start).count(),
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(t_end - reg.t_start).count()};
+        if (ring.events.size() < reg.capacity) {
+            ring.events.push_back(ev);
+        } else {
+            ring.events[ring.n_recorded % reg.capacity] = ev;
+        }
+        ring.n_recorded++;
+    } catch (std::bad_alloc&) {
+        // an event that cannot be stored is dropped
+    }
+}
+
+const char* trace_name(const std::string& name) {
+    auto& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    return reg.names.insert(name).first->c_str();
+}
+
+void trace_thread_name(const std::string& name) {
+    if (not trace_enabled()) {
+        return;
+    }
+    auto& ring = this_thread_ring();
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    ring.name = name;
+}
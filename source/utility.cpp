@@ -3,16 +3,29 @@
 
 // Provides simple utilities for VXSDR programs
 
+#include <pthread.h>
+#include <sched.h>
+
+#include <array>
+#include <bit>
 #include <cctype>
 #include <chrono>
 #include <cmath>
 #include <complex>
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <numeric>
+#include <span>
 #include <sstream>
 #include <vector>
 
+#include "sample_buffer.hpp"
+#include "trace.hpp"
+#include "utility.hpp"
+
 std::string format_time(const std::chrono::time_point<std::chrono::system_clock> t, const std::string& fmt) {
     std::stringstream output;
     time_t n_seconds = std::chrono::system_clock::to_time_t(t);
@@ -23,7 +36,8 @@ std::string format_time(const std::chrono::time_point<std::chrono::system_clock>
     return output.str();
 }
 
-size_t read_cplx_16(const std::string& name, std::vector<std::complex<int16_t> >& data) {
+size_t read_cplx_16(const std::string& name, sample_vector& data) {
+    trace_scope trace("read_cplx_16");
     std::ifstream infile(name, std::ios::in | std::ios::binary);
 
     if (infile.is_open()) {
@@ -48,15 +62,138 @@ size_t read_cplx_16(const std::string& name, std::vector<std::complex<int16_t> >
     return 0;
 }
 
-size_t write_cplx_16(const std::string& name, std::vector<std::complex<int16_t> >& data) {
-    std::fstream outfile(name, std::ios::out | std::ios::trunc | std::ios::binary);
+size_t write_cplx_16(const std::string& name, sample_vector& data) {
+    std::ofstream outfile(name, std::ios::out | std::ios::trunc | std::ios::binary);
 
     if (outfile.good()) {
-        outfile.write((char*)&data.front(), sizeof(std::complex<int16_t>) * data.size());
-        outfile.seekg(0, std::fstream::end);
-        size_t num_elem = outfile.tellg() / sizeof(std::complex<int16_t>);
+        outfile.write((char*)data.data(), (std::streamsize)(sizeof(std::complex<int16_t>) * data.size()));
         outfile.close();
-        return num_elem;
+        if (outfile.good()) {
+            return data.size();
+        }
     }
     return 0;
 }
+
+size_t granularity_tile_count(const size_t n_samples, const size_t granularity) {
+    if (n_samples == 0 or granularity == 0) {
+        return 1;
+    }
+    return granularity / std::gcd(n_samples, granularity);
+}
+
+sample_vector tile_waveform(std::span<const std::complex<int16_t>> data, const size_t n_copies) {
+    sample_vector tiled;
+    tiled.reserve(data.size() * n_copies);
+    for (size_t i = 0; i < n_copies; i++) {
+        tiled.insert(tiled.end(), data.begin(), data.end());
+    }
+    return tiled;
+}
+
+bool set_current_thread_affinity(const int cpu) {
+    if (cpu < 0) {
+        return true;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus) == 0;
+}
+
+namespace {
+// tables for the slicing-by-8 form of the CRC, which handles 8 bytes per step
+std::array<std::array<uint32_t, 256>, 8> make_crc32_tables() {
+    std::array<std::array<uint32_t, 256>, 8> t{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = ((c & 1U) != 0) ? 0xEDB88320U ^ (c >> 1U) : c >> 1U;
+        }
+        t[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (size_t j = 1; j < 8; j++) {
+            t[j][i] = (t[j - 1][i] >> 8U) ^ t[0][t[j - 1][i] & 0xFFU];
+        }
+    }
+    return t;
+}
+}  // namespace
+
+uint32_t crc32(std::span<const std::byte> data, const uint32_t crc) {
+    static const auto t = make_crc32_tables();
+    uint32_t c          = ~crc;
+    const auto* p       = reinterpret_cast<const uint8_t*>(data.data());
+    size_t n            = data.size();
+    for (; n >= 8; n -= 8, p += 8) {
+        uint32_t lo = c ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8U | (uint32_t)p[2] << 16U | (uint32_t)p[3] << 24U);
+        c = t[7][lo & 0xFFU] ^ t[6][(lo >> 8U) & 0xFFU] ^ t[5][(lo >> 16U) & 0xFFU] ^ t[4][lo >> 24U] ^ t[3][p[4]] ^ t[2][p[5]]
+            ^ t[1][p[6]] ^ t[0][p[7]];
+    }
+    for (; n > 0; n--, p++) {
+        c = t[0][(c ^ *p) & 0xFFU] ^ (c >> 8U);
+    }
+    return ~c;
+}
+
+namespace {
+constexpr uint64_t xxh_prime_1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t xxh_prime_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t xxh_prime_3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t xxh_prime_4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t xxh_prime_5 = 0x27D4EB2F165667C5ULL;
+
+uint64_t xxh_round(uint64_t acc, const uint64_t input) {
+    acc += input * xxh_prime_2;
+    acc = std::rotl(acc, 31);
+    return acc * xxh_prime_1;
+}
+
+uint64_t xxh_merge(uint64_t acc, const uint64_t val) {
+    acc ^= xxh_round(0, val);
+    return acc * xxh_prime_1 + xxh_prime_4;
+}
+}  // namespace
+
+uint64_t xxhash64(std::span<const std::byte> data, const uint64_t seed) {
+    const auto* p = reinterpret_cast<const uint8_t*>(data.data());
+    size_t n      = data.size();
+    uint64_t h    = 0;
+    if (n >= 32) {
+        // four independent lanes, so the loop is limited by throughput rather than latency
+        std::array<uint64_t, 4> v = {seed + xxh_prime_1 + xxh_prime_2, seed + xxh_prime_2, seed, seed - xxh_prime_1};
+        for (; n >= 32; n -= 32, p += 32) {
+            for (size_t j = 0; j < 4; j++) {
+                v[j] = xxh_round(v[j], load_le<uint64_t>(p + 8 * j));
+            }
+        }
+        h = std::rotl(v[0], 1) + std::rotl(v[1], 7) + std::rotl(v[2], 12) + std::rotl(v[3], 18);
+        for (auto x : v) {
+            h = xxh_merge(h, x);
+        }
+    } else {
+        h = seed + xxh_prime_5;
+    }
+    h += (uint64_t)data.size();
+    for (; n >= 8; n -= 8, p += 8) {
+        h ^= xxh_round(0, load_le<uint64_t>(p));
+        h = std::rotl(h, 27) * xxh_prime_1 + xxh_prime_4;
+    }
+    if (n >= 4) {
+        h ^= (uint64_t)load_le<uint32_t>(p) * xxh_prime_1;
+        h = std::rotl(h, 23) * xxh_prime_2 + xxh_prime_3;
+        n -= 4;
+        p += 4;
+    }
+    for (; n > 0; n--, p++) {
+        h ^= (uint64_t)*p * xxh_prime_5;
+        h = std::rotl(h, 11) * xxh_prime_1;
+    }
+    h ^= h >> 33U;
+    h *= xxh_prime_2;
+    h ^= h >> 29U;
+    h *= xxh_prime_3;
+    h ^= h >> 32U;
+    return h;
+}
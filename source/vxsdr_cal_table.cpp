@@ -0,0 +1,72 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides a tool to build and list the binary calibration tables used by --cal_table_file
+//
+// Text tables written by vxsdr_tx_lo_iq_cal or python/loopback_tx_lo_iq_corr.py can be imported
+// for a given device unique ID; entries already in the table at the same frequencies are replaced.
+
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "cal_table.hpp"
+#include "option_utils.hpp"
+
+int main(int argc, char* argv[]) {
+    try {
+        option_utils::program_options desc("vxsdr_cal_table", "import and list calibration tables");
+
+        // clang-format off
+        desc.add_flag("help", "show help message");
+        desc.add_option("config_file", "configuration file name", option_utils::supported_types::STRING);
+        desc.add_option("cal_table_file", "binary calibration table (created if it does not exist)", option_utils::supported_types::STRING, true);
+        desc.add_option("import_file", "text calibration table to add to the binary table", option_utils::supported_types::STRING);
+        desc.add_option("device_id", "device unique ID (from hello()) that the imported table was measured on", option_utils::supported_types::INTEGER);
+        desc.add_flag("list", "list the entries in the binary table", false, false);
+        // clang-format on
+
+        auto vm = desc.parse(argc, argv);
+
+        auto table_name = vm["cal_table_file"].as<std::string>();
+        calibration_table table;
+        if (std::filesystem::exists(table_name) and not table.load(table_name)) {
+            return 1;
+        }
+
+        if (vm.count("import_file") > 0) {
+            if (vm.count("device_id") == 0) {
+                std::cerr << "--device_id is required with --import_file" << std::endl;
+                return 1;
+            }
+            auto n_read = table.import_text(vm["import_file"].as<std::string>(), vm["device_id"].as<uint32_t>());
+            if (n_read == 0) {
+                std::cerr << "no calibration entries found in " << vm["import_file"].as<std::string>() << std::endl;
+                return 1;
+            }
+            if (not table.save(table_name)) {
+                return 1;
+            }
+            std::cout << "imported " << n_read << " entries; " << table_name << " has " << table.size() << " entries" << std::endl;
+        }
+
+        if (vm["list"].as<bool>()) {
+            std::cout << "  device    dir    F (GHz)   Bias1      Bias2      IQ1        IQ2        IQ3        IQ4" << std::endl;
+            for (const auto& e : table.entries()) {
+                std::cout << std::setw(8) << e.device_id << " " << std::setw(6) << (e.direction == cal_direction::tx ? "tx" : "rx")
+                          << std::fixed << " " << std::setw(10) << std::setprecision(3) << 1e-9 * e.freq << std::setprecision(6);
+                for (auto x : e.iq_bias) {
+                    std::cout << " " << std::setw(10) << x;
+                }
+                for (auto x : e.iq_corr) {
+                    std::cout << " " << std::setw(10) << x;
+                }
+                std::cout << std::endl;
+            }
+        }
+    } catch (std::exception& e) {
+        std::cerr << "exception caught: " << e.what() << std::endl;
+        return 3;
+    }
+}
@@ -0,0 +1,401 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides a benchmark of TX to RX latency and timing jitter over a loopback connection (the same
+// cabling used by loopback_tx_lo_iq_corr.py), over a grid of rates and network settings
+//
+// A marker burst (a PRBS by default) is looped with tx_loop once every --latency_period
+// seconds, and a timed receive starting at the same radio time captures every period. The
+// arrival of each marker is found by cross-correlation, interpolated to a fraction of a
+// sample. Two latencies are reported for each setting:
+//     path delay: from the radio time a marker is sent to the radio time it is received,
+//         whose spread is the timestamp jitter and whose slope over the run is the drift
+//     host delay: from the radio time the last sample of a search window is received to
+//         the time get_rx_data returns it to the host, which is what real-time tuning
+//         (thread priority, affinity, payload size) changes
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+#include "host_radio_options.hpp"
+#include "sample_buffer.hpp"
+#include "utility.hpp"
+#include "waveform_gen.hpp"
+
+using namespace std::chrono_literals;
+
+struct latency_point {
+    unsigned payload_size   = 0;
+    int net_thread_priority = 0;
+    double rate             = 0;
+};
+
+struct latency_result {
+    latency_point point;
+    size_t n_trials   = 0;
+    size_t n_detected = 0;
+    std::vector<double> path_delay_ns;
+    std::vector<double> host_delay_us;
+    double jitter_ns         = 0;  // standard deviation of the path delay after removing drift
+    double drift_ns_per_s    = 0;
+    std::vector<double> path_pct;  // percentiles of path delay in ns, in the order of latency_quantiles
+    std::vector<double> host_pct;  // percentiles of host delay in us
+};
+
+static const std::vector<double> latency_quantiles = {0.5, 0.99, 0.999};
+
+// returns the given quantile of values, which are sorted in place
+static double quantile(std::vector<double>& values, const double q) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t k = (size_t)std::ceil(q * (double)values.size());
+    return values[std::clamp<size_t>(k, 1, values.size()) - 1];
+}
+
+// the marker and received data are kept as separate real and imaginary parts, so the
+// correlation is a set of plain multiply-adds the compiler can vectorize
+struct split_complex {
+    std::vector<float> re;
+    std::vector<float> im;
+    void assign(std::span<const std::complex<int16_t>> x) {
+        re.resize(x.size());
+        im.resize(x.size());
+        for (size_t i = 0; i < x.size(); i++) {
+            re[i] = (float)x[i].real();
+            im[i] = (float)x[i].imag();
+        }
+    }
+};
+
+// finds the offset in x at which the marker correlates best, interpolated between samples;
+// returns false if the peak is less than min_ratio times the mean correlation power
+static bool find_marker(const split_complex& x, const split_complex& marker, const double min_ratio, double& offset) {
+    const size_t n_marker = marker.re.size();
+    if (x.re.size() < n_marker + 2) {
+        return false;
+    }
+    const size_t n_lags = x.re.size() - n_marker + 1;
+    std::vector<float> power(n_lags);
+    const float* mr     = marker.re.data();
+    const float* mi     = marker.im.data();
+    for (size_t lag = 0; lag < n_lags; lag++) {
+        const float* xr = x.re.data() + lag;
+        const float* xi = x.im.data() + lag;
+        float cr        = 0;
+        float ci        = 0;
+        // x times the conjugate of the marker
+        for (size_t i = 0; i < n_marker; i++) {
+            cr += xr[i] * mr[i] + xi[i] * mi[i];
+            ci += xi[i] * mr[i] - xr[i] * mi[i];
+        }
+        power[lag] = cr * cr + ci * ci;
+    }
+    size_t peak = std::max_element(power.begin(), power.end()) - power.begin();
+    double mean = 0;
+    for (auto p : power) {
+        mean += p;
+    }
+    mean /= (double)n_lags;
+    if (mean <= 0 or power[peak] < min_ratio * mean) {
+        return false;
+    }
+    // fit a parabola through the peak and its neighbors, using magnitudes
+    offset = (double)peak;
+    if (peak > 0 and peak + 1 < n_lags) {
+        double a = std::sqrt(power[peak - 1]);
+        double b = std::sqrt(power[peak]);
+        double c = std::sqrt(power[peak + 1]);
+        double d = a - 2 * b + c;
+        if (d < 0) {
+            offset += 0.5 * (a - c) / d;
+        }
+    }
+    return true;
+}
+
+// returns the radio time minus the host time, from the quickest of several time requests
+static std::chrono::nanoseconds radio_host_offset(std::unique_ptr<vxsdr>& radio) {
+    std::chrono::nanoseconds best_rtt = std::chrono::nanoseconds::max();
+    std::chrono::nanoseconds offset{0};
+    for (unsigned i = 0; i < 8; i++) {
+        auto h0    = std::chrono::system_clock::now();
+        auto t_now = radio->get_time_now();
+        auto h1    = std::chrono::system_clock::now();
+        if (t_now.has_value() and h1 - h0 < best_rtt) {
+            best_rtt = h1 - h0;
+            offset   = t_now.value() - (h0 + (h1 - h0) / 2);
+        }
+    }
+    return offset;
+}
+
+static latency_result run_trials(std::unique_ptr<vxsdr>& radio,
+                                 const latency_point& pt,
+                                 const sample_vector& marker,
+                                 const size_t n_trials,
+                                 const double period_sec,
+                                 const double window_sec,
+                                 const double min_ratio) {
+    latency_result res;
+    res.point    = pt;
+    res.n_trials = n_trials;
+
+    // the period is a whole number of nanoseconds, as tx_loop takes it
+    vxsdr::duration pri      = std::chrono::nanoseconds(std::llround(1e9 * period_sec));
+    const double period_samp = 1e-9 * (double)pri.count() * pt.rate;
+    const size_t n_window    = marker.size() + (size_t)std::llround(window_sec * pt.rate);
+    if ((double)n_window > period_samp) {
+        std::cerr << "latency_window plus the marker is longer than latency_period at rate " << pt.rate << std::endl;
+        return res;
+    }
+    const auto n_total = (uint64_t)std::ceil((double)(n_trials - 1) * period_samp) + n_window;
+
+    auto t_now = radio->get_time_now();
+    if (not t_now.has_value()) {
+        std::cerr << "unable to get radio time" << std::endl;
+        return res;
+    }
+    auto offset  = radio_host_offset(radio);
+    auto t_start = t_now.value() + 200ms;
+    if (not radio->tx_loop(t_start, marker.size(), pri, n_trials)) {
+        std::cerr << "tx_loop() failed" << std::endl;
+        return res;
+    }
+    if (radio->put_tx_data(marker) != marker.size()) {
+        std::cerr << "error sending marker data" << std::endl;
+        radio->tx_stop();
+        return res;
+    }
+    if (not radio->rx_start(t_start, n_total)) {
+        std::cerr << "rx_start() failed" << std::endl;
+        radio->tx_stop();
+        return res;
+    }
+
+    split_complex ref;
+    ref.assign(marker);
+    split_complex x;
+    sample_vector rx_data((size_t)std::ceil(period_samp) + 1);
+    std::vector<double> trial_time;
+    for (size_t k = 0; k < n_trials; k++) {
+        // each trial's samples start where its marker would arrive with no delay
+        double expected     = (double)k * period_samp;
+        uint64_t start      = (uint64_t)std::floor(expected);
+        uint64_t next_start = (k + 1 < n_trials) ? (uint64_t)std::floor(expected + period_samp) : start + n_window;
+        size_t n_chunk = next_start - start;
+
+        size_t n = radio->get_rx_data(std::span(rx_data).first(n_window), n_window);
+        auto t_got = std::chrono::system_clock::now() + offset;
+        if (n != n_window) {
+            std::cerr << "timeout receiving data in trial " << k << std::endl;
+            break;
+        }
+        auto t_window_end = t_start + std::chrono::nanoseconds(std::llround(1e9 * (double)(start + n_window) / pt.rate));
+        if (n_chunk > n_window) {
+            if (radio->get_rx_data(std::span(rx_data).subspan(n_window, n_chunk - n_window), n_chunk - n_window) !=
+                n_chunk - n_window) {
+                std::cerr << "timeout receiving data in trial " << k << std::endl;
+                break;
+            }
+        }
+
+        x.assign(std::span(rx_data).first(n_window));
+        double arrival = 0;
+        if (find_marker(x, ref, min_ratio, arrival)) {
+            res.n_detected++;
+            res.path_delay_ns.push_back(1e9 * ((double)start + arrival - expected) / pt.rate);
+            res.host_delay_us.push_back(std::chrono::duration<double, std::micro>(t_got - t_window_end).count());
+            trial_time.push_back((double)k * period_sec);
+        }
+    }
+    radio->rx_stop();
+    radio->tx_stop();
+
+    // drift is the slope of a line fit to the path delay, and jitter the spread about it
+    const size_t n_det = res.path_delay_ns.size();
+    if (n_det >= 2) {
+        double mt = 0;
+        double md = 0;
+        for (size_t i = 0; i < n_det; i++) {
+            mt += trial_time[i];
+            md += res.path_delay_ns[i];
+        }
+        mt /= (double)n_det;
+        md /= (double)n_det;
+        double s_tt = 0;
+        double s_td = 0;
+        for (size_t i = 0; i < n_det; i++) {
+            s_tt += (trial_time[i] - mt) * (trial_time[i] - mt);
+            s_td += (trial_time[i] - mt) * (res.path_delay_ns[i] - md);
+        }
+        res.drift_ns_per_s = s_tt > 0 ? s_td / s_tt : 0;
+        double ss          = 0;
+        for (size_t i = 0; i < n_det; i++) {
+            double r = res.path_delay_ns[i] - md - res.drift_ns_per_s * (trial_time[i] - mt);
+            ss += r * r;
+        }
+        res.jitter_ns = std::sqrt(ss / (double)(n_det - 1));
+    }
+    for (auto q : latency_quantiles) {
+        res.path_pct.push_back(quantile(res.path_delay_ns, q));
+        res.host_pct.push_back(quantile(res.host_delay_us, q));
+    }
+    return res;
+}
+
+static void write_csv(std::ostream& out, const std::vector<latency_result>& results) {
+    out << "rate,payload_size,net_thread_priority,trials,detected,path_p50_ns,path_p99_ns,path_p999_ns,jitter_ns,"
+           "drift_ns_per_s,host_p50_us,host_p99_us,host_p999_us"
+        << std::endl;
+    // a point which stopped early has no percentiles, jitter, or drift; those fields are left empty,
+    // so every row has one field for each column
+    auto write_pct = [&out](const std::vector<double>& pct) {
+        for (size_t k = 0; k < latency_quantiles.size(); k++) {
+            out << ",";
+            if (k < pct.size()) {
+                out << pct[k];
+            }
+        }
+    };
+    for (const auto& r : results) {
+        const auto& p = r.point;
+        out << p.rate << "," << p.payload_size << "," << p.net_thread_priority << "," << r.n_trials << "," << r.n_detected;
+        write_pct(r.path_pct);
+        if (r.path_delay_ns.size() >= 2) {
+            out << "," << r.jitter_ns << "," << r.drift_ns_per_s;
+        } else {
+            out << ",,";
+        }
+        write_pct(r.host_pct);
+        out << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::cout << argv[0] << " started" << std::endl;
+
+        // set up options and read from command line and/or configuration file
+        option_utils::program_options desc("vxsdr_latency_bench", "benchmark TX to RX latency and jitter over loopback");
+
+        add_common_options(desc);
+        add_network_options(desc);
+        add_tx_1ch_options(desc);
+        add_rx_1ch_options(desc);
+
+        // clang-format off
+        desc.add_option("latency_rates", "list of sample rates to test, e.g. \"[1e6,10e6,50e6]\" (default is --rate)", option_utils::supported_types::STRING);
+        desc.add_option("latency_payload_sizes", "list of payload sizes to test (default is --payload_size)", option_utils::supported_types::STRING);
+        desc.add_option("latency_thread_priorities", "list of network thread priorities to test (default is --net_thread_priority)", option_utils::supported_types::STRING);
+        desc.add_option("latency_trials", "number of markers sent for each setting", option_utils::supported_types::INTEGER, false, "1000");
+        desc.add_option("latency_period", "time between markers in seconds", option_utils::supported_types::REAL, false, "0.01");
+        desc.add_option("latency_window", "longest path delay searched for in seconds", option_utils::supported_types::REAL, false, "0.0001");
+        desc.add_option("latency_marker", "marker waveform (see --tx_waveform in vxsdr_tx_loop_file)", option_utils::supported_types::STRING, false, "prbs:order=9,sps=2");
+        desc.add_option("latency_min_snr", "minimum ratio in dB of the correlation peak to its mean for a marker to be detected", option_utils::supported_types::REAL, false, "15.0");
+        desc.add_option("latency_output_file", "CSV file for the results (the default is standard output only)", option_utils::supported_types::STRING);
+        // clang-format on
+
+        auto vm = desc.parse(argc, argv);
+        set_buffer_options(vm);
+        if (set_trace_options(vm) != 0) {
+            return 1;
+        }
+
+        auto n_trials   = vm["latency_trials"].as<size_t>();
+        auto period_sec = vm["latency_period"].as<double>();
+        auto window_sec = vm["latency_window"].as<double>();
+        auto min_ratio  = std::pow(10.0, vm["latency_min_snr"].as<double>() / 10.0);
+        if (n_trials == 0 or period_sec <= 0.0 or window_sec < 0.0) {
+            std::cerr << "latency_trials and latency_period must be positive, and latency_window nonnegative" << std::endl;
+            return 1;
+        }
+        waveform_spec marker_spec;
+        if (not parse_waveform_spec(vm["latency_marker"].as<std::string>(), marker_spec)) {
+            return 1;
+        }
+
+        auto rates         = get_sweep_values(vm, "latency_rates", "rate", true);
+        auto payload_sizes = get_sweep_values(vm, "latency_payload_sizes", "payload_size");
+        auto priorities    = get_sweep_values(vm, "latency_thread_priorities", "net_thread_priority");
+
+        std::vector<latency_result> results;
+        for (auto payload : payload_sizes) {
+            for (auto priority : priorities) {
+                latency_point pt;
+                pt.payload_size        = (unsigned)payload;
+                pt.net_thread_priority = (int)priority;
+
+                // thread settings only take effect when the radio is constructed
+                auto settings                   = get_radio_settings(vm);
+                settings["net_thread_priority"] = pt.net_thread_priority;
+                auto radio                      = std::make_unique<vxsdr>(settings);
+
+                set_common_options(vm, radio);
+                set_tx_1ch_options(vm, radio);
+                set_rx_1ch_options(vm, radio);
+                if (pt.payload_size > 0 and not radio->set_max_payload_bytes(pt.payload_size)) {
+                    std::cerr << "error setting payload size " << pt.payload_size << std::endl;
+                }
+
+                for (auto rate : rates) {
+                    pt.rate = rate;
+                    if (not radio->set_tx_rate(rate) or not radio->set_rx_rate(rate)) {
+                        std::cerr << "rate " << rate << " not accepted" << std::endl;
+                        continue;
+                    }
+                    // the marker is made at each rate, so its bandwidth scales with the rate
+                    auto marker = synthesize_waveform(marker_spec, rate);
+                    if (marker.empty()) {
+                        return 1;
+                    }
+                    auto res = run_trials(radio, pt, marker, n_trials, period_sec, window_sec, min_ratio);
+                    // the line is formatted separately, so its precision does not carry over to later output
+                    std::stringstream line;
+                    line << std::fixed << std::setprecision(1) << "payload " << pt.payload_size << " prio "
+                         << pt.net_thread_priority << " rate " << std::setprecision(0) << rate << ": " << res.n_detected << "/"
+                         << res.n_trials << " detected";
+                    if (res.n_detected > 0) {
+                        line << std::setprecision(1) << ", path delay p50/p99/p99.9 " << res.path_pct[0] << "/" << res.path_pct[1]
+                             << "/" << res.path_pct[2] << " ns, jitter " << res.jitter_ns << " ns, drift " << res.drift_ns_per_s
+                             << " ns/s, host delay p50/p99/p99.9 " << res.host_pct[0] << "/" << res.host_pct[1] << "/"
+                             << res.host_pct[2] << " us";
+                    }
+                    std::cout << line.str() << std::endl;
+                    results.push_back(res);
+                }
+                // allow the network threads to shut down before the next radio is constructed
+                radio.reset();
+                std::this_thread::sleep_for(100ms);
+            }
+        }
+
+        if (vm.count("latency_output_file") > 0) {
+            std::ofstream outfile(vm["latency_output_file"].as<std::string>());
+            if (not outfile.is_open()) {
+                std::cerr << "unable to open output file " << vm["latency_output_file"].as<std::string>() << std::endl;
+                return 1;
+            }
+            write_csv(outfile, results);
+        }
+
+        std::cout << "benchmark complete" << std::endl;
+    } catch (std::exception& e) {
+        std::cerr << "exception caught: " << e.what() << std::endl;
+        return 3;
+    }
+}
@@ -0,0 +1,355 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides a benchmark of sustained data throughput over a grid of network settings
+// and sample rates, so the best settings for a host and network interface can be found
+
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numbers>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+#include "host_radio_options.hpp"
+#include "sample_buffer.hpp"
+#include "thread_stats.hpp"
+#include "utility.hpp"
+
+using namespace std::chrono_literals;
+
+struct bench_point {
+    unsigned payload_size      = 0;
+    unsigned network_mtu       = 0;
+    unsigned send_buffer_bytes = 0;
+    unsigned tx_queue_packets  = 0;
+    int net_thread_priority    = 0;
+    int thread_affinity_offset = 0;
+    double rate                = 0;
+    std::string direction;
+};
+
+struct bench_result {
+    bench_point point;
+    bool rate_accepted     = false;
+    size_t n_requested     = 0;
+    size_t n_transferred   = 0;
+    double elapsed_seconds = 0;
+    double samples_per_sec = 0;
+    size_t n_lost          = 0;
+    bool late              = false;
+    std::vector<std::pair<std::string, double>> thread_cpu;
+};
+
+static bench_result run_tx(std::unique_ptr<vxsdr>& radio, const bench_point& pt, const double bench_sec,
+                           const sample_vector& data) {
+    bench_result res;
+    res.point       = pt;
+    res.n_requested = std::llround(bench_sec * pt.rate);
+
+    auto t_now = radio->get_time_now();
+    if (not t_now.has_value()) {
+        std::cerr << "unable to get radio time" << std::endl;
+        return res;
+    }
+    // leave time for the queue to fill before the radio starts consuming data
+    auto t_start = t_now.value() + 500ms;
+    if (not radio->tx_start(t_start, res.n_requested)) {
+        std::cerr << "tx_start() failed" << std::endl;
+        return res;
+    }
+    auto radio_host_offset = t_now.value() - std::chrono::system_clock::now();
+
+    auto cpu_before = get_thread_cpu_samples();
+    auto t0         = std::chrono::steady_clock::now();
+    while (res.n_transferred < res.n_requested) {
+        size_t n_block = std::min(data.size(), res.n_requested - res.n_transferred);
+        size_t n       = radio->put_tx_data(data, n_block);
+        res.n_transferred += n;
+        if (n < n_block) {
+            break;
+        }
+    }
+    auto t1        = std::chrono::steady_clock::now();
+    auto cpu_after = get_thread_cpu_samples();
+    // the radio needs the last sample at the end of the stream; finishing later than that means it ran dry
+    auto t_done = std::chrono::system_clock::now() + radio_host_offset;
+    auto t_end  = t_start + std::chrono::duration<double>((double)res.n_requested / pt.rate);
+
+    res.elapsed_seconds = std::chrono::duration<double>(t1 - t0).count();
+    // the transfer runs ahead of the radio until the queue fills, so measure against the radio's stream time
+    double stream_sec   = std::max(res.elapsed_seconds, std::chrono::duration<double>(t_done - t_start).count());
+    res.samples_per_sec = stream_sec > 0 ? (double)res.n_transferred / stream_sec : 0;
+    res.n_lost          = res.n_requested - res.n_transferred;
+    res.late            = t_done > t_end;
+    res.thread_cpu      = compute_thread_cpu_usage(cpu_before, cpu_after, res.elapsed_seconds);
+    res.rate_accepted   = true;
+
+    radio->tx_stop();
+    return res;
+}
+
+static bench_result run_rx(std::unique_ptr<vxsdr>& radio, const bench_point& pt, const double bench_sec,
+                           sample_vector& data) {
+    bench_result res;
+    res.point       = pt;
+    res.n_requested = std::llround(bench_sec * pt.rate);
+
+    auto t_now = radio->get_time_now();
+    if (not t_now.has_value()) {
+        std::cerr << "unable to get radio time" << std::endl;
+        return res;
+    }
+    auto t_start = t_now.value() + 100ms;
+    if (not radio->rx_start(t_start, res.n_requested)) {
+        std::cerr << "rx_start() failed" << std::endl;
+        return res;
+    }
+
+    auto cpu_before = get_thread_cpu_samples();
+    auto t0         = std::chrono::steady_clock::now();
+    bool started    = false;
+    while (res.n_transferred < res.n_requested) {
+        size_t n_block = std::min(data.size(), res.n_requested - res.n_transferred);
+        size_t n       = radio->get_rx_data(data, n_block, 0, 1.0);
+        if (not started and n > 0) {
+            // time from the first data, so the start delay is not counted
+            t0      = std::chrono::steady_clock::now();
+            started = true;
+        }
+        res.n_transferred += n;
+        if (n < n_block) {
+            break;
+        }
+    }
+    auto t1        = std::chrono::steady_clock::now();
+    auto cpu_after = get_thread_cpu_samples();
+
+    res.elapsed_seconds = std::chrono::duration<double>(t1 - t0).count();
+    res.samples_per_sec = res.elapsed_seconds > 0 ? (double)res.n_transferred / res.elapsed_seconds : 0;
+    res.n_lost          = res.n_requested - res.n_transferred;
+    res.thread_cpu      = compute_thread_cpu_usage(cpu_before, cpu_after, res.elapsed_seconds);
+    res.rate_accepted   = true;
+
+    radio->rx_stop();
+    return res;
+}
+
+static std::string format_thread_cpu(const bench_result& r) {
+    std::stringstream out;
+    for (size_t i = 0; i < r.thread_cpu.size(); i++) {
+        out << (i > 0 ? ";" : "") << r.thread_cpu[i].first << ":" << std::fixed << std::setprecision(1) << r.thread_cpu[i].second;
+    }
+    return out.str();
+}
+
+static void write_csv(std::ostream& out, const std::vector<bench_result>& results) {
+    out << "direction,payload_size,network_mtu,network_send_buffer_bytes,tx_data_queue_packets,net_thread_priority,"
+           "thread_affinity_offset,rate,rate_accepted,samples_requested,samples_transferred,samples_lost,late,"
+           "elapsed_s,samples_per_s,thread_cpu_percent"
+        << std::endl;
+    for (const auto& r : results) {
+        const auto& p = r.point;
+        out << p.direction << "," << p.payload_size << "," << p.network_mtu << "," << p.send_buffer_bytes << ","
+            << p.tx_queue_packets << "," << p.net_thread_priority << "," << p.thread_affinity_offset << "," << p.rate << ","
+            << (r.rate_accepted ? 1 : 0) << "," << r.n_requested << "," << r.n_transferred << "," << r.n_lost << ","
+            << (r.late ? 1 : 0) << "," << r.elapsed_seconds << "," << r.samples_per_sec << "," << format_thread_cpu(r)
+            << std::endl;
+    }
+}
+
+static void write_json(std::ostream& out, const std::vector<bench_result>& results) {
+    out << "[" << std::endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        const auto& p = r.point;
+        out << "  {\"direction\": \"" << p.direction << "\", \"payload_size\": " << p.payload_size
+            << ", \"network_mtu\": " << p.network_mtu << ", \"network_send_buffer_bytes\": " << p.send_buffer_bytes
+            << ", \"tx_data_queue_packets\": " << p.tx_queue_packets << ", \"net_thread_priority\": " << p.net_thread_priority
+            << ", \"thread_affinity_offset\": " << p.thread_affinity_offset << ", \"rate\": " << p.rate
+            << ", \"rate_accepted\": " << (r.rate_accepted ? "true" : "false") << ", \"samples_requested\": " << r.n_requested
+            << ", \"samples_transferred\": " << r.n_transferred << ", \"samples_lost\": " << r.n_lost
+            << ", \"late\": " << (r.late ? "true" : "false") << ", \"elapsed_s\": " << r.elapsed_seconds
+            << ", \"samples_per_s\": " << r.samples_per_sec << ", \"thread_cpu_percent\": {";
+        for (size_t j = 0; j < r.thread_cpu.size(); j++) {
+            out << (j > 0 ? ", " : "") << "\"" << r.thread_cpu[j].first << "\": " << r.thread_cpu[j].second;
+        }
+        out << "}}" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    out << "]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::cout << argv[0] << " started" << std::endl;
+
+        // set up options and read from command line and/or configuration file
+        option_utils::program_options desc("vxsdr_net_bench", "benchmark data throughput over a grid of network settings");
+
+        add_common_options(desc);
+        add_network_options(desc);
+        add_tx_1ch_options(desc);
+        add_rx_1ch_options(desc);
+
+        // clang-format off
+        desc.add_option("bench_rates", "list of sample rates to test, e.g. \"[1e6,10e6,50e6]\" (default is --rate)", option_utils::supported_types::STRING);
+        desc.add_option("bench_payload_sizes", "list of payload sizes to test (default is --payload_size)", option_utils::supported_types::STRING);
+        desc.add_option("bench_network_mtus", "list of network MTUs to test (default is --network_mtu)", option_utils::supported_types::STRING);
+        desc.add_option("bench_send_buffer_bytes", "list of network send buffer sizes to test (default is --network_send_buffer_bytes)", option_utils::supported_types::STRING);
+        desc.add_option("bench_tx_queue_packets", "list of transmit queue sizes to test (default is --tx_data_queue_packets)", option_utils::supported_types::STRING);
+        desc.add_option("bench_thread_priorities", "list of network thread priorities to test (default is --net_thread_priority)", option_utils::supported_types::STRING);
+        desc.add_option("bench_affinity_offsets", "list of thread affinity offsets to test (default is --thread_affinity_offset)", option_utils::supported_types::STRING);
+        desc.add_option("bench_direction", "data direction to test (tx, rx, or both)", option_utils::supported_types::STRING, false, "tx");
+        desc.add_option("bench_block_samples", "number of samples in each put_tx_data or get_rx_data call", option_utils::supported_types::INTEGER, false, "65536");
+        desc.add_option("bench_output_file", "file for the results (the default is standard output only)", option_utils::supported_types::STRING);
+        desc.add_option("bench_output_format", "format of the results file (csv or json)", option_utils::supported_types::STRING, false, "csv");
+        // clang-format on
+
+        auto vm = desc.parse(argc, argv);
+        set_buffer_options(vm);
+        if (set_trace_options(vm) != 0) {
+            return 1;
+        }
+
+        // the duration is the length of each measurement
+        auto bench_sec = vm["duration"].as<double>();
+        if (bench_sec <= 0.0) {
+            std::cerr << "duration must be positive" << std::endl;
+            return 1;
+        }
+
+        auto direction = vm["bench_direction"].as<std::string>();
+        if (direction != "tx" and direction != "rx" and direction != "both") {
+            std::cerr << "Error: unknown option value for --bench_direction: " << direction << std::endl;
+            return 1;
+        }
+        auto format = vm["bench_output_format"].as<std::string>();
+        if (format != "csv" and format != "json") {
+            std::cerr << "Error: unknown option value for --bench_output_format: " << format << std::endl;
+            return 1;
+        }
+        auto block_samples = vm["bench_block_samples"].as<size_t>();
+        if (block_samples == 0) {
+            std::cerr << "bench_block_samples must be positive" << std::endl;
+            return 1;
+        }
+
+        auto rates            = get_sweep_values(vm, "bench_rates", "rate", true);
+        auto payload_sizes    = get_sweep_values(vm, "bench_payload_sizes", "payload_size");
+        auto mtus             = get_sweep_values(vm, "bench_network_mtus", "network_mtu");
+        auto send_buffers     = get_sweep_values(vm, "bench_send_buffer_bytes", "network_send_buffer_bytes");
+        auto tx_queues        = get_sweep_values(vm, "bench_tx_queue_packets", "tx_data_queue_packets");
+        auto priorities       = get_sweep_values(vm, "bench_thread_priorities", "net_thread_priority");
+        auto affinity_offsets = get_sweep_values(vm, "bench_affinity_offsets", "thread_affinity_offset");
+
+        // synthetic data is a tone at one eighth of the sample rate, reused for every call
+        sample_vector tx_data(block_samples);
+        for (size_t i = 0; i < block_samples; i++) {
+            double phase = 2.0 * std::numbers::pi * (double)(i % 8) / 8.0;
+            tx_data[i]   = {(int16_t)std::lround(16384 * std::cos(phase)), (int16_t)std::lround(16384 * std::sin(phase))};
+        }
+        sample_vector rx_data(block_samples);
+
+        std::vector<bench_result> results;
+
+        for (auto payload : payload_sizes) {
+            for (auto mtu : mtus) {
+                for (auto send_buf : send_buffers) {
+                    for (auto tx_queue : tx_queues) {
+                        for (auto priority : priorities) {
+                            for (auto affinity : affinity_offsets) {
+                                bench_point pt;
+                                pt.payload_size           = (unsigned)payload;
+                                pt.network_mtu            = (unsigned)mtu;
+                                pt.send_buffer_bytes      = (unsigned)send_buf;
+                                pt.tx_queue_packets       = (unsigned)tx_queue;
+                                pt.net_thread_priority    = (int)priority;
+                                pt.thread_affinity_offset = (int)affinity;
+
+                                // thread and socket settings only take effect when the radio is constructed
+                                auto settings                      = get_radio_settings(vm);
+                                settings["net_thread_priority"]    = pt.net_thread_priority;
+                                settings["thread_affinity_offset"] = pt.thread_affinity_offset;
+                                if (pt.network_mtu > 0) {
+                                    settings["udp_data_transport:mtu_bytes"] = pt.network_mtu;
+                                }
+                                if (pt.send_buffer_bytes > 0) {
+                                    settings["network_send_buffer_bytes"] = pt.send_buffer_bytes;
+                                }
+                                if (pt.tx_queue_packets > 0) {
+                                    settings["tx_data_queue_packets"] = pt.tx_queue_packets;
+                                }
+
+                                auto radio = std::make_unique<vxsdr>(settings);
+
+                                set_common_options(vm, radio);
+                                set_tx_1ch_options(vm, radio);
+                                if (direction != "tx") {
+                                    set_rx_1ch_options(vm, radio);
+                                }
+                                if (pt.payload_size > 0 and not radio->set_max_payload_bytes(pt.payload_size)) {
+                                    std::cerr << "error setting payload size " << pt.payload_size << std::endl;
+                                }
+
+                                for (auto rate : rates) {
+                                    pt.rate = rate;
+                                    for (const std::string dir : {"tx", "rx"}) {
+                                        if (direction != "both" and direction != dir) {
+                                            continue;
+                                        }
+                                        pt.direction = dir;
+                                        bench_result res;
+                                        bool rate_ok = (dir == "tx") ? radio->set_tx_rate(rate) : radio->set_rx_rate(rate);
+                                        if (not rate_ok) {
+                                            std::cerr << "rate " << rate << " not accepted for " << dir << std::endl;
+                                            res.point = pt;
+                                        } else if (dir == "tx") {
+                                            res = run_tx(radio, pt, bench_sec, tx_data);
+                                        } else {
+                                            res = run_rx(radio, pt, bench_sec, rx_data);
+                                        }
+                                        std::cout << dir << " payload " << pt.payload_size << " mtu " << pt.network_mtu
+                                                  << " sndbuf " << pt.send_buffer_bytes << " txq " << pt.tx_queue_packets
+                                                  << " prio " << pt.net_thread_priority << " affinity " << pt.thread_affinity_offset
+                                                  << " rate " << rate << ": " << res.samples_per_sec << " samples/s, " << res.n_lost
+                                                  << " lost" << (res.late ? ", late" : "") << std::endl;
+                                        results.push_back(res);
+                                    }
+                                }
+                                // allow the network threads to shut down before the next radio is constructed
+                                radio.reset();
+                                std::this_thread::sleep_for(100ms);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        if (vm.count("bench_output_file") > 0) {
+            std::ofstream outfile(vm["bench_output_file"].as<std::string>());
+            if (not outfile.is_open()) {
+                std::cerr << "unable to open output file " << vm["bench_output_file"].as<std::string>() << std::endl;
+                return 1;
+            }
+            if (format == "json") {
+                write_json(outfile, results);
+            } else {
+                write_csv(outfile, results);
+            }
+        }
+
+        std::cout << "benchmark complete" << std::endl;
+    } catch (std::exception& e) {
+        std::cerr << "exception caught: " << e.what() << std::endl;
+        return 3;
+    }
+}
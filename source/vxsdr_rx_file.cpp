@@ -0,0 +1,255 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides a simple example of high-rate receive to a file, using a
+// lock-free ring between the receiving thread and the file writer
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+#include "host_radio_options.hpp"
+#include "sample_buffer.hpp"
+#include "sample_ring.hpp"
+#include "utility.hpp"
+
+using namespace std::chrono_literals;
+
+// direct I/O requires buffers, offsets, and lengths that are multiples of the device block size;
+// 4096 bytes is sufficient for all common devices
+constexpr size_t direct_io_alignment = 4096;
+constexpr size_t block_granularity   = direct_io_alignment / sizeof(std::complex<int16_t>);
+
+// sample buffers are aligned to at least direct_io_alignment
+using rx_ring = sample_ring<std::complex<int16_t>, sample_allocator<std::complex<int16_t>>>;
+
+struct rx_counters {
+    std::atomic<size_t> n_received{0};
+    std::atomic<size_t> n_dropped{0};
+    std::atomic<size_t> n_written{0};
+    std::atomic<bool> write_error{false};
+};
+
+// runs on a pinned thread: moves data from the radio into the ring, never waiting for the writer
+static void receive_to_ring(vxsdr* radio, const size_t n_total, const int cpu, rx_ring& ring, rx_counters& counts) {
+    if (not set_current_thread_affinity(cpu)) {
+        std::cerr << "unable to set receive thread affinity to cpu " << cpu << std::endl;
+    }
+    // if the ring is full, data must still be taken from the radio to avoid stalling the network threads
+    sample_vector discard(ring.block_size());
+    size_t n_recv = 0;
+    while (n_recv < n_total) {
+        auto block     = ring.try_write_block();
+        bool is_full   = block.empty();
+        auto dest      = is_full ? std::span<std::complex<int16_t>>(discard) : block;
+        size_t n_block = std::min(dest.size(), n_total - n_recv);
+        size_t n_fill  = 0;
+        while (n_fill < n_block) {
+            size_t n = radio->get_rx_data(dest.subspan(n_fill, n_block - n_fill));
+            if (n == 0) {
+                break;
+            }
+            n_fill += n;
+        }
+        if (is_full) {
+            counts.n_dropped += n_fill;
+        } else {
+            ring.commit_write(n_fill);
+        }
+        n_recv += n_fill;
+        counts.n_received = n_recv;
+        if (n_fill < n_block) {
+            std::cerr << "timeout receiving data (" << n_recv << " of " << n_total << " samples received)" << std::endl;
+            break;
+        }
+    }
+    ring.close();
+}
+
+// drains the ring with large writes; with direct I/O every write is a whole, aligned block
+static void write_from_ring(const int fd, const bool direct_io, rx_ring& ring, rx_counters& counts) {
+    while (true) {
+        auto block = ring.read_block();
+        if (block.empty()) {
+            break;
+        }
+        if (counts.write_error) {
+            // keep draining after an error so the receiver is never blocked
+            ring.release_read();
+            continue;
+        }
+        // a short final block is padded out for direct I/O, and the file is truncated afterwards
+        size_t n_bytes = sizeof(std::complex<int16_t>) * (direct_io ? ring.block_size() : block.size());
+        const auto* p  = reinterpret_cast<const char*>(block.data());
+        size_t n_done  = 0;
+        while (n_done < n_bytes) {
+            ssize_t n = write(fd, p + n_done, n_bytes - n_done);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "error writing rx data file" << std::endl;
+                counts.write_error = true;
+                break;
+            }
+            n_done += (size_t)n;
+        }
+        ring.release_read();
+        if (counts.write_error) {
+            continue;
+        }
+        counts.n_written += block.size();
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::cout << argv[0] << " started" << std::endl;
+
+        // set up options and read from command line and/or configuration file
+        option_utils::program_options desc("vxsdr_rx_file", "test receive to a file");
+
+        add_common_options(desc);
+        add_network_options(desc);
+        add_rx_1ch_options(desc);
+
+        desc.add_option("rx_file", "output file name (the default is prefix, start time, suffix)",
+                        option_utils::supported_types::STRING);
+        desc.add_option("rx_ring_blocks", "number of blocks buffered between the receiver and the file writer",
+                        option_utils::supported_types::INTEGER, false, "256");
+        desc.add_option("rx_block_samples", "number of samples in each file write (rounded up to a multiple of 1024)",
+                        option_utils::supported_types::INTEGER, false, "262144");
+        desc.add_option("rx_thread_cpu", "CPU for the receiving thread (set to a negative number to not use CPU affinity)",
+                        option_utils::supported_types::INTEGER, false, "-1");
+        desc.add_flag("rx_direct_io", "bypass the page cache when writing the file (O_DIRECT)", false, true);
+
+        auto vm = desc.parse(argc, argv);
+        set_buffer_options(vm);
+        if (set_trace_options(vm) != 0) {
+            return 1;
+        }
+
+        auto duration_sec = vm["duration"].as<double>();
+        if (duration_sec <= 0.0) {
+            std::cerr << "duration must be positive" << std::endl;
+            return 1;
+        }
+
+        auto ring_blocks   = vm["rx_ring_blocks"].as<size_t>();
+        auto block_samples = vm["rx_block_samples"].as<size_t>();
+        if (block_samples == 0 or ring_blocks < 2) {
+            std::cerr << "rx_block_samples must be positive and rx_ring_blocks must be at least 2" << std::endl;
+            return 1;
+        }
+        block_samples = block_granularity * ((block_samples + block_granularity - 1) / block_granularity);
+
+        // set up the radio using settings from command line arguments
+        auto radio = std::make_unique<vxsdr>(get_radio_settings(vm));
+
+        set_common_options(vm, radio);
+        set_network_options(vm, radio);
+        set_rx_1ch_options(vm, radio);
+
+        double rate = radio->get_rx_rate().value_or(-1);
+        if (rate <= 0) {
+            std::cerr << "unable to get rx rate" << std::endl;
+            return 1;
+        }
+        size_t n_total = std::llround(duration_sec * rate);
+
+        auto t1 = radio->get_time_now();
+        if (t1.has_value()) {
+            std::cout << "radio time: " << format_time(t1.value()) << std::endl;
+        } else {
+            std::cerr << "unable to get radio time" << std::endl;
+            return 1;
+        }
+
+        // start 1-2 seconds in the future
+        auto t_start = std::chrono::ceil<std::chrono::seconds>(t1.value()) + 1s;
+
+        std::string file_name;
+        if (vm.count("rx_file") > 0) {
+            file_name = vm["rx_file"].as<std::string>();
+        } else {
+            file_name = vm["prefix"].as<std::string>() + format_time(t_start, "%Y%m%d_%H%M%S") + vm["suffix"].as<std::string>();
+        }
+
+        bool direct_io = vm["rx_direct_io"].as<bool>();
+        int open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        int fd         = open(file_name.c_str(), open_flags | (direct_io ? O_DIRECT : 0), 0644);
+        if (fd < 0 and direct_io and errno == EINVAL) {
+            // some filesystems (e.g. tmpfs) do not support direct I/O
+            std::cout << "direct I/O not supported for " << file_name << ", using buffered writes" << std::endl;
+            direct_io = false;
+            fd        = open(file_name.c_str(), open_flags, 0644);
+        }
+        if (fd < 0) {
+            std::cerr << "unable to open rx data file " << file_name << std::endl;
+            return 1;
+        }
+
+        std::cout << "using frequency " << radio->get_rx_freq().value_or(-1) << " Hz" << std::endl;
+        std::cout << "using rate      " << rate << " samples/s" << std::endl;
+        std::cout << "using rx_gain   " << radio->get_rx_gain().value_or(-1) << " dB" << std::endl;
+        std::cout << "using duration  " << duration_sec << " s" << std::endl;
+        std::cout << "using file      " << file_name << std::endl;
+        std::cout << "start time: " << format_time(t_start) << std::endl;
+
+        rx_ring ring(ring_blocks, block_samples);
+        rx_counters counts;
+
+        std::thread writer(write_from_ring, fd, direct_io, std::ref(ring), std::ref(counts));
+        ring_thread_guard writer_guard(ring, writer);
+
+        if (not radio->rx_start(t_start, n_total)) {
+            std::cerr << "rx_start() failed" << std::endl;
+            ring.close();
+            writer.join();
+            close(fd);
+            return 1;
+        }
+
+        std::thread receiver(receive_to_ring, radio.get(), n_total, vm["rx_thread_cpu"].as<int>(), std::ref(ring),
+                             std::ref(counts));
+        receiver.join();
+        writer.join();
+
+        if (direct_io and ftruncate(fd, (off_t)(sizeof(std::complex<int16_t>) * counts.n_written)) != 0) {
+            std::cerr << "error truncating rx data file" << std::endl;
+        }
+        close(fd);
+
+        std::cout << "samples received:      " << counts.n_received << std::endl;
+        std::cout << "samples written:       " << counts.n_written << std::endl;
+        std::cout << "samples dropped:       " << counts.n_dropped << std::endl;
+        std::cout << "ring high water:       " << ring.max_blocks_used() << " of " << ring.capacity() << " blocks ("
+                  << std::lround(100.0 * (double)ring.max_blocks_used() / (double)ring.capacity()) << "%)" << std::endl;
+        if (counts.n_dropped > 0) {
+            std::cerr << "ring overflowed -- increase rx_ring_blocks or use faster storage" << std::endl;
+        }
+        if (counts.write_error or counts.n_dropped > 0 or counts.n_received != n_total) {
+            std::cerr << "receive incomplete" << std::endl;
+            return 1;
+        }
+
+        std::cout << "receive complete" << std::endl;
+    } catch (std::exception& e) {
+        std::cerr << "exception caught: " << e.what() << std::endl;
+        return 3;
+    }
+}
@@ -0,0 +1,526 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides a real-time spectrum monitor: received blocks are shared among a pool of workers
+// which compute overlapping Hann-windowed FFTs, and averaged and max-hold spectra are output
+// at a fixed frame rate
+//
+// The receiver copies the end of each block to the start of the next, so the FFTs overlap
+// across blocks. Each worker accumulates into its own spectra for each frame, so no locks are
+// taken per FFT; when the last block of a frame is done, the main thread combines the workers'
+// spectra and outputs the frame. Frames are summarized on the console, and can be written to
+// --spectrum_file as float32 values: for each frame, --spectrum_bins average powers and then
+// --spectrum_bins max-hold powers, in dB relative to full scale, from the lowest frequency up.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <numbers>
+#include <span>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+#include "aligned_allocator.hpp"
+#include "fft.hpp"
+#include "host_radio_options.hpp"
+#include "sample_buffer.hpp"
+#include "utility.hpp"
+
+using namespace std::chrono_literals;
+
+static std::atomic<bool> stop_requested{false};
+
+static void signal_handler(int /*signal*/) {
+    stop_requested = true;
+}
+
+// frames use one of a few accumulator slots in turn, so a slow output only costs whole frames
+constexpr size_t n_slots = 8;
+
+struct spectrum_settings {
+    uint64_t n_total        = 0;  // zero to receive until stopped
+    size_t fft_size         = 0;
+    size_t hop              = 0;  // samples between the starts of successive FFTs
+    size_t ffts_per_block   = 0;
+    size_t block_len        = 0;  // samples in a block, including the overlap with the previous block
+    size_t advance          = 0;  // new samples in each block
+    size_t blocks_per_frame = 0;
+    int cpu                 = -1;
+};
+
+struct spectrum_accumulator {
+    std::vector<float> sum;
+    std::vector<float> max;
+    size_t n_ffts = 0;
+};
+
+struct spectrum_pipeline {
+    std::vector<sample_vector> blocks;
+    std::vector<uint64_t> block_frame;
+
+    // free blocks are only taken by the receiver, which never waits for one
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<size_t> free_blocks;
+    std::deque<size_t> full_blocks;
+    bool closed = false;
+
+    // accumulators are indexed by [worker][slot]
+    std::vector<std::vector<spectrum_accumulator>> acc;
+    std::array<std::atomic<int64_t>, n_slots> slot_frame;  // frame using each slot, or -1 if free
+    std::array<std::atomic<size_t>, n_slots> slot_blocks_done;
+
+    std::mutex frame_mutex;
+    std::condition_variable frame_cv;
+    std::deque<std::pair<uint64_t, bool>> frames_done;  // frame, and whether it was skipped
+    bool frames_closed = false;
+
+    std::atomic<uint64_t> n_received{0};
+    std::atomic<size_t> n_dropped_blocks{0};
+    std::atomic<size_t> n_dropped_frames{0};
+};
+
+// counts a block of a frame as done; the frame is output once all of its blocks are done
+static void block_done(spectrum_pipeline& sp, const spectrum_settings& ss, const uint64_t frame) {
+    if (sp.slot_blocks_done[frame % n_slots].fetch_add(1, std::memory_order_acq_rel) + 1 == ss.blocks_per_frame) {
+        std::lock_guard<std::mutex> lock(sp.frame_mutex);
+        sp.frames_done.emplace_back(frame, false);
+        sp.frame_cv.notify_one();
+    }
+}
+
+// runs on a pinned thread: fills blocks from the radio, dropping them if no worker is free
+static void receive_blocks(vxsdr* radio, const spectrum_settings& ss, spectrum_pipeline& sp) {
+    if (not set_current_thread_affinity(ss.cpu)) {
+        std::cerr << "unable to set receive thread affinity to cpu " << ss.cpu << std::endl;
+    }
+    const size_t n_overlap = ss.block_len - ss.advance;
+    sample_vector discard(ss.block_len);
+    sample_vector tail(n_overlap);
+    bool have_tail  = false;
+    uint64_t n_recv = 0;
+    bool frame_used = false;
+    for (uint64_t j = 0; (ss.n_total == 0 or n_recv < ss.n_total) and not stop_requested; j++) {
+        uint64_t frame = j / ss.blocks_per_frame;
+        if (j % ss.blocks_per_frame == 0) {
+            // a frame can only start once the frame that last used its slot has been output
+            int64_t expected = -1;
+            frame_used       = sp.slot_frame[frame % n_slots].compare_exchange_strong(expected, (int64_t)frame);
+            if (frame_used) {
+                sp.slot_blocks_done[frame % n_slots] = 0;
+            } else {
+                sp.n_dropped_frames++;
+                std::lock_guard<std::mutex> lock(sp.frame_mutex);
+                sp.frames_done.emplace_back(frame, true);
+                sp.frame_cv.notify_one();
+            }
+        }
+
+        size_t k = 0;
+        {
+            std::lock_guard<std::mutex> lock(sp.mutex);
+            if (frame_used and not sp.free_blocks.empty()) {
+                k = sp.free_blocks.front();
+                sp.free_blocks.pop_front();
+            } else {
+                k = sp.blocks.size();
+            }
+        }
+        bool dropped = k == sp.blocks.size();
+        std::span<std::complex<int16_t>> block(dropped ? discard : sp.blocks[k]);
+
+        // the end of the previous block starts this one, so only the new samples are received
+        size_t n_fill = 0;
+        if (have_tail) {
+            std::copy(tail.begin(), tail.end(), block.begin());
+            n_fill = n_overlap;
+        }
+        // the last block of a finite capture only asks for the samples the radio has left to send
+        size_t n_want = ss.block_len;
+        if (ss.n_total > 0) {
+            n_want = (size_t)std::min<uint64_t>(n_want, n_fill + (ss.n_total - n_recv));
+        }
+        while (n_fill < n_want) {
+            size_t n = radio->get_rx_data(block.subspan(n_fill, n_want - n_fill));
+            if (n == 0) {
+                break;
+            }
+            n_recv += n;
+            n_fill += n;
+        }
+        sp.n_received = n_recv;
+        if (n_fill < ss.block_len) {
+            // a short block at the end of the capture is not an error, but is too short to process
+            if (n_fill < n_want) {
+                std::cerr << "timeout receiving data (" << n_recv << " samples received)" << std::endl;
+            }
+            if (not dropped) {
+                std::lock_guard<std::mutex> lock(sp.mutex);
+                sp.free_blocks.push_back(k);
+            }
+            break;
+        }
+        std::copy(block.end() - (ptrdiff_t)n_overlap, block.end(), tail.begin());
+        have_tail = true;
+
+        if (dropped) {
+            if (frame_used) {
+                sp.n_dropped_blocks++;
+                block_done(sp, ss, frame);
+            }
+        } else {
+            std::lock_guard<std::mutex> lock(sp.mutex);
+            sp.block_frame[k] = frame;
+            sp.full_blocks.push_back(k);
+            sp.cv.notify_one();
+        }
+    }
+    std::lock_guard<std::mutex> lock(sp.mutex);
+    sp.closed = true;
+    sp.cv.notify_all();
+}
+
+// computes the windowed FFTs of blocks and accumulates their power spectra
+static void process_blocks(const unsigned worker,
+                           const spectrum_settings& ss,
+                           const fft_plan& fft,
+                           const std::vector<float>& window,
+                           spectrum_pipeline& sp,
+                           double& busy_sec) {
+    std::vector<std::complex<float>, aligned_allocator<std::complex<float>, fft_alignment>> buf(ss.fft_size);
+    auto* z = reinterpret_cast<float*>(buf.data());
+    while (true) {
+        size_t k = 0;
+        {
+            std::unique_lock<std::mutex> lock(sp.mutex);
+            sp.cv.wait(lock, [&]() { return not sp.full_blocks.empty() or sp.closed; });
+            if (sp.full_blocks.empty()) {
+                return;
+            }
+            k = sp.full_blocks.front();
+            sp.full_blocks.pop_front();
+        }
+        auto t0       = std::chrono::steady_clock::now();
+        uint64_t f    = sp.block_frame[k];
+        auto& acc     = sp.acc[worker][f % n_slots];
+        float* sum    = acc.sum.data();
+        float* max    = acc.max.data();
+        const auto* x = reinterpret_cast<const int16_t*>(sp.blocks[k].data());
+        for (size_t m = 0; m < ss.ffts_per_block; m++) {
+            const int16_t* xm = x + 2 * m * ss.hop;
+            for (size_t i = 0; i < 2 * ss.fft_size; i++) {
+                z[i] = window[i / 2] * (float)xm[i];
+            }
+            fft.forward(buf.data());
+            for (size_t i = 0; i < ss.fft_size; i++) {
+                float p = z[2 * i] * z[2 * i] + z[2 * i + 1] * z[2 * i + 1];
+                sum[i] += p;
+                max[i] = std::max(max[i], p);
+            }
+        }
+        acc.n_ffts += ss.ffts_per_block;
+        {
+            std::lock_guard<std::mutex> lock(sp.mutex);
+            sp.free_blocks.push_back(k);
+        }
+        busy_sec += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        block_done(sp, ss, f);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::cout << argv[0] << " started" << std::endl;
+
+        // set up options and read from command line and/or configuration file
+        option_utils::program_options desc("vxsdr_rx_spectrum", "real-time receive spectrum monitor");
+
+        add_common_options(desc);
+        add_network_options(desc);
+        add_rx_1ch_options(desc);
+
+        // clang-format off
+        desc.add_option("fft_size", "number of points in each FFT (a power of two)", option_utils::supported_types::INTEGER, false, "4096");
+        desc.add_option("fft_overlap", "fraction of each FFT overlapping the next", option_utils::supported_types::REAL, false, "0.5");
+        desc.add_option("ffts_per_block", "number of FFTs in each block given to a worker", option_utils::supported_types::INTEGER, false, "32");
+        desc.add_option("spectrum_workers", "number of FFT worker threads (0 for one less than the number of CPUs)", option_utils::supported_types::INTEGER, false, "0");
+        desc.add_option("spectrum_pool_blocks", "number of blocks shared between the receiver and the workers", option_utils::supported_types::INTEGER, false, "64");
+        desc.add_option("frame_rate", "spectrum frames output per second", option_utils::supported_types::REAL, false, "10.0");
+        desc.add_option("spectrum_bins", "number of frequency bins in each output frame (a power of two, at most fft_size)", option_utils::supported_types::INTEGER, false, "512");
+        desc.add_option("spectrum_file", "file to which the output frames are written as float32", option_utils::supported_types::STRING);
+        desc.add_option("rx_thread_cpu", "CPU for the receiving thread (set to a negative number to not use CPU affinity)", option_utils::supported_types::INTEGER, false, "-1");
+        // clang-format on
+
+        auto vm = desc.parse(argc, argv);
+        set_buffer_options(vm);
+        if (set_trace_options(vm) != 0) {
+            return 1;
+        }
+
+        // a duration of zero receives until interrupted
+        auto duration_sec = vm["duration"].as<double>();
+        auto overlap      = vm["fft_overlap"].as<double>();
+        auto frame_rate   = vm["frame_rate"].as<double>();
+        if (duration_sec < 0.0 or overlap < 0.0 or overlap >= 1.0 or frame_rate <= 0.0) {
+            std::cerr << "duration must be nonnegative, fft_overlap in [0, 1), and frame_rate positive" << std::endl;
+            return 1;
+        }
+
+        spectrum_settings ss;
+        ss.fft_size       = vm["fft_size"].as<size_t>();
+        ss.ffts_per_block = vm["ffts_per_block"].as<size_t>();
+        ss.cpu            = vm["rx_thread_cpu"].as<int>();
+        auto n_bins       = vm["spectrum_bins"].as<size_t>();
+        auto pool_blocks  = vm["spectrum_pool_blocks"].as<size_t>();
+        auto n_workers    = vm["spectrum_workers"].as<unsigned>();
+        if (n_workers == 0) {
+            n_workers = std::max(2U, std::thread::hardware_concurrency()) - 1;
+        }
+        if (ss.fft_size < 2 or (ss.fft_size & (ss.fft_size - 1)) != 0 or n_bins == 0 or (n_bins & (n_bins - 1)) != 0
+            or n_bins > ss.fft_size or ss.ffts_per_block == 0 or pool_blocks < 2) {
+            std::cerr << "fft_size and spectrum_bins must be powers of two with spectrum_bins no more than fft_size, "
+                      << "ffts_per_block positive, and spectrum_pool_blocks at least 2" << std::endl;
+            return 1;
+        }
+        ss.hop       = std::max<size_t>(1, std::llround((double)ss.fft_size * (1.0 - overlap)));
+        ss.block_len = (ss.ffts_per_block - 1) * ss.hop + ss.fft_size;
+        ss.advance   = ss.ffts_per_block * ss.hop;
+
+        std::ofstream spectrum_file;
+        if (vm.count("spectrum_file") > 0) {
+            spectrum_file.open(vm["spectrum_file"].as<std::string>(), std::ios::binary | std::ios::trunc);
+            if (not spectrum_file.is_open()) {
+                std::cerr << "unable to open spectrum file " << vm["spectrum_file"].as<std::string>() << std::endl;
+                return 1;
+            }
+        }
+
+        // set up the radio using settings from command line arguments
+        auto radio = std::make_unique<vxsdr>(get_radio_settings(vm));
+
+        set_common_options(vm, radio);
+        set_network_options(vm, radio);
+        set_rx_1ch_options(vm, radio);
+
+        double rate = radio->get_rx_rate().value_or(-1);
+        double freq = radio->get_rx_freq().value_or(0);
+        if (rate <= 0) {
+            std::cerr << "unable to get rx rate" << std::endl;
+            return 1;
+        }
+        ss.n_total          = std::llround(duration_sec * rate);
+        ss.blocks_per_frame = std::max<size_t>(1, std::llround(rate / frame_rate / (double)ss.advance));
+
+        // the window is scaled so a full-scale tone at a bin center has a power of 1 (0 dBFS)
+        std::vector<double> hann(ss.fft_size);
+        double window_sum = 0;
+        for (size_t i = 0; i < ss.fft_size; i++) {
+            hann[i] = 0.5 * (1 - std::cos(2 * std::numbers::pi * (double)i / (double)ss.fft_size));
+            window_sum += hann[i];
+        }
+        std::vector<float> window(ss.fft_size);
+        for (size_t i = 0; i < ss.fft_size; i++) {
+            window[i] = (float)(hann[i] / (32767.0 * window_sum));
+        }
+        fft_plan fft(ss.fft_size);
+
+        spectrum_pipeline sp;
+        sp.blocks.assign(pool_blocks, sample_vector(ss.block_len));
+        sp.block_frame.assign(pool_blocks, 0);
+        for (size_t k = 0; k < pool_blocks; k++) {
+            sp.free_blocks.push_back(k);
+        }
+        sp.acc.resize(n_workers);
+        for (auto& w : sp.acc) {
+            w.resize(n_slots);
+            for (auto& a : w) {
+                a.sum.assign(ss.fft_size, 0.0F);
+                a.max.assign(ss.fft_size, 0.0F);
+            }
+        }
+        for (size_t s = 0; s < n_slots; s++) {
+            sp.slot_frame[s]       = -1;
+            sp.slot_blocks_done[s] = 0;
+        }
+
+        auto t1 = radio->get_time_now();
+        if (t1.has_value()) {
+            std::cout << "radio time: " << format_time(t1.value()) << std::endl;
+        } else {
+            std::cerr << "unable to get radio time" << std::endl;
+            return 1;
+        }
+
+        // start 1-2 seconds in the future
+        auto t_start = std::chrono::ceil<std::chrono::seconds>(t1.value()) + 1s;
+        double frame_sec = (double)(ss.blocks_per_frame * ss.advance) / rate;
+
+        std::cout << "using frequency " << freq << " Hz" << std::endl;
+        std::cout << "using rate      " << rate << " samples/s" << std::endl;
+        std::cout << "using rx_gain   " << radio->get_rx_gain().value_or(-1) << " dB" << std::endl;
+        std::cout << "using FFT       " << ss.fft_size << " points (" << fft_plan::implementation() << "), hop " << ss.hop
+                  << ", " << n_workers << " workers" << std::endl;
+        std::cout << "using frames    " << 1 / frame_sec << " per second (" << ss.blocks_per_frame * ss.ffts_per_block
+                  << " FFTs each)" << std::endl;
+        std::cout << "start time: " << format_time(t_start) << std::endl;
+
+        std::signal(SIGINT, signal_handler);
+        std::signal(SIGTERM, signal_handler);
+
+        if (not radio->rx_start(t_start, ss.n_total)) {
+            std::cerr << "rx_start() failed" << std::endl;
+            return 1;
+        }
+
+        std::vector<double> busy_sec(n_workers, 0.0);
+        std::vector<std::thread> workers;
+        for (unsigned w = 0; w < n_workers; w++) {
+            workers.emplace_back(process_blocks, w, std::cref(ss), std::cref(fft), std::cref(window), std::ref(sp),
+                                 std::ref(busy_sec[w]));
+        }
+        auto t_run = std::chrono::steady_clock::now();
+        std::thread receiver(receive_blocks, radio.get(), std::cref(ss), std::ref(sp));
+
+        // output frames as they are completed, until the receiver and workers are done
+        std::thread joiner([&]() {
+            receiver.join();
+            for (auto& w : workers) {
+                w.join();
+            }
+            std::lock_guard<std::mutex> lock(sp.frame_mutex);
+            sp.frames_closed = true;
+            sp.frame_cv.notify_one();
+        });
+
+        const size_t group = ss.fft_size / n_bins;
+        std::vector<float> avg_out(n_bins);
+        std::vector<float> max_out(n_bins);
+        std::vector<float> sum(ss.fft_size);
+        std::vector<float> max(ss.fft_size);
+        size_t n_frames     = 0;
+        uint64_t next_frame = 0;
+        std::map<uint64_t, bool> ready;
+        while (true) {
+            // workers can finish frames out of order, so they are held until the earlier ones are done
+            if (ready.empty() or ready.begin()->first != next_frame) {
+                std::unique_lock<std::mutex> lock(sp.frame_mutex);
+                sp.frame_cv.wait(lock, [&]() { return not sp.frames_done.empty() or sp.frames_closed; });
+                if (sp.frames_done.empty()) {
+                    break;
+                }
+                ready.insert(sp.frames_done.begin(), sp.frames_done.end());
+                sp.frames_done.clear();
+                continue;
+            }
+            uint64_t f   = next_frame++;
+            bool skipped = ready.begin()->second;
+            ready.erase(ready.begin());
+            if (skipped) {
+                continue;
+            }
+
+            // combine the workers' spectra for the frame, and clear them for the next use of the slot
+            std::fill(sum.begin(), sum.end(), 0.0F);
+            std::fill(max.begin(), max.end(), 0.0F);
+            size_t n_ffts = 0;
+            for (auto& w : sp.acc) {
+                auto& a = w[f % n_slots];
+                for (size_t i = 0; i < ss.fft_size; i++) {
+                    sum[i] += a.sum[i];
+                    max[i] = std::max(max[i], a.max[i]);
+                }
+                n_ffts += a.n_ffts;
+                std::fill(a.sum.begin(), a.sum.end(), 0.0F);
+                std::fill(a.max.begin(), a.max.end(), 0.0F);
+                a.n_ffts = 0;
+            }
+            sp.slot_frame[f % n_slots].store(-1, std::memory_order_release);
+            if (n_ffts == 0) {
+                continue;
+            }
+
+            // reorder from the lowest frequency up, and reduce to the output bins; the peak is
+            // found at full resolution
+            size_t peak = 0;
+            for (size_t b = 0; b < n_bins; b++) {
+                double s = 0;
+                float m  = 0;
+                for (size_t i = b * group; i < (b + 1) * group; i++) {
+                    size_t k = (i + ss.fft_size / 2) % ss.fft_size;
+                    s += sum[k];
+                    m = std::max(m, max[k]);
+                    if (sum[k] > sum[(peak + ss.fft_size / 2) % ss.fft_size]) {
+                        peak = i;
+                    }
+                }
+                avg_out[b] = (float)(10 * std::log10(std::max(s / (double)(group * n_ffts), 1e-30)));
+                max_out[b] = 10 * std::log10(std::max(m, 1e-30F));
+            }
+            size_t k_peak = (peak + ss.fft_size / 2) % ss.fft_size;
+            std::vector<float> sorted(avg_out);
+            std::nth_element(sorted.begin(), sorted.begin() + (ptrdiff_t)(n_bins / 2), sorted.end());
+
+            n_frames++;
+            auto t_frame = t_start + std::chrono::nanoseconds(std::llround(1e9 * (double)f * frame_sec));
+            double peak_freq = freq + ((double)peak - (double)(ss.fft_size / 2)) * rate / (double)ss.fft_size;
+            double peak_avg  = 10 * std::log10(std::max(sum[k_peak] / (double)n_ffts, 1e-30));
+            double peak_max  = 10 * std::log10(std::max(max[k_peak], 1e-30F));
+            std::stringstream summary;
+            summary << std::fixed << std::setprecision(1) << ": peak " << peak_avg << " dBFS at " << std::setprecision(0)
+                    << peak_freq << " Hz, max hold " << std::setprecision(1) << peak_max << " dBFS, median " << sorted[n_bins / 2]
+                    << " dBFS";
+            std::cout << format_time(t_frame) << summary.str() << std::endl;
+            if (spectrum_file.is_open()) {
+                spectrum_file.write(reinterpret_cast<const char*>(avg_out.data()), (std::streamsize)(n_bins * sizeof(float)));
+                spectrum_file.write(reinterpret_cast<const char*>(max_out.data()), (std::streamsize)(n_bins * sizeof(float)));
+            }
+        }
+        joiner.join();
+        double run_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_run).count();
+        if (stop_requested) {
+            radio->rx_stop();
+        }
+
+        // headroom is how many times faster than the sample rate the workers could go
+        double total_busy = 0;
+        for (auto b : busy_sec) {
+            total_busy += b;
+        }
+        double processed   = (double)sp.n_received - (double)(sp.n_dropped_blocks * ss.advance);
+        double worker_rate = processed / std::max(total_busy, 1e-9);
+        std::cout << "samples received:      " << sp.n_received << std::endl;
+        std::cout << "frames output:         " << n_frames << std::endl;
+        std::cout << "blocks dropped:        " << sp.n_dropped_blocks << std::endl;
+        std::cout << "frames dropped:        " << sp.n_dropped_frames << std::endl;
+        std::cout << "worker busy:           " << 100.0 * total_busy / std::max(run_sec * n_workers, 1e-9) << "%" << std::endl;
+        std::cout << "processing rate:       " << 1e-6 * worker_rate << " Msamples/s per worker" << std::endl;
+        std::cout << "processing headroom:   " << worker_rate * n_workers / rate << "x the sample rate" << std::endl;
+        if (sp.n_dropped_blocks > 0 or sp.n_dropped_frames > 0) {
+            std::cerr << "processing fell behind -- increase spectrum_workers or spectrum_pool_blocks, or reduce fft_overlap"
+                      << std::endl;
+            return 1;
+        }
+
+        std::cout << "receive complete" << std::endl;
+    } catch (std::exception& e) {
+        std::cerr << "exception caught: " << e.what() << std::endl;
+        return 3;
+    }
+}
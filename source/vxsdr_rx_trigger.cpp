@@ -0,0 +1,403 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides an example of long-running receive which keeps the most recent samples in memory
+// and writes only the samples around detected events to files
+//
+// Every block received is checked by a power detector; when the mean power of a block is above
+// --trigger_threshold (in dB relative to full scale), the first sample above the threshold is
+// the trigger, and the samples from --trigger_pre_sec before it to --trigger_post_sec after it
+// are written to a file named with the radio time of the first sample written; if that file
+// already exists, _1, _2, ... is added to the name, so no file is ever overwritten. Files are
+// written straight from the history ring by a separate thread, so memory use is fixed and the
+// receiver never waits for the disk; an event whose samples are overwritten before they are
+// written out, or which arrives while too many events are waiting, is counted as lost.
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <span>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <vxsdr.hpp>
+
+#include "host_radio_options.hpp"
+#include "sample_buffer.hpp"
+#include "utility.hpp"
+
+using namespace std::chrono_literals;
+
+static std::atomic<bool> stop_requested{false};
+
+static void signal_handler(int /*signal*/) {
+    stop_requested = true;
+}
+
+struct trigger_settings {
+    uint64_t n_total     = 0;  // zero to receive until stopped
+    size_t block_samples = 0;
+    size_t n_pre         = 0;
+    size_t n_post        = 0;
+    size_t n_holdoff     = 0;
+    size_t max_pending   = 0;
+    double threshold     = 0;  // mean |x|^2 in int16 units
+    int cpu              = -1;
+};
+
+struct trigger_event {
+    uint64_t trigger_sample = 0;
+    double power_db         = 0;
+};
+
+// events are passed from the receiver to the writer through a short fixed-length queue
+struct event_queue {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<trigger_event> events;
+    bool closed = false;
+};
+
+struct trigger_counters {
+    std::atomic<uint64_t> n_received{0};
+    std::atomic<size_t> n_events{0};
+    std::atomic<size_t> n_written{0};
+    std::atomic<size_t> n_lost{0};
+    std::atomic<uint64_t> bytes_written{0};
+};
+
+// returns the sum of |x|^2 over the block; this loop is vectorized by the compiler
+static uint64_t block_energy(std::span<const std::complex<int16_t>> x) {
+    const auto* v = reinterpret_cast<const int16_t*>(x.data());
+    uint64_t sum  = 0;
+    for (size_t i = 0; i < 2 * x.size(); i++) {
+        int32_t a = v[i];
+        sum += (uint32_t)(a * a);
+    }
+    return sum;
+}
+
+// runs on a pinned thread: fills the history ring from the radio and queues an event whenever
+// the detector triggers
+static void receive_with_trigger(vxsdr* radio,
+                                 const trigger_settings& ts,
+                                 sample_vector& history,
+                                 event_queue& queue,
+                                 trigger_counters& counts) {
+    if (not set_current_thread_affinity(ts.cpu)) {
+        std::cerr << "unable to set receive thread affinity to cpu " << ts.cpu << std::endl;
+    }
+    constexpr double full_scale = 32767.0 * 32767.0;
+    uint64_t n_recv             = 0;
+    uint64_t next_allowed       = 0;
+    while ((ts.n_total == 0 or n_recv < ts.n_total) and not stop_requested) {
+        // the history is a whole number of blocks, so a block never wraps around the end
+        size_t n_block = ts.block_samples;
+        if (ts.n_total > 0) {
+            n_block = std::min<uint64_t>(n_block, ts.n_total - n_recv);
+        }
+        auto dest     = std::span(history).subspan(n_recv % history.size(), n_block);
+        size_t n_fill = 0;
+        while (n_fill < n_block) {
+            size_t n = radio->get_rx_data(dest.subspan(n_fill, n_block - n_fill));
+            if (n == 0) {
+                break;
+            }
+            n_fill += n;
+        }
+        dest = dest.first(n_fill);
+
+        if (n_recv + n_fill > next_allowed and n_fill > 0
+            and (double)block_energy(dest) > ts.threshold * (double)n_fill) {
+            // the trigger is the first sample over the threshold, which must be in this block
+            size_t i = (next_allowed > n_recv) ? next_allowed - n_recv : 0;
+            for (; i < n_fill; i++) {
+                if ((double)block_energy(dest.subspan(i, 1)) > ts.threshold) {
+                    break;
+                }
+            }
+            if (i < n_fill) {
+                trigger_event ev{n_recv + i, 10 * std::log10((double)block_energy(dest) / (double)n_fill / full_scale)};
+                next_allowed = ev.trigger_sample + ts.n_post + ts.n_holdoff;
+                counts.n_events++;
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (queue.events.size() < ts.max_pending) {
+                    queue.events.push_back(ev);
+                    queue.cv.notify_one();
+                } else {
+                    counts.n_lost++;
+                }
+            }
+        }
+
+        n_recv += n_fill;
+        counts.n_received.store(n_recv, std::memory_order_release);
+        if (n_fill < n_block) {
+            std::cerr << "timeout receiving data (" << n_recv << " samples received)" << std::endl;
+            break;
+        }
+    }
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.closed = true;
+    queue.cv.notify_one();
+}
+
+// writes samples [first, first + n) from the history ring to fd; returns false on a write error
+static bool write_history(const int fd, const sample_vector& history, const uint64_t first, const size_t n) {
+    size_t n_done = 0;
+    while (n_done < n) {
+        size_t pos     = (first + n_done) % history.size();
+        size_t n_chunk = std::min(n - n_done, history.size() - pos);
+        const auto* p  = reinterpret_cast<const char*>(&history[pos]);
+        size_t n_bytes = sizeof(std::complex<int16_t>) * n_chunk;
+        size_t b_done  = 0;
+        while (b_done < n_bytes) {
+            ssize_t k = write(fd, p + b_done, n_bytes - b_done);
+            if (k < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            b_done += (size_t)k;
+        }
+        n_done += n_chunk;
+    }
+    return true;
+}
+
+// creates a new event file named stem + suffix, or stem_1 + suffix, stem_2 + suffix, ... if that exists
+// (from an earlier run, or an event starting at the same sample), so no file is overwritten; returns the fd
+static int create_event_file(const std::string& stem, const std::string& suffix, std::string& name) {
+    for (unsigned seq = 0;; seq++) {
+        name   = (seq == 0) ? stem + suffix : stem + "_" + std::to_string(seq) + suffix;
+        int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd >= 0 or errno != EEXIST) {
+            return fd;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::cout << argv[0] << " started" << std::endl;
+
+        // set up options and read from command line and/or configuration file
+        option_utils::program_options desc("vxsdr_rx_trigger", "receive continuously, writing only the samples around events");
+
+        add_common_options(desc);
+        add_network_options(desc);
+        add_rx_1ch_options(desc);
+
+        // clang-format off
+        desc.add_option("rx_history_sec", "seconds of the most recent samples kept in memory", option_utils::supported_types::REAL, false, "1.0");
+        desc.add_option("trigger_threshold", "mean power of a block in dB relative to full scale that starts an event", option_utils::supported_types::REAL, false, "-30.0");
+        desc.add_option("trigger_pre_sec", "seconds of samples written before each trigger", option_utils::supported_types::REAL, false, "0.01");
+        desc.add_option("trigger_post_sec", "seconds of samples written after each trigger", option_utils::supported_types::REAL, false, "0.01");
+        desc.add_option("trigger_holdoff_sec", "seconds after the end of an event before the next trigger is allowed", option_utils::supported_types::REAL, false, "0.0");
+        desc.add_option("detector_block_samples", "number of samples in each block checked by the detector", option_utils::supported_types::INTEGER, false, "4096");
+        desc.add_option("max_pending_events", "number of events that can wait to be written before more are lost", option_utils::supported_types::INTEGER, false, "16");
+        desc.add_option("event_log", "file to which a line is appended for each event written", option_utils::supported_types::STRING);
+        desc.add_option("rx_thread_cpu", "CPU for the receiving thread (set to a negative number to not use CPU affinity)", option_utils::supported_types::INTEGER, false, "-1");
+        // clang-format on
+
+        auto vm = desc.parse(argc, argv);
+        set_buffer_options(vm);
+        if (set_trace_options(vm) != 0) {
+            return 1;
+        }
+
+        // a duration of zero receives until interrupted
+        auto duration_sec = vm["duration"].as<double>();
+        auto history_sec  = vm["rx_history_sec"].as<double>();
+        auto pre_sec      = vm["trigger_pre_sec"].as<double>();
+        auto post_sec     = vm["trigger_post_sec"].as<double>();
+        auto holdoff_sec  = vm["trigger_holdoff_sec"].as<double>();
+        if (duration_sec < 0.0 or pre_sec < 0.0 or post_sec <= 0.0 or holdoff_sec < 0.0) {
+            std::cerr << "duration, trigger_pre_sec, and trigger_holdoff_sec must be nonnegative, and trigger_post_sec positive"
+                      << std::endl;
+            return 1;
+        }
+
+        trigger_settings ts;
+        ts.block_samples = vm["detector_block_samples"].as<size_t>();
+        ts.max_pending   = vm["max_pending_events"].as<size_t>();
+        ts.threshold     = 32767.0 * 32767.0 * std::pow(10.0, vm["trigger_threshold"].as<double>() / 10);
+        ts.cpu           = vm["rx_thread_cpu"].as<int>();
+        if (ts.block_samples == 0 or ts.max_pending == 0) {
+            std::cerr << "detector_block_samples and max_pending_events must be positive" << std::endl;
+            return 1;
+        }
+
+        // set up the radio using settings from command line arguments
+        auto radio = std::make_unique<vxsdr>(get_radio_settings(vm));
+
+        set_common_options(vm, radio);
+        set_network_options(vm, radio);
+        set_rx_1ch_options(vm, radio);
+
+        double rate = radio->get_rx_rate().value_or(-1);
+        if (rate <= 0) {
+            std::cerr << "unable to get rx rate" << std::endl;
+            return 1;
+        }
+        ts.n_total   = std::llround(duration_sec * rate);
+        ts.n_pre     = std::llround(pre_sec * rate);
+        ts.n_post    = std::llround(post_sec * rate);
+        ts.n_holdoff = std::llround(holdoff_sec * rate);
+
+        // the history must hold a whole event, with time to spare for writing it out
+        size_t n_history = ts.block_samples * (size_t)std::ceil(history_sec * rate / (double)ts.block_samples);
+        if (n_history < ts.n_pre + ts.n_post + 2 * ts.block_samples) {
+            std::cerr << "rx_history_sec must be longer than trigger_pre_sec plus trigger_post_sec" << std::endl;
+            return 1;
+        }
+        sample_vector history(n_history);
+
+        std::ofstream event_log;
+        if (vm.count("event_log") > 0) {
+            event_log.open(vm["event_log"].as<std::string>(), std::ios::app);
+            if (not event_log.is_open()) {
+                std::cerr << "unable to open event log " << vm["event_log"].as<std::string>() << std::endl;
+                return 1;
+            }
+        }
+
+        auto t1 = radio->get_time_now();
+        if (t1.has_value()) {
+            std::cout << "radio time: " << format_time(t1.value()) << std::endl;
+        } else {
+            std::cerr << "unable to get radio time" << std::endl;
+            return 1;
+        }
+
+        // start 1-2 seconds in the future
+        auto t_start = std::chrono::ceil<std::chrono::seconds>(t1.value()) + 1s;
+        auto sample_time = [&](uint64_t k) {
+            return t_start + std::chrono::duration_cast<vxsdr::duration>(std::chrono::duration<double>((double)k / rate));
+        };
+
+        std::cout << "using frequency " << radio->get_rx_freq().value_or(-1) << " Hz" << std::endl;
+        std::cout << "using rate      " << rate << " samples/s" << std::endl;
+        std::cout << "using rx_gain   " << radio->get_rx_gain().value_or(-1) << " dB" << std::endl;
+        std::cout << "using history   " << (double)n_history / rate << " s (" << n_history << " samples)" << std::endl;
+        std::cout << "start time: " << format_time(t_start) << std::endl;
+
+        std::signal(SIGINT, signal_handler);
+        std::signal(SIGTERM, signal_handler);
+
+        if (not radio->rx_start(t_start, ts.n_total)) {
+            std::cerr << "rx_start() failed" << std::endl;
+            return 1;
+        }
+
+        event_queue queue;
+        trigger_counters counts;
+        std::thread receiver(receive_with_trigger, radio.get(), std::cref(ts), std::ref(history), std::ref(queue),
+                             std::ref(counts));
+
+        // the samples before the oldest intact one may be being overwritten by the receiver
+        auto oldest_intact = [&]() {
+            uint64_t n = counts.n_received.load(std::memory_order_acquire) + ts.block_samples;
+            return (n > n_history) ? n - n_history : 0;
+        };
+
+        while (true) {
+            trigger_event ev;
+            {
+                std::unique_lock<std::mutex> lock(queue.mutex);
+                queue.cv.wait(lock, [&]() { return not queue.events.empty() or queue.closed; });
+                if (queue.events.empty()) {
+                    break;
+                }
+                ev = queue.events.front();
+                queue.events.pop_front();
+            }
+
+            // wait for the post-trigger samples, or the end of the stream
+            uint64_t first = (ev.trigger_sample > ts.n_pre) ? ev.trigger_sample - ts.n_pre : 0;
+            uint64_t last  = ev.trigger_sample + ts.n_post;
+            while (counts.n_received.load(std::memory_order_acquire) < last) {
+                std::unique_lock<std::mutex> lock(queue.mutex);
+                if (queue.closed) {
+                    break;
+                }
+                lock.unlock();
+                std::this_thread::sleep_for(1ms);
+            }
+            last = std::min<uint64_t>(last, counts.n_received.load(std::memory_order_acquire));
+
+            auto t_first       = sample_time(first);
+            auto t_trigger_str = format_time(sample_time(ev.trigger_sample));
+            std::string name;
+            int fd = create_event_file(vm["prefix"].as<std::string>() + format_time(t_first, "%Y%m%d_%H%M%S"),
+                                       vm["suffix"].as<std::string>(), name);
+            if (first < oldest_intact() or fd < 0 or not write_history(fd, history, first, last - first)) {
+                std::cerr << "unable to write event at " << t_trigger_str << " to " << name << std::endl;
+                counts.n_lost++;
+                if (fd >= 0) {
+                    close(fd);
+                    unlink(name.c_str());
+                }
+                continue;
+            }
+            close(fd);
+            // if the receiver caught up with the write, the start of the file may have been overwritten
+            if (first < oldest_intact()) {
+                std::cerr << "event at " << t_trigger_str << " was overwritten while being written" << std::endl;
+                counts.n_lost++;
+                unlink(name.c_str());
+                continue;
+            }
+
+            counts.n_written++;
+            counts.bytes_written += sizeof(std::complex<int16_t>) * (last - first);
+            // the power is formatted separately, so its precision does not carry over to later output
+            std::ostringstream power;
+            power << std::fixed << std::setprecision(1) << ev.power_db;
+            std::cout << "event at " << t_trigger_str << " (" << power.str() << " dBFS): " << last - first
+                      << " samples written to " << name << std::endl;
+            if (event_log.is_open()) {
+                event_log << t_trigger_str << " " << ev.power_db << " " << format_time(t_first) << " " << last - first << " "
+                          << name << std::endl;
+            }
+        }
+        receiver.join();
+        if (stop_requested) {
+            radio->rx_stop();
+        }
+
+        double received_sec = (double)counts.n_received / rate;
+        std::cout << "samples received:      " << counts.n_received << " (" << received_sec << " s)" << std::endl;
+        std::cout << "events detected:       " << counts.n_events << std::endl;
+        std::cout << "events written:        " << counts.n_written << std::endl;
+        std::cout << "events lost:           " << counts.n_lost << std::endl;
+        std::cout << "bytes written:         " << counts.bytes_written << " ("
+                  << 100.0 * (double)counts.bytes_written / std::max(1.0, (double)counts.n_received * sizeof(std::complex<int16_t>))
+                  << "% of the stream)" << std::endl;
+        if (counts.n_lost > 0) {
+            std::cerr << "events lost -- increase rx_history_sec or max_pending_events, or use faster storage" << std::endl;
+            return 1;
+        }
+
+        std::cout << "receive complete" << std::endl;
+    } catch (std::exception& e) {
+        std::cerr << "exception caught: " << e.what() << std::endl;
+        return 3;
+    }
+}
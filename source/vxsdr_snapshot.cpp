@@ -0,0 +1,157 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides a tool to save the settings of a radio to a snapshot file, and to restore them
+//
+// A restore reads the current settings and sends only the ones which differ from the snapshot
+// (see radio_snapshot.hpp), so switching a radio between saved setups takes a few command
+// round trips instead of a full setup. The time and clock source are not saved, since they
+// cannot be read from the radio.
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+#include "host_radio_options.hpp"
+#include "option_utils.hpp"
+#include "radio_config.hpp"
+#include "radio_snapshot.hpp"
+
+static void print_channel(const std::string& dir, const radio_channel_config& cfg) {
+    std::cout << "    " << dir << " " << (unsigned)cfg.subdev << ":" << (unsigned)cfg.channel;
+    if (cfg.rate.has_value()) {
+        std::cout << "  rate " << cfg.rate.value();
+    }
+    if (cfg.freq.has_value()) {
+        std::cout << "  freq " << cfg.freq.value();
+    }
+    if (cfg.gain.has_value()) {
+        std::cout << "  gain " << cfg.gain.value();
+    }
+    if (cfg.port_name.has_value()) {
+        std::cout << "  port " << cfg.port_name.value();
+    }
+    if (cfg.iq_bias.has_value()) {
+        std::cout << "  iq_bias (" << cfg.iq_bias->at(0) << "," << cfg.iq_bias->at(1) << ")";
+    }
+    if (cfg.iq_corr.has_value()) {
+        std::cout << "  iq_corr (" << cfg.iq_corr->at(0) << "," << cfg.iq_corr->at(1) << "," << cfg.iq_corr->at(2) << ","
+                  << cfg.iq_corr->at(3) << ")";
+    }
+    std::cout << std::endl;
+}
+
+static void print_report(const std::string& what, const radio_config_report& report) {
+    std::cout << what << ": " << report.n_commands << " commands in " << report.n_stages << " stages took "
+              << 1e3 * report.elapsed_sec << " ms";
+    if (report.n_failed > 0) {
+        std::cout << " (" << report.n_failed << " failed)";
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::cout << argv[0] << " started" << std::endl;
+
+        option_utils::program_options desc("vxsdr_snapshot", "save or restore the settings of a radio");
+
+        // clang-format off
+        desc.add_flag("help", "show help message");
+        desc.add_option("config_file", "configuration file name", option_utils::supported_types::STRING);
+        desc.add_option("save", "snapshot file to save the current settings to", option_utils::supported_types::STRING);
+        desc.add_option("restore", "snapshot file to restore the settings from", option_utils::supported_types::STRING);
+        desc.add_option("snapshot_channels", "channels to save as subdevice:channel, for example \"[0:0,1:0]\" (the default is channel 0 of every subdevice)",
+                        option_utils::supported_types::STRING);
+        desc.add_flag("dry_run", "with --restore, show the settings which differ without sending them", false, false);
+        desc.add_flag("config_parallel", "send independent radio commands concurrently (only if the library is thread-safe for them)", false, false);
+        // clang-format on
+
+        add_network_options(desc);
+
+        auto vm = desc.parse(argc, argv);
+
+        if ((vm.count("save") > 0) == (vm.count("restore") > 0)) {
+            std::cerr << "exactly one of --save or --restore is required" << std::endl;
+            return 1;
+        }
+        const bool parallel = vm["config_parallel"].as<bool>();
+
+        auto radio = std::make_unique<vxsdr>(get_radio_settings(vm));
+        set_network_options(vm, radio);
+
+        if (vm.count("save") > 0) {
+            std::vector<radio_channel_config> channels;
+            if (vm.count("snapshot_channels") > 0) {
+                channels = interpret_channel_list(vm["snapshot_channels"].as<std::string>(), "snapshot_channels");
+            } else {
+                unsigned n_subdevs = radio->get_num_subdevices().value_or(1);
+                for (unsigned sd = 0; sd < n_subdevs; sd++) {
+                    radio_channel_config cfg;
+                    cfg.subdev = (uint8_t)sd;
+                    channels.push_back(cfg);
+                }
+            }
+            radio_snapshot snapshot;
+            snapshot.tx = channels;
+            snapshot.rx = channels;
+            auto report = take_snapshot(radio, snapshot, parallel);
+            print_report("read settings", report);
+            if (not save_snapshot(vm["save"].as<std::string>(), snapshot)) {
+                return 1;
+            }
+            std::cout << "saved " << snapshot.tx.size() << " tx and " << snapshot.rx.size() << " rx channels of device "
+                      << snapshot.device_id << " to " << vm["save"].as<std::string>() << std::endl;
+            return (report.n_failed > 0) ? 2 : 0;
+        }
+
+        radio_snapshot snapshot;
+        if (not load_snapshot(vm["restore"].as<std::string>(), snapshot)) {
+            return 1;
+        }
+
+        if (vm["dry_run"].as<bool>()) {
+            radio_snapshot current;
+            current.tx = same_channels(snapshot.tx);
+            current.rx = same_channels(snapshot.rx);
+            print_report("read settings", take_snapshot(radio, current, parallel));
+            auto diff = snapshot_difference(snapshot, current);
+            if (not snapshot_device_matches(snapshot, current)) {
+                std::cout << "snapshot was taken on device " << snapshot.device_id << ", not this device (" << current.device_id
+                          << "), so its IQ bias and corrections would not be restored" << std::endl;
+            }
+            std::cout << "settings which differ from " << vm["restore"].as<std::string>() << ":" << std::endl;
+            for (const auto& cfg : diff.tx) {
+                if (count_settings(cfg) > 0) {
+                    print_channel("tx", cfg);
+                }
+            }
+            for (const auto& cfg : diff.rx) {
+                if (count_settings(cfg) > 0) {
+                    print_channel("rx", cfg);
+                }
+            }
+            return 0;
+        }
+
+        auto t0     = std::chrono::steady_clock::now();
+        auto report = restore_snapshot(radio, snapshot, parallel, "vxsdr_snapshot");
+        auto t1     = std::chrono::steady_clock::now();
+        print_report("read settings", report.read);
+        print_report("set tx", report.tx);
+        print_report("set rx", report.rx);
+        std::cout << "restored " << vm["restore"].as<std::string>() << " in "
+                  << 1e3 * std::chrono::duration<double>(t1 - t0).count() << " ms (" << report.tx.n_commands + report.rx.n_commands
+                  << " of " << report.n_settings << " settings sent)" << std::endl;
+        if (report.read.n_failed > 0 or report.tx.n_failed > 0 or report.rx.n_failed > 0) {
+            return 2;
+        }
+    } catch (std::exception& e) {
+        std::cerr << "exception caught: " << e.what() << std::endl;
+        return 3;
+    }
+}
@@ -0,0 +1,261 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides swept measurements using the sweep engine (see sweep_engine.hpp):
+//     network  transmits a carrier at each frequency and measures its level on the RX (through a
+//              loopback or the device under test), as a scalar network measurement
+//     spur     transmits nothing and finds the largest spur in the RX band at each frequency
+//
+// Each step is retuned, captured once settled, and processed with a Hann-windowed FFT on a worker
+// thread while the next step is captured, and its line is written to the output as soon as it
+// is processed. Levels are in dB relative to a full-scale tone. With --cal_table_file, the TX IQ
+// bias and corrections for each frequency are sent with its retune.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numbers>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+#include "aligned_allocator.hpp"
+#include "cal_table.hpp"
+#include "capture_scheduler.hpp"
+#include "fft.hpp"
+#include "host_radio_options.hpp"
+#include "radio_config.hpp"
+#include "sample_buffer.hpp"
+#include "sweep_engine.hpp"
+
+using namespace std::chrono_literals;
+
+// bins on each side of a peak counted in its power, which covers the Hann window's main lobe
+constexpr int peak_half_width = 2;
+// the Hann window's noise bandwidth in bins, by which the summed power of a peak is divided
+constexpr double hann_noise_bandwidth = 1.5;
+
+int main(int argc, char* argv[]) {
+    try {
+        std::cout << argv[0] << " started" << std::endl;
+
+        option_utils::program_options desc("vxsdr_sweep", "swept network and spur measurements");
+
+        add_common_options(desc);
+        add_network_options(desc);
+        add_tx_1ch_options(desc);
+        add_rx_1ch_options(desc);
+
+        // clang-format off
+        desc.add_option("sweep_mode", "measurement at each step (network or spur)", option_utils::supported_types::STRING, false, "network");
+        desc.add_option("sweep_stop_freq", "last frequency of the sweep in Hz (the first is --freq)", option_utils::supported_types::REAL);
+        desc.add_option("sweep_freq_step", "frequency step of the sweep in Hz", option_utils::supported_types::REAL, false, "10e6");
+        desc.add_option("sweep_samples", "samples captured at each step (a power of two)", option_utils::supported_types::INTEGER, false, "16384");
+        desc.add_option("sweep_settle_time", "time in seconds from each retune to its capture", option_utils::supported_types::REAL, false, "1e-3");
+        desc.add_option("sweep_start_margin", "least time in seconds allowed for a start command to reach the radio", option_utils::supported_types::REAL, false, "2e-3");
+        desc.add_option("sweep_buffers", "captures which may wait for processing", option_utils::supported_types::INTEGER, false, "4");
+        desc.add_option("sweep_output", "file the results are written to", option_utils::supported_types::STRING, false, "sweep.txt");
+        // clang-format on
+
+        auto vm = desc.parse(argc, argv);
+        set_buffer_options(vm);
+        if (set_trace_options(vm) != 0) {
+            return 1;
+        }
+
+        const std::string mode = vm["sweep_mode"].as<std::string>();
+        if (mode != "network" and mode != "spur") {
+            std::cerr << "Error: unknown option value for --sweep_mode: " << mode << std::endl;
+            return 1;
+        }
+        const bool network = (mode == "network");
+
+        double f_start = vm["freq"].as<double>();
+        double f_stop  = (vm.count("sweep_stop_freq") > 0) ? vm["sweep_stop_freq"].as<double>() : f_start;
+        double f_step  = vm["sweep_freq_step"].as<double>();
+        if (f_stop < f_start or f_step <= 0) {
+            std::cerr << "sweep_stop_freq must not be less than freq, and sweep_freq_step must be positive" << std::endl;
+            return 1;
+        }
+        sweep_settings settings;
+        settings.n_samples    = vm["sweep_samples"].as<size_t>();
+        settings.settle_time  = vm["sweep_settle_time"].as<double>();
+        settings.start_margin = vm["sweep_start_margin"].as<double>();
+        settings.n_buffers    = vm["sweep_buffers"].as<size_t>();
+        settings.parallel     = vm["config_parallel"].as<bool>();
+        if (settings.n_samples < 64 or (settings.n_samples & (settings.n_samples - 1)) != 0 or settings.n_buffers == 0) {
+            std::cerr << "sweep_samples must be a power of two of at least 64, and sweep_buffers positive" << std::endl;
+            return 1;
+        }
+
+        std::ofstream outfile(vm["sweep_output"].as<std::string>());
+        if (not outfile.is_open()) {
+            std::cerr << "unable to open output file " << vm["sweep_output"].as<std::string>() << std::endl;
+            return 1;
+        }
+
+        // set up the radio using settings from command line arguments
+        auto radio = std::make_unique<vxsdr>(get_radio_settings(vm));
+
+        set_common_options(vm, radio);
+        set_network_options(vm, radio);
+        set_tx_1ch_options(vm, radio);
+        set_rx_1ch_options(vm, radio);
+
+        double rate = radio->get_rx_rate().value_or(-1);
+        if (rate <= 0) {
+            std::cerr << "unable to get rx rate" << std::endl;
+            return 1;
+        }
+        // the carrier is received away from DC, where the RX has its own LO feedthrough
+        const double rx_offset = rate / 8;
+
+        calibration_table cal_table;
+        uint32_t device_id = 0;
+        bool use_cal       = false;
+        if (network and vm.count("cal_table_file") > 0 and cal_table.load(vm["cal_table_file"].as<std::string>())) {
+            auto hello_info = radio->hello();
+            if (hello_info.has_value()) {
+                device_id = hello_info->at(3);
+                use_cal   = true;
+            }
+        }
+
+        // the settings for every step are made before the sweep starts
+        auto freqs = sweep_frequencies(f_start, f_stop, f_step);
+        std::vector<sweep_step> plan;
+        for (double f : freqs) {
+            sweep_step step;
+            step.freq = f;
+            radio_channel_config rx;
+            rx.freq = network ? f - rx_offset : f;
+            step.rx = rx;
+            if (network) {
+                radio_channel_config tx;
+                tx.freq = f;
+                if (use_cal) {
+                    auto cal = cal_table.lookup(device_id, cal_direction::tx, f);
+                    if (cal.has_value()) {
+                        tx.iq_bias = cal->iq_bias;
+                        tx.iq_corr = cal->iq_corr;
+                    }
+                }
+                step.tx = tx;
+            }
+            plan.push_back(step);
+        }
+
+        // the window is scaled so a full-scale tone at a bin center has a power of 1 (0 dB)
+        const size_t n_fft = settings.n_samples;
+        std::vector<double> hann(n_fft);
+        double window_sum = 0;
+        for (size_t i = 0; i < n_fft; i++) {
+            hann[i] = 0.5 * (1 - std::cos(2 * std::numbers::pi * (double)i / (double)n_fft));
+            window_sum += hann[i];
+        }
+        std::vector<float> window(n_fft);
+        for (size_t i = 0; i < n_fft; i++) {
+            window[i] = (float)(hann[i] / window_sum);
+        }
+        fft_plan fft(n_fft);
+        std::vector<std::complex<float>, aligned_allocator<std::complex<float>, fft_alignment>> spectrum(n_fft);
+        std::vector<double> bin_power(n_fft);
+
+        // returns the power of a peak at bin k, which is spread over the window's main lobe
+        auto peak_power = [&](const int k) {
+            double sum = 0;
+            for (int j = k - peak_half_width; j <= k + peak_half_width; j++) {
+                sum += bin_power[(size_t)((j + (int)n_fft) % (int)n_fft)];
+            }
+            return sum / hann_noise_bandwidth;
+        };
+        auto to_db = [](const double x) { return 10 * std::log10(std::max(x, 1e-30)); };
+        const int tone_bin = (int)std::lround(rx_offset / rate * (double)n_fft);
+
+        if (network) {
+            outfile << "% F (GHz)     level (dB)  total (dB)  max abs" << std::endl;
+        } else {
+            outfile << "% F (GHz)     spur F (GHz)  spur (dB)   total (dB)  max abs" << std::endl;
+        }
+        auto process = [&](const size_t step, const std::span<const std::complex<float>> samples) {
+            float max_abs   = 0;
+            double total_db = to_db(block_power(samples, max_abs));
+            for (size_t i = 0; i < n_fft; i++) {
+                spectrum[i] = window[i] * samples[i];
+            }
+            fft.forward(spectrum.data());
+            for (size_t i = 0; i < n_fft; i++) {
+                bin_power[i] = std::norm(spectrum[i]);
+            }
+
+            outfile << std::fixed << std::setprecision(6) << std::setw(12) << 1e-9 * plan[step].freq;
+            if (network) {
+                outfile << std::setprecision(2) << std::setw(12) << to_db(peak_power(tone_bin));
+            } else {
+                // the bins around DC hold the RX's own LO feedthrough, so they are not searched
+                size_t k_max = peak_half_width + 1;
+                for (size_t k = k_max; k < n_fft - peak_half_width; k++) {
+                    if (bin_power[k] > bin_power[k_max]) {
+                        k_max = k;
+                    }
+                }
+                int k_signed   = (k_max < n_fft / 2) ? (int)k_max : (int)k_max - (int)n_fft;
+                double spur_hz = plan[step].freq + (double)k_signed * rate / (double)n_fft;
+                outfile << std::setprecision(6) << std::setw(14) << 1e-9 * spur_hz << std::setprecision(2) << std::setw(12)
+                        << to_db(peak_power((int)k_max));
+            }
+            outfile << std::setw(12) << total_db << std::setprecision(4) << std::setw(9) << max_abs << std::endl;
+        };
+
+        if (network) {
+            // the carrier is a constant at half scale, looped until the sweep ends
+            sample_vector tx_data(20480, {16384, 0});
+            auto t_start = radio->get_time_now().value_or(std::chrono::system_clock::now()) + 50ms;
+            if (not radio->tx_loop(t_start, tx_data.size(), {}, 0)) {
+                std::cerr << "tx_loop() failed" << std::endl;
+                return 1;
+            }
+            if (radio->put_tx_data(tx_data) != tx_data.size()) {
+                std::cerr << "error sending waveform data" << std::endl;
+                radio->tx_stop();
+                return 1;
+            }
+            std::this_thread::sleep_for(100ms);
+        }
+
+        std::cout << "sweeping        " << plan.size() << " steps from " << f_start << " to " << f_stop << " Hz (" << mode
+                  << ")" << std::endl;
+        std::cout << "using FFT       " << n_fft << " points (" << fft_plan::implementation() << ")" << std::endl;
+
+        sweep_stats stats;
+        bool ok = run_sweep(radio, plan, settings, process, stats);
+        if (network) {
+            radio->tx_stop();
+        }
+
+        const double n = (double)std::max<size_t>(stats.n_steps, 1);
+        std::cout << "steps:                " << stats.n_steps << " of " << plan.size() << " (" << stats.n_failed
+                  << " failed commands)" << std::endl;
+        std::cout << "elapsed:              " << stats.elapsed_sec << " s (" << 1e3 * stats.elapsed_sec / n << " ms per step)"
+                  << std::endl;
+        std::cout << "mean retune time:     " << 1e3 * stats.retune_sec / n << " ms (max " << 1e3 * stats.max_retune_sec << " ms)"
+                  << std::endl;
+        std::cout << "mean capture time:    " << 1e3 * stats.capture_sec / n << " ms" << std::endl;
+        std::cout << "mean processing time: " << 1e3 * stats.process_sec / n << " ms (waited " << 1e3 * stats.wait_sec
+                  << " ms in all, " << stats.max_buffers_used << " of " << settings.n_buffers << " buffers used)" << std::endl;
+        std::cout << "results written to " << vm["sweep_output"].as<std::string>() << std::endl;
+        if (not ok or stats.n_failed > 0) {
+            return 2;
+        }
+    } catch (std::exception& e) {
+        std::cerr << "exception caught: " << e.what() << std::endl;
+        return 3;
+    }
+}
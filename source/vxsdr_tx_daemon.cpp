@@ -0,0 +1,461 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides a long-running transmit server, which keeps the radio open and time-synchronized
+// and runs looped transmit jobs received over a local (UNIX domain) socket
+//
+// Each job is one line of space-separated key=value pairs, for example
+//     tx_waveform_file=/data/chirp.dat freq=2.4e9 rate=10e6 gain=-10 pri=0.001 duration=2
+// where tx_waveform_file is required, and freq, rate, gain, pri, duration, and format
+// (as for --tx_waveform_format) default to their values in the previous job (the first job's
+// duration defaults to --duration). Only radio
+// settings which differ from the previous job are sent to the radio. The server replies with
+// one line starting with "ok" or "error" when the job has finished. The lines "status" and
+// "shutdown" are also accepted. A simple client is:
+//     echo "tx_waveform_file=chirp.dat pri=0.001" | nc -U /tmp/vxsdr_tx_daemon.sock
+//
+// Each job's waveform is uploaded in chunks of --daemon_upload_chunk samples, and the reply gives
+// the upload throughput in megabytes per second (upload_MBps). The daemon keeps the hash (XXH64)
+// of the waveform it last uploaded; with --daemon_skip_reupload, a job whose waveform has the same
+// hash and length is re-armed with tx_loop only, using the samples already in the radio's TX buffer,
+// and its reply says upload=skipped. Only use this if the radio keeps the contents of its TX buffer
+// after a loop finishes or is ended by tx_stop().
+//
+// One client is served at a time; a client which sends nothing for --daemon_client_timeout
+// seconds is disconnected so that others can connect.
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+#include "host_radio_options.hpp"
+#include "mapped_waveform.hpp"
+#include "sample_buffer.hpp"
+#include "sample_convert.hpp"
+#include "utility.hpp"
+
+using namespace std::chrono_literals;
+
+static std::atomic<bool> stop_requested{false};
+
+static void signal_handler(int /*signal*/) {
+    stop_requested = true;
+}
+
+// the settings the radio currently has, so only changes need to be sent
+struct tx_job_settings {
+    double rate         = 0;
+    double freq         = 0;
+    double gain         = 0;
+    double pri_sec      = 0;
+    double duration_sec = 1.0;
+    std::string format  = "cs16";
+};
+
+class tx_daemon {
+  private:
+    std::unique_ptr<vxsdr>& radio;
+    tx_job_settings current;
+    size_t tx_buffer_samps = 0;
+    size_t granularity     = 1;
+    double network_bps     = 10e9;
+    size_t jobs_run        = 0;
+    size_t commands_saved  = 0;
+    size_t upload_chunk    = 1 << 20;
+    bool skip_reupload     = false;
+    size_t uploads         = 0;
+    size_t uploads_skipped = 0;
+    // the waveform in the radio's TX buffer, if it is known
+    std::optional<uint64_t> loaded_hash;
+    size_t loaded_samples = 0;
+
+  public:
+    tx_daemon(std::unique_ptr<vxsdr>& r,
+              const double network_bit_rate,
+              const size_t upload_chunk_samples,
+              const bool skip,
+              const double duration_sec)
+        : radio(r), network_bps(network_bit_rate), upload_chunk(std::max<size_t>(upload_chunk_samples, 1)), skip_reupload(skip) {
+        current.duration_sec = duration_sec;
+    }
+
+    bool initialize() {
+        current.rate = radio->get_tx_rate().value_or(-1);
+        current.freq = radio->get_tx_freq().value_or(-1);
+        current.gain = radio->get_tx_gain().value_or(-1);
+        auto bsize   = radio->get_buffer_info();
+        if (not bsize.has_value()) {
+            std::cerr << "unable to get buffer info" << std::endl;
+            return false;
+        }
+        tx_buffer_samps = bsize->at(1) / sizeof(vxsdr::wire_sample);
+        auto hello_info = radio->hello();
+        if (hello_info.has_value()) {
+            granularity = radio->compute_sample_granularity(hello_info->at(5));
+        }
+        return current.rate > 0;
+    }
+
+    std::string status() const {
+        std::stringstream out;
+        out << "ok jobs=" << jobs_run << " commands_saved=" << commands_saved << " uploads=" << uploads
+            << " uploads_skipped=" << uploads_skipped << " rate=" << current.rate << " freq=" << current.freq
+            << " gain=" << current.gain;
+        if (loaded_hash.has_value()) {
+            out << " loaded_hash=" << hash_string(loaded_hash.value());
+        }
+        return out.str();
+    }
+
+    static std::string hash_string(const uint64_t hash) {
+        std::stringstream out;
+        out << std::hex << std::setw(16) << std::setfill('0') << hash;
+        return out.str();
+    }
+
+    // sends the waveform in chunks, checking that each is accepted whole; returns the throughput in
+    // MB/s, or a negative number if the upload fails
+    double upload(std::span<const std::complex<int16_t>> data) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t n_sent = 0; n_sent < data.size();) {
+            auto chunk = data.subspan(n_sent, std::min(upload_chunk, data.size() - n_sent));
+            if (radio->put_tx_data(chunk) != chunk.size()) {
+                std::cerr << "upload stopped after " << n_sent << " of " << data.size() << " samples" << std::endl;
+                return -1;
+            }
+            n_sent += chunk.size();
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        return 1e-6 * (double)data.size_bytes() / std::max(elapsed, 1e-9);
+    }
+
+    // sends a setting only if it has changed
+    template <typename F>
+    bool apply_if_changed(double& current_value, const double new_value, F setter, const std::string& name, std::string& error) {
+        if (new_value == current_value) {
+            commands_saved++;
+            return true;
+        }
+        if (not setter(new_value)) {
+            error = "set_tx_" + name + " failed";
+            return false;
+        }
+        current_value = new_value;
+        return true;
+    }
+
+    std::string run_job(const std::string& line) {
+        tx_job_settings job = current;
+        std::string file_name;
+
+        std::istringstream iss(line);
+        std::string token;
+        while (iss >> token) {
+            auto eq = token.find('=');
+            if (eq == std::string::npos) {
+                return "error expected key=value: " + token;
+            }
+            auto key   = token.substr(0, eq);
+            auto value = token.substr(eq + 1);
+            try {
+                if (key == "tx_waveform_file") {
+                    file_name = value;
+                } else if (key == "format") {
+                    job.format = value;
+                } else if (key == "rate") {
+                    job.rate = std::stod(value);
+                } else if (key == "freq") {
+                    job.freq = std::stod(value);
+                } else if (key == "gain") {
+                    job.gain = std::stod(value);
+                } else if (key == "pri") {
+                    job.pri_sec = std::stod(value);
+                } else if (key == "duration") {
+                    job.duration_sec = std::stod(value);
+                } else {
+                    return "error unknown key: " + key;
+                }
+            } catch (std::exception&) {
+                return "error cannot interpret value for " + key + ": " + value;
+            }
+        }
+        if (file_name.empty()) {
+            return "error tx_waveform_file is required";
+        }
+        if (job.duration_sec <= 0 or job.pri_sec < 0 or job.rate <= 0) {
+            return "error duration and rate must be positive and pri nonnegative";
+        }
+
+        waveform_format format = waveform_format::cs16;
+        if (not parse_waveform_format(job.format, format)) {
+            return "error unknown format: " + job.format;
+        }
+        mapped_waveform wf;
+        if (wf.open(file_name) == 0) {
+            return "error unable to read tx waveform file " + file_name;
+        }
+        sample_vector converted;
+        std::span<const std::complex<int16_t>> data = wf.samples();
+        if (format != waveform_format::cs16) {
+            converted.resize(wf.bytes().size() / waveform_format_bytes(format));
+            convert_to_cs16(format, wf.bytes(), converted);
+            data = converted;
+        }
+        if (data.empty() or data.size() > tx_buffer_samps) {
+            return "error waveform has " + std::to_string(data.size()) + " samples, buffer holds " +
+                   std::to_string(tx_buffer_samps);
+        }
+
+        std::string error;
+        if (not apply_if_changed(current.rate, job.rate, [this](double x) { return radio->set_tx_rate(x); }, "rate", error) or
+            not apply_if_changed(current.freq, job.freq, [this](double x) { return radio->set_tx_freq(x); }, "freq", error) or
+            not apply_if_changed(current.gain, job.gain, [this](double x) { return radio->set_tx_gain(x); }, "gain", error)) {
+            return "error " + error;
+        }
+        current.pri_sec      = job.pri_sec;
+        current.duration_sec = job.duration_sec;
+        current.format       = job.format;
+
+        double waveform_sec = (double)data.size() / current.rate;
+        if (job.pri_sec > 0 and waveform_sec > job.pri_sec) {
+            return "error duration of waveform is longer than pri";
+        }
+        if (job.pri_sec == 0 and data.size() % granularity != 0) {
+            std::cerr << "waveform length does not match granularity -- gaps will occur" << std::endl;
+        }
+
+        size_t n_pulses = (job.pri_sec > 0) ? (size_t)std::llround(job.duration_sec / job.pri_sec) : 0;
+
+        // the samples uploaded are hashed, so a change of format or file contents is found as well
+        const uint64_t hash = xxhash64(std::as_bytes(data));
+        const bool reuse    = skip_reupload and loaded_hash == hash and loaded_samples == data.size();
+
+        auto t_now = radio->get_time_now();
+        if (not t_now.has_value()) {
+            return "error unable to get radio time";
+        }
+        // start as soon as the upload can be finished, rather than on a second boundary
+        auto upload_time = std::chrono::nanoseconds(
+            reuse ? 0 : std::llround(2e9 * 8.0 * sizeof(vxsdr::wire_sample) * (double)data.size() / network_bps));
+        auto t_start = t_now.value() + upload_time + 20ms;
+
+        vxsdr::duration pri = std::chrono::nanoseconds(std::llround(1e9 * job.pri_sec));
+        if (not radio->tx_loop(t_start, data.size(), pri, n_pulses)) {
+            loaded_hash.reset();
+            return "error tx_loop() failed";
+        }
+        std::string upload_info = " upload=skipped";
+        if (reuse) {
+            uploads_skipped++;
+        } else {
+            // until the upload is complete, the buffer holds no known waveform
+            loaded_hash.reset();
+            double mbytes_per_sec = upload(data);
+            if (mbytes_per_sec < 0) {
+                radio->tx_stop();
+                return "error sending waveform data";
+            }
+            loaded_hash    = hash;
+            loaded_samples = data.size();
+            uploads++;
+            std::stringstream info;
+            info << " upload_MBps=" << std::fixed << std::setprecision(1) << mbytes_per_sec;
+            upload_info = info.str();
+        }
+
+        auto radio_host_offset = t_now.value() - std::chrono::system_clock::now();
+        auto t_end             = t_start + std::chrono::nanoseconds(std::llround(1e9 * job.duration_sec));
+        std::this_thread::sleep_until(t_end - radio_host_offset);
+        if (job.pri_sec == 0) {
+            radio->tx_stop();
+        }
+        jobs_run++;
+
+        return "ok start=" + format_time(t_start) + " samples=" + std::to_string(data.size()) +
+               " pulses=" + std::to_string(n_pulses) + " hash=" + hash_string(hash) + upload_info;
+    }
+};
+
+// reads one line from the client, waking up periodically to check for a stop request; gives up if the
+// client sends nothing for idle_timeout_sec, so an idle client does not hold off other clients
+static bool read_line(const int fd, std::string& line, const double idle_timeout_sec) {
+    line.clear();
+    char c       = 0;
+    auto t_input = std::chrono::steady_clock::now();
+    while (true) {
+        pollfd pfd = {fd, POLLIN, 0};
+        int ready  = poll(&pfd, 1, 500);
+        if (stop_requested) {
+            return false;
+        }
+        if (ready < 0 and errno != EINTR) {
+            return false;
+        }
+        if (ready <= 0) {
+            if (std::chrono::duration<double>(std::chrono::steady_clock::now() - t_input).count() > idle_timeout_sec) {
+                return false;
+            }
+            continue;
+        }
+        ssize_t n = read(fd, &c, 1);
+        if (n < 0 and errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return not line.empty();
+        }
+        t_input = std::chrono::steady_clock::now();
+        if (c == '\n') {
+            return true;
+        }
+        line.push_back(c);
+    }
+}
+
+static void write_line(const int fd, const std::string& line) {
+    std::string out = line + "\n";
+    size_t n_done   = 0;
+    while (n_done < out.size()) {
+        ssize_t n = write(fd, out.data() + n_done, out.size() - n_done);
+        if (n <= 0) {
+            return;
+        }
+        n_done += (size_t)n;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::cout << argv[0] << " started" << std::endl;
+
+        // set up options and read from command line and/or configuration file
+        option_utils::program_options desc("vxsdr_tx_daemon", "run looped transmit jobs received over a local socket");
+
+        add_common_options(desc);
+        add_network_options(desc);
+        add_realtime_options(desc);
+        add_tx_1ch_options(desc);
+
+        desc.add_option("daemon_socket", "path of the socket used to receive jobs", option_utils::supported_types::STRING, false,
+                        "/tmp/vxsdr_tx_daemon.sock");
+        desc.add_option("daemon_upload_chunk", "number of samples sent in each part of a waveform upload",
+                        option_utils::supported_types::INTEGER, false, "1048576");
+        desc.add_option("daemon_client_timeout", "seconds to wait for a command before closing an idle client connection",
+                        option_utils::supported_types::REAL, false, "30");
+        desc.add_flag("daemon_skip_reupload", "do not upload a waveform already in the TX buffer (if tx_stop keeps it)", false,
+                      false);
+
+        auto vm = desc.parse(argc, argv);
+        set_buffer_options(vm);
+        if (set_trace_options(vm) != 0) {
+            return 1;
+        }
+
+        // without SA_RESTART, so a signal interrupts a blocked poll() or read() instead of restarting it
+        struct sigaction action = {};
+        action.sa_handler       = signal_handler;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+        std::signal(SIGPIPE, SIG_IGN);
+
+        // set up the radio using settings from command line arguments; this is only done once
+        auto radio = std::make_unique<vxsdr>(get_radio_settings(vm));
+
+        set_common_options(vm, radio);
+        set_network_options(vm, radio);
+        set_tx_1ch_options(vm, radio);
+
+        tx_daemon daemon(radio, vm["network_bit_rate"].as<double>(), vm["daemon_upload_chunk"].as<size_t>(),
+                         vm["daemon_skip_reupload"].as<bool>(), vm["duration"].as<double>());
+        if (not daemon.initialize()) {
+            std::cerr << "unable to get radio settings" << std::endl;
+            return 1;
+        }
+
+        // if memory is locked, waveforms loaded for later jobs are locked as well when the limit allows
+        if (set_realtime_options(vm) != 0) {
+            return 1;
+        }
+
+        auto socket_path = vm["daemon_socket"].as<std::string>();
+        sockaddr_un addr = {};
+        if (socket_path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "socket path is too long: " << socket_path << std::endl;
+            return 1;
+        }
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+        int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        unlink(socket_path.c_str());
+        if (listen_fd < 0 or bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 or listen(listen_fd, 4) != 0) {
+            std::cerr << "unable to listen on socket " << socket_path << ": " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        std::cout << "listening on " << socket_path << std::endl;
+
+        const double client_timeout = vm["daemon_client_timeout"].as<double>();
+
+        while (not stop_requested) {
+            pollfd pfd = {listen_fd, POLLIN, 0};
+            // wake up periodically to check for a stop request
+            if (poll(&pfd, 1, 500) <= 0) {
+                continue;
+            }
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                continue;
+            }
+            std::string line;
+            while (not stop_requested and read_line(fd, line, client_timeout)) {
+                if (line.empty()) {
+                    continue;
+                }
+                std::string reply;
+                if (line == "status") {
+                    reply = daemon.status();
+                } else if (line == "shutdown") {
+                    stop_requested = true;
+                    reply          = "ok shutting down";
+                } else {
+                    reply = daemon.run_job(line);
+                }
+                std::cout << line << " -> " << reply << std::endl;
+                write_line(fd, reply);
+            }
+            close(fd);
+        }
+
+        close(listen_fd);
+        unlink(socket_path.c_str());
+        radio->tx_stop();
+
+        std::cout << "daemon stopped" << std::endl;
+    } catch (std::exception& e) {
+        std::cerr << "exception caught: " << e.what() << std::endl;
+        return 3;
+    }
+}
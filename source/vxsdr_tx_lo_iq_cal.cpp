@@ -0,0 +1,480 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides measurement of LO bias (LO feedthrough) and IQ corrections using a loopback connection
+//
+// This does the same measurement as python/loopback_tx_lo_iq_corr.py, and writes the same
+// output table, but instead of successive linear searches it fits a paraboloid to the measured
+// power (in linear units) around the current estimate and moves to the fitted minimum, which
+// usually converges in two to four iterations of 8 captures. Each frequency after the first starts
+// from the result at the previous frequency, with a smaller search step.
+//
+// The captures for the points of each fit are batched (see capture_scheduler.hpp): the settings
+// for all of them are applied in turn during one RX stream, instead of starting a stream and
+// retuning the RX for every capture.
+//
+// The Python script uses an RX gain of -10 dB; use --rx_gain=-10 for the same setting.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+#include "cal_table.hpp"
+#include "capture_scheduler.hpp"
+#include "host_radio_options.hpp"
+#include "sample_buffer.hpp"
+#include "utility.hpp"
+
+using namespace std::chrono_literals;
+
+// measures the power of a batch of captures at one RX frequency, and measures again with more RX gain
+// the captures too weak to be measured accurately
+static std::vector<double> rx_measure_power_agc(std::unique_ptr<vxsdr>& radio,
+                                                capture_scheduler& scheduler,
+                                                const double freq,
+                                                const std::vector<capture_request>& requests) {
+    constexpr double gain_inc = 20;
+    const double pwr_fs       = 10 * std::log10(std::sqrt(0.5));
+
+    std::vector<double> pwr(requests.size(), 0);
+    std::vector<capture_result> results;
+    radio->set_rx_freq(freq);
+    scheduler.clear();
+    for (const auto& req : requests) {
+        scheduler.add(req);
+    }
+    if (not scheduler.run(radio, results)) {
+        return pwr;
+    }
+
+    std::vector<size_t> weak;
+    for (size_t i = 0; i < results.size(); i++) {
+        pwr[i] = results[i].power_db;
+        if (results[i].max_abs >= 0.8F) {
+            std::cerr << "warning: near clipping on rx" << std::endl;
+        }
+        if (pwr_fs - pwr[i] > gain_inc + 3) {
+            weak.push_back(i);
+        }
+    }
+
+    if (not weak.empty()) {
+        double current_gain = radio->get_rx_gain().value_or(0);
+        radio->set_rx_gain(current_gain + gain_inc);
+        scheduler.clear();
+        for (auto i : weak) {
+            scheduler.add(requests[i]);
+        }
+        if (scheduler.run(radio, results)) {
+            for (size_t k = 0; k < weak.size(); k++) {
+                pwr[weak[k]] = results[k].power_db - gain_inc;
+            }
+        }
+        radio->set_rx_gain(current_gain);
+    }
+
+    return pwr;
+}
+
+struct search_limits {
+    double a_min;
+    double a_max;
+    double b_min;
+    double b_max;
+};
+
+struct search_result {
+    double a        = 0;
+    double b        = 0;
+    double value_db = 0;
+};
+
+// fits y = c0 + c1 u + c2 v + c3 u^2 + c4 uv + c5 v^2 by least squares, and returns the
+// location of its minimum in (u, v); returns false if the fit has no minimum
+static bool paraboloid_minimum(const std::vector<std::array<double, 3>>& points, double& u_min, double& v_min) {
+    constexpr unsigned n = 6;
+    std::array<std::array<double, n + 1>, n> m{};  // normal equations, with the right side in the last column
+    for (const auto& [u, v, y] : points) {
+        const std::array<double, n> basis = {1, u, v, u * u, u * v, v * v};
+        for (unsigned i = 0; i < n; i++) {
+            for (unsigned j = 0; j < n; j++) {
+                m[i][j] += basis[i] * basis[j];
+            }
+            m[i][n] += basis[i] * y;
+        }
+    }
+    // Gaussian elimination with partial pivoting
+    for (unsigned col = 0; col < n; col++) {
+        unsigned pivot = col;
+        for (unsigned row = col + 1; row < n; row++) {
+            if (std::abs(m[row][col]) > std::abs(m[pivot][col])) {
+                pivot = row;
+            }
+        }
+        if (std::abs(m[pivot][col]) < 1e-12) {
+            return false;
+        }
+        std::swap(m[col], m[pivot]);
+        for (unsigned row = col + 1; row < n; row++) {
+            double f = m[row][col] / m[col][col];
+            for (unsigned k = col; k <= n; k++) {
+                m[row][k] -= f * m[col][k];
+            }
+        }
+    }
+    std::array<double, n> c{};
+    for (int i = n - 1; i >= 0; i--) {
+        double sum = m[i][n];
+        for (unsigned k = i + 1; k < n; k++) {
+            sum -= m[i][k] * c[k];
+        }
+        c[i] = sum / m[i][i];
+    }
+    // the gradient is zero where [2 c3, c4; c4, 2 c5] [u; v] = -[c1; c2]
+    double h11 = 2 * c[3];
+    double h12 = c[4];
+    double h22 = 2 * c[5];
+    double det = h11 * h22 - h12 * h12;
+    if (h11 <= 0 or det <= 0) {
+        return false;
+    }
+    u_min = (-c[1] * h22 + c[2] * h12) / det;
+    v_min = (-c[2] * h11 + c[1] * h12) / det;
+    return true;
+}
+
+// minimizes a measured power (in dB) over two parameters, starting from (a, b) with search step h; measure
+// takes a batch of (a, b) points and returns the power at each, so that the points can share one capture stream
+template <typename F>
+static search_result minimize_power(F measure,
+                                    const double a_start,
+                                    const double b_start,
+                                    const double h_start,
+                                    const search_limits& lim,
+                                    const double tolerance,
+                                    const unsigned max_iterations) {
+    search_result best;
+    best.a        = std::clamp(a_start, lim.a_min, lim.a_max);
+    best.b        = std::clamp(b_start, lim.b_min, lim.b_max);
+    best.value_db = measure(std::vector<std::array<double, 2>>{{best.a, best.b}})[0];
+
+    // the stencil gives 7 distinct points for the 6 coefficients of the fit
+    const std::array<std::array<double, 2>, 6> stencil = {{{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {-1, -1}}};
+
+    // less improvement than this in an iteration means the noise floor has been reached
+    constexpr double min_improvement_db = 0.2;
+
+    double h = h_start;
+    for (unsigned it = 0; it < max_iterations and h >= tolerance; it++) {
+        const double a_center = best.a;
+        const double b_center = best.b;
+        const double start_db = best.value_db;
+        // the stencil points do not depend on each other, so they are measured as one batch
+        std::vector<std::array<double, 2>> batch;
+        for (const auto& [du, dv] : stencil) {
+            batch.push_back({std::clamp(a_center + h * du, lim.a_min, lim.a_max),
+                             std::clamp(b_center + h * dv, lim.b_min, lim.b_max)});
+        }
+        auto values = measure(batch);
+
+        // fitting power rather than dB makes the function close to a paraboloid near its minimum
+        std::vector<std::array<double, 3>> points = {{0, 0, std::pow(10.0, best.value_db / 10)}};
+        for (size_t k = 0; k < batch.size(); k++) {
+            const auto [a, b] = batch[k];
+            double y          = values[k];
+            points.push_back({(a - a_center) / h, (b - b_center) / h, std::pow(10.0, y / 10)});
+            if (y < best.value_db) {
+                best.a        = a;
+                best.b        = b;
+                best.value_db = y;
+            }
+        }
+
+        double u = 0;
+        double v = 0;
+        if (paraboloid_minimum(points, u, v)) {
+            // do not trust the fit far outside the points it was made from
+            double dist = std::hypot(u, v);
+            if (dist > 4) {
+                u *= 4 / dist;
+                v *= 4 / dist;
+            }
+            double a = std::clamp(a_center + h * u, lim.a_min, lim.a_max);
+            double b = std::clamp(b_center + h * v, lim.b_min, lim.b_max);
+            double y = measure(std::vector<std::array<double, 2>>{{a, b}})[0];
+            if (y < best.value_db) {
+                best.a        = a;
+                best.b        = b;
+                best.value_db = y;
+            }
+            // the next step is scaled to the remaining error, which the fit estimates
+            h = std::clamp(std::hypot(a - a_center, b - b_center) / 2, h / 16, h / 2);
+            if (start_db - best.value_db < min_improvement_db) {
+                break;
+            }
+        } else if (best.a == a_center and best.b == b_center) {
+            // no minimum in the fit and no better point, so the minimum is close
+            h /= 2;
+        }
+    }
+    return best;
+}
+
+static std::string format_table_line(const double freq,
+                                     const std::array<double, 2>& lo_best,
+                                     const double start_lo,
+                                     const double best_lo,
+                                     const std::array<double, 4>& iq_best,
+                                     const double start_iq,
+                                     const double best_iq) {
+    std::stringstream out;
+    out << std::fixed << " " << std::setw(10) << std::setprecision(3) << 1e-9 * freq;
+    out << std::setprecision(6) << " " << std::setw(10) << lo_best[0] << " " << std::setw(10) << lo_best[1];
+    out << std::setprecision(2) << " " << std::setw(8) << start_lo << " " << std::setw(8) << best_lo;
+    out << std::setprecision(6);
+    for (auto x : iq_best) {
+        out << " " << std::setw(10) << x;
+    }
+    out << std::setprecision(2) << " " << std::setw(8) << start_iq << " " << std::setw(8) << best_iq;
+    return out.str();
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::cout << argv[0] << " started" << std::endl;
+
+        // set up options and read from command line and/or configuration file
+        option_utils::program_options desc("vxsdr_tx_lo_iq_cal", "measure TX LO and IQ corrections using loopback");
+
+        add_common_options(desc);
+        add_network_options(desc);
+        add_rx_1ch_options(desc);
+        add_tx_1ch_options(desc);
+
+        // clang-format off
+        desc.add_option("cal_stop_freq", "last frequency to measure in Hz (default is --freq only)", option_utils::supported_types::REAL);
+        desc.add_option("cal_freq_step", "measurement frequency increment in Hz", option_utils::supported_types::REAL, false, "100e6");
+        desc.add_option("cal_data_length", "number of samples in each capture", option_utils::supported_types::INTEGER, false, "20480");
+        desc.add_option("cal_settle_samples", "number of samples discarded after each setting change", option_utils::supported_types::INTEGER, false, "1024");
+        desc.add_option("cal_capture_guard", "time planned for each setting change within a capture stream in seconds", option_utils::supported_types::REAL, false, "0.002");
+        desc.add_option("cal_max_iterations", "maximum number of fits for each of LO and IQ", option_utils::supported_types::INTEGER, false, "6");
+        desc.add_option("cal_output_base", "output file base name (without extension)", option_utils::supported_types::STRING, false, "tx_lo_iq_corr");
+        desc.add_flag("cal_add_header", "include a header in the output file with device info", false, false);
+        desc.add_option("cal_comment_delimiter", "characters to place at start of header lines in output file", option_utils::supported_types::STRING, false, "%");
+        desc.add_flag("cal_add_unique_id", "append device id to output file basename", false, false);
+        desc.add_flag("cal_add_timestamp", "append date and time to output file basename", false, false);
+        desc.add_option("cal_table_output", "binary calibration table to add the results to (created if it does not exist)", option_utils::supported_types::STRING);
+        // clang-format on
+
+        auto vm = desc.parse(argc, argv);
+        set_buffer_options(vm);
+        if (set_trace_options(vm) != 0) {
+            return 1;
+        }
+
+        double f_min  = vm["freq"].as<double>();
+        double f_max  = f_min;
+        double f_step = vm["cal_freq_step"].as<double>();
+        if (vm.count("cal_stop_freq") > 0) {
+            f_max = vm["cal_stop_freq"].as<double>();
+        }
+        if (f_max < f_min or f_step <= 0) {
+            std::cerr << "cal_stop_freq must not be less than freq, and cal_freq_step must be positive" << std::endl;
+            return 1;
+        }
+        auto rx_ndata       = vm["cal_data_length"].as<size_t>();
+        auto max_iterations = vm["cal_max_iterations"].as<unsigned>();
+        auto guard_sec      = vm["cal_capture_guard"].as<double>();
+        if (guard_sec <= 0) {
+            std::cerr << "cal_capture_guard must be positive" << std::endl;
+            return 1;
+        }
+
+        // set up the radio using settings from command line arguments
+        auto radio = std::make_unique<vxsdr>(get_radio_settings(vm));
+
+        set_common_options(vm, radio);
+        set_network_options(vm, radio);
+        set_tx_1ch_options(vm, radio);
+        set_rx_1ch_options(vm, radio);
+
+        double rate    = radio->get_tx_rate().value_or(-1);
+        double if_freq = radio->get_tx_if_freq().value_or(0);
+        if (rate <= 0) {
+            std::cerr << "unable to get tx rate" << std::endl;
+            return 1;
+        }
+
+        capture_schedule_settings capture_settings;
+        capture_settings.n_window = rx_ndata;
+        capture_settings.n_settle = vm["cal_settle_samples"].as<size_t>();
+        capture_settings.n_guard  = (size_t)std::ceil(guard_sec * radio->get_rx_rate().value_or(rate));
+        capture_scheduler scheduler(capture_settings);
+
+        const double lo_offset = if_freq;
+        const double iq_offset = 2 * if_freq;
+        // move signal away from DC on RX
+        const double rx_offset = rate / 8;
+
+        // the carrier for the IQ measurement is a constant at half scale
+        sample_vector tx_data(20480, {16384, 0});
+
+        uint32_t device_id = 0;
+        auto hello_info    = radio->hello();
+        if (hello_info.has_value()) {
+            device_id = hello_info->at(3);
+        }
+
+        calibration_table cal_table;
+        if (vm.count("cal_table_output") > 0 and std::filesystem::exists(vm["cal_table_output"].as<std::string>())) {
+            if (not cal_table.load(vm["cal_table_output"].as<std::string>())) {
+                return 1;
+            }
+        }
+
+        std::string base = vm["cal_output_base"].as<std::string>();
+        if (vm["cal_add_unique_id"].as<bool>()) {
+            base += "_" + std::to_string(device_id);
+        }
+        if (vm["cal_add_timestamp"].as<bool>()) {
+            base += "_" + format_time(std::chrono::system_clock::now(), "%Y-%m-%d-%H.%M.%S");
+        }
+        std::string outfile_name = base + ".txt";
+
+        if (std::filesystem::exists(outfile_name)) {
+            std::cout << "output file " << outfile_name << " exists -- return to overwrite, ctrl-C to quit" << std::flush;
+            std::string reply;
+            std::getline(std::cin, reply);
+        }
+        std::ofstream outfile(outfile_name);
+        if (not outfile.is_open()) {
+            std::cerr << "unable to open output file " << outfile_name << std::endl;
+            return 1;
+        }
+
+        if (vm["cal_add_header"].as<bool>()) {
+            std::string delimiter = vm["cal_comment_delimiter"].as<std::string>();
+            std::cout << delimiter << " measurement data and time: " << format_time(std::chrono::system_clock::now()) << std::endl;
+            std::stringstream header;
+            header << delimiter << " input arguments:" << std::endl;
+            const std::vector<std::pair<std::string, double>> arguments = {
+                {"freq", f_min}, {"cal_stop_freq", f_max}, {"cal_freq_step", f_step}, {"cal_data_length", (double)rx_ndata},
+                {"rate", rate},  {"tx_gain", radio->get_tx_gain().value_or(-1)}};
+            for (const auto& [name, value] : arguments) {
+                header << delimiter << "   " << std::left << std::setw(24) << name << std::right << " " << value << std::endl;
+            }
+            header << delimiter
+                   << "    F (GHz)   Bias1      Bias2    LO uncorr LO corr    IQ1        IQ2        IQ3        IQ4     "
+                      "IQ uncorr IQ corr"
+                   << std::endl;
+            std::cout << header.str();
+            outfile << header.str();
+        }
+
+        // first frequency searches widely; later ones start from the previous result
+        constexpr double lo_first_step = 0.25;
+        constexpr double lo_warm_step  = 0.02;
+        constexpr double lo_tol        = 5e-6;
+        constexpr double iq_first_step = 0.1;
+        constexpr double iq_warm_step  = 0.01;
+        constexpr double iq_tol        = 1.0 / (1U << 13U);
+
+        const search_limits lo_limits = {-1.0, 1.0, -1.0, 1.0};
+        const search_limits iq_limits = {0.5, 1.9990, -0.5, 0.49975};
+
+        std::array<double, 2> lo_start = {0.0, 0.0};
+        std::array<double, 2> iq_start = {1.0, 0.0};
+        double lo_step                 = lo_first_step;
+        double iq_step                 = iq_first_step;
+
+        auto t0 = std::chrono::steady_clock::now();
+
+        for (double tx_freq = f_min; tx_freq <= f_max + 1.0; tx_freq += f_step) {
+            radio->set_tx_freq(tx_freq);
+
+            // LO feedthrough is measured with nothing transmitted
+            auto measure_lo = [&](const std::vector<std::array<double, 2>>& batch) {
+                std::vector<capture_request> requests;
+                for (const auto& ab : batch) {
+                    requests.push_back({ab, {}});
+                }
+                return rx_measure_power_agc(radio, scheduler, tx_freq - lo_offset + rx_offset, requests);
+            };
+            double start_lo = measure_lo({{0.0, 0.0}})[0];
+
+            auto lo = minimize_power(measure_lo, lo_start[0], lo_start[1], lo_step, lo_limits, lo_tol, max_iterations);
+            if (lo.value_db > start_lo) {
+                lo = {0.0, 0.0, start_lo};
+            }
+            std::array<double, 2> lo_best = {lo.a, lo.b};
+            radio->set_tx_iq_bias(lo_best);
+
+            // the image is measured relative to the carrier
+            radio->set_tx_iq_corr({1.0, 0.0, 0.0, 1.0});
+            radio->tx_loop(radio->get_time_now().value_or(std::chrono::system_clock::now()) + 50ms, tx_data.size(), {}, 0);
+            radio->put_tx_data(tx_data);
+            std::this_thread::sleep_for(100ms);
+
+            // the carrier and image are each measured for the whole batch, so the RX is only retuned twice
+            auto measure_iq = [&](const std::vector<std::array<double, 2>>& batch) {
+                std::vector<capture_request> requests;
+                for (const auto& [a, b] : batch) {
+                    requests.push_back({{}, std::array<double, 4>{a, 0.0, b, 1.0}});
+                }
+                auto pwr_carrier = rx_measure_power_agc(radio, scheduler, tx_freq + rx_offset, requests);
+                auto pwr_image   = rx_measure_power_agc(radio, scheduler, tx_freq - iq_offset + rx_offset, requests);
+                for (size_t k = 0; k < pwr_image.size(); k++) {
+                    pwr_image[k] -= pwr_carrier[k];
+                }
+                return pwr_image;
+            };
+            double start_iq = measure_iq({{1.0, 0.0}})[0];
+            auto iq         = minimize_power(measure_iq, iq_start[0], iq_start[1], iq_step, iq_limits, iq_tol, max_iterations);
+            if (iq.value_db > start_iq) {
+                iq = {1.0, 0.0, start_iq};
+            }
+            std::array<double, 4> iq_best = {iq.a, 0.0, iq.b, 1.0};
+            radio->set_tx_iq_corr(iq_best);
+
+            radio->tx_stop();
+
+            auto line = format_table_line(tx_freq, lo_best, start_lo, lo.value_db, iq_best, start_iq, iq.value_db);
+            std::cout << line << std::endl;
+            outfile << line << std::endl;
+            cal_table.insert({device_id, cal_direction::tx, tx_freq, lo_best, iq_best});
+
+            lo_start = lo_best;
+            iq_start = {iq.a, iq.b};
+            lo_step  = lo_warm_step;
+            iq_step  = iq_warm_step;
+        }
+
+        radio->tx_stop();
+        if (vm.count("cal_table_output") > 0) {
+            if (not cal_table.save(vm["cal_table_output"].as<std::string>())) {
+                return 1;
+            }
+            std::cout << "calibration table " << vm["cal_table_output"].as<std::string>() << " has " << cal_table.size()
+                      << " entries" << std::endl;
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        std::cout << "Done. Elapsed time = " << std::fixed << std::setprecision(1) << elapsed << " seconds ("
+                  << scheduler.captures_taken() << " captures in " << scheduler.streams_started() << " rx streams)" << std::endl;
+    } catch (std::exception& e) {
+        std::cerr << "exception caught: " << e.what() << std::endl;
+        return 3;
+    }
+}
@@ -0,0 +1,315 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides an example of looped pulse transmit with the frequency and gain changed between pulses
+//
+// The schedule file has one line per pulse, which is used in turn (repeating from the start
+// when it runs out):
+//     <frequency in Hz> [<gain in dB>]
+// where either value can be "-" to keep the previous setting. Blank lines and lines starting
+// with # are ignored.
+//
+// Each retune is sent as soon as the previous pulse ends, from a thread which waits on the
+// host clock (aligned to the radio clock at start), and must complete at least retune_margin
+// before the next pulse starts. The retune commands are sent together (frequency, gain, and
+// any corrections from --cal_table_file), so each retune takes about two command round trips.
+// The shortest pri which would have allowed every retune is reported at the end.
+//
+// The options are read through a schema (see option_utils.hpp), so they are converted once and
+// their names are checked when compiling.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+#include "cal_table.hpp"
+#include "host_radio_options.hpp"
+#include "mapped_waveform.hpp"
+#include "radio_config.hpp"
+#include "sample_buffer.hpp"
+#include "sample_convert.hpp"
+#include "utility.hpp"
+
+using namespace std::chrono_literals;
+
+using option_utils::supported_types;
+
+// clang-format off
+static constexpr option_utils::option_decl agile_schema[] = {
+    {"tx_waveform_file", supported_types::STRING, "file containing the transmit waveform", "", true},
+    {"tx_waveform_format", supported_types::STRING, "sample format of the waveform file (cs16, cs16_be, cf32, or cs8)", "cs16"},
+    {"tx_schedule_file", supported_types::STRING, "file giving the frequency and gain for each pulse", "", true},
+    {"pri", supported_types::REAL, "pulse repetition interval in seconds", "", true},
+    {"retune_margin", supported_types::REAL, "time in seconds that a retune must be complete before the next pulse", "100e-6"},
+    {"retune_thread_cpu", supported_types::INTEGER, "CPU for the thread sending retunes (negative to leave unpinned)", "-1"},
+    // declared by add_common_options
+    {"duration", supported_types::REAL},
+    {"config_parallel", supported_types::BOOLEAN},
+    {"cal_table_file", supported_types::STRING},
+};
+// clang-format on
+using agile_options = option_utils::typed_options<agile_schema>;
+
+struct pulse_settings {
+    std::optional<double> freq;
+    std::optional<double> gain;
+};
+
+static bool read_schedule(const std::string& name, std::vector<pulse_settings>& schedule) {
+    std::ifstream infile(name);
+    if (not infile.is_open()) {
+        std::cerr << "unable to open schedule file " << name << std::endl;
+        return false;
+    }
+    std::string line;
+    unsigned line_number = 0;
+    while (std::getline(infile, line)) {
+        line_number++;
+        std::istringstream iss(line);
+        std::string freq_str;
+        std::string gain_str = "-";
+        if (not(iss >> freq_str) or freq_str.starts_with("#")) {
+            continue;
+        }
+        iss >> gain_str;
+        pulse_settings p;
+        try {
+            if (freq_str != "-") {
+                p.freq = std::stod(freq_str);
+            }
+            if (gain_str != "-") {
+                p.gain = std::stod(gain_str);
+            }
+        } catch (std::exception&) {
+            std::cerr << "error in schedule file " << name << " line " << line_number << ": expected <freq> [<gain>]" << std::endl;
+            return false;
+        }
+        schedule.push_back(p);
+    }
+    return true;
+}
+
+// sleeps until shortly before t, then spins, since sleep_until alone can wake late by a scheduler tick
+static void wait_until(const std::chrono::system_clock::time_point t) {
+    constexpr auto spin_time = 200us;
+    std::this_thread::sleep_until(t - spin_time);
+    while (std::chrono::system_clock::now() < t) {
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::cout << argv[0] << " started" << std::endl;
+
+        // set up options and read from command line and/or configuration file
+        option_utils::program_options desc("vxsdr_tx_loop_agile",
+                                           "test loop transmit with frequency and gain changed between pulses");
+
+        add_common_options(desc);
+        add_network_options(desc);
+        add_realtime_options(desc);
+        add_tx_1ch_options(desc);
+
+        agile_options::declare(desc);
+
+        auto vm = desc.parse(argc, argv);
+        set_buffer_options(vm);
+        if (set_trace_options(vm) != 0) {
+            return 1;
+        }
+        const agile_options opts(vm);
+
+        auto duration_sec = opts.get<"duration">();
+        auto pri_sec      = opts.get<"pri">();
+        auto margin_sec   = opts.get<"retune_margin">();
+        if (duration_sec <= 0.0 or pri_sec <= 0.0 or margin_sec < 0.0) {
+            std::cerr << "duration and pri must be positive, and retune_margin nonnegative" << std::endl;
+            return 1;
+        }
+        size_t n_pulses = std::llround(duration_sec / pri_sec);
+
+        std::vector<pulse_settings> schedule;
+        if (not read_schedule(opts.get<"tx_schedule_file">(), schedule)) {
+            return 1;
+        }
+        if (schedule.empty()) {
+            std::cerr << "schedule file contains no pulses" << std::endl;
+            return 1;
+        }
+
+        waveform_format wf_format = waveform_format::cs16;
+        if (not parse_waveform_format(opts.get<"tx_waveform_format">(), wf_format)) {
+            std::cerr << "Error: unknown option value for --tx_waveform_format: " << opts.get<"tx_waveform_format">() << std::endl;
+            return 1;
+        }
+        mapped_waveform tx_wf;
+        if (tx_wf.open(opts.get<"tx_waveform_file">(), mapped_waveform::sequential | mapped_waveform::populate) == 0) {
+            std::cerr << "unable to read tx waveform file " << opts.get<"tx_waveform_file">() << std::endl;
+            return 1;
+        }
+        sample_vector tx_converted;
+        std::span<const std::complex<int16_t>> tx_data = tx_wf.samples();
+        if (wf_format != waveform_format::cs16) {
+            tx_converted.resize(tx_wf.bytes().size() / waveform_format_bytes(wf_format));
+            convert_to_cs16(wf_format, tx_wf.bytes(), tx_converted);
+            tx_data = tx_converted;
+        }
+        const size_t n_samples = tx_data.size();
+
+        // set up the radio using settings from command line arguments
+        auto radio = std::make_unique<vxsdr>(get_radio_settings(vm));
+
+        set_common_options(vm, radio);
+        set_network_options(vm, radio);
+        set_tx_1ch_options(vm, radio);
+
+        double rate = radio->get_tx_rate().value_or(-1);
+        if (rate <= 0 or n_samples == 0) {
+            std::cerr << "unable to get tx rate, or waveform file is empty" << std::endl;
+            return 1;
+        }
+        const double waveform_sec = (double)n_samples / rate;
+        if (waveform_sec + margin_sec >= pri_sec) {
+            std::cerr << "pri leaves no time to retune (waveform " << waveform_sec << " s, margin " << margin_sec << " s)"
+                      << std::endl;
+            return 1;
+        }
+        auto bsize = radio->get_buffer_info();
+        if (not bsize.has_value() or bsize->at(1) / sizeof(vxsdr::wire_sample) < n_samples) {
+            std::cerr << "unable to get buffer info, or waveform will not fit in tx buffer" << std::endl;
+            return 1;
+        }
+
+        // corrections follow the frequency if a calibration table is given
+        calibration_table cal_table;
+        uint32_t device_id = 0;
+        bool use_cal       = false;
+        if (opts.has<"cal_table_file">() and cal_table.load(opts.get<"cal_table_file">())) {
+            auto hello_info = radio->hello();
+            if (hello_info.has_value()) {
+                device_id = hello_info->at(3);
+                use_cal   = true;
+            }
+        }
+
+        radio_channel_config current;
+        current.freq = radio->get_tx_freq().value_or(-1);
+        current.gain = radio->get_tx_gain().value_or(0);
+
+        // returns the commands needed to change from the current settings to those for pulse k
+        auto retune_config = [&](size_t k) {
+            const auto& p = schedule[k % schedule.size()];
+            radio_channel_config cfg;
+            if (p.freq.has_value() and p.freq != current.freq) {
+                cfg.freq     = p.freq;
+                current.freq = p.freq;
+                if (use_cal) {
+                    auto cal = cal_table.lookup(device_id, cal_direction::tx, p.freq.value());
+                    if (cal.has_value()) {
+                        cfg.iq_bias = cal->iq_bias;
+                        cfg.iq_corr = cal->iq_corr;
+                    }
+                }
+            }
+            if (p.gain.has_value() and p.gain != current.gain) {
+                cfg.gain     = p.gain;
+                current.gain = p.gain;
+            }
+            return cfg;
+        };
+        const bool parallel = opts.get<"config_parallel">();
+
+        // the first pulse's settings are made before starting
+        apply_radio_config(radio, cal_direction::tx, retune_config(0), parallel, "vxsdr_tx_loop_agile");
+
+        // the realtime checks are made once the waveform is in place, so memory locking (if asked for) covers it
+        if (set_realtime_options(vm) != 0) {
+            return 1;
+        }
+
+        auto t_radio = radio->get_time_now();
+        if (not t_radio.has_value()) {
+            std::cerr << "unable to get radio time" << std::endl;
+            return 1;
+        }
+        // converts radio times to host times for scheduling the retunes
+        auto radio_host_offset = t_radio.value() - std::chrono::system_clock::now();
+
+        auto t_start        = std::chrono::ceil<std::chrono::seconds>(t_radio.value()) + 1s;
+        vxsdr::duration pri = std::chrono::nanoseconds(std::llround(1e9 * pri_sec));
+        auto waveform_time  = std::chrono::nanoseconds(std::llround(1e9 * waveform_sec));
+        auto margin         = std::chrono::nanoseconds(std::llround(1e9 * margin_sec));
+        std::cout << "start time: " << format_time(t_start) << std::endl;
+        std::cout << "using pri       " << pri_sec << " s with " << schedule.size() << " schedule entries" << std::endl;
+
+        if (not radio->tx_loop(t_start, n_samples, pri, n_pulses)) {
+            std::cerr << "tx_loop() failed" << std::endl;
+            return 1;
+        }
+        if (radio->put_tx_data(tx_data) != n_samples) {
+            std::cerr << "error sending waveform data" << std::endl;
+        }
+
+        size_t n_retunes  = 0;
+        size_t n_late     = 0;
+        size_t n_failed   = 0;
+        auto max_latency  = std::chrono::system_clock::duration::zero();
+        auto max_wake_lag = std::chrono::system_clock::duration::zero();
+
+        std::thread retuner([&]() {
+            set_current_thread_affinity((int)opts.get<"retune_thread_cpu">());
+            for (size_t k = 1; k < n_pulses; k++) {
+                auto cfg = retune_config(k);
+                if (not cfg.freq.has_value() and not cfg.gain.has_value()) {
+                    continue;
+                }
+                // the previous pulse has ended, so the change can be made now
+                auto t_issue    = t_start + (int64_t)(k - 1) * pri + waveform_time - radio_host_offset;
+                auto t_deadline = t_start + (int64_t)k * pri - margin - radio_host_offset;
+                wait_until(t_issue);
+                auto t0     = std::chrono::system_clock::now();
+                auto report = apply_radio_config(radio, cal_direction::tx, cfg, parallel, "vxsdr_tx_loop_agile");
+                auto t1     = std::chrono::system_clock::now();
+
+                n_retunes++;
+                n_failed += report.n_failed;
+                max_wake_lag = std::max(max_wake_lag, t0 - t_issue);
+                max_latency  = std::max(max_latency, t1 - t_issue);
+                if (t1 > t_deadline) {
+                    n_late++;
+                }
+            }
+        });
+        retuner.join();
+
+        std::this_thread::sleep_until(t_start + (int64_t)n_pulses * pri + 100ms - radio_host_offset);
+
+        double latency_sec = std::chrono::duration<double>(max_latency).count();
+        std::cout << "retunes:              " << n_retunes << " (" << n_late << " late, " << n_failed << " failed commands)"
+                  << std::endl;
+        std::cout << "max wake lag:         " << 1e6 * std::chrono::duration<double>(max_wake_lag).count() << " us" << std::endl;
+        std::cout << "max retune time:      " << 1e6 * latency_sec << " us" << std::endl;
+        std::cout << "min retune interval:  " << 1e6 * (latency_sec + margin_sec) << " us after each pulse" << std::endl;
+        std::cout << "min pri at this rate: " << 1e6 * (waveform_sec + latency_sec + margin_sec) << " us" << std::endl;
+
+        std::cout << "transmit complete" << std::endl;
+        if (n_late > 0 or n_failed > 0) {
+            return 2;
+        }
+    } catch (std::exception& e) {
+        std::cerr << "exception caught: " << e.what() << std::endl;
+        return 3;
+    }
+}
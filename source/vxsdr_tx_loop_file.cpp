@@ -3,7 +3,6 @@
 
 // Provides a simple example of looped transmit from a file
 
-#include <arpa/inet.h>
 #include <chrono>
 #include <cmath>
 #include <complex>
@@ -11,22 +10,131 @@
 #include <cstdlib>
 #include <ctime>
 #include <fstream>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <span>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <vxsdr.hpp>
 
 #include "host_radio_options.hpp"
+#include "mapped_waveform.hpp"
+#include "radio_monitor.hpp"
+#include "sample_buffer.hpp"
+#include "sample_convert.hpp"
+#include "trace.hpp"
 #include "utility.hpp"
+#include "waveform_container.hpp"
+#include "waveform_gen.hpp"
 
 using namespace std::chrono_literals;
 
+// a waveform read from a file; messages are held until the load is joined, so they are not
+// interleaved with the output of the radio setup
+struct tx_waveform_load {
+    mapped_waveform wf;
+    sample_vector converted;
+    std::span<const std::complex<int16_t>> data;
+    waveform_container_info info;
+    bool from_container = false;
+    uint32_t crc        = 0;
+    double load_sec     = 0;
+    double checksum_sec = 0;
+    std::stringstream log;
+};
+
+static double seconds_between(const std::chrono::steady_clock::time_point t0, const std::chrono::steady_clock::time_point t1) {
+    return std::chrono::duration<double>(t1 - t0).count();
+}
+
+// reads, converts, and checksums a waveform file; it does not use the radio or the options, so it
+// can run alongside the radio setup
+static bool load_tx_waveform(const std::string& file_name,
+                             const std::string& format,
+                             const bool populate,
+                             const float scale,
+                             tx_waveform_load& load) {
+    trace_thread_name("waveform load");
+    trace_scope trace("load_tx_waveform");
+    auto t0   = std::chrono::steady_clock::now();
+    auto& log = load.log;
+
+    load.from_container = is_waveform_container(file_name);
+    if (load.from_container) {
+        // the container gives the format, and its chunks are checked and decoded in parallel
+        waveform_container_reader reader;
+        if (not reader.open(file_name)) {
+            return false;
+        }
+        load.info = reader.info();
+        load.converted.resize(load.info.n_samples);
+        trace_scope trace_read("read waveform container");
+        if (reader.read(0, load.converted) != load.converted.size()) {
+            log << "unable to read tx waveform file " << file_name << std::endl;
+            return false;
+        }
+        load.data = load.converted;
+        log << "loaded tx waveform container " << file_name << " (" << load.data.size() << " samples in " << load.info.n_chunks
+            << " chunks)" << std::endl;
+    } else {
+        waveform_format wf_format = waveform_format::cs16;
+        if (not parse_waveform_format(format, wf_format)) {
+            log << "Error: unknown option value for --tx_waveform_format: " << format << std::endl;
+            return false;
+        }
+
+        // map the file instead of reading it, so the data is sent straight from the page cache
+        unsigned map_flags = mapped_waveform::sequential;
+        if (populate) {
+            map_flags |= mapped_waveform::populate;
+        }
+
+        // check that the given file exists and map it
+        {
+            trace_scope trace_map("map waveform file");
+            if (load.wf.open(file_name, map_flags) == 0) {
+                log << "unable to read tx waveform file " << file_name << std::endl;
+                return false;
+            }
+        }
+        log << "loaded tx waveform file " << file_name << std::endl;
+
+        // data in the radio's format is used in place; anything else is converted in one pass
+        load.data = load.wf.samples();
+        if (wf_format != waveform_format::cs16) {
+            trace_scope trace_convert("convert_to_cs16");
+            load.converted.resize(load.wf.bytes().size() / waveform_format_bytes(wf_format));
+            convert_to_cs16(wf_format, load.wf.bytes(), load.converted, scale);
+            load.wf.close();
+            load.data = load.converted;
+        }
+    }
+    if (load.data.empty()) {
+        log << "tx waveform file contains 0 samples" << std::endl;
+        return false;
+    }
+    log << "tx waveform file contains " << load.data.size() << " samples" << std::endl;
+    auto t1 = std::chrono::steady_clock::now();
+
+    // the checksum also brings a mapped file into memory before it is sent
+    load.crc          = crc32(std::as_bytes(load.data));
+    auto t2           = std::chrono::steady_clock::now();
+    trace_event("crc32", t1, t2);
+    load.load_sec     = seconds_between(t0, t1);
+    load.checksum_sec = seconds_between(t1, t2);
+    log << "tx waveform crc32 " << std::hex << std::setw(8) << std::setfill('0') << load.crc << std::dec << std::setfill(' ')
+        << std::endl;
+    return true;
+}
+
 int main(int argc, char* argv[]) {
     try {
+        auto t_program = std::chrono::steady_clock::now();
         std::cout << argv[0] << " started" << std::endl;
 
         // set up options and read from command line and/or configuration file
@@ -34,13 +142,34 @@ int main(int argc, char* argv[]) {
 
         add_common_options(desc);
         add_network_options(desc);
+        add_realtime_options(desc);
         add_tx_1ch_options(desc);
+        add_monitor_options(desc);
 
-        desc.add_option("tx_waveform_file", "file containing the transmit waveform", option_utils::supported_types::STRING, true);
+        desc.add_option("tx_waveform_file", "file containing the transmit waveform (raw samples or a waveform container)",
+                        option_utils::supported_types::STRING);
+        desc.add_option("tx_waveform",
+                        "waveform to synthesize instead of reading a file (for example tone:f=1e6 or chirp:bw=20e6,len=65536)",
+                        option_utils::supported_types::STRING);
         desc.add_option("pri", "pulse repetition interval in seconds (zero for continuous loop)",
                         option_utils::supported_types::REAL, false, "0.0");
+        desc.add_flag("tx_waveform_populate", "fault in the whole waveform file before starting", false, false);
+        desc.add_flag("tx_tile_to_granularity",
+                      "for continuous loops, repeat the waveform until its length matches the sample granularity", false, false);
+        desc.add_option("tx_waveform_format", "sample format of the waveform file (cs16, cs16_be, cf32, or cs8)",
+                        option_utils::supported_types::STRING, false, "cs16");
+        desc.add_option("tx_waveform_scale", "value multiplying cf32 samples to convert them to integers",
+                        option_utils::supported_types::REAL, false, "32767.0");
 
         auto vm = desc.parse(argc, argv);
+        set_buffer_options(vm);
+        if (set_trace_options(vm) != 0) {
+            return 1;
+        }
+        auto t_parsed     = std::chrono::steady_clock::now();
+        auto t_radio_done = t_parsed;
+        // tracing can only start once the options are read, so their phase is recorded afterward
+        trace_event("parse options", t_program, t_parsed);
 
         // get the duration and pri from the command line
         auto duration_sec = vm["duration"].as<double>();
@@ -61,47 +190,84 @@ int main(int argc, char* argv[]) {
             n_pulses = std::llround(duration_sec / pri_sec);
         }
 
-        std::vector<std::complex<int16_t>> tx_wf;
-
-        // check that the given file exists and read it
-        if (read_cplx_16(vm["tx_waveform_file"].as<std::string>(), tx_wf) == 0) {
-            std::cerr << "unable to read tx waveform file " << vm["tx_waveform_file"].as<std::string>() << std::endl;
+        if ((vm.count("tx_waveform_file") > 0) == (vm.count("tx_waveform") > 0)) {
+            std::cerr << "Please specify either --tx_waveform_file or --tx_waveform" << std::endl;
             return 1;
         }
-        std::cout << "loaded tx waveform file " << vm["tx_waveform_file"].as<std::string>() << std::endl;
 
-        size_t n_samples = tx_wf.size();
-        if (n_samples == 0) {
-            std::cerr << "tx waveform file contains " << n_samples << " samples" << std::endl;
+        // a synthesized waveform needs the rate and granularity, so it is made once the radio is set up
+        waveform_spec tx_spec;
+        const bool synthesize = vm.count("tx_waveform") > 0;
+        if (synthesize and not parse_waveform_spec(vm["tx_waveform"].as<std::string>(), tx_spec)) {
             return 1;
         }
-        std::cout << "tx waveform file contains " << n_samples << " samples" << std::endl;
-
-        // get radio settings from command line arguments
-        uint32_t local_addr  = ntohl(inet_addr(vm["local_address"].as<std::string>().c_str()));
-        uint32_t device_addr = ntohl(inet_addr(vm["device_address"].as<std::string>().c_str()));
-
-        std::map<std::string, int64_t> settings = {
-            {"udp_transport:local_address", local_addr},
-            {"udp_transport:device_address", device_addr},
-            {"tx_data_queue_packets", vm["tx_data_queue_packets"].as<unsigned>()},
-            {"rx_data_queue_packets", vm["rx_data_queue_packets"].as<unsigned>()},
-            {"network_send_buffer_bytes", vm["network_send_buffer_bytes"].as<unsigned>()},
-            {"network_receive_buffer_bytes", vm["network_receive_buffer_bytes"].as<unsigned>()},
-            {"net_thread_priority", vm["net_thread_priority"].as<int>()},
-            {"thread_affinity_offset", vm["thread_affinity_offset"].as<int>()}};
 
-        if (vm.count("network_mtu") > 0) {
-            settings["udp_data_transport:mtu_bytes"] = vm["network_mtu"].as<unsigned>();
+        // a waveform file is loaded, converted, and checked on another thread while the radio is set up
+        tx_waveform_load tx_load;
+        std::future<bool> tx_loaded;
+        if (not synthesize) {
+            tx_loaded = std::async(std::launch::async, load_tx_waveform, vm["tx_waveform_file"].as<std::string>(),
+                                   vm["tx_waveform_format"].as<std::string>(), vm["tx_waveform_populate"].as<bool>(),
+                                   (float)vm["tx_waveform_scale"].as<double>(), std::ref(tx_load));
+        }
+        auto& tx_wf        = tx_load.wf;
+        auto& tx_converted = tx_load.converted;
+        auto& tx_data      = tx_load.data;
+        auto& wf_info      = tx_load.info;
+        size_t n_samples   = 0;
+
+        // set up the radio using settings from command line arguments
+        std::unique_ptr<vxsdr> radio;
+        {
+            trace_scope trace("construct vxsdr");
+            radio = std::make_unique<vxsdr>(get_radio_settings(vm));
         }
-
-        // set up the radio
-        auto radio = std::make_unique<vxsdr>(settings);
 
         set_common_options(vm, radio);
         set_network_options(vm, radio);
         set_tx_1ch_options(vm, radio);
 
+        if (synthesize) {
+            size_t granularity = 1;
+            auto hello_info    = radio->hello();
+            if (hello_info.has_value()) {
+                granularity = radio->compute_sample_granularity(hello_info->at(5));
+            }
+            tx_converted = synthesize_waveform(tx_spec, radio->get_tx_rate().value_or(-1), granularity);
+            tx_data      = tx_converted;
+            n_samples    = tx_data.size();
+            if (n_samples == 0) {
+                return 1;
+            }
+            std::cout << "synthesized " << vm["tx_waveform"].as<std::string>() << " (" << n_samples << " samples)" << std::endl;
+        }
+
+        t_radio_done = std::chrono::steady_clock::now();
+
+        // the radio is set up, so the waveform is needed from here on
+        if (not synthesize) {
+            trace_scope trace("wait for waveform load");
+            bool loaded = tx_loaded.get();
+            std::cout << tx_load.log.str();
+            if (not loaded) {
+                return 1;
+            }
+            n_samples = tx_data.size();
+        }
+        auto t_joined = std::chrono::steady_clock::now();
+
+        if (tx_load.from_container) {
+            // the settings the waveform was made for are stored with it, so a mismatch can be caught here
+            if (wf_info.rate > 0 and radio->get_tx_rate().value_or(-1) != wf_info.rate) {
+                std::cerr << "warning: tx rate differs from the rate stored with the waveform (" << wf_info.rate << ")"
+                          << std::endl;
+            }
+            if (wf_info.freq > 0 and radio->get_tx_freq().value_or(-1) != wf_info.freq) {
+                std::cerr << "warning: tx frequency differs from the frequency stored with the waveform (" << wf_info.freq << ")"
+                          << std::endl;
+            }
+        }
+
         // the radio is now set up, so we can query it for settings
         double waveform_duration = n_samples / radio->get_tx_rate().value_or(-1);
         if (pri_sec > 0 and waveform_duration > pri_sec) {
@@ -112,7 +278,9 @@ int main(int argc, char* argv[]) {
 
         // check that the looped waveform will fit in the FPGA buffer
         size_t tx_buffer_size_bytes = 0;
+        auto t_query                = trace_clock::now();
         auto bsize                  = radio->get_buffer_info();
+        trace_event("get_buffer_info", t_query, trace_clock::now());
         if (bsize.has_value()) {
             tx_buffer_size_bytes = bsize->at(1);
         } else {
@@ -130,15 +298,42 @@ int main(int argc, char* argv[]) {
         // the buffer ram bus width sets the sample granularity of the radio when looping
         // if there is dead time between loops, this doesn't matter, but if samples are looped end-to-end
         // (pri == 0), the waveform looped must match the sample granularity, or gaps will occur
+        t_query         = trace_clock::now();
         auto hello_info = radio->hello();
+        trace_event("hello", t_query, trace_clock::now());
         if (hello_info.has_value()) {
             uint32_t wire_format = hello_info->at(5);
             auto granularity     = radio->compute_sample_granularity(wire_format);
+            if (wf_info.granularity > 0 and wf_info.granularity != granularity) {
+                std::cerr << "warning: waveform was made for granularity " << wf_info.granularity << ", radio granularity is "
+                          << granularity << std::endl;
+            }
             if (pri_sec == 0.0 and n_samples % granularity != 0) {
-                std::cerr << "waveform length does not match granularity -- gaps will occur" << std::endl;
+                if (vm["tx_tile_to_granularity"].as<bool>()) {
+                    // the shortest repetition of the waveform that is a multiple of the granularity loops seamlessly
+                    size_t n_copies = granularity_tile_count(n_samples, granularity);
+                    if (n_copies * n_samples > tx_buffer_samps) {
+                        std::cerr << "tiled waveform will not fit in tx buffer (" << tx_buffer_samps << " available, "
+                                  << n_copies * n_samples << " needed)" << std::endl;
+                        return 1;
+                    }
+                    tx_converted = tile_waveform(tx_data, n_copies);
+                    tx_wf.close();
+                    tx_data   = tx_converted;
+                    n_samples = tx_data.size();
+                    std::cout << "waveform repeated " << n_copies << " times to match granularity (" << n_samples
+                              << " samples)" << std::endl;
+                } else {
+                    std::cerr << "waveform length does not match granularity -- gaps will occur" << std::endl;
+                }
             }
         }
 
+        // the realtime checks are made once the waveform is in place, so memory locking (if asked for) covers it
+        if (set_realtime_options(vm) != 0) {
+            return 1;
+        }
+
         // start and stop times are synched to the radio clock
         // command line options control whether the radio clock is set by the host clock or from the pps
         // setting from pps uses date, hour, minute, and second from host clock, which must be within +/- 100 ms of pps
@@ -160,21 +355,47 @@ int main(int argc, char* argv[]) {
         auto t_start = std::chrono::ceil<std::chrono::seconds>(radio->get_time_now().value()) + 1s;
         std::cout << "start time: " << format_time(t_start) << std::endl;
 
+        // the load is only hidden while the radio setup takes at least as long
+        auto t_ready = std::chrono::steady_clock::now();
+        if (not synthesize) {
+            double saved_sec = tx_load.load_sec + tx_load.checksum_sec - seconds_between(t_radio_done, t_joined);
+            std::cout << "startup timing:" << std::endl;
+            std::cout << "    options         " << 1e3 * seconds_between(t_program, t_parsed) << " ms" << std::endl;
+            std::cout << "    waveform load   " << 1e3 * tx_load.load_sec << " ms (in parallel)" << std::endl;
+            std::cout << "    checksum        " << 1e3 * tx_load.checksum_sec << " ms (in parallel)" << std::endl;
+            std::cout << "    radio setup     " << 1e3 * seconds_between(t_parsed, t_radio_done) << " ms" << std::endl;
+            std::cout << "    waiting on load " << 1e3 * seconds_between(t_radio_done, t_joined) << " ms" << std::endl;
+            std::cout << "    validation      " << 1e3 * seconds_between(t_joined, t_ready) << " ms" << std::endl;
+            std::cout << "    total           " << 1e3 * seconds_between(t_program, t_ready) << " ms (" << 1e3 * saved_sec
+                      << " ms less than loading first)" << std::endl;
+        }
+
         // set up loop (round pri to nearest nanosecond)
         vxsdr::duration pri = std::chrono::duration(std::chrono::nanoseconds(std::llround(1e9 * pri_sec)));
-        if (not radio->tx_loop(t_start, n_samples, pri, n_pulses)) {
-            std::cerr << "tx_loop() failed" << std::endl;
-            return 1;
+        {
+            trace_scope trace("tx_loop");
+            if (not radio->tx_loop(t_start, n_samples, pri, n_pulses)) {
+                std::cerr << "tx_loop() failed" << std::endl;
+                return 1;
+            }
         }
 
         // send the data
-        auto n_sent = radio->put_tx_data(tx_wf);
+        size_t n_sent = 0;
+        {
+            trace_scope trace("put_tx_data");
+            n_sent = radio->put_tx_data(tx_data);
+        }
         if (n_sent != n_samples) {
             std::cerr << "error sending waveform data" << std::endl;
         }
 
         vxsdr::duration duration = std::chrono::duration(std::chrono::milliseconds(std::llround(1e3 * duration_sec)));
-        std::this_thread::sleep_until(t_start + duration + 100ms);
+        // report on the radio while the loop runs
+        {
+            trace_scope trace("monitor_radio");
+            monitor_radio(vm, radio, t_start + duration + 100ms);
+        }
 
         std::cout << "transmit complete" << std::endl;
     } catch (std::exception& e) {
@@ -0,0 +1,256 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides an example of synchronized looped transmit from a file on several radios from one process
+//
+// The radios are given as a comma-separated --device_address list. Each radio is set up and
+// sent the waveform by its own thread, so setup takes about as long as the slowest radio rather
+// than the sum of all of them. The network threads of radio k use CPUs starting at
+// thread_affinity_offset + k * radio_affinity_stride, so the radios do not share cores.
+// All radios are scheduled to start at the same whole second; use --time_source=pps with a
+// common pps to align them.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+#include "host_radio_options.hpp"
+#include "mapped_waveform.hpp"
+#include "sample_buffer.hpp"
+#include "sample_convert.hpp"
+#include "utility.hpp"
+
+using namespace std::chrono_literals;
+
+// runs f(k) for each radio in its own thread, and returns true if all of them succeed
+template <typename F>
+static bool for_each_radio(const size_t n_radios, F f) {
+    std::vector<std::thread> workers;
+    std::vector<char> ok(n_radios, 0);
+    for (size_t k = 0; k < n_radios; k++) {
+        workers.emplace_back([&, k]() {
+            try {
+                ok[k] = f(k) ? 1 : 0;
+            } catch (std::exception& e) {
+                std::cerr << "radio " << k << ": exception caught: " << e.what() << std::endl;
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    return std::all_of(ok.begin(), ok.end(), [](char x) { return x != 0; });
+}
+
+static double seconds_since(const std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::cout << argv[0] << " started" << std::endl;
+
+        // set up options and read from command line and/or configuration file
+        option_utils::program_options desc("vxsdr_tx_loop_multi", "test synchronized loop transmit on several radios");
+
+        add_common_options(desc);
+        add_network_options(desc);
+        add_realtime_options(desc);
+        add_tx_1ch_options(desc);
+
+        // replaces the common option, since only this program accepts several addresses
+        desc.add_option("device_address", "comma-separated list of the IPv4 addresses of the radios",
+                        option_utils::supported_types::STRING, true);
+        desc.add_option("tx_waveform_file", "file containing the transmit waveform", option_utils::supported_types::STRING, true);
+        desc.add_option("pri", "pulse repetition interval in seconds (zero for continuous loop)",
+                        option_utils::supported_types::REAL, false, "0.0");
+        desc.add_option("tx_waveform_format", "sample format of the waveform file (cs16, cs16_be, cf32, or cs8)",
+                        option_utils::supported_types::STRING, false, "cs16");
+        desc.add_option("tx_waveform_scale", "value multiplying cf32 samples to convert them to integers",
+                        option_utils::supported_types::REAL, false, "32767.0");
+        desc.add_option("radio_affinity_stride", "difference in thread_affinity_offset between successive radios",
+                        option_utils::supported_types::INTEGER, false, "2");
+
+        auto vm = desc.parse(argc, argv);
+        set_buffer_options(vm);
+        if (set_trace_options(vm) != 0) {
+            return 1;
+        }
+
+        auto duration_sec = vm["duration"].as<double>();
+        if (duration_sec <= 0.0) {
+            std::cerr << "duration must be positive" << std::endl;
+            return 1;
+        }
+
+        auto pri_sec = vm["pri"].as<double>();
+        if (pri_sec < 0.0) {
+            std::cerr << "pri must be nonnegative" << std::endl;
+            return 1;
+        }
+
+        size_t n_pulses = 0;
+        if (pri_sec > 0.0) {
+            n_pulses = std::llround(duration_sec / pri_sec);
+        }
+
+        auto addresses = split_address_list(vm["device_address"].as<std::string>());
+        if (addresses.empty()) {
+            std::cerr << "no device addresses given" << std::endl;
+            return 1;
+        }
+        const size_t n_radios = addresses.size();
+
+        waveform_format wf_format = waveform_format::cs16;
+        if (not parse_waveform_format(vm["tx_waveform_format"].as<std::string>(), wf_format)) {
+            std::cerr << "Error: unknown option value for --tx_waveform_format: " << vm["tx_waveform_format"].as<std::string>()
+                      << std::endl;
+            return 1;
+        }
+
+        // the waveform is loaded once and sent to every radio
+        mapped_waveform tx_wf;
+        if (tx_wf.open(vm["tx_waveform_file"].as<std::string>(), mapped_waveform::sequential | mapped_waveform::populate) == 0) {
+            std::cerr << "unable to read tx waveform file " << vm["tx_waveform_file"].as<std::string>() << std::endl;
+            return 1;
+        }
+        sample_vector tx_converted;
+        std::span<const std::complex<int16_t>> tx_data = tx_wf.samples();
+        if (wf_format != waveform_format::cs16) {
+            tx_converted.resize(tx_wf.bytes().size() / waveform_format_bytes(wf_format));
+            convert_to_cs16(wf_format, tx_wf.bytes(), tx_converted, (float)vm["tx_waveform_scale"].as<double>());
+            tx_wf.close();
+            tx_data = tx_converted;
+        }
+
+        const size_t n_samples = tx_data.size();
+        if (n_samples == 0) {
+            std::cerr << "tx waveform file contains " << n_samples << " samples" << std::endl;
+            return 1;
+        }
+        std::cout << "tx waveform file contains " << n_samples << " samples" << std::endl;
+
+        // set up all the radios at once
+        auto t_setup        = std::chrono::steady_clock::now();
+        int affinity_offset = vm["thread_affinity_offset"].as<int>();
+        int affinity_stride = vm["radio_affinity_stride"].as<int>();
+        std::vector<std::unique_ptr<vxsdr>> radios(n_radios);
+        std::vector<double> setup_sec(n_radios, 0);
+
+        bool setup_ok = for_each_radio(n_radios, [&](size_t k) {
+            auto t0 = std::chrono::steady_clock::now();
+            // a negative offset turns off CPU affinity for all the radios
+            int offset = (affinity_offset < 0) ? affinity_offset : affinity_offset + (int)k * affinity_stride;
+            radios[k]  = std::make_unique<vxsdr>(get_radio_settings(vm, addresses[k], offset));
+
+            set_network_options(vm, radios[k]);
+            set_tx_1ch_options(vm, radios[k]);
+
+            double rate = radios[k]->get_tx_rate().value_or(-1);
+            if (rate <= 0) {
+                std::cerr << "radio " << addresses[k] << ": unable to get tx rate" << std::endl;
+                return false;
+            }
+            if (pri_sec > 0 and (double)n_samples / rate > pri_sec) {
+                std::cerr << "radio " << addresses[k] << ": duration of waveform is longer than pri, check tx_rate" << std::endl;
+                return false;
+            }
+            auto bsize = radios[k]->get_buffer_info();
+            if (not bsize.has_value()) {
+                std::cerr << "radio " << addresses[k] << ": unable to get buffer info" << std::endl;
+                return false;
+            }
+            size_t tx_buffer_samps = bsize->at(1) / sizeof(vxsdr::wire_sample);
+            if (tx_buffer_samps < n_samples) {
+                std::cerr << "radio " << addresses[k] << ": file data will not fit in tx buffer (" << tx_buffer_samps
+                          << " available, " << n_samples << " needed)" << std::endl;
+                return false;
+            }
+            auto hello_info = radios[k]->hello();
+            if (hello_info.has_value() and pri_sec == 0.0 and
+                n_samples % radios[k]->compute_sample_granularity(hello_info->at(5)) != 0) {
+                std::cerr << "radio " << addresses[k] << ": waveform length does not match granularity -- gaps will occur"
+                          << std::endl;
+            }
+            setup_sec[k] = seconds_since(t0);
+            return true;
+        });
+        if (not setup_ok) {
+            std::cerr << "radio setup failed" << std::endl;
+            return 1;
+        }
+
+        // setting the time is done together, so that all radios take the same pps
+        set_common_options(vm, radios);
+
+        for (size_t k = 0; k < n_radios; k++) {
+            std::cout << "radio " << addresses[k] << " set up in " << setup_sec[k] << " s" << std::endl;
+        }
+        std::cout << "all radios set up in " << seconds_since(t_setup) << " s" << std::endl;
+
+        // the realtime checks are made once the waveform is in place and every radio is set up
+        if (set_realtime_options(vm) != 0) {
+            return 1;
+        }
+
+        // every radio must be ready to start; the upload time allows for the radios sharing the host's network
+        vxsdr::time_point t_latest;
+        for (size_t k = 0; k < n_radios; k++) {
+            auto t_now = radios[k]->get_time_now();
+            if (not t_now.has_value()) {
+                std::cerr << "radio " << addresses[k] << ": unable to get radio time" << std::endl;
+                return 1;
+            }
+            t_latest = std::max(t_latest, t_now.value());
+        }
+        double network_bps = vm["network_bit_rate"].as<double>();
+        auto upload_time   = std::chrono::nanoseconds(
+            std::llround(2e9 * 8.0 * sizeof(vxsdr::wire_sample) * (double)(n_samples * n_radios) / network_bps));
+        auto t_start = std::chrono::ceil<std::chrono::seconds>(t_latest + upload_time) + 1s;
+        std::cout << "start time: " << format_time(t_start) << std::endl;
+
+        vxsdr::duration pri = std::chrono::nanoseconds(std::llround(1e9 * pri_sec));
+        auto t_upload       = std::chrono::steady_clock::now();
+        bool upload_ok      = for_each_radio(n_radios, [&](size_t k) {
+            if (not radios[k]->tx_loop(t_start, n_samples, pri, n_pulses)) {
+                std::cerr << "radio " << addresses[k] << ": tx_loop() failed" << std::endl;
+                return false;
+            }
+            if (radios[k]->put_tx_data(tx_data) != n_samples) {
+                std::cerr << "radio " << addresses[k] << ": error sending waveform data" << std::endl;
+                return false;
+            }
+            return true;
+        });
+        std::cout << "waveform sent to " << n_radios << " radios in " << seconds_since(t_upload) << " s" << std::endl;
+        if (not upload_ok) {
+            for (auto& radio : radios) {
+                radio->tx_stop();
+            }
+            return 1;
+        }
+
+        vxsdr::duration duration = std::chrono::milliseconds(std::llround(1e3 * duration_sec));
+        std::this_thread::sleep_until(t_start + duration + 100ms);
+        if (pri_sec == 0.0) {
+            for (auto& radio : radios) {
+                radio->tx_stop();
+            }
+        }
+
+        std::cout << "transmit complete" << std::endl;
+    } catch (std::exception& e) {
+        std::cerr << "exception caught: " << e.what() << std::endl;
+        return 3;
+    }
+}
@@ -0,0 +1,287 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides an example of looped transmit from files on several channels of one radio at once
+//
+// The channels are given by --tx_channels as subdevice:channel pairs, with one waveform file
+// for each channel in --tx_waveform_files (or one file for all of them). The waveforms for the
+// channels of each subdevice are interleaved sample by sample into one upload buffer; a
+// subdevice with a single channel of cs16 data is sent straight from the mapped file. Every
+// subdevice is given the same start time, so all channels start together, and the subdevices'
+// buffers are uploaded concurrently.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+#include "host_radio_options.hpp"
+#include "mapped_waveform.hpp"
+#include "radio_config.hpp"
+#include "radio_monitor.hpp"
+#include "sample_buffer.hpp"
+#include "sample_convert.hpp"
+#include "utility.hpp"
+
+using namespace std::chrono_literals;
+
+// the data sent to one subdevice, with its channels' samples interleaved
+struct subdev_upload {
+    uint8_t subdev = 0;
+    std::vector<size_t> channels;  // indices into the channel list, in interleaving order
+    sample_vector buffer;
+    std::span<const std::complex<int16_t>> data;
+};
+
+int main(int argc, char* argv[]) {
+    try {
+        std::cout << argv[0] << " started" << std::endl;
+
+        // set up options and read from command line and/or configuration file
+        option_utils::program_options desc("vxsdr_tx_loop_nch", "test loop transmit on several channels using data from files");
+
+        add_common_options(desc);
+        add_network_options(desc);
+        add_realtime_options(desc);
+        add_tx_nch_options(desc);
+        add_monitor_options(desc);
+
+        desc.add_option("tx_waveform_files", "comma-separated transmit waveform files, one for each channel or one for all",
+                        option_utils::supported_types::STRING, true);
+        desc.add_option("pri", "pulse repetition interval in seconds (zero for continuous loop)",
+                        option_utils::supported_types::REAL, false, "0.0");
+        desc.add_option("tx_waveform_format", "sample format of the waveform files (cs16, cs16_be, cf32, or cs8)",
+                        option_utils::supported_types::STRING, false, "cs16");
+        desc.add_option("tx_waveform_scale", "value multiplying cf32 samples to convert them to integers",
+                        option_utils::supported_types::REAL, false, "32767.0");
+
+        auto vm = desc.parse(argc, argv);
+        set_buffer_options(vm);
+        if (set_trace_options(vm) != 0) {
+            return 1;
+        }
+
+        auto duration_sec = vm["duration"].as<double>();
+        if (duration_sec <= 0.0) {
+            std::cerr << "duration must be positive" << std::endl;
+            return 1;
+        }
+
+        auto pri_sec = vm["pri"].as<double>();
+        if (pri_sec < 0.0) {
+            std::cerr << "pri must be nonnegative" << std::endl;
+            return 1;
+        }
+
+        size_t n_pulses = 0;
+        if (pri_sec > 0.0) {
+            n_pulses = std::llround(duration_sec / pri_sec);
+        }
+
+        auto channels          = get_tx_nch_config(vm);
+        const size_t n_channel = channels.size();
+        auto file_names        = split_address_list(vm["tx_waveform_files"].as<std::string>());
+        if (file_names.size() == 1) {
+            file_names.resize(n_channel, file_names[0]);
+        }
+        if (file_names.size() != n_channel) {
+            std::cerr << "--tx_waveform_files must name one file or " << n_channel << " files (one per channel)" << std::endl;
+            return 1;
+        }
+
+        waveform_format wf_format = waveform_format::cs16;
+        if (not parse_waveform_format(vm["tx_waveform_format"].as<std::string>(), wf_format)) {
+            std::cerr << "Error: unknown option value for --tx_waveform_format: " << vm["tx_waveform_format"].as<std::string>()
+                      << std::endl;
+            return 1;
+        }
+
+        // map each channel's file, converting it if it is not already in the radio's format
+        std::vector<mapped_waveform> tx_wf(n_channel);
+        std::vector<sample_vector> tx_converted(n_channel);
+        std::vector<std::span<const std::complex<int16_t>>> tx_data(n_channel);
+        for (size_t k = 0; k < n_channel; k++) {
+            if (tx_wf[k].open(file_names[k], mapped_waveform::sequential) == 0) {
+                std::cerr << "unable to read tx waveform file " << file_names[k] << std::endl;
+                return 1;
+            }
+            tx_data[k] = tx_wf[k].samples();
+            if (wf_format != waveform_format::cs16) {
+                tx_converted[k].resize(tx_wf[k].bytes().size() / waveform_format_bytes(wf_format));
+                convert_to_cs16(wf_format, tx_wf[k].bytes(), tx_converted[k], (float)vm["tx_waveform_scale"].as<double>());
+                tx_wf[k].close();
+                tx_data[k] = tx_converted[k];
+            }
+        }
+
+        // the channels loop together, so their waveforms must be the same length
+        const size_t n_samples = tx_data[0].size();
+        if (n_samples == 0) {
+            std::cerr << "tx waveform file contains " << n_samples << " samples" << std::endl;
+            return 1;
+        }
+        for (size_t k = 1; k < n_channel; k++) {
+            if (tx_data[k].size() != n_samples) {
+                std::cerr << "tx waveform files must all have the same length (" << file_names[k] << " has " << tx_data[k].size()
+                          << " samples, " << file_names[0] << " has " << n_samples << ")" << std::endl;
+                return 1;
+            }
+        }
+        std::cout << "tx waveform files contain " << n_samples << " samples for each of " << n_channel << " channels" << std::endl;
+
+        // group the channels by subdevice, in the order the subdevices first appear
+        std::vector<subdev_upload> uploads;
+        for (size_t k = 0; k < n_channel; k++) {
+            const uint8_t subdev = channels[k].subdev;
+            auto it              = std::find_if(uploads.begin(), uploads.end(),
+                                                [subdev](const subdev_upload& u) { return u.subdev == subdev; });
+            if (it == uploads.end()) {
+                uploads.push_back({subdev, {}, {}, {}});
+                it = uploads.end() - 1;
+            }
+            it->channels.push_back(k);
+        }
+
+        // build each subdevice's upload buffer in one pass over its channels' data
+        for (auto& u : uploads) {
+            const size_t n_ch = u.channels.size();
+            if (n_ch == 1) {
+                u.data = tx_data[u.channels[0]];
+                continue;
+            }
+            u.buffer.resize(n_samples * n_ch);
+            for (size_t i = 0; i < n_samples; i++) {
+                for (size_t c = 0; c < n_ch; c++) {
+                    u.buffer[i * n_ch + c] = tx_data[u.channels[c]][i];
+                }
+            }
+            u.data = u.buffer;
+        }
+
+        // set up the radio using settings from command line arguments
+        auto radio = std::make_unique<vxsdr>(get_radio_settings(vm));
+
+        set_common_options(vm, radio);
+        set_network_options(vm, radio);
+        if (set_tx_nch_options(vm, radio) != 0) {
+            std::cerr << "unable to set up tx channels" << std::endl;
+            return 1;
+        }
+
+        // check each subdevice's rate, buffer size, and granularity
+        size_t granularity = 1;
+        auto hello_info    = radio->hello();
+        if (hello_info.has_value()) {
+            granularity = radio->compute_sample_granularity(hello_info->at(5));
+        }
+        for (const auto& u : uploads) {
+            double rate = radio->get_tx_rate(u.subdev).value_or(-1);
+            if (rate <= 0) {
+                std::cerr << "subdevice " << (int)u.subdev << ": unable to get tx rate" << std::endl;
+                return 1;
+            }
+            if (pri_sec > 0 and (double)n_samples / rate > pri_sec) {
+                std::cerr << "subdevice " << (int)u.subdev << ": duration of waveform is longer than pri, check tx_rate"
+                          << std::endl;
+                return 1;
+            }
+            auto bsize = radio->get_buffer_info(u.subdev);
+            if (not bsize.has_value()) {
+                std::cerr << "subdevice " << (int)u.subdev << ": unable to get buffer info" << std::endl;
+                return 1;
+            }
+            size_t tx_buffer_samps = bsize->at(1) / sizeof(vxsdr::wire_sample);
+            if (tx_buffer_samps < u.data.size()) {
+                std::cerr << "subdevice " << (int)u.subdev << ": file data will not fit in tx buffer (" << tx_buffer_samps
+                          << " available, " << u.data.size() << " needed)" << std::endl;
+                return 1;
+            }
+        }
+        if (pri_sec == 0.0 and n_samples % granularity != 0) {
+            std::cerr << "waveform length does not match granularity -- gaps will occur" << std::endl;
+        }
+
+        // the realtime checks are made once the waveforms are in place, so memory locking (if asked for) covers them
+        if (set_realtime_options(vm) != 0) {
+            return 1;
+        }
+
+        auto t1 = radio->get_time_now();
+        if (t1.has_value()) {
+            std::cout << "radio time: " << format_time(t1.value()) << std::endl;
+        } else {
+            std::cerr << "unable to get radio time" << std::endl;
+            return 1;
+        }
+
+        for (const auto& cfg : channels) {
+            std::cout << "channel " << (int)cfg.subdev << ":" << (int)cfg.channel << ": frequency "
+                      << radio->get_tx_freq(cfg.subdev).value_or(-1) << " Hz, rate " << radio->get_tx_rate(cfg.subdev).value_or(-1)
+                      << " samples/s, gain " << radio->get_tx_gain(cfg.subdev, cfg.channel).value_or(-1) << " dB" << std::endl;
+        }
+        std::cout << "using pri       " << pri_sec << " s" << std::endl;
+        std::cout << "using duration  " << duration_sec << " s" << std::endl;
+
+        // start 1-2 seconds in the future, leaving time for all the uploads to share the network
+        double network_bps = vm["network_bit_rate"].as<double>();
+        auto upload_time   = std::chrono::nanoseconds(
+            std::llround(2e9 * 8.0 * sizeof(vxsdr::wire_sample) * (double)(n_samples * n_channel) / network_bps));
+        auto t_start = std::chrono::ceil<std::chrono::seconds>(t1.value() + upload_time) + 1s;
+        std::cout << "start time: " << format_time(t_start) << std::endl;
+
+        // every subdevice gets the same timed loop (the length is per channel), then the data is sent to all of them at once
+        vxsdr::duration pri = std::chrono::nanoseconds(std::llround(1e9 * pri_sec));
+        for (const auto& u : uploads) {
+            if (not radio->tx_loop(t_start, n_samples, pri, n_pulses, u.subdev)) {
+                std::cerr << "subdevice " << (int)u.subdev << ": tx_loop() failed" << std::endl;
+                return 1;
+            }
+        }
+        auto t_upload = std::chrono::steady_clock::now();
+        std::vector<std::future<bool>> sent;
+        for (const auto& u : uploads) {
+            sent.push_back(std::async(std::launch::async, [&radio, &u]() {
+                return radio->put_tx_data(u.data, 0, u.subdev) == u.data.size();
+            }));
+        }
+        bool upload_ok = true;
+        for (size_t k = 0; k < uploads.size(); k++) {
+            if (not sent[k].get()) {
+                std::cerr << "subdevice " << (int)uploads[k].subdev << ": error sending waveform data" << std::endl;
+                upload_ok = false;
+            }
+        }
+        std::cout << "waveforms sent to " << uploads.size() << " subdevices in "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - t_upload).count() << " s" << std::endl;
+        if (not upload_ok) {
+            for (const auto& u : uploads) {
+                radio->tx_stop(u.subdev);
+            }
+            return 1;
+        }
+
+        vxsdr::duration duration = std::chrono::milliseconds(std::llround(1e3 * duration_sec));
+        // report on the radio while the loop runs
+        monitor_radio(vm, radio, t_start + duration + 100ms);
+        if (pri_sec == 0.0) {
+            for (const auto& u : uploads) {
+                radio->tx_stop(u.subdev);
+            }
+        }
+
+        std::cout << "transmit complete" << std::endl;
+    } catch (std::exception& e) {
+        std::cerr << "exception caught: " << e.what() << std::endl;
+        return 3;
+    }
+}
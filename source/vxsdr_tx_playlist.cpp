@@ -0,0 +1,290 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides an example of transmitting a playlist of waveforms, each with its own
+// pulse repetition interval and number of repetitions, from a single radio setup
+//
+// The playlist file has one segment per line:
+//     <waveform file> <pri in seconds (zero for end-to-end)> <repetitions> [<sample format>]
+// Blank lines and lines starting with # are ignored.
+//
+// If the whole sequence (including the dead time between pulses) fits in the radio's
+// transmit buffer, it is packed into one buffer and sent once, then played with a single
+// timed loop, so there is no host involvement between segments. Otherwise each segment is
+// uploaded and started in turn, which still avoids reconstructing and resynchronizing the radio.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vxsdr.hpp>
+
+#include "host_radio_options.hpp"
+#include "mapped_waveform.hpp"
+#include "sample_buffer.hpp"
+#include "sample_convert.hpp"
+#include "utility.hpp"
+
+using namespace std::chrono_literals;
+
+struct playlist_segment {
+    std::string file_name;
+    double pri_sec   = 0;
+    size_t n_repeats = 1;
+    sample_vector samples;
+};
+
+static bool read_playlist(const std::string& name, std::vector<playlist_segment>& segments) {
+    std::ifstream infile(name);
+    if (not infile.is_open()) {
+        std::cerr << "unable to open playlist file " << name << std::endl;
+        return false;
+    }
+    std::string line;
+    unsigned line_number = 0;
+    while (std::getline(infile, line)) {
+        line_number++;
+        std::istringstream iss(line);
+        playlist_segment seg;
+        std::string format_name = "cs16";
+        if (not(iss >> seg.file_name) or seg.file_name.starts_with("#")) {
+            continue;
+        }
+        if (not(iss >> seg.pri_sec >> seg.n_repeats) or seg.pri_sec < 0 or seg.n_repeats == 0) {
+            std::cerr << "error in playlist file " << name << " line " << line_number
+                      << ": expected <file> <pri> <repetitions> [<format>]" << std::endl;
+            return false;
+        }
+        iss >> format_name;
+
+        waveform_format format = waveform_format::cs16;
+        if (not parse_waveform_format(format_name, format)) {
+            std::cerr << "error in playlist file " << name << " line " << line_number << ": unknown format " << format_name
+                      << std::endl;
+            return false;
+        }
+        mapped_waveform wf;
+        if (wf.open(seg.file_name) == 0) {
+            std::cerr << "unable to read tx waveform file " << seg.file_name << std::endl;
+            return false;
+        }
+        seg.samples.resize(wf.bytes().size() / waveform_format_bytes(format));
+        convert_to_cs16(format, wf.bytes(), seg.samples);
+        if (seg.samples.empty()) {
+            std::cerr << "tx waveform file " << seg.file_name << " contains no samples" << std::endl;
+            return false;
+        }
+        segments.push_back(std::move(seg));
+    }
+    return true;
+}
+
+// returns the number of samples taken by a segment, including dead time after each pulse
+static size_t segment_samples(const playlist_segment& seg, const double rate) {
+    if (seg.pri_sec == 0) {
+        return seg.n_repeats * seg.samples.size();
+    }
+    return std::llround((double)seg.n_repeats * seg.pri_sec * rate);
+}
+
+// returns the number of samples taken by the packed sequence; the packed buffer is looped end to
+// end, so it is padded to the granularity
+static size_t packed_samples(const size_t n_sequence, const size_t granularity) {
+    return granularity * ((n_sequence + granularity - 1) / granularity);
+}
+
+// builds the whole sequence as one buffer, with pulse start times rounded to the nearest sample
+static sample_vector pack_playlist(const std::vector<playlist_segment>& segments, const double rate, const size_t granularity) {
+    size_t n_total = 0;
+    for (const auto& seg : segments) {
+        n_total += segment_samples(seg, rate);
+    }
+    n_total = packed_samples(n_total, granularity);
+
+    sample_vector packed(n_total, {0, 0});
+    size_t seg_start = 0;
+    for (const auto& seg : segments) {
+        for (size_t k = 0; k < seg.n_repeats; k++) {
+            size_t pulse_start = seg_start + ((seg.pri_sec == 0) ? k * seg.samples.size()
+                                                                 : (size_t)std::llround((double)k * seg.pri_sec * rate));
+            std::copy(seg.samples.begin(), seg.samples.end(), packed.begin() + (std::ptrdiff_t)pulse_start);
+        }
+        seg_start += segment_samples(seg, rate);
+    }
+    return packed;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::cout << argv[0] << " started" << std::endl;
+
+        // set up options and read from command line and/or configuration file
+        option_utils::program_options desc("vxsdr_tx_playlist", "test transmit of a playlist of waveforms");
+
+        add_common_options(desc);
+        add_network_options(desc);
+        add_realtime_options(desc);
+        add_tx_1ch_options(desc);
+
+        desc.add_option("playlist_file", "file listing the waveform file, pri, and repetitions of each segment",
+                        option_utils::supported_types::STRING, true);
+        desc.add_option("playlist_repeats", "number of times to play the whole playlist", option_utils::supported_types::INTEGER,
+                        false, "1");
+        desc.add_flag("playlist_sequenced", "upload and start each segment in turn, even if the playlist fits in the buffer", false,
+                      false);
+
+        auto vm = desc.parse(argc, argv);
+        set_buffer_options(vm);
+        if (set_trace_options(vm) != 0) {
+            return 1;
+        }
+
+        auto playlist_repeats = vm["playlist_repeats"].as<size_t>();
+        if (playlist_repeats == 0) {
+            std::cerr << "playlist_repeats must be positive" << std::endl;
+            return 1;
+        }
+
+        std::vector<playlist_segment> segments;
+        if (not read_playlist(vm["playlist_file"].as<std::string>(), segments)) {
+            return 1;
+        }
+        if (segments.empty()) {
+            std::cerr << "playlist contains no segments" << std::endl;
+            return 1;
+        }
+        std::cout << "loaded " << segments.size() << " playlist segments" << std::endl;
+
+        // set up the radio using settings from command line arguments
+        auto radio = std::make_unique<vxsdr>(get_radio_settings(vm));
+
+        set_common_options(vm, radio);
+        set_network_options(vm, radio);
+        set_tx_1ch_options(vm, radio);
+
+        double rate = radio->get_tx_rate().value_or(-1);
+        if (rate <= 0) {
+            std::cerr << "unable to get tx rate" << std::endl;
+            return 1;
+        }
+
+        size_t tx_buffer_samps = 0;
+        auto bsize             = radio->get_buffer_info();
+        if (bsize.has_value()) {
+            tx_buffer_samps = bsize->at(1) / sizeof(vxsdr::wire_sample);
+        } else {
+            std::cerr << "unable to get buffer info" << std::endl;
+            return 1;
+        }
+
+        size_t granularity = 1;
+        auto hello_info    = radio->hello();
+        if (hello_info.has_value()) {
+            granularity = radio->compute_sample_granularity(hello_info->at(5));
+        }
+
+        for (const auto& seg : segments) {
+            if (seg.samples.size() > tx_buffer_samps) {
+                std::cerr << "waveform " << seg.file_name << " will not fit in tx buffer (" << tx_buffer_samps << " available, "
+                          << seg.samples.size() << " needed)" << std::endl;
+                return 1;
+            }
+            if (seg.pri_sec > 0 and (double)seg.samples.size() / rate > seg.pri_sec) {
+                std::cerr << "duration of waveform " << seg.file_name << " is longer than its pri, check tx_rate" << std::endl;
+                return 1;
+            }
+        }
+
+        size_t n_sequence = 0;
+        for (const auto& seg : segments) {
+            n_sequence += segment_samples(seg, rate);
+        }
+        bool packed = not vm["playlist_sequenced"].as<bool>() and packed_samples(n_sequence, granularity) <= tx_buffer_samps;
+
+        // the realtime checks are made once the segments are loaded, so memory locking (if asked for) covers them
+        if (set_realtime_options(vm) != 0) {
+            return 1;
+        }
+
+        auto t1 = radio->get_time_now();
+        if (t1.has_value()) {
+            std::cout << "radio time: " << format_time(t1.value()) << std::endl;
+        } else {
+            std::cerr << "unable to get radio time" << std::endl;
+            return 1;
+        }
+
+        std::cout << "using frequency " << radio->get_tx_freq().value_or(-1) << " Hz" << std::endl;
+        std::cout << "using rate      " << rate << " samples/s" << std::endl;
+        std::cout << "using tx_gain   " << radio->get_tx_gain().value_or(-1) << " dB" << std::endl;
+
+        // start 1-2 seconds in the future
+        auto t_start = std::chrono::ceil<std::chrono::seconds>(t1.value()) + 1s;
+        std::cout << "start time: " << format_time(t_start) << std::endl;
+
+        if (packed) {
+            auto sequence = pack_playlist(segments, rate, granularity);
+            std::cout << "playlist packed into " << sequence.size() << " samples of " << tx_buffer_samps << " available"
+                      << std::endl;
+
+            // each repetition of the playlist is one pulse of the loop; the pri is rounded up, so it is
+            // never shorter than the sequence
+            vxsdr::duration seq_pri = std::chrono::nanoseconds((int64_t)std::ceil(1e9 * (double)sequence.size() / rate));
+            if (not radio->tx_loop(t_start, sequence.size(), seq_pri, playlist_repeats)) {
+                std::cerr << "tx_loop() failed" << std::endl;
+                return 1;
+            }
+            if (radio->put_tx_data(sequence) != sequence.size()) {
+                std::cerr << "error sending waveform data" << std::endl;
+            }
+            std::this_thread::sleep_until(t_start + playlist_repeats * seq_pri + 100ms);
+        } else {
+            std::cout << "playlist needs " << n_sequence << " samples, more than the " << tx_buffer_samps
+                      << " available; segments will be sent in turn" << std::endl;
+
+            // allows time to send each segment before it starts
+            double network_bps          = vm["network_bit_rate"].as<double>();
+            vxsdr::time_point t_segment = t_start;
+            for (size_t rep = 0; rep < playlist_repeats; rep++) {
+                for (const auto& seg : segments) {
+                    vxsdr::duration pri = std::chrono::nanoseconds(std::llround(1e9 * seg.pri_sec));
+                    size_t n_pulses     = (seg.pri_sec > 0) ? seg.n_repeats : 0;
+                    auto seg_duration   = std::chrono::nanoseconds(std::llround(1e9 * (double)segment_samples(seg, rate) / rate));
+
+                    if (not radio->tx_loop(t_segment, seg.samples.size(), pri, n_pulses)) {
+                        std::cerr << "tx_loop() failed for " << seg.file_name << std::endl;
+                        return 1;
+                    }
+                    if (radio->put_tx_data(seg.samples) != seg.samples.size()) {
+                        std::cerr << "error sending waveform data for " << seg.file_name << std::endl;
+                    }
+                    std::cout << "segment " << seg.file_name << " starts at " << format_time(t_segment) << std::endl;
+
+                    // the buffer can only be refilled once the segment is done
+                    std::this_thread::sleep_until(t_segment + seg_duration);
+                    if (seg.pri_sec == 0) {
+                        radio->tx_stop();
+                    }
+                    auto upload_time = std::chrono::nanoseconds(
+                        std::llround(2e9 * 8.0 * sizeof(vxsdr::wire_sample) * (double)seg.samples.size() / network_bps));
+                    auto t_now = radio->get_time_now();
+                    t_segment  = (t_now.has_value() ? t_now.value() : t_segment + seg_duration) + upload_time + 50ms;
+                }
+            }
+            std::this_thread::sleep_for(100ms);
+        }
+
+        std::cout << "transmit complete" << std::endl;
+    } catch (std::exception& e) {
+        std::cerr << "exception caught: " << e.what() << std::endl;
+        return 3;
+    }
+}
@@ -0,0 +1,317 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides a simple example of streaming transmit from a file, for waveforms
+// too large to fit in the radio's loop buffer
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <vxsdr.hpp>
+
+#include "host_radio_options.hpp"
+#include "sample_buffer.hpp"
+#include "sample_ring.hpp"
+#include "utility.hpp"
+#include "waveform_container.hpp"
+
+using namespace std::chrono_literals;
+
+using tx_ring = sample_ring<std::complex<int16_t>, sample_allocator<std::complex<int16_t>>>;
+
+// fills blocks from the file until n_total samples have been read, rewinding at end of file if needed
+static void read_file_to_ring(std::ifstream& infile,
+                              const size_t n_file_samples,
+                              const size_t n_total,
+                              tx_ring& ring) {
+    size_t n_read   = 0;
+    size_t file_pos = 0;
+    while (n_read < n_total) {
+        auto block = ring.write_block();
+        if (block.empty()) {
+            break;
+        }
+        size_t n_block = std::min(block.size(), n_total - n_read);
+        size_t n_fill  = 0;
+        while (n_fill < n_block) {
+            if (file_pos == n_file_samples) {
+                infile.clear();
+                infile.seekg(0, std::ifstream::beg);
+                file_pos = 0;
+            }
+            size_t n_chunk = std::min(n_block - n_fill, n_file_samples - file_pos);
+            infile.read((char*)&block[n_fill], (std::streamsize)(sizeof(std::complex<int16_t>) * n_chunk));
+            if (not infile.good()) {
+                std::cerr << "error reading tx waveform file" << std::endl;
+                ring.commit_write(n_fill);
+                ring.close();
+                return;
+            }
+            n_fill += n_chunk;
+            file_pos += n_chunk;
+        }
+        ring.commit_write(n_fill);
+        n_read += n_fill;
+    }
+    ring.close();
+}
+
+// as read_file_to_ring, but decoding the chunks of a waveform container straight into each block
+static void read_container_to_ring(const waveform_container_reader& reader,
+                                   const size_t n_total,
+                                   const unsigned n_threads,
+                                   tx_ring& ring) {
+    const size_t n_file_samples = reader.info().n_samples;
+    size_t n_read               = 0;
+    size_t file_pos             = 0;
+    while (n_read < n_total) {
+        auto block = ring.write_block();
+        if (block.empty()) {
+            break;
+        }
+        size_t n_block = std::min(block.size(), n_total - n_read);
+        size_t n_fill  = 0;
+        while (n_fill < n_block) {
+            if (file_pos == n_file_samples) {
+                file_pos = 0;
+            }
+            size_t n_chunk = std::min(n_block - n_fill, n_file_samples - file_pos);
+            if (reader.read(file_pos, block.subspan(n_fill, n_chunk), n_threads) != n_chunk) {
+                std::cerr << "error reading tx waveform file" << std::endl;
+                ring.commit_write(n_fill);
+                ring.close();
+                return;
+            }
+            n_fill += n_chunk;
+            file_pos += n_chunk;
+        }
+        ring.commit_write(n_fill);
+        n_read += n_fill;
+    }
+    ring.close();
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::cout << argv[0] << " started" << std::endl;
+
+        // set up options and read from command line and/or configuration file
+        option_utils::program_options desc("vxsdr_tx_stream_file", "test streaming transmit using data from a file");
+
+        add_common_options(desc);
+        add_network_options(desc);
+        add_realtime_options(desc);
+        add_tx_1ch_options(desc);
+
+        desc.add_option("tx_waveform_file", "file containing the transmit waveform (raw samples or a waveform container)",
+                        option_utils::supported_types::STRING, true);
+        desc.add_option("stream_block_samples", "number of samples in each block read from the file",
+                        option_utils::supported_types::INTEGER, false, "65536");
+        desc.add_option("stream_ring_blocks", "number of blocks buffered between the file reader and the radio",
+                        option_utils::supported_types::INTEGER, false, "256");
+        desc.add_option("stream_read_threads", "number of threads decoding waveform container chunks (0 for one per CPU)",
+                        option_utils::supported_types::INTEGER, false, "0");
+        desc.add_flag("stream_repeat", "repeat the file until the duration has elapsed", false, false);
+
+        auto vm = desc.parse(argc, argv);
+        set_buffer_options(vm);
+        if (set_trace_options(vm) != 0) {
+            return 1;
+        }
+
+        auto duration_sec = vm["duration"].as<double>();
+        if (duration_sec <= 0.0) {
+            std::cerr << "duration must be positive" << std::endl;
+            return 1;
+        }
+
+        auto block_samples = vm["stream_block_samples"].as<size_t>();
+        auto ring_blocks   = vm["stream_ring_blocks"].as<size_t>();
+        if (block_samples == 0 or ring_blocks < 2) {
+            std::cerr << "stream_block_samples must be positive and stream_ring_blocks must be at least 2" << std::endl;
+            return 1;
+        }
+
+        // check that the given file exists and find its length
+        std::ifstream infile;
+        waveform_container_reader container;
+        waveform_container_info wf_info;
+        size_t n_file_samples     = 0;
+        const bool from_container = is_waveform_container(vm["tx_waveform_file"].as<std::string>());
+        if (from_container) {
+            // the header and index are checked here, so a truncated file is found before streaming starts
+            if (not container.open(vm["tx_waveform_file"].as<std::string>())) {
+                return 1;
+            }
+            wf_info        = container.info();
+            n_file_samples = wf_info.n_samples;
+            // blocks are made whole numbers of chunks (keeping the ring about the same size), so no chunk
+            // is decoded twice; blocks of several chunks are decoded in parallel
+            size_t chunk_samples = wf_info.chunk_samples;
+            size_t ring_samples  = block_samples * ring_blocks;
+            block_samples        = chunk_samples * ((block_samples + chunk_samples - 1) / chunk_samples);
+            ring_blocks          = std::max<size_t>(2, ring_samples / block_samples);
+            std::cout << "tx waveform file is a container with " << wf_info.n_chunks << " chunks; using "
+                      << ring_blocks << " blocks of " << block_samples << " samples" << std::endl;
+        } else {
+            infile.open(vm["tx_waveform_file"].as<std::string>(), std::ios::in | std::ios::binary);
+            if (not infile.is_open()) {
+                std::cerr << "unable to read tx waveform file " << vm["tx_waveform_file"].as<std::string>() << std::endl;
+                return 1;
+            }
+            infile.seekg(0, std::ifstream::end);
+            n_file_samples = infile.tellg() / sizeof(std::complex<int16_t>);
+            infile.seekg(0, std::ifstream::beg);
+        }
+        if (n_file_samples == 0) {
+            std::cerr << "tx waveform file contains " << n_file_samples << " samples" << std::endl;
+            return 1;
+        }
+        std::cout << "tx waveform file contains " << n_file_samples << " samples" << std::endl;
+
+        // set up the radio using settings from command line arguments
+        auto radio = std::make_unique<vxsdr>(get_radio_settings(vm));
+
+        set_common_options(vm, radio);
+        set_network_options(vm, radio);
+        set_tx_1ch_options(vm, radio);
+
+        if (from_container) {
+            // the settings the waveform was made for are stored with it, so a mismatch can be caught here
+            if (wf_info.rate > 0 and radio->get_tx_rate().value_or(-1) != wf_info.rate) {
+                std::cerr << "warning: tx rate differs from the rate stored with the waveform (" << wf_info.rate << ")"
+                          << std::endl;
+            }
+            if (wf_info.freq > 0 and radio->get_tx_freq().value_or(-1) != wf_info.freq) {
+                std::cerr << "warning: tx frequency differs from the frequency stored with the waveform (" << wf_info.freq << ")"
+                          << std::endl;
+            }
+        }
+
+        double rate = radio->get_tx_rate().value_or(-1);
+        if (rate <= 0) {
+            std::cerr << "unable to get tx rate" << std::endl;
+            return 1;
+        }
+
+        size_t n_total = n_file_samples;
+        if (vm["stream_repeat"].as<bool>()) {
+            n_total = std::llround(duration_sec * rate);
+        }
+
+        // the realtime checks are made just before streaming, before the ring is allocated and its reader started
+        if (set_realtime_options(vm) != 0) {
+            return 1;
+        }
+
+        // the reader thread keeps the ring full, so disk latency is hidden from the radio stream
+        tx_ring ring(ring_blocks, block_samples);
+        std::thread reader;
+        ring_thread_guard reader_guard(ring, reader);
+        if (from_container) {
+            reader = std::thread(read_container_to_ring, std::cref(container), n_total, vm["stream_read_threads"].as<unsigned>(),
+                                 std::ref(ring));
+        } else {
+            reader = std::thread(read_file_to_ring, std::ref(infile), n_file_samples, n_total, std::ref(ring));
+        }
+
+        // preload the ring before starting
+        while (ring.blocks_used() < ring.capacity() and not ring.is_closed()) {
+            std::this_thread::sleep_for(1ms);
+        }
+
+        auto t1 = radio->get_time_now();
+        if (t1.has_value()) {
+            std::cout << "radio time: " << format_time(t1.value()) << std::endl;
+        } else {
+            std::cerr << "unable to get radio time" << std::endl;
+            return 1;
+        }
+        // used to convert host clock readings to radio time when checking that the stream keeps up
+        auto radio_host_offset = t1.value() - std::chrono::system_clock::now();
+
+        std::cout << "using frequency " << radio->get_tx_freq().value_or(-1) << " Hz" << std::endl;
+        std::cout << "using rate      " << rate << " samples/s" << std::endl;
+        std::cout << "using tx_gain   " << radio->get_tx_gain().value_or(-1) << " dB" << std::endl;
+        std::cout << "using samples   " << n_total << std::endl;
+
+        // start 1-2 seconds in the future
+        auto t_start = std::chrono::ceil<std::chrono::seconds>(radio->get_time_now().value()) + 1s;
+        std::cout << "start time: " << format_time(t_start) << std::endl;
+
+        if (not radio->tx_start(t_start, n_total)) {
+            std::cerr << "tx_start() failed" << std::endl;
+            return 1;
+        }
+
+        size_t n_sent         = 0;
+        size_t ring_underruns = 0;
+        size_t late_events    = 0;
+        size_t short_sends    = 0;
+        bool is_late          = false;
+
+        while (true) {
+            auto block = ring.try_read_block();
+            if (block.empty()) {
+                if (not ring.is_closed() and std::chrono::system_clock::now() + radio_host_offset > t_start) {
+                    // the reader has fallen behind while the radio is streaming; wait for it
+                    ring_underruns++;
+                }
+                block = ring.read_block();
+                if (block.empty()) {
+                    break;
+                }
+            }
+            auto n = radio->put_tx_data(block);
+            ring.release_read();
+            if (n != block.size()) {
+                short_sends++;
+            }
+            n_sent += n;
+
+            // if fewer samples have been sent than the radio has needed so far, the radio's buffer has run dry
+            auto t_now = std::chrono::system_clock::now() + radio_host_offset;
+            if (t_now > t_start) {
+                double n_needed = std::chrono::duration<double>(t_now - t_start).count() * rate;
+                if ((double)n_sent < n_needed and n_sent < n_total) {
+                    if (not is_late) {
+                        late_events++;
+                        is_late = true;
+                    }
+                } else {
+                    is_late = false;
+                }
+            }
+        }
+        reader.join();
+
+        if (n_sent != n_total) {
+            std::cerr << "error sending waveform data (" << n_sent << " of " << n_total << " samples sent)" << std::endl;
+        }
+
+        auto stream_duration = std::chrono::duration<double>((double)n_total / rate);
+        std::this_thread::sleep_until(t_start - radio_host_offset + stream_duration + 100ms);
+
+        std::cout << "samples sent:          " << n_sent << std::endl;
+        std::cout << "ring high water:       " << ring.max_blocks_used() << " of " << ring.capacity() << " blocks" << std::endl;
+        std::cout << "reader underruns:      " << ring_underruns << std::endl;
+        std::cout << "late stream events:    " << late_events << std::endl;
+        std::cout << "incomplete sends:      " << short_sends << std::endl;
+        if (ring_underruns > 0 or late_events > 0 or short_sends > 0) {
+            std::cerr << "underruns detected -- gaps in transmission may have occurred" << std::endl;
+        }
+
+        std::cout << "transmit complete" << std::endl;
+    } catch (std::exception& e) {
+        std::cerr << "exception caught: " << e.what() << std::endl;
+        return 3;
+    }
+}
@@ -0,0 +1,95 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides a tool to pack raw waveform files into waveform containers, and to check containers
+//
+// If the input file is already a container, its header is listed and every chunk is read and
+// checked against its CRC; otherwise the raw samples are packed into --output_file, along with
+// the rate, frequency, and granularity they were made for (which the transmit examples use).
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mapped_waveform.hpp"
+#include "option_utils.hpp"
+#include "waveform_container.hpp"
+
+int main(int argc, char* argv[]) {
+    try {
+        option_utils::program_options desc("vxsdr_waveform_pack", "pack waveform files into containers and check containers");
+
+        // clang-format off
+        desc.add_flag("help", "show help message");
+        desc.add_option("config_file", "configuration file name", option_utils::supported_types::STRING);
+        desc.add_option("input_file", "raw waveform file to pack, or container to check", option_utils::supported_types::STRING, true);
+        desc.add_option("output_file", "container to write", option_utils::supported_types::STRING);
+        desc.add_option("input_format", "sample format of the raw waveform file (cs16, cs16_be, cf32, or cs8)", option_utils::supported_types::STRING, false, "cs16");
+        desc.add_option("rate", "sample rate in Hz the waveform was made for (zero if not known)", option_utils::supported_types::REAL, false, "0.0");
+        desc.add_option("freq", "center frequency in Hz the waveform was made for (zero if not known)", option_utils::supported_types::REAL, false, "0.0");
+        desc.add_option("granularity", "sample granularity the waveform was made for (zero if not known)", option_utils::supported_types::INTEGER, false, "0");
+        desc.add_option("chunk_samples", "number of samples in each chunk", option_utils::supported_types::INTEGER, false, "262144");
+        desc.add_flag("compress", "compress the chunks with LZ4", false, false);
+        // clang-format on
+
+        auto vm = desc.parse(argc, argv);
+
+        auto input_name = vm["input_file"].as<std::string>();
+        if (is_waveform_container(input_name)) {
+            waveform_container_reader reader;
+            if (not reader.open(input_name)) {
+                return 1;
+            }
+            const auto& info = reader.info();
+            std::cout << "samples:      " << info.n_samples << std::endl;
+            std::cout << "chunks:       " << info.n_chunks << " of " << info.chunk_samples << " samples"
+                      << (info.compressed ? " (compressed)" : "") << std::endl;
+            std::cout << "rate:         " << info.rate << " samples/s" << std::endl;
+            std::cout << "frequency:    " << info.freq << " Hz" << std::endl;
+            std::cout << "granularity:  " << info.granularity << std::endl;
+
+            // read a group of chunks at a time, so they are decoded in parallel
+            std::vector<std::complex<int16_t>> buffer(16 * (size_t)info.chunk_samples);
+            auto t0 = std::chrono::steady_clock::now();
+            for (uint64_t pos = 0; pos < info.n_samples; pos += buffer.size()) {
+                if (reader.read(pos, buffer) != std::min<uint64_t>(buffer.size(), info.n_samples - pos)) {
+                    std::cerr << input_name << " failed checks" << std::endl;
+                    return 1;
+                }
+            }
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            std::cout << "all chunks passed checks (" << 1e-6 * (double)info.n_samples / elapsed << " Msamples/s)" << std::endl;
+            return 0;
+        }
+
+        if (vm.count("output_file") == 0) {
+            std::cerr << "--output_file is required to pack a raw waveform file" << std::endl;
+            return 1;
+        }
+        waveform_container_info info;
+        if (not parse_waveform_format(vm["input_format"].as<std::string>(), info.format)) {
+            std::cerr << "Error: unknown option value for --input_format: " << vm["input_format"].as<std::string>() << std::endl;
+            return 1;
+        }
+        info.rate          = vm["rate"].as<double>();
+        info.freq          = vm["freq"].as<double>();
+        info.granularity   = vm["granularity"].as<uint32_t>();
+        info.chunk_samples = vm["chunk_samples"].as<uint32_t>();
+
+        mapped_waveform input;
+        if (input.open(input_name, mapped_waveform::sequential) == 0) {
+            std::cerr << "unable to read input file " << input_name << std::endl;
+            return 1;
+        }
+        if (not write_waveform_container(vm["output_file"].as<std::string>(), input.bytes(), info, vm["compress"].as<bool>())) {
+            return 1;
+        }
+        std::cout << "packed " << input.bytes().size() / waveform_format_bytes(info.format) << " samples into "
+                  << vm["output_file"].as<std::string>() << std::endl;
+    } catch (std::exception& e) {
+        std::cerr << "exception caught: " << e.what() << std::endl;
+        return 3;
+    }
+}
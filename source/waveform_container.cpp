@@ -0,0 +1,433 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides reading and writing of the indexed, checksummed waveform container format
+//
+// The file is a 64-byte header, an index with one 24-byte entry per chunk, then the chunk
+// data; all values, including cs16 samples, are little-endian whatever the host byte order.
+// The header CRC covers the header (with the CRC field zero) and the index, and each chunk's
+// CRC covers its samples as stored before compression.
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#ifdef VXSDR_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#include "utility.hpp"
+#include "waveform_container.hpp"
+
+namespace {
+constexpr std::array<char, 8> container_magic = {'V', 'X', 'S', 'D', 'R', 'W', 'F', '1'};
+constexpr uint32_t container_version          = 1;
+constexpr uint32_t flag_compressed            = 1U;
+
+enum chunk_compression : uint32_t { none = 0, lz4 = 1 };
+
+struct container_header {
+    std::array<char, 8> magic = container_magic;
+    uint32_t version          = container_version;
+    uint32_t header_crc       = 0;
+    uint32_t format           = 0;
+    uint32_t flags            = 0;
+    uint64_t n_samples        = 0;
+    double rate               = 0;
+    double freq               = 0;
+    uint32_t granularity      = 0;
+    uint32_t chunk_samples    = 0;
+    uint32_t n_chunks         = 0;
+    uint32_t reserved         = 0;
+};
+
+struct container_chunk_record {
+    uint64_t offset       = 0;
+    uint32_t stored_bytes = 0;
+    uint32_t raw_bytes    = 0;
+    uint32_t crc          = 0;
+    uint32_t compression  = none;
+};
+
+constexpr size_t header_bytes = 64;
+constexpr size_t record_bytes = 24;
+
+using header_buffer = std::array<uint8_t, header_bytes>;
+
+header_buffer encode_header(const container_header& h) {
+    header_buffer b{};
+    std::memcpy(&b[0], h.magic.data(), h.magic.size());
+    store_le(&b[8], h.version);
+    store_le(&b[12], h.header_crc);
+    store_le(&b[16], h.format);
+    store_le(&b[20], h.flags);
+    store_le(&b[24], h.n_samples);
+    store_le(&b[32], h.rate);
+    store_le(&b[40], h.freq);
+    store_le(&b[48], h.granularity);
+    store_le(&b[52], h.chunk_samples);
+    store_le(&b[56], h.n_chunks);
+    store_le(&b[60], h.reserved);
+    return b;
+}
+
+container_header decode_header(const header_buffer& b) {
+    container_header h;
+    std::memcpy(h.magic.data(), &b[0], h.magic.size());
+    h.version       = load_le<uint32_t>(&b[8]);
+    h.header_crc    = load_le<uint32_t>(&b[12]);
+    h.format        = load_le<uint32_t>(&b[16]);
+    h.flags         = load_le<uint32_t>(&b[20]);
+    h.n_samples     = load_le<uint64_t>(&b[24]);
+    h.rate          = load_le<double>(&b[32]);
+    h.freq          = load_le<double>(&b[40]);
+    h.granularity   = load_le<uint32_t>(&b[48]);
+    h.chunk_samples = load_le<uint32_t>(&b[52]);
+    h.n_chunks      = load_le<uint32_t>(&b[56]);
+    h.reserved      = load_le<uint32_t>(&b[60]);
+    return h;
+}
+
+std::vector<uint8_t> encode_index(std::span<const container_chunk_record> records) {
+    std::vector<uint8_t> b(records.size() * record_bytes);
+    for (size_t k = 0; k < records.size(); k++) {
+        uint8_t* p = &b[k * record_bytes];
+        store_le(&p[0], records[k].offset);
+        store_le(&p[8], records[k].stored_bytes);
+        store_le(&p[12], records[k].raw_bytes);
+        store_le(&p[16], records[k].crc);
+        store_le(&p[20], records[k].compression);
+    }
+    return b;
+}
+
+std::vector<container_chunk_record> decode_index(std::span<const uint8_t> b) {
+    std::vector<container_chunk_record> records(b.size() / record_bytes);
+    for (size_t k = 0; k < records.size(); k++) {
+        const uint8_t* p        = &b[k * record_bytes];
+        records[k].offset       = load_le<uint64_t>(&p[0]);
+        records[k].stored_bytes = load_le<uint32_t>(&p[8]);
+        records[k].raw_bytes    = load_le<uint32_t>(&p[12]);
+        records[k].crc          = load_le<uint32_t>(&p[16]);
+        records[k].compression  = load_le<uint32_t>(&p[20]);
+    }
+    return records;
+}
+
+uint32_t header_crc(container_header header, std::span<const uint8_t> index_bytes) {
+    header.header_crc = 0;
+    auto bytes        = encode_header(header);
+    auto crc          = crc32(std::as_bytes(std::span(bytes)));
+    return crc32(std::as_bytes(index_bytes), crc);
+}
+
+// cs16 samples are stored little-endian, so on a big-endian host each value is swapped after reading
+void cs16_from_le(std::span<std::complex<int16_t>> samples) {
+    if constexpr (std::endian::native == std::endian::big) {
+        auto swap = [](const int16_t v) { return (int16_t)(((uint16_t)v << 8U) | ((uint16_t)v >> 8U)); };
+        for (auto& x : samples) {
+            x = std::complex<int16_t>(swap(x.real()), swap(x.imag()));
+        }
+    }
+}
+
+// reads exactly buf.size() bytes at offset, retrying short reads; pread does not move the
+// file position, so this can be used from several threads at once
+bool pread_all(const int fd, std::span<std::byte> buf, uint64_t offset) {
+    size_t n_done = 0;
+    while (n_done < buf.size()) {
+        auto n = ::pread(fd, buf.data() + n_done, buf.size() - n_done, (off_t)(offset + n_done));
+        if (n < 0 and errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        n_done += (size_t)n;
+    }
+    return true;
+}
+}  // namespace
+
+bool is_waveform_container(const std::string& name) {
+    std::ifstream infile(name, std::ios::binary);
+    std::array<char, 8> magic{};
+    return infile.read(magic.data(), magic.size()) and magic == container_magic;
+}
+
+bool waveform_container_compression_available() {
+#ifdef VXSDR_HAVE_LZ4
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool write_waveform_container(const std::string& name,
+                              std::span<const std::byte> raw,
+                              const waveform_container_info& info,
+                              const bool compress) {
+    const size_t sample_bytes = waveform_format_bytes(info.format);
+    if (info.chunk_samples == 0 or (uint64_t)info.chunk_samples * sample_bytes > std::numeric_limits<int32_t>::max()) {
+        std::cerr << "error in write_waveform_container: chunk_samples must be positive and chunks less than 2 GB" << std::endl;
+        return false;
+    }
+    if (compress and not waveform_container_compression_available()) {
+        std::cerr << "error in write_waveform_container: compression requested, but not built with LZ4" << std::endl;
+        return false;
+    }
+
+    container_header header;
+    header.format        = (uint32_t)info.format;
+    header.n_samples     = raw.size() / sample_bytes;
+    header.rate          = info.rate;
+    header.freq          = info.freq;
+    header.granularity   = info.granularity;
+    header.chunk_samples = info.chunk_samples;
+    header.n_chunks      = (uint32_t)((header.n_samples + info.chunk_samples - 1) / info.chunk_samples);
+
+    std::ofstream outfile(name, std::ios::out | std::ios::trunc | std::ios::binary);
+    if (not outfile.is_open()) {
+        std::cerr << "error in write_waveform_container: unable to open " << name << std::endl;
+        return false;
+    }
+
+    // the header and index are written last, once the chunk sizes are known
+    std::vector<container_chunk_record> records(header.n_chunks);
+    uint64_t offset = header_bytes + records.size() * record_bytes;
+    outfile.seekp((std::streamoff)offset);
+
+    [[maybe_unused]] std::vector<char> packed;
+    for (uint32_t k = 0; k < header.n_chunks; k++) {
+        size_t first_sample = (size_t)k * info.chunk_samples;
+        size_t n_samples    = std::min<size_t>(info.chunk_samples, header.n_samples - first_sample);
+        auto chunk          = raw.subspan(first_sample * sample_bytes, n_samples * sample_bytes);
+        auto& r             = records[k];
+        r.offset            = offset;
+        r.raw_bytes         = (uint32_t)chunk.size();
+        r.stored_bytes      = r.raw_bytes;
+        r.crc               = crc32(chunk);
+        const char* data    = reinterpret_cast<const char*>(chunk.data());
+#ifdef VXSDR_HAVE_LZ4
+        if (compress) {
+            packed.resize(LZ4_compressBound((int)chunk.size()));
+            int n_packed = LZ4_compress_default(data, packed.data(), (int)chunk.size(), (int)packed.size());
+            // chunks which do not compress are stored as they are
+            if (n_packed > 0 and (uint32_t)n_packed < r.raw_bytes) {
+                r.stored_bytes = (uint32_t)n_packed;
+                r.compression  = lz4;
+                data           = packed.data();
+                header.flags |= flag_compressed;
+            }
+        }
+#endif
+        outfile.write(data, r.stored_bytes);
+        offset += r.stored_bytes;
+    }
+
+    auto index_bytes  = encode_index(records);
+    header.header_crc = header_crc(header, index_bytes);
+    auto header_out   = encode_header(header);
+    outfile.seekp(0);
+    outfile.write(reinterpret_cast<const char*>(header_out.data()), header_out.size());
+    outfile.write(reinterpret_cast<const char*>(index_bytes.data()), (std::streamsize)index_bytes.size());
+    outfile.close();
+    if (not outfile.good()) {
+        std::cerr << "error in write_waveform_container: unable to write " << name << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool waveform_container_reader::open(const std::string& name) {
+    close();
+    fd = ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "error in waveform_container_reader: unable to open " << name << std::endl;
+        return false;
+    }
+
+    struct stat st = {};
+    header_buffer header_in{};
+    if (fstat(fd, &st) != 0 or not pread_all(fd, std::as_writable_bytes(std::span(header_in)), 0)
+        or std::memcmp(header_in.data(), container_magic.data(), container_magic.size()) != 0) {
+        std::cerr << "error in waveform_container_reader: " << name << " is not a waveform container" << std::endl;
+        close();
+        return false;
+    }
+    const auto header = decode_header(header_in);
+    if (header.version != container_version or header.format > (uint32_t)waveform_format::cs8 or header.chunk_samples == 0
+        or header.n_chunks != (header.n_samples + header.chunk_samples - 1) / header.chunk_samples) {
+        std::cerr << "error in waveform_container_reader: " << name << " has an unsupported version or an invalid header"
+                  << std::endl;
+        close();
+        return false;
+    }
+
+    // the index size is checked against the file before anything is allocated for it
+    if (header_bytes + (uint64_t)header.n_chunks * record_bytes > (uint64_t)st.st_size) {
+        std::cerr << "error in waveform_container_reader: " << name << " is truncated (the index of " << header.n_chunks
+                  << " chunks is larger than the file)" << std::endl;
+        close();
+        return false;
+    }
+    std::vector<uint8_t> index_bytes((size_t)header.n_chunks * record_bytes);
+    if (not pread_all(fd, std::as_writable_bytes(std::span(index_bytes)), header_bytes)
+        or header_crc(header, index_bytes) != header.header_crc) {
+        std::cerr << "error in waveform_container_reader: header or index of " << name << " is damaged" << std::endl;
+        close();
+        return false;
+    }
+    const auto records = decode_index(index_bytes);
+
+    // check that every chunk is present and consistent before any data is used
+    const size_t sample_bytes = waveform_format_bytes((waveform_format)header.format);
+    for (uint32_t k = 0; k < header.n_chunks; k++) {
+        const auto& r      = records[k];
+        uint64_t n_samples = std::min<uint64_t>(header.chunk_samples, header.n_samples - (uint64_t)k * header.chunk_samples);
+        if (r.offset + r.stored_bytes > (uint64_t)st.st_size) {
+            std::cerr << "error in waveform_container_reader: " << name << " is truncated (chunk " << k << " ends at byte "
+                      << r.offset + r.stored_bytes << ", file has " << st.st_size << " bytes)" << std::endl;
+            close();
+            return false;
+        }
+        if (r.raw_bytes != n_samples * sample_bytes or r.compression > lz4
+            or (r.compression == none and r.stored_bytes != r.raw_bytes)) {
+            std::cerr << "error in waveform_container_reader: index entry for chunk " << k << " of " << name << " is invalid"
+                      << std::endl;
+            close();
+            return false;
+        }
+        if (r.compression == lz4 and not waveform_container_compression_available()) {
+            std::cerr << "error in waveform_container_reader: " << name << " is compressed, but this program was built without LZ4"
+                      << std::endl;
+            close();
+            return false;
+        }
+    }
+
+    index.resize(records.size());
+    for (size_t k = 0; k < records.size(); k++) {
+        index[k] = {records[k].offset, records[k].stored_bytes, records[k].raw_bytes, records[k].crc, records[k].compression};
+    }
+    header_info.format        = (waveform_format)header.format;
+    header_info.n_samples     = header.n_samples;
+    header_info.rate          = header.rate;
+    header_info.freq          = header.freq;
+    header_info.granularity   = header.granularity;
+    header_info.chunk_samples = header.chunk_samples;
+    header_info.n_chunks      = header.n_chunks;
+    header_info.compressed    = (header.flags & flag_compressed) != 0;
+    return true;
+}
+
+void waveform_container_reader::close() noexcept {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    header_info = {};
+    index.clear();
+}
+
+bool waveform_container_reader::read_chunk(const uint32_t k, const size_t skip, std::span<std::complex<int16_t>> out) const {
+    const auto& e             = index[k];
+    const size_t sample_bytes = waveform_format_bytes(header_info.format);
+
+    // a whole uncompressed cs16 chunk is read straight into the output
+    if (e.compression == none and header_info.format == waveform_format::cs16 and skip == 0
+        and out.size_bytes() == e.raw_bytes) {
+        auto dst = std::as_writable_bytes(out);
+        if (not pread_all(fd, dst, e.offset) or crc32(dst) != e.crc) {
+            return false;
+        }
+        cs16_from_le(out);
+        return true;
+    }
+
+    std::vector<std::byte> stored(e.stored_bytes);
+    if (not pread_all(fd, stored, e.offset)) {
+        return false;
+    }
+    std::vector<std::byte> unpacked;
+    std::span<const std::byte> raw = stored;
+#ifdef VXSDR_HAVE_LZ4
+    if (e.compression == lz4) {
+        unpacked.resize(e.raw_bytes);
+        int n = LZ4_decompress_safe(reinterpret_cast<const char*>(stored.data()), reinterpret_cast<char*>(unpacked.data()),
+                                    (int)e.stored_bytes, (int)e.raw_bytes);
+        if (n != (int)e.raw_bytes) {
+            return false;
+        }
+        raw = unpacked;
+    }
+#endif
+    if (crc32(raw) != e.crc) {
+        return false;
+    }
+    convert_to_cs16(header_info.format, raw.subspan(skip * sample_bytes, out.size() * sample_bytes), out);
+    if (header_info.format == waveform_format::cs16) {
+        cs16_from_le(out);
+    }
+    return true;
+}
+
+size_t waveform_container_reader::read(const uint64_t first_sample,
+                                       std::span<std::complex<int16_t>> out,
+                                       const unsigned n_threads) const {
+    if (fd < 0 or first_sample >= header_info.n_samples or out.empty()) {
+        return 0;
+    }
+    const uint64_t cs = header_info.chunk_samples;
+    const size_t n    = std::min<uint64_t>(out.size(), header_info.n_samples - first_sample);
+    const auto k0     = (uint32_t)(first_sample / cs);
+    const auto k1     = (uint32_t)((first_sample + n - 1) / cs);
+
+    // the output span of each chunk is disjoint, so the chunks can be decoded in any order
+    std::atomic<uint32_t> next_chunk = k0;
+    std::atomic<uint32_t> first_bad  = k1 + 1;
+    auto worker = [&]() {
+        for (uint32_t k = next_chunk++; k <= k1; k = next_chunk++) {
+            uint64_t chunk_start = std::max<uint64_t>((uint64_t)k * cs, first_sample);
+            uint64_t chunk_end   = std::min<uint64_t>((uint64_t)(k + 1) * cs, first_sample + n);
+            auto dst             = out.subspan(chunk_start - first_sample, chunk_end - chunk_start);
+            if (not read_chunk(k, chunk_start - (uint64_t)k * cs, dst)) {
+                uint32_t bad = first_bad.load();
+                while (k < bad and not first_bad.compare_exchange_weak(bad, k)) {
+                }
+            }
+        }
+    };
+
+    unsigned max_threads = (n_threads > 0) ? n_threads : std::max(1U, std::thread::hardware_concurrency());
+    unsigned n_workers   = std::min<unsigned>(max_threads, k1 - k0 + 1);
+    if (n_workers == 1) {
+        worker();
+    } else {
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < n_workers; i++) {
+            workers.emplace_back(worker);
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+    }
+
+    if (first_bad <= k1) {
+        std::cerr << "error in waveform_container_reader: chunk " << first_bad << " is damaged (CRC or read error)" << std::endl;
+        return std::max<uint64_t>((uint64_t)first_bad * cs, first_sample) - first_sample;
+    }
+    return n;
+}
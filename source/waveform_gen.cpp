@@ -0,0 +1,277 @@
+// Copyright (c) 2024 Vesperix Corporation
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Provides synthesis of standard test waveforms directly in the radio's complex<int16_t> format
+//
+// Tones, chirps, and multitones all have phase phi0 + a n + b n^2 at sample n. The kernel keeps
+// 8 independent phase accumulators (one per lane, as complex rotators) that each advance by 8
+// samples per step, so the inner loops have no dependence between lanes and are vectorized
+// by the compiler; every block the accumulators are recomputed exactly, so rounding errors
+// cannot build up. The result is quantized with the vectorized cf32 conversion.
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <iostream>
+#include <numbers>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sample_convert.hpp"
+#include "utility.hpp"
+#include "waveform_gen.hpp"
+
+namespace {
+constexpr unsigned n_lanes     = 8;
+constexpr size_t block_samples = 1024;  // samples between exact recomputations of the accumulators
+
+// phase of a tone or chirp, in radians, as phi0 + a n + b n^2
+struct phase_poly {
+    double phi0 = 0;
+    double a    = 0;
+    double b    = 0;
+    [[nodiscard]] double at(const double n) const { return phi0 + (a + b * n) * n; }
+};
+
+// adds amp * exp(i phase(n)) to out[n] for n in [n_start, n_end)
+void add_phase_poly(std::complex<float>* out, const size_t n_start, const size_t n_end, const phase_poly& p, const float amp) {
+    auto* o = reinterpret_cast<float*>(out);
+    for (size_t blk = n_start; blk < n_end; blk += block_samples) {
+        const size_t m = std::min(block_samples, n_end - blk);
+
+        alignas(32) float z_re[n_lanes];
+        alignas(32) float z_im[n_lanes];
+        alignas(32) float r_re[n_lanes];
+        alignas(32) float r_im[n_lanes];
+        for (unsigned j = 0; j < n_lanes; j++) {
+            double n     = (double)(blk + j);
+            double theta = std::remainder(p.at(n), 2 * std::numbers::pi);
+            double delta = std::remainder(p.at(n + n_lanes) - p.at(n), 2 * std::numbers::pi);
+            z_re[j]      = amp * (float)std::cos(theta);
+            z_im[j]      = amp * (float)std::sin(theta);
+            r_re[j]      = (float)std::cos(delta);
+            r_im[j]      = (float)std::sin(delta);
+        }
+        // the step of every lane grows by the same amount, 2 b n_lanes^2, each time
+        const double dd   = 2 * p.b * n_lanes * n_lanes;
+        const float rr_re = (float)std::cos(dd);
+        const float rr_im = (float)std::sin(dd);
+
+        size_t g = 0;
+        for (; g + n_lanes <= m; g += n_lanes) {
+            float* dst = o + 2 * (blk + g);
+            for (unsigned j = 0; j < n_lanes; j++) {
+                dst[2 * j] += z_re[j];
+                dst[2 * j + 1] += z_im[j];
+                float zr = z_re[j] * r_re[j] - z_im[j] * r_im[j];
+                float zi = z_re[j] * r_im[j] + z_im[j] * r_re[j];
+                float rr = r_re[j] * rr_re - r_im[j] * rr_im;
+                float ri = r_re[j] * rr_im + r_im[j] * rr_re;
+                z_re[j]  = zr;
+                z_im[j]  = zi;
+                r_re[j]  = rr;
+                r_im[j]  = ri;
+            }
+        }
+        for (unsigned j = 0; g + j < m; j++) {
+            o[2 * (blk + g + j)] += z_re[j];
+            o[2 * (blk + g + j) + 1] += z_im[j];
+        }
+    }
+}
+
+// runs f(n_start, n_end) over [0, n), split across threads for large n
+template <typename F>
+void split_samples(const size_t n, F f) {
+    constexpr size_t min_samples_per_thread = 1U << 20U;
+    size_t n_threads = std::clamp<size_t>(n / min_samples_per_thread, 1, std::max(1U, std::thread::hardware_concurrency()));
+    if (n_threads == 1) {
+        f(0, n);
+        return;
+    }
+    // chunks are whole blocks, so each thread recomputes its accumulators at the same places
+    size_t per_thread = block_samples * ((n / n_threads + block_samples - 1) / block_samples);
+    std::vector<std::thread> workers;
+    for (size_t start = 0; start < n; start += per_thread) {
+        workers.emplace_back(f, start, std::min(n, start + per_thread));
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+// moves a frequency to the nearest one with a whole number of cycles in n samples
+double snap_to_bin(const double f, const double rate, const size_t n) {
+    return std::round(f * (double)n / rate) * rate / (double)n;
+}
+
+double param(const waveform_spec& spec, const std::string& key, const double default_value) {
+    auto it = spec.params.find(key);
+    return (it == spec.params.end()) ? default_value : it->second;
+}
+
+// returns a count (a length, number of tones, and so on) rounded down, or zero if the value is not a
+// finite number from 1 to 2^40, so a bad value is reported rather than converted out of range
+size_t count_param(const waveform_spec& spec, const std::string& key, const double default_value) {
+    constexpr double max_count = 1ULL << 40U;
+    double x                   = param(spec, key, default_value);
+    if (not std::isfinite(x) or x < 1 or x > max_count) {
+        return 0;
+    }
+    return (size_t)x;
+}
+
+// maximal-length LFSR feedback taps (Fibonacci form) for the supported orders
+unsigned prbs_tap(const unsigned order) {
+    switch (order) {
+        case 7:
+            return 6;
+        case 9:
+            return 5;
+        case 11:
+            return 9;
+        case 15:
+            return 14;
+        case 23:
+            return 18;
+        case 31:
+            return 28;
+        default:
+            return 0;
+    }
+}
+
+sample_vector quantize(const std::vector<std::complex<float>>& x) {
+    sample_vector result(x.size());
+    std::span<const std::byte> bytes(reinterpret_cast<const std::byte*>(x.data()), x.size() * sizeof(x[0]));
+    convert_to_cs16(waveform_format::cf32, bytes, result);
+    return result;
+}
+}  // namespace
+
+bool parse_waveform_spec(const std::string& spec, waveform_spec& result) {
+    static const std::map<std::string, std::set<std::string>> allowed_keys = {
+        {"tone", {"len", "amp", "f"}},
+        {"chirp", {"len", "amp", "bw", "f0"}},
+        {"prbs", {"len", "amp", "order", "sps"}},
+        {"multitone", {"len", "amp", "n", "df", "f0"}}};
+
+    result = {};
+    auto colon  = spec.find(':');
+    result.type = spec.substr(0, colon);
+    if (allowed_keys.count(result.type) == 0) {
+        std::cerr << "unknown waveform type in " << spec << " (use tone, chirp, prbs, or multitone)" << std::endl;
+        return false;
+    }
+    if (colon == std::string::npos) {
+        return true;
+    }
+    std::istringstream iss(spec.substr(colon + 1));
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        auto eq = item.find('=');
+        if (eq == std::string::npos or allowed_keys.at(result.type).count(item.substr(0, eq)) == 0) {
+            std::cerr << "cannot interpret " << item << " in waveform spec " << spec << std::endl;
+            return false;
+        }
+        try {
+            result.params[item.substr(0, eq)] = std::stod(item.substr(eq + 1));
+        } catch (std::exception&) {
+            std::cerr << "cannot interpret value in " << item << " in waveform spec " << spec << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+sample_vector synthesize_waveform(const waveform_spec& spec, const double rate, const size_t granularity) {
+    const double amp = param(spec, "amp", 0.7);
+    const size_t g   = std::max<size_t>(granularity, 1);
+    if (amp <= 0 or amp > 1 or rate <= 0) {
+        std::cerr << "waveform amplitude must be in (0, 1], and the rate positive" << std::endl;
+        return {};
+    }
+
+    if (spec.type == "prbs") {
+        auto order = (unsigned)std::min<size_t>(count_param(spec, "order", 9), 64);
+        auto sps   = count_param(spec, "sps", 4);
+        auto tap   = prbs_tap(order);
+        if (tap == 0 or sps == 0 or (order > 15 and spec.params.count("len") == 0)) {
+            std::cerr << "prbs order must be 7, 9, 11, 15, 23, or 31 (with len given above 15), and sps positive" << std::endl;
+            return {};
+        }
+        // a whole period of the sequence loops seamlessly
+        size_t n_symbols = count_param(spec, "len", (double)(((1ULL << order) - 1) * sps)) / sps;
+        if (n_symbols == 0) {
+            std::cerr << "prbs length must be at least sps" << std::endl;
+            return {};
+        }
+        auto level       = (int16_t)std::lrint(32767 * amp);
+        sample_vector result;
+        result.reserve(n_symbols * sps);
+        uint32_t state = 1;
+        for (size_t k = 0; k < n_symbols; k++) {
+            uint32_t bit = ((state >> (order - 1)) ^ (state >> (tap - 1))) & 1U;
+            state        = ((state << 1) | bit) & ((1U << order) - 1);
+            result.insert(result.end(), sps, {(int16_t)(bit != 0 ? level : -level), 0});
+        }
+        if (result.size() % g != 0) {
+            result = tile_waveform(result, granularity_tile_count(result.size(), g));
+        }
+        return result;
+    }
+
+    size_t n = count_param(spec, "len", 65536);
+    n        = g * ((n + g - 1) / g);
+    if (n == 0) {
+        std::cerr << "waveform length must be positive and at most 2^40 samples" << std::endl;
+        return {};
+    }
+    std::vector<std::complex<float>> x(n, {0.0F, 0.0F});
+    const double w = 2 * std::numbers::pi / rate;
+
+    if (spec.type == "tone") {
+        phase_poly p{0, w * snap_to_bin(param(spec, "f", 0), rate, n), 0};
+        split_samples(n, [&](size_t n0, size_t n1) { add_phase_poly(x.data(), n0, n1, p, (float)amp); });
+    } else if (spec.type == "chirp") {
+        double bw = param(spec, "bw", 0);
+        if (bw <= 0 or bw > rate) {
+            std::cerr << "chirp bandwidth must be positive and no more than the sample rate" << std::endl;
+            return {};
+        }
+        // sweeps f0 - bw/2 to f0 + bw/2 over the waveform; the phase is continuous at the loop
+        // point when f0 has a whole number of cycles in n samples
+        double f0 = snap_to_bin(param(spec, "f0", 0), rate, n);
+        phase_poly p{0, w * (f0 - bw / 2), w * bw / (2 * (double)n)};
+        split_samples(n, [&](size_t n0, size_t n1) { add_phase_poly(x.data(), n0, n1, p, (float)amp); });
+    } else if (spec.type == "multitone") {
+        auto n_tones = count_param(spec, "n", 8);
+        double df    = param(spec, "df", 0);
+        double f0    = param(spec, "f0", 0);
+        if (n_tones == 0 or df <= 0) {
+            std::cerr << "multitone needs a positive number of tones and spacing" << std::endl;
+            return {};
+        }
+        split_samples(n, [&](size_t n0, size_t n1) {
+            for (size_t k = 0; k < n_tones; k++) {
+                // Newman phases keep the crest factor low
+                double f = snap_to_bin(f0 + ((double)k - 0.5 * (double)(n_tones - 1)) * df, rate, n);
+                phase_poly p{std::numbers::pi * (double)(k * k) / (double)n_tones, w * f, 0};
+                add_phase_poly(x.data(), n0, n1, p, 1.0F);
+            }
+        });
+        float peak = 0;
+        for (const auto& v : x) {
+            peak = std::max(peak, std::abs(v));
+        }
+        auto scale = (float)amp / std::max(peak, 1e-6F);
+        for (auto& v : x) {
+            v *= scale;
+        }
+    }
+
+    return quantize(x);
+}